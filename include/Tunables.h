@@ -0,0 +1,35 @@
+#ifndef __tunables_h__
+#define __tunables_h__
+
+#include <stdint.h>
+
+// Settings of the programs that can be changed over Serial while they run. The led task keeps the
+// live copy and takes new values between two frames, see setTunable() in main.cpp for the limits.
+struct Tunables
+{
+  float    max_lightness;    // head of the program 5 tail, 0.5 is full bright
+  uint16_t tail_length;      // program 5, shorter than the strip
+  uint16_t pixel_fade_ms;    // trail of program 3
+  uint16_t level_full_scale; // RMS that lights the whole program 6 bar
+  uint8_t  sample_shift;     // right shift of the raw microphone words while the AGC is off
+  uint16_t transition_ms;    // crossfade between programs, 0 cuts
+  uint8_t  transition_mode;  // BlendMode of the crossfade
+  uint16_t max_idle_ms;      // longest sleep of the render task while nothing changes, 0 draws every frame
+  uint8_t  brightness;       // of every program, scales each channel as the frame is pushed
+};
+
+// ids of the SetParam message
+enum TunableId : uint8_t
+{
+  TunableId_MaxLightness = 1, // in thousandths
+  TunableId_TailLength,
+  TunableId_PixelFadeDuration,
+  TunableId_LevelFullScale,
+  TunableId_SampleShift,
+  TunableId_TransitionDuration,
+  TunableId_TransitionMode,
+  TunableId_MaxIdleDuration,
+  TunableId_Brightness,
+};
+
+#endif
@@ -0,0 +1,309 @@
+#include "BeatTracker.h"
+
+#include <math.h>
+
+// rise of the log2 energy that counts as an onset even in a quiet passage (a doubling)
+static const float MinOnsetFlux = 1.0f;
+// deviations above the mean strength an onset has to reach
+static const float OnsetThreshold = 3.5f;
+// energy added to every hop so silence does not turn into huge log swings, an rms of 8
+static const float FloorSquare = 64.0f;
+// time constants, the strength statistics follow ~1s and the autocorrelation ~4s of music
+static const float MeanSeconds = 1.0f;
+static const float AcfSeconds  = 4.0f;
+// fraction of a beat an onset may be off to count as on the beat, and how much of the error is corrected
+static const float PllWindow = 0.15f;
+static const float PllGain   = 0.25f;
+// tempo change that restarts the lock instead of gliding to it
+static const float TempoJump = 0.08f;
+// onsets on the beat and tempo confidence needed to lock
+static const int   LockOnsets     = 3;
+static const float LockConfidence = 0.3f;
+// centre of the tempo preference, between the halves of the 87 / 174 bpm drum and bass octave pair
+static const float PreferredBpm = 130.0f;
+// the tempo is re-estimated every TempoHops hops (~93ms)
+static const int TempoHops = 16;
+
+bool BeatTracker::begin(uint32_t sample_rate)
+{
+  // HopSize samples at 44.1kHz
+  m_hop_size = (HopSize * sample_rate + 22050) / 44100;
+  if (m_hop_size < 1)
+    return false;
+  float hop_rate = (float)sample_rate / m_hop_size;
+  m_min_lag      = (int)(60.0f * hop_rate / MaxBpm);
+  m_lag_count    = (int)ceilf(60.0f * hop_rate / MinBpm) - m_min_lag + 1;
+  if (m_min_lag < 1 || m_lag_count > MaxLags || m_min_lag + m_lag_count >= HistorySize)
+    return false;
+  m_hop_ms       = 1000.0f / hop_rate;
+  m_energy_floor = m_hop_size * FloorSquare;
+  // one pole low pass at 150Hz splits the kick drum and bass from the rest
+  m_low_coeff = 1.0f - expf(-2.0f * (float)M_PI * 150.0f / sample_rate);
+  // log gaussian preference for the usual tempos, one octave away weighs ~0.5
+  for (int lag = 0; lag < m_lag_count; lag++) {
+    float bpm     = 60.0f * hop_rate / (m_min_lag + lag);
+    float octaves = log2f(bpm / PreferredBpm);
+    m_prior[lag]  = expf(-0.5f * octaves * octaves / (0.85f * 0.85f));
+    m_acf[lag]    = 0.0f;
+  }
+  for (int index = 0; index < HistorySize; index++) {
+    m_history[index] = 0.0f;
+  }
+  m_low            = 0.0f;
+  m_low_energy     = 0.0f;
+  m_high_energy    = 0.0f;
+  m_hop_pos        = 0;
+  m_hop            = 0;
+  m_last_low_log   = log2f(m_energy_floor);
+  m_last_high_log  = log2f(m_energy_floor);
+  m_flux_mean      = 0.0f;
+  m_flux_dev       = 0.0f;
+  m_last_onset_hop = 0;
+  for (int index = 0; index < 3; index++) {
+    m_flux[index] = 0.0f;
+  }
+  // half a beat at the fastest tempo
+  m_refractory_hops = (int)(30.0f * hop_rate / MaxBpm);
+  m_confidence      = 0.0f;
+  m_period_hops     = 0.5f * hop_rate;
+  m_to_beat         = m_period_hops;
+  m_beat_index      = 0;
+  m_matched         = 0;
+  m_locked          = false;
+  m_onsets.store(0, std::memory_order_relaxed);
+  publish(0);
+  return true;
+}
+
+void BeatTracker::process(const int16_t* samples, int count, uint32_t end_ms)
+{
+  float low         = m_low;
+  float low_energy  = m_low_energy;
+  float high_energy = m_high_energy;
+  for (int index = 0; index < count; index++) {
+    float sample = samples[index];
+    low += (sample - low) * m_low_coeff;
+    float high = sample - low;
+    low_energy += low * low;
+    high_energy += high * high;
+    if (++m_hop_pos == m_hop_size) {
+      m_low_energy  = low_energy;
+      m_high_energy = high_energy;
+      processHop();
+      low_energy  = 0.0f;
+      high_energy = 0.0f;
+      m_hop_pos   = 0;
+    }
+  }
+  m_low         = low;
+  m_low_energy  = low_energy;
+  m_high_energy = high_energy;
+  publish(end_ms);
+}
+
+void BeatTracker::processHop()
+{
+  // sum of the rises of the log energy in both bands
+  float low_log  = log2f(m_low_energy + m_energy_floor);
+  float high_log = log2f(m_high_energy + m_energy_floor);
+  float flux     = fmaxf(low_log - m_last_low_log, 0.0f) + fmaxf(high_log - m_last_high_log, 0.0f);
+  m_last_low_log  = low_log;
+  m_last_high_log = high_log;
+  m_flux[2]       = m_flux[1];
+  m_flux[1]       = m_flux[0];
+  m_flux[0]       = flux;
+  m_hop++;
+
+  // the previous hop is an onset if it is a local peak well above the recent strength
+  float peak = m_flux[1];
+  if (peak > m_flux[2] && peak >= flux && peak > MinOnsetFlux && peak > m_flux_mean + OnsetThreshold * m_flux_dev &&
+      m_hop - 1 - m_last_onset_hop >= (uint32_t)m_refractory_hops) {
+    m_last_onset_hop = m_hop - 1;
+    onset();
+  }
+
+  // running mean and mean absolute deviation of the strength
+  float rate = m_hop_ms / (MeanSeconds * 1000.0f);
+  m_flux_mean += (flux - m_flux_mean) * rate;
+  m_flux_dev += (fabsf(flux - m_flux_mean) - m_flux_dev) * rate;
+
+  // running autocorrelation of the strength above its mean
+  float    centred = fmaxf(flux - m_flux_mean, 0.0f);
+  uint32_t slot    = m_hop & (HistorySize - 1);
+  m_history[slot]  = centred;
+  float    decay   = 1.0f - m_hop_ms / (AcfSeconds * 1000.0f);
+  for (int lag = 0; lag < m_lag_count; lag++) {
+    m_acf[lag] = m_acf[lag] * decay + centred * m_history[(slot - m_min_lag - lag) & (HistorySize - 1)];
+  }
+
+  // advance the beat oscillator
+  m_to_beat -= 1.0f;
+  if (m_to_beat <= 0.0f) {
+    m_to_beat += m_period_hops;
+    m_beat_index++;
+  }
+
+  if (m_hop % TempoHops == 0)
+    updateTempo();
+  // the lock is lost when the music stops
+  if (m_locked && m_hop - m_last_onset_hop > 4 * m_period_hops) {
+    m_locked  = false;
+    m_matched = 0;
+  }
+}
+
+void BeatTracker::onset()
+{
+  m_onsets.fetch_add(1, std::memory_order_relaxed);
+  // phase of the onset, one hop back from the current position of the oscillator
+  float phase = (m_period_hops - m_to_beat - 1.0f) / m_period_hops;
+  float error = phase < 0.5f ? phase : phase - 1.0f;
+  if (fabsf(error) < PllWindow) {
+    // close to a beat, pull the grid towards it
+    m_to_beat += PllGain * error * m_period_hops;
+    if (m_matched < LockOnsets)
+      m_matched++;
+  }
+  else if (!m_locked) {
+    // not following anything yet, onsets off the grid wear it down and then take over as the beat
+    if (m_matched > 0) {
+      m_matched--;
+    }
+    else {
+      m_to_beat = m_period_hops - 1.0f;
+      m_beat_index++;
+    }
+  }
+  m_locked = m_matched >= LockOnsets && m_confidence >= LockConfidence;
+}
+
+void BeatTracker::updateTempo()
+{
+  // strongest lag weighted by the tempo preference. A period that is not a whole number of hops
+  // spreads over two lags, so each lag is scored together with its neighbours
+  int   best       = -1;
+  float best_value = 0.0f;
+  float sum        = 0.0f;
+  for (int lag = 0; lag < m_lag_count; lag++) {
+    sum += m_acf[lag];
+    if (lag == 0 || lag == m_lag_count - 1)
+      continue;
+    float value = (m_acf[lag - 1] + m_acf[lag] + m_acf[lag + 1]) * m_prior[lag];
+    if (value > best_value) {
+      best_value = value;
+      best       = lag;
+    }
+  }
+  if (best < 0) {
+    m_confidence = 0.0f;
+    return;
+  }
+  // interpolate around the strongest of the three lags
+  if (best > 1 && m_acf[best - 1] > m_acf[best] && m_acf[best - 1] >= m_acf[best + 1])
+    best--;
+  else if (best < m_lag_count - 2 && m_acf[best + 1] > m_acf[best])
+    best++;
+  // how far the peak stands out of the average correlation
+  m_confidence = 1.0f - sum / (m_lag_count * m_acf[best]);
+
+  // parabolic interpolation between the neighbouring lags
+  float before = m_acf[best - 1];
+  float peak   = m_acf[best];
+  float after  = m_acf[best + 1];
+  float curve  = before - 2.0f * peak + after;
+  float offset = curve < 0.0f ? 0.5f * (before - after) / curve : 0.0f;
+  float period = m_min_lag + best + offset;
+
+  if (fabsf(period / m_period_hops - 1.0f) > TempoJump) {
+    // a new tempo, keep the phase of the current beat and start locking again
+    float phase   = m_to_beat / m_period_hops;
+    m_period_hops = period;
+    m_to_beat     = phase * period;
+    m_matched     = 0;
+    m_locked      = false;
+  }
+  else {
+    m_to_beat += (period - m_period_hops) * (m_to_beat / m_period_hops) * 0.25f;
+    m_period_hops += (period - m_period_hops) * 0.25f;
+  }
+  if (m_confidence < LockConfidence)
+    m_locked = false;
+}
+
+void BeatTracker::publish(uint32_t end_ms)
+{
+  // time of the last beat, the samples of the unfinished hop came after the last processed hop
+  float since_beat = (m_period_hops - m_to_beat) * m_hop_ms + m_hop_pos * m_hop_ms / m_hop_size;
+  if (since_beat < 0.0f)
+    since_beat = 0.0f;
+  // sequence lock, odd while the grid is being written
+  m_sequence.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  m_beat_ms.store(end_ms - (uint32_t)(since_beat + 0.5f), std::memory_order_relaxed);
+  m_published_index.store(m_beat_index, std::memory_order_relaxed);
+  m_period_us.store((uint32_t)(m_period_hops * m_hop_ms * 1000.0f), std::memory_order_relaxed);
+  m_published_locked.store(m_locked, std::memory_order_relaxed);
+  m_published_ms.store(end_ms, std::memory_order_relaxed);
+  m_sequence.fetch_add(1, std::memory_order_release);
+}
+
+BeatTracker::Grid BeatTracker::readGrid() const
+{
+  Grid     grid;
+  uint32_t sequence;
+  do {
+    sequence = m_sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+      continue;
+    grid.beat_ms      = m_beat_ms.load(std::memory_order_relaxed);
+    grid.beat_index   = m_published_index.load(std::memory_order_relaxed);
+    grid.period_us    = m_period_us.load(std::memory_order_relaxed);
+    grid.locked       = m_published_locked.load(std::memory_order_relaxed);
+    grid.published_ms = m_published_ms.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((sequence & 1) || sequence != m_sequence.load(std::memory_order_relaxed));
+  return grid;
+}
+
+bool BeatTracker::isLocked(uint32_t now_ms) const
+{
+  Grid grid = readGrid();
+  // now_ms may be a little behind the audio task, that is a fresh grid as well
+  return grid.locked && (int32_t)(now_ms - grid.published_ms) < (int32_t)LockTimeoutMs;
+}
+
+// time from the published beat to now_ms, negative when now_ms is a little behind the audio task; in
+// 64 bits as the grid is extrapolated without limit, 32 bits of us would wrap after 35 minutes
+static int64_t elapsedUs(uint32_t now_ms, uint32_t beat_ms)
+{
+  return (int64_t)(int32_t)(now_ms - beat_ms) * 1000;
+}
+
+// beats since the published one, rounded down
+static int64_t beatsSince(int64_t elapsed_us, uint32_t period_us)
+{
+  int64_t beats = elapsed_us / period_us;
+  return elapsed_us < 0 && beats * period_us != elapsed_us ? beats - 1 : beats;
+}
+
+uint32_t BeatTracker::getBeatIndex(uint32_t now_ms) const
+{
+  Grid grid = readGrid();
+  return grid.beat_index + (uint32_t)beatsSince(elapsedUs(now_ms, grid.beat_ms), grid.period_us);
+}
+
+uint16_t BeatTracker::getBeatPhase(uint32_t now_ms) const
+{
+  Grid    grid       = readGrid();
+  int64_t elapsed_us = elapsedUs(now_ms, grid.beat_ms);
+  int64_t into_beat  = elapsed_us - beatsSince(elapsed_us, grid.period_us) * grid.period_us;
+  return (uint64_t)into_beat * 65536 / grid.period_us;
+}
+
+uint32_t BeatTracker::getMsToBeat(uint32_t now_ms, uint8_t beats_ahead) const
+{
+  Grid    grid       = readGrid();
+  int64_t elapsed_us = elapsedUs(now_ms, grid.beat_ms);
+  int64_t beat       = beatsSince(elapsed_us, grid.period_us) + beats_ahead;
+  return (uint32_t)((beat * grid.period_us - elapsed_us) / 1000);
+}
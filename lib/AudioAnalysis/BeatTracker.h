@@ -0,0 +1,148 @@
+#ifndef __beat_tracker_h__
+#define __beat_tracker_h__
+
+#include <atomic>
+#include <stdint.h>
+
+// Streaming onset detector and tempo tracker.
+//
+// The audio is cut into hops of 5.8ms, HopSize samples at 44.1kHz and fewer at the decimated rates. Every hop the energy below and
+// above ~150Hz is turned into a log level and the rises of both levels are summed into an onset
+// strength (a two band spectral flux). Onsets are peaks of the strength above an adaptive threshold
+// that follows its running mean and deviation. The tempo is the strongest lag of a running
+// autocorrelation of the onset strength, weighted towards ~130 bpm to settle octave errors, and a beat
+// oscillator at that tempo is pulled towards the onsets that land close to its beats.
+//
+// process() runs on the audio task. The beat grid is published with a sequence lock, so any task can
+// read it without blocking and extrapolate the beats to its own clock: once locked the render task
+// sees a beat on the frame it falls on, the block size only delays the corrections to the grid. A
+// grid that has not been corrected for LockTimeoutMs, because the blocks stopped, is no longer locked.
+class BeatTracker
+{
+public:
+  static const int HopSize = 256;
+  static const int MinBpm  = 60;
+  static const int MaxBpm  = 180;
+  // autocorrelation lags covering MinBpm..MaxBpm at up to 48kHz, hops take as long at any rate
+  static const int MaxLags = 160;
+  // time without a block after which the published grid stops being locked
+  static const uint32_t LockTimeoutMs = 1000;
+
+private:
+  // onset strength history, long enough for the largest lag
+  static const int HistorySize = 256;
+
+  int      m_hop_size     = HopSize;
+  float    m_hop_ms       = 0.0f;
+  float    m_energy_floor = 0.0f;
+  float    m_low_coeff    = 0.0f;
+  float    m_low          = 0.0f;
+  float    m_low_energy   = 0.0f;
+  float    m_high_energy  = 0.0f;
+  int      m_hop_pos      = 0;
+  uint32_t m_hop          = 0;
+  // onset strength of the current hop and the two before it, the peak is picked one hop late
+  float    m_last_low_log    = 0.0f;
+  float    m_last_high_log   = 0.0f;
+  float    m_flux[3]         = {0.0f, 0.0f, 0.0f};
+  float    m_flux_mean       = 0.0f;
+  float    m_flux_dev        = 0.0f;
+  uint32_t m_last_onset_hop  = 0;
+  int      m_refractory_hops = 0;
+  // onset strength above its mean, the input of the autocorrelation
+  float m_history[HistorySize];
+  // tempo
+  float m_acf[MaxLags];
+  float m_prior[MaxLags];
+  int   m_min_lag    = 0;
+  int   m_lag_count  = 0;
+  float m_confidence = 0.0f;
+  // beat oscillator, in hops
+  float    m_period_hops = 0.0f;
+  float    m_to_beat     = 0.0f;
+  uint32_t m_beat_index  = 0;
+  int      m_matched     = 0;
+  bool     m_locked      = false;
+  // beat grid published to the readers
+  std::atomic<uint32_t> m_sequence{0};
+  std::atomic<uint32_t> m_beat_ms{0};
+  std::atomic<uint32_t> m_published_index{0};
+  std::atomic<uint32_t> m_period_us{500000};
+  std::atomic<bool>     m_published_locked{false};
+  std::atomic<uint32_t> m_published_ms{0};
+  std::atomic<uint32_t> m_onsets{0};
+
+  struct Grid
+  {
+    uint32_t beat_ms;
+    uint32_t beat_index;
+    uint32_t period_us;
+    bool     locked;
+    // end of the block the grid was published with
+    uint32_t published_ms;
+  };
+
+  void processHop();
+  void onset();
+  void updateTempo();
+  void publish(uint32_t end_ms);
+  Grid readGrid() const;
+
+public:
+  // build the filter and tempo tables for sample_rate
+  bool begin(uint32_t sample_rate);
+  // analyse a block of samples, end_ms is the time of its last sample on the reader's clock (millis())
+  void process(const int16_t* samples, int count, uint32_t end_ms);
+
+  // the grid starts at 120 bpm and keeps the last estimate while unlocked, check isLocked() before
+  // following it, false as well once no block came for LockTimeoutMs before now_ms
+  bool isLocked(uint32_t now_ms) const;
+  float getBpm() const
+  {
+    return 60000000.0f / m_period_us.load(std::memory_order_relaxed);
+  }
+  uint32_t getBeatPeriodMs() const
+  {
+    return m_period_us.load(std::memory_order_relaxed) / 1000;
+  }
+  // running number of the beat at now_ms
+  uint32_t getBeatIndex(uint32_t now_ms) const;
+  // position within the beat at now_ms, Q16
+  uint16_t getBeatPhase(uint32_t now_ms) const;
+  // time from now_ms to the beats_ahead'th next beat
+  uint32_t getMsToBeat(uint32_t now_ms, uint8_t beats_ahead = 1) const;
+  uint32_t getOnsetCount() const
+  {
+    return m_onsets.load(std::memory_order_relaxed);
+  }
+  // strength of the tempo estimate 0..1, written by process()
+  float getConfidence() const
+  {
+    return m_confidence;
+  }
+};
+
+// Beat events for one consumer, polled from the render task.
+class BeatSubscriber
+{
+private:
+  uint32_t m_last_index = 0;
+  bool     m_synced     = false;
+
+public:
+  // true once for every frame that crosses a beat while the tracker is locked
+  bool poll(const BeatTracker& tracker, uint32_t now_ms)
+  {
+    if (!tracker.isLocked(now_ms)) {
+      m_synced = false;
+      return false;
+    }
+    uint32_t index = tracker.getBeatIndex(now_ms);
+    bool     beat  = m_synced && index != m_last_index;
+    m_last_index   = index;
+    m_synced       = true;
+    return beat;
+  }
+};
+
+#endif
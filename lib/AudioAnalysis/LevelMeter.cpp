@@ -0,0 +1,82 @@
+#include <math.h>
+
+#include "LevelMeter.h"
+
+// quieter than any 16 bit signal can be
+static const float SilencedBFS = -96.0f;
+
+bool LevelMeter::begin(int32_t block_size_in_samples, int window_blocks)
+{
+  if (block_size_in_samples <= 0 || window_blocks < 1 || window_blocks > MaxWindowBlocks)
+    return false;
+  m_block_size_in_samples = block_size_in_samples;
+  m_window_blocks         = window_blocks;
+  m_next_block            = 0;
+  m_filled_blocks         = 0;
+  m_window_sum            = 0;
+  m_peak                  = 0;
+  m_peak_hold_left        = 0;
+  m_envelope              = 0.0f;
+  m_mean_square.store(0);
+  m_peak_level.store(0);
+  m_envelope_level.store(0.0f);
+  return true;
+}
+
+void LevelMeter::addBlock(const int16_t* samples)
+{
+  uint64_t sum       = 0;
+  int32_t  block_max = 0;
+  for (int32_t i = 0; i < m_block_size_in_samples; i++) {
+    int32_t sample = samples[i];
+    sum += (uint32_t)(sample * sample);
+    int32_t magnitude = sample < 0 ? -sample : sample;
+    block_max         = magnitude > block_max ? magnitude : block_max;
+  }
+
+  // slide the window: drop the oldest block, add the newest
+  if (m_filled_blocks == m_window_blocks)
+    m_window_sum -= m_block_sums[m_next_block];
+  else
+    m_filled_blocks++;
+  m_block_sums[m_next_block] = sum;
+  m_window_sum += sum;
+  m_next_block = (m_next_block + 1) % m_window_blocks;
+  m_mean_square.store(m_window_sum / ((uint64_t)m_filled_blocks * m_block_size_in_samples), std::memory_order_relaxed);
+
+  // peak hold then fall back
+  if (block_max >= m_peak) {
+    m_peak           = block_max;
+    m_peak_hold_left = m_peak_hold_blocks;
+  }
+  else if (m_peak_hold_left > 0) {
+    m_peak_hold_left--;
+  }
+  else {
+    m_peak -= (m_peak >> 3) + 1;
+    m_peak = m_peak < block_max ? block_max : m_peak;
+  }
+  m_peak_level.store(m_peak, std::memory_order_relaxed);
+
+  // envelope follows the RMS of each block
+  float block_rms = sqrtf((float)sum / m_block_size_in_samples);
+  m_envelope += (block_rms - m_envelope) * (block_rms > m_envelope ? m_attack : m_release);
+  m_envelope_level.store(m_envelope, std::memory_order_relaxed);
+}
+
+float LevelMeter::getRMS() const
+{
+  return sqrtf((float)m_mean_square.load(std::memory_order_relaxed));
+}
+
+float LevelMeter::getRMSdBFS() const
+{
+  float rms = getRMS();
+  return rms > 0 ? 20.0f * log10f(rms / 32768.0f) : SilencedBFS;
+}
+
+float LevelMeter::getPeakdBFS() const
+{
+  int32_t peak = getPeak();
+  return peak > 0 ? 20.0f * log10f(peak / 32768.0f) : SilencedBFS;
+}
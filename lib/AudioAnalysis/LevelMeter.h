@@ -0,0 +1,72 @@
+#ifndef __level_meter_h__
+#define __level_meter_h__
+
+#include <atomic>
+#include <stdint.h>
+
+// Streaming RMS / peak / envelope meter.
+//
+// addBlock() is called by the audio task for every captured block. It keeps the integer sum of
+// squares of the last few blocks as a sliding window, so each block is only scanned once, and
+// publishes the results as single words. The getters can then be called from any task at any
+// rate and cost O(1).
+class LevelMeter
+{
+public:
+  static const int MaxWindowBlocks = 32;
+
+private:
+  // sum of squares of each block in the window, oldest overwritten first
+  uint64_t m_block_sums[MaxWindowBlocks];
+  uint64_t m_window_sum    = 0;
+  int      m_window_blocks = 0;
+  int      m_next_block    = 0;
+  int      m_filled_blocks = 0;
+  int32_t  m_block_size_in_samples = 0;
+  // peak hold in blocks, then the peak falls by 1/8 per block
+  uint16_t m_peak_hold_blocks = 20;
+  uint16_t m_peak_hold_left   = 0;
+  int32_t  m_peak             = 0;
+  // envelope follower coefficients, fraction of the distance covered per block
+  float m_attack  = 0.5f;
+  float m_release = 0.1f;
+  float m_envelope = 0.0f;
+
+  // values published for the readers
+  std::atomic<uint32_t> m_mean_square{0};
+  std::atomic<int32_t>  m_peak_level{0};
+  std::atomic<float>    m_envelope_level{0.0f};
+
+public:
+  // window_blocks blocks of block_size_in_samples are averaged by getRMS()
+  bool begin(int32_t block_size_in_samples, int window_blocks);
+  void setPeakHold(uint16_t hold_blocks)
+  {
+    m_peak_hold_blocks = hold_blocks;
+  }
+  void setEnvelope(float attack, float release)
+  {
+    m_attack  = attack;
+    m_release = release;
+  }
+  // update the running values with the next block of samples
+  void addBlock(const int16_t* samples);
+
+  // RMS over the window, in sample units
+  float getRMS() const;
+  // held peak absolute sample value
+  int32_t getPeak() const
+  {
+    return m_peak_level.load(std::memory_order_relaxed);
+  }
+  // smoothed per block RMS, in sample units
+  float getEnvelope() const
+  {
+    return m_envelope_level.load(std::memory_order_relaxed);
+  }
+  // levels relative to a full scale 16 bit sample
+  float getRMSdBFS() const;
+  float getPeakdBFS() const;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#include <math.h>
+#include <string.h>
+
+#include "SpectrumAnalyzer.h"
+
+static inline int16_t toQ15(float value)
+{
+  int32_t q = (int32_t)lrintf(value * 32768.0f);
+  return q > 32767 ? 32767 : (q < -32768 ? -32768 : q);
+}
+
+bool SpectrumAnalyzer::begin(uint32_t sample_rate, int band_count, float min_freq, float max_freq)
+{
+  if (band_count < 1 || band_count > MaxBands || min_freq <= 0 || max_freq <= min_freq)
+    return false;
+
+  for (int n = 0; n < FftSize; n++) {
+    m_window[n] = toQ15(0.5f - 0.5f * cosf(2.0f * (float)M_PI * n / FftSize));
+  }
+  for (int k = 0; k < HalfSize; k++) {
+    m_cos[k] = toQ15(cosf(2.0f * (float)M_PI * k / FftSize));
+    m_sin[k] = toQ15(sinf(2.0f * (float)M_PI * k / FftSize));
+  }
+  int bits = 0;
+  while ((1 << bits) < HalfSize)
+    bits++;
+  for (int k = 0; k < HalfSize; k++) {
+    uint16_t reversed = 0;
+    for (int bit = 0; bit < bits; bit++) {
+      if (k & (1 << bit))
+        reversed |= 1 << (bits - 1 - bit);
+    }
+    m_bit_reverse[k] = reversed;
+  }
+
+  // log spaced band edges, every band gets at least one bin and the DC bin is skipped
+  float nyquist = sample_rate / 2.0f;
+  if (max_freq > nyquist)
+    max_freq = nyquist;
+  for (int band = 0; band <= band_count; band++) {
+    float    freq = min_freq * powf(max_freq / min_freq, (float)band / band_count);
+    int32_t  bin  = lrintf(freq * FftSize / sample_rate);
+    uint16_t min  = band == 0 ? 1 : m_band_start[band - 1] + 1;
+    m_band_start[band] = bin < min ? min : bin;
+  }
+  if (m_band_start[band_count] > HalfSize)
+    return false;
+
+  memset(m_history, 0, sizeof(m_history));
+  for (int band = 0; band < band_count; band++) {
+    m_band_level[band]  = 0;
+    m_band_power[band]  = 0;
+    m_band_output[band] = 0;
+  }
+  m_band_count = band_count;
+  return true;
+}
+
+// half of the last bit dropped by a Q15 product, so it rounds instead of truncating
+static const int32_t Round15 = 1 << 14;
+
+// in place radix-2 decimation in time FFT of HalfSize points, scaled by 1 / HalfSize
+void SpectrumAnalyzer::fft()
+{
+  for (int size = 2; size <= HalfSize; size <<= 1) {
+    int half = size >> 1;
+    // W_size^j == W_FftSize^(j * step)
+    int step = FftSize / size;
+    for (int start = 0; start < HalfSize; start += size) {
+      for (int j = 0; j < half; j++) {
+        int32_t wr = m_cos[j * step];
+        int32_t wi = -m_sin[j * step];
+        int     a  = start + j;
+        int     b  = a + half;
+        int32_t tr = (m_re[b] * wr - m_im[b] * wi + Round15) >> 15;
+        int32_t ti = (m_re[b] * wi + m_im[b] * wr + Round15) >> 15;
+        int32_t ar = m_re[a];
+        int32_t ai = m_im[a];
+        // halve every stage so the butterflies can never overflow, rounded so the stages add no bias
+        m_re[a] = (ar + tr + 1) >> 1;
+        m_im[a] = (ai + ti + 1) >> 1;
+        m_re[b] = (ar - tr + 1) >> 1;
+        m_im[b] = (ai - ti + 1) >> 1;
+      }
+    }
+  }
+}
+
+void SpectrumAnalyzer::transform(const int16_t* samples)
+{
+  // window and pack even / odd samples as the real / imaginary parts, pre-scaled by 1/2 to leave headroom
+  for (int k = 0; k < HalfSize; k++) {
+    int index     = m_bit_reverse[k];
+    m_re[index]   = (samples[2 * k] * m_window[2 * k]) >> 16;
+    m_im[index]   = (samples[2 * k + 1] * m_window[2 * k + 1]) >> 16;
+  }
+  fft();
+}
+
+void SpectrumAnalyzer::getBin(int k, int32_t& re, int32_t& im) const
+{
+  // split the packed FFT into the spectrum of the real input: X[k] = Fe[k] + W^k * Fo[k]
+  int     mk  = (HalfSize - k) & (HalfSize - 1);
+  int32_t er  = (m_re[k] + m_re[mk]) >> 1;
+  int32_t ei  = (m_im[k] - m_im[mk]) >> 1;
+  int32_t orr = (m_im[k] + m_im[mk]) >> 1;
+  int32_t oi  = (m_re[mk] - m_re[k]) >> 1;
+  int32_t wr  = m_cos[k];
+  int32_t wi  = -m_sin[k];
+  re          = er + ((wr * orr - wi * oi) >> 15);
+  im          = ei + ((wr * oi + wi * orr) >> 15);
+}
+
+void SpectrumAnalyzer::addBandPower()
+{
+  int band = 0;
+  for (int k = m_band_start[0]; k < m_band_start[m_band_count]; k++) {
+    int32_t re, im;
+    getBin(k, re, im);
+    if (k == m_band_start[band + 1])
+      band++;
+    m_band_power[band] += (uint64_t)((int64_t)re * re + (int64_t)im * im);
+  }
+}
+
+void SpectrumAnalyzer::updateBands(uint32_t windows)
+{
+  // a full scale sine ends up at roughly 32768 / 4 after the window and the scaling
+  const float full_scale_power = 8192.0f * 8192.0f;
+  for (int band = 0; band < m_band_count; band++) {
+    // convert the mean band power of the windows to a 0..255 level on the dB scale
+    uint64_t power = m_band_power[band] / windows;
+    float    db    = power > 0 ? 10.0f * log10f(power / full_scale_power) : m_floor_db;
+    int32_t  level = (int32_t)((1.0f - db / m_floor_db) * 255.0f);
+    level          = level < 0 ? 0 : (level > 255 ? 255 : level);
+    // smooth with a fast attack and a slower decay
+    int32_t  target = level << 8;
+    int32_t& value  = m_band_level[band];
+    value += ((target - value) * (target > value ? m_attack : m_decay)) >> 8;
+    m_band_output[band] = value >> 8;
+    m_band_power[band]  = 0;
+  }
+}
+
+void SpectrumAnalyzer::process(const int16_t* samples)
+{
+  if (m_band_count == 0)
+    return;
+  transform(samples);
+  addBandPower();
+  updateBands(1);
+}
+
+void SpectrumAnalyzer::process(const int16_t* samples, int count)
+{
+  if (count < FftSize) {
+    memmove(m_history, m_history + count, (FftSize - count) * sizeof(int16_t));
+    memcpy(m_history + FftSize - count, samples, count * sizeof(int16_t));
+    process(m_history);
+    return;
+  }
+  if (m_band_count == 0)
+    return;
+  // every whole window of the block, the last one ending on its latest sample, averaged into one update
+  uint32_t windows = 0;
+  for (int first = count % FftSize; first < count; first += FftSize) {
+    transform(samples + first);
+    addBandPower();
+    windows++;
+  }
+  updateBands(windows);
+  memcpy(m_history, samples + count - FftSize, sizeof(m_history));
+}
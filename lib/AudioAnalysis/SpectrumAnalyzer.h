@@ -0,0 +1,90 @@
+#ifndef __spectrum_analyzer_h__
+#define __spectrum_analyzer_h__
+
+#include <stdint.h>
+
+// Q15 fixed point real FFT spectrum analyzer.
+//
+// Every call to process() windows the latest FftSize samples, runs a radix-2 complex FFT of
+// FftSize / 2 points on the even/odd packed input and splits the result into the real spectrum.
+// The bins are summed into log spaced bands which are converted to dB and smoothed with separate
+// attack and decay rates, giving one 0..255 level per band. A block longer than FftSize is cut
+// into whole windows whose band powers are averaged, so no part of it goes unseen. All tables live in the object so
+// nothing is allocated at runtime.
+class SpectrumAnalyzer
+{
+public:
+  static const int FftSize  = 512;
+  static const int MaxBands = 32;
+
+private:
+  static const int HalfSize = FftSize / 2;
+
+  // hann window, Q15
+  int16_t m_window[FftSize];
+  // cos / sin of 2 * pi * k / FftSize, Q15, shared by the complex FFT and the real split
+  int16_t m_cos[HalfSize];
+  int16_t m_sin[HalfSize];
+  // bit reversed order of the complex FFT input
+  uint16_t m_bit_reverse[HalfSize];
+  // latest FftSize samples, for blocks shorter than that
+  int16_t m_history[FftSize];
+  // complex FFT work buffer
+  int16_t m_re[HalfSize];
+  int16_t m_im[HalfSize];
+  // first bin of each band, the last entry is one past the final bin
+  uint16_t m_band_start[MaxBands + 1];
+  // power summed per band over the windows of one update
+  uint64_t m_band_power[MaxBands];
+  // smoothed band levels with 8 fractional bits
+  int32_t m_band_level[MaxBands];
+  uint8_t m_band_output[MaxBands];
+  int     m_band_count = 0;
+  // smoothing coefficients, Q8 (256 follows the input instantly)
+  uint16_t m_attack = 200;
+  uint16_t m_decay  = 24;
+  // level mapped to 0
+  float m_floor_db = -60.0f;
+
+  void fft();
+  // window FftSize samples into the complex FFT and run it
+  void transform(const int16_t* samples);
+  // add the power of the bins of the last transform to their bands
+  void addBandPower();
+  // turn the band powers summed over windows into smoothed levels
+  void updateBands(uint32_t windows);
+
+public:
+  // build the tables and log spaced bands between min_freq and max_freq
+  bool begin(uint32_t sample_rate, int band_count, float min_freq, float max_freq);
+  // attack / decay are the fraction of the distance to the new level covered per frame, Q8
+  void setResponse(uint16_t attack, uint16_t decay)
+  {
+    m_attack = attack;
+    m_decay  = decay;
+  }
+  // dBFS level shown as 0, 0 dBFS is always shown as 255
+  void setFloor(float floor_db)
+  {
+    m_floor_db = floor_db;
+  }
+  // analyse the FftSize samples starting at samples and update the band levels
+  void process(const int16_t* samples);
+  // analyse a block of count samples: shorter ones are joined with the samples before them into the
+  // latest FftSize, longer ones are averaged over all of their whole windows
+  void process(const int16_t* samples, int count);
+  // bin k (1 .. FftSize / 2 - 1) of the last window's real spectrum, the DFT of the windowed samples
+  // divided by FftSize; a full scale sine peaks at about 8192
+  void getBin(int k, int32_t& re, int32_t& im) const;
+  int getBandCount() const
+  {
+    return m_band_count;
+  }
+  // smoothed band levels, 0..255
+  const uint8_t* getBands() const
+  {
+    return m_band_output;
+  }
+};
+
+#endif
@@ -0,0 +1,67 @@
+#include "ButtonDecoder.h"
+
+void ButtonDecoder::edge(uint32_t now_ms)
+{
+  m_edge_ms    = now_ms;
+  m_debouncing = true;
+}
+
+ButtonEvent ButtonDecoder::poll(bool pressed, uint32_t now_ms)
+{
+  ButtonEvent event = ButtonEvent_None;
+  if (m_debouncing && reached(now_ms, m_edge_ms + DebounceMs)) {
+    m_debouncing = false;
+    // a glitch shorter than the debounce time comes back to the same level and is ignored
+    if (pressed && !m_pressed) {
+      m_pressed  = true;
+      m_press_ms = m_edge_ms;
+      m_handled  = false;
+      if (m_waiting_second) {
+        m_waiting_second = false;
+        m_handled        = true;
+        event            = ButtonEvent_Double;
+      }
+    }
+    else if (!pressed && m_pressed) {
+      m_pressed = false;
+      if (!m_handled) {
+        m_waiting_second = true;
+        m_release_ms     = m_edge_ms;
+      }
+    }
+  }
+  if (event != ButtonEvent_None)
+    return event;
+  if (m_pressed && !m_handled && reached(now_ms, m_press_ms + LongPressMs)) {
+    m_handled = true;
+    return ButtonEvent_Long;
+  }
+  if (m_waiting_second && !m_pressed && !m_debouncing && reached(now_ms, m_release_ms + DoubleGapMs)) {
+    m_waiting_second = false;
+    return ButtonEvent_Short;
+  }
+  return ButtonEvent_None;
+}
+
+bool ButtonDecoder::hasDeadline() const
+{
+  return m_debouncing || (m_pressed && !m_handled) || m_waiting_second;
+}
+
+uint32_t ButtonDecoder::getDeadline() const
+{
+  // the earliest of the pending timeouts
+  uint32_t deadline = 0;
+  bool     found    = false;
+  if (m_debouncing) {
+    deadline = m_edge_ms + DebounceMs;
+    found    = true;
+  }
+  if (m_pressed && !m_handled && (!found || reached(deadline, m_press_ms + LongPressMs))) {
+    deadline = m_press_ms + LongPressMs;
+    found    = true;
+  }
+  if (m_waiting_second && (!found || reached(deadline, m_release_ms + DoubleGapMs)))
+    deadline = m_release_ms + DoubleGapMs;
+  return deadline;
+}
@@ -0,0 +1,56 @@
+#ifndef __button_decoder_h__
+#define __button_decoder_h__
+
+#include <stdint.h>
+
+enum ButtonEvent : uint8_t
+{
+  ButtonEvent_None,
+  ButtonEvent_Short,  // pressed and released, no second press within DoubleGapMs
+  ButtonEvent_Long,   // held for LongPressMs, sent while still held
+  ButtonEvent_Double, // second press within DoubleGapMs of the first release
+};
+
+// Debounce and press classification of one button, without any hardware.
+//
+// edge() is told when the pin changed, poll() is called at getDeadline() with the pin level and
+// returns what happened. A level only counts once the pin has been quiet for DebounceMs, so the
+// bursts of a bouncing contact collapse into one change. Times are milliseconds and may wrap.
+class ButtonDecoder
+{
+public:
+  static const uint16_t DebounceMs  = 25;
+  static const uint16_t LongPressMs = 700;
+  static const uint16_t DoubleGapMs = 250;
+
+private:
+  uint32_t m_edge_ms    = 0;
+  uint32_t m_press_ms   = 0;
+  uint32_t m_release_ms = 0;
+  bool     m_debouncing = false;
+  bool     m_pressed    = false;
+  // released after a short press, a Short unless the button goes down again within DoubleGapMs
+  bool m_waiting_second = false;
+  // the current press already sent Long or Double, its release sends nothing
+  bool m_handled = false;
+
+  static bool reached(uint32_t now_ms, uint32_t deadline_ms)
+  {
+    return (int32_t)(now_ms - deadline_ms) >= 0;
+  }
+
+public:
+  // the pin changed at now_ms
+  void edge(uint32_t now_ms);
+  // pressed is the pin level at now_ms, returns ButtonEvent_None when nothing happened yet
+  ButtonEvent poll(bool pressed, uint32_t now_ms);
+  // false when nothing happens before the next edge
+  bool     hasDeadline() const;
+  uint32_t getDeadline() const;
+  bool     isPressed() const
+  {
+    return m_pressed;
+  }
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include "ButtonInput.h"
+
+bool ButtonInput::begin(uint8_t pin, bool active_high)
+{
+  m_pin         = pin;
+  m_active_high = active_high;
+  m_queue       = xQueueCreateStatic(QueueLength, sizeof(ButtonEvent), m_queue_storage, &m_queue_buffer);
+  m_timer       = xTimerCreateStatic("Button", pdMS_TO_TICKS(ButtonDecoder::DebounceMs), pdFALSE, this, onTimer, &m_timer_buffer);
+  if (m_queue == NULL || m_timer == NULL)
+    return false;
+  pinMode(pin, active_high ? INPUT_PULLDOWN : INPUT_PULLUP);
+  attachInterruptArg(digitalPinToInterrupt(pin), onEdge, this, CHANGE);
+  return true;
+}
+
+bool ButtonInput::receive(ButtonEvent& event)
+{
+  return m_queue != NULL && xQueueReceive(m_queue, &event, 0) == pdPASS;
+}
+
+void IRAM_ATTR ButtonInput::onEdge(void* param)
+{
+  ButtonInput* input = (ButtonInput*)param;
+  input->m_edge_ms   = millis();
+  input->m_edge      = true;
+  // every edge pushes the timer back, it fires once the contact has settled
+  BaseType_t woken = pdFALSE;
+  xTimerChangePeriodFromISR(input->m_timer, pdMS_TO_TICKS(ButtonDecoder::DebounceMs), &woken);
+  if (woken == pdTRUE) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+void ButtonInput::onTimer(TimerHandle_t timer)
+{
+  ((ButtonInput*)pvTimerGetTimerID(timer))->decode();
+}
+
+void ButtonInput::decode()
+{
+  // runs in the timer task, the interrupt only hands over the time of the last edge
+  if (m_edge) {
+    m_edge = false;
+    m_decoder.edge(m_edge_ms);
+  }
+  bool        pressed = (digitalRead(m_pin) == HIGH) == m_active_high;
+  uint32_t    now_ms  = millis();
+  ButtonEvent event   = m_decoder.poll(pressed, now_ms);
+  if (event != ButtonEvent_None) {
+    if (xQueueSend(m_queue, &event, 0) != pdPASS)
+      m_dropped++;
+    else if (m_listener != NULL)
+      xTaskNotifyGive(m_listener);
+  }
+  // the interrupt restarts the timer on the next edge, until then only the timeouts are left
+  if (m_decoder.hasDeadline()) {
+    int32_t wait_ms = (int32_t)(m_decoder.getDeadline() - now_ms);
+    xTimerChangePeriod(m_timer, pdMS_TO_TICKS(wait_ms > 0 ? wait_ms : 1), 0);
+  }
+  // the timer task applies the commands in order, an edge that came in meanwhile must not wait for the deadline set above
+  if (m_edge)
+    xTimerChangePeriod(m_timer, pdMS_TO_TICKS(ButtonDecoder::DebounceMs), 0);
+}
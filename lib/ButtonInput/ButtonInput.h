@@ -0,0 +1,57 @@
+#ifndef __button_input_h__
+#define __button_input_h__
+
+#include <Arduino.h>
+#include "freertos/queue.h"
+#include "freertos/timers.h"
+
+#include "ButtonDecoder.h"
+
+// Interrupt driven button, decoded into short / long / double presses for the render task.
+//
+// The pin interrupt only notes the time of the edge and (re)starts a one-shot software timer for the
+// debounce time, so a bouncing contact costs a few microseconds per edge and nothing else. The timer
+// callback runs the ButtonDecoder with the settled level, re-arms itself for the next long press or
+// double press timeout, and posts the events to a queue that the render task drains at the start of
+// a frame, notifying the render task in case it idles. Nothing polls the pin and nothing is allocated.
+class ButtonInput
+{
+public:
+  static const uint8_t QueueLength = 8;
+
+private:
+  ButtonDecoder     m_decoder;
+  uint8_t           m_pin         = 0xff;
+  bool              m_active_high = true;
+  volatile uint32_t m_edge_ms     = 0;
+  volatile bool     m_edge        = false;
+  uint32_t          m_dropped     = 0;
+  TaskHandle_t      m_listener    = NULL;
+  TimerHandle_t     m_timer       = NULL;
+  StaticTimer_t     m_timer_buffer;
+  QueueHandle_t     m_queue = NULL;
+  StaticQueue_t     m_queue_buffer;
+  uint8_t           m_queue_storage[QueueLength * sizeof(ButtonEvent)];
+
+  static void IRAM_ATTR onEdge(void* param);
+  static void           onTimer(TimerHandle_t timer);
+  void                  decode();
+
+public:
+  // pin reads active_high when pressed, the opposite level is pulled internally
+  bool begin(uint8_t pin, bool active_high);
+  // task notified of every press, e.g. the render task while it idles
+  void setListener(TaskHandle_t task)
+  {
+    m_listener = task;
+  }
+  // next press, false if there is none, never blocks
+  bool receive(ButtonEvent& event);
+  // presses lost because the queue was full
+  uint32_t getDropped() const
+  {
+    return m_dropped;
+  }
+};
+
+#endif
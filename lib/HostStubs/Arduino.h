@@ -0,0 +1,82 @@
+#ifndef __host_arduino_h__
+#define __host_arduino_h__
+
+#include <algorithm>
+#include <functional>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+// Arduino core subset used by the firmware, see HostRuntime.h for how time and input behave
+
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define INPUT_PULLUP 0x05
+#define INPUT_PULLDOWN 0x09
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define IRAM_ATTR
+
+#define digitalPinToInterrupt(pin) (pin)
+
+uint32_t millis();
+uint32_t micros();
+void     delay(uint32_t ms);
+long     random(long max);
+long     random(long min, long max);
+void     randomSeed(unsigned long seed);
+// the hardware RNG, from the same generator as random() on the host
+uint32_t esp_random();
+long     map(long x, long in_min, long in_max, long out_min, long out_max);
+int      analogRead(uint8_t pin);
+int      digitalRead(uint8_t pin);
+void     pinMode(uint8_t pin, uint8_t mode);
+// the handler runs from hostSetPin() when the level changes the way mode asks for
+void     attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode);
+void     detachInterrupt(uint8_t pin);
+uint32_t getCpuFrequencyMhz();
+
+class HostSerial
+{
+public:
+  void   begin(unsigned long baud);
+  size_t print(const char* text);
+  size_t println(const char* text);
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  size_t write(const uint8_t* buffer, size_t size);
+  size_t write(uint8_t value);
+  void   flush();
+  int    available();
+  int    availableForWrite();
+  int    read();
+  size_t read(uint8_t* buffer, size_t size);
+  size_t setRxBufferSize(size_t size);
+  size_t setTxBufferSize(size_t size);
+  // called whenever hostSerialInput() adds data
+  void onReceive(std::function<void()> callback);
+  operator bool() const
+  {
+    return true;
+  }
+};
+extern HostSerial Serial;
+
+class HostEsp
+{
+public:
+  void restart();
+  // nanoseconds of the host clock, getCpuFrequencyMhz() reports 1000 to match
+  uint32_t getCycleCount();
+};
+extern HostEsp ESP;
+
+#endif
@@ -0,0 +1,359 @@
+#include <algorithm>
+#include <new>
+#include <stdio.h>
+
+#include <Arduino.h>
+
+#include "AudioCapture.h"
+#include "AudioCaptureReader.h"
+#include "AudioReplay.h"
+#include "ClipBank.h"
+#include "ClipEncoder.h"
+#include "ControlProtocol.h"
+#include "Decimator.h"
+#include "HostHarness.h"
+#include "MemoryBudget.h"
+
+// heap allocations made through new, and through malloc with glibc
+static uint64_t s_allocations = 0;
+
+#ifdef __GLIBC__
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* memory, size_t size);
+
+extern "C" void* malloc(size_t size)
+{
+  s_allocations++;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+  s_allocations++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* memory, size_t size)
+{
+  s_allocations++;
+  return __libc_realloc(memory, size);
+}
+#endif
+
+// the heap guard brings its own operator new, its calls to malloc are still counted with glibc
+#if !HEAP_GUARD_ENABLED
+void* operator new(size_t size)
+{
+#ifndef __GLIBC__
+  s_allocations++;
+#endif
+  void* memory = malloc(size);
+  if (memory == NULL)
+    throw std::bad_alloc();
+  return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+  free(memory);
+}
+
+void operator delete(void* memory, size_t size) noexcept
+{
+  free(memory);
+}
+#endif
+
+uint64_t hostGetAllocations()
+{
+  return s_allocations;
+}
+
+double hostSecondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void hostRunTask(const char* name)
+{
+  HostTask* task = hostFindTask(name);
+  if (task == NULL)
+    return;
+  try {
+    task->function(task->param);
+  }
+  catch (const HostStop&) {
+  }
+}
+
+uint8_t hostRunLedFrames(uint32_t frames)
+{
+  hostSetFrameLimit(frames);
+  hostRunTask("Led Task");
+  hostSetFrameLimit(0);
+  return program;
+}
+
+// the sampler being run and what consumes its blocks
+static I2SSampler* s_sampler = NULL;
+static void (*s_drain)(I2SSampler& sampler) = NULL;
+
+static void drainSampler()
+{
+  s_drain(*s_sampler);
+}
+
+bool hostRunSampler(I2SSampler& sampler, bool agc, HostI2SSource& source, void (*drain)(I2SSampler& sampler))
+{
+  i2s_config_t     i2s_config = {.mode                 = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
+                                 .sample_rate          = SampleRate,
+                                 .bits_per_sample      = I2S_BITS_PER_SAMPLE_32BIT,
+                                 .channel_format       = I2S_CHANNEL_FMT_ONLY_RIGHT,
+                                 .communication_format = i2s_comm_format_t(I2S_COMM_FORMAT_STAND_I2S),
+                                 .intr_alloc_flags     = ESP_INTR_FLAG_LEVEL1,
+                                 .dma_buf_count        = 8,
+                                 .dma_buf_len          = 64,
+                                 .use_apll             = false,
+                                 .tx_desc_auto_clear   = false,
+                                 .fixed_mclk           = 0};
+  i2s_pin_config_t i2s_pins   = {.bck_io_num = 0, .ws_io_num = 0, .data_out_num = I2S_PIN_NO_CHANGE, .data_in_num = 0};
+
+  sampler.enableAgc(agc);
+  sampler.setDecimation(AUDIO_DECIMATION);
+  s_sampler = &sampler;
+  s_drain   = drain;
+  static int16_t blocks[8 * BlockSamples];
+  if (!sampler.start(I2S_NUM_1, i2s_pins, i2s_config, blocks, BlockSamples * sizeof(int16_t), 8, NULL, 0)) {
+    printf("I2SSampler failed to start\n");
+    return false;
+  }
+  source.rewind();
+  hostSetI2SSource(&source);
+  hostSetI2SReadHook(drainSampler);
+  hostRunTask("i2s Reader Task");
+  drainSampler();
+  hostSetI2SReadHook(NULL);
+  hostSetI2SSource(NULL);
+  return true;
+}
+
+void hostSendMessage(std::vector<uint8_t>& stream, uint8_t type, const uint8_t* payload, uint16_t size)
+{
+  size_t start = stream.size();
+  stream.resize(start + size + ControlProtocol::Overhead);
+  ControlProtocol::encode(type, payload, size, &stream[start]);
+}
+
+void hostSendParam(std::vector<uint8_t>& stream, uint8_t id, int32_t value)
+{
+  uint8_t payload[5] = {id, (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+  hostSendMessage(stream, ControlMessage_SetParam, payload, sizeof(payload));
+}
+
+void hostSendFrame(std::vector<uint8_t>& stream, const uint8_t* pixels, uint16_t count)
+{
+  uint8_t payload[ControlProtocol::MaxPayload];
+  for (uint16_t first = 0; first < count; first += ControlProtocol::MaxChunkPixels) {
+    uint16_t chunk = std::min<uint16_t>(count - first, ControlProtocol::MaxChunkPixels);
+    payload[0]     = first & 0xff;
+    payload[1]     = first >> 8;
+    memcpy(payload + 2, pixels + first * 3, chunk * 3);
+    hostSendMessage(stream, ControlMessage_Pixels, payload, chunk * 3 + 2);
+  }
+}
+
+std::vector<std::vector<uint8_t>> hostReceiveMessages(const std::vector<uint8_t>& stream)
+{
+  std::vector<std::vector<uint8_t>> messages;
+  ControlParser                     parser;
+  const uint8_t*                    data = stream.data();
+  size_t                            size = stream.size();
+  while (size > 0 || parser.hasMessage()) {
+    size_t used = parser.feed(data, size);
+    data += used;
+    size -= used;
+    if (parser.hasMessage()) {
+      messages.push_back({parser.getType()});
+      messages.back().insert(messages.back().end(), parser.getPayload(), parser.getPayload() + parser.getLength());
+    }
+  }
+  return messages;
+}
+
+void hostSetCapture(bool enabled)
+{
+  std::vector<uint8_t> request;
+  uint8_t              enable = enabled;
+  hostSendMessage(request, ControlMessage_Capture, &enable, 1);
+  hostSerialInput(request.data(), request.size());
+  hostRunTask("Serial Control");
+}
+
+// every block of the sampler sent by the capture, the way a host gets it from the firmware
+static AudioCapture s_capture;
+
+static void drainCapture(I2SSampler& sampler)
+{
+  const int16_t* block;
+  while ((block = sampler.tryAcquireBlock()) != NULL) {
+    s_capture.send(block, sampler.getBufferSizeInSamples(), sampler.getBlockSequence(), sampler.getBlockTimeMs());
+    sampler.releaseBlock();
+  }
+}
+
+std::vector<int16_t> hostRecordCapture(HostI2SSource& source)
+{
+  I2SSampler           sampler;
+  std::vector<uint8_t> capture;
+  hostSetSerialCapture(&capture);
+  hostRunSampler(sampler, false, source, drainCapture);
+  hostSetSerialCapture(NULL);
+  AudioCaptureReader reader;
+  reader.feed(capture.data(), capture.size());
+  return reader.getSamples();
+}
+
+bool hostLoadRecording(const char* path, std::vector<int16_t>& samples)
+{
+  HostI2SSource wav;
+  if (wav.loadWav(path)) {
+    std::vector<int32_t> words(wav.getSampleCount());
+    wav.read(words.data(), words.size() * sizeof(int32_t));
+    for (int32_t word : words) {
+      samples.push_back(word >> 16);
+    }
+    Decimator decimator;
+    decimator.begin(AUDIO_DECIMATION);
+    samples.resize(decimator.process(samples.data(), samples.size()));
+    return true;
+  }
+  FILE* file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+  AudioCaptureReader reader;
+  uint8_t            buffer[4096];
+  size_t             size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    reader.feed(buffer, size);
+  }
+  fclose(file);
+  samples = reader.getSamples();
+  return !samples.empty();
+}
+
+// the frames of a replay as the hash of everything shown up to each of them
+static AudioReplay            s_replay;
+static std::vector<uint32_t>* s_replay_hashes = NULL;
+
+// end of a led frame: the transmit task shows it, then the writer task gets the audio up to the next frame
+static void replayFrame()
+{
+  hostRunTask("Strip Transmit Task");
+  s_replay_hashes->push_back(hostGetShownHash());
+  s_replay.advanceTo(millis());
+  hostSetTimeoutsStop(true);
+  try {
+    i2sWriterTask(&s_replay);
+  }
+  catch (const HostStop&) {
+  }
+  hostSetTimeoutsStop(false);
+}
+
+static std::vector<uint32_t> replayProgram(const std::vector<int16_t>& samples, uint8_t replay_program, uint32_t frames)
+{
+  program = OffProgram;
+  hostRunLedFrames(100);
+  hostRunTask("Strip Transmit Task");
+  effectRandom.seed(1);
+  beginAudioAnalysis();
+  hostResetShownHash();
+  static int16_t        blocks[8 * BlockSamples];
+  std::vector<uint32_t> hashes;
+  s_replay.begin(samples.data(), samples.size(), AnalysisRate, millis(), blocks, BlockSamples * sizeof(int16_t), 8, NULL);
+  s_replay_hashes = &hashes;
+  hostSetFrameHook(replayFrame);
+  program = replay_program;
+  hostRunLedFrames(frames);
+  hostSetFrameHook(NULL);
+  return hashes;
+}
+
+HostReplay hostReplayPrograms(const std::vector<int16_t>& samples, uint32_t frames)
+{
+  HostReplay replay = {{}, true, true};
+  for (uint8_t replay_program : ReplayPrograms) {
+    // the first time the firmware captures the blocks back out over Serial
+    std::vector<uint8_t> capture;
+    hostSetSerialCapture(&capture);
+    hostSetCapture(true);
+    std::vector<uint32_t> first = replayProgram(samples, replay_program, frames);
+    hostSetCapture(false);
+    hostSetSerialCapture(NULL);
+    std::vector<uint32_t> second = replayProgram(samples, replay_program, frames);
+    replay.repeated              = replay.repeated && first == second;
+
+    AudioCaptureReader reader;
+    reader.feed(capture.data(), capture.size());
+    const std::vector<int16_t>& played = reader.getSamples();
+    replay.captured = replay.captured && reader.getBlocks() > 0 && reader.getMissingBlocks() == 0 && played.size() <= samples.size() &&
+                      std::equal(played.begin(), played.end(), samples.begin());
+    replay.hashes.insert(replay.hashes.end(), first.begin(), first.end());
+  }
+  return replay;
+}
+
+void hostCometFrames(std::vector<uint8_t>& frames, uint16_t count)
+{
+  // a red comet with a 20 pixel tail running over black
+  for (uint16_t index = 0; index < count; index++) {
+    size_t first = frames.size();
+    frames.resize(first + ClipPixels * 3, 0);
+    for (int tail = 0; tail < 20; tail++) {
+      int pixel = (index * 2 - tail + ClipPixels) % ClipPixels;
+      frames[first + pixel * 3] = 255 - tail * 12;
+    }
+  }
+}
+
+void hostRainbowFrames(std::vector<uint8_t>& frames, uint16_t count)
+{
+  // every pixel changes on every frame
+  for (uint16_t index = 0; index < count; index++) {
+    for (uint16_t pixel = 0; pixel < ClipPixels; pixel++) {
+      uint8_t hue = pixel + index * 3;
+      frames.push_back(hue < 85 ? 255 - hue * 3 : hue < 170 ? 0 : (hue - 170) * 3);
+      frames.push_back(hue < 85 ? hue * 3 : hue < 170 ? 255 - (hue - 85) * 3 : 0);
+      frames.push_back(hue < 85 ? 0 : hue < 170 ? (hue - 85) * 3 : 255 - (hue - 170) * 3);
+    }
+  }
+}
+
+void hostNoiseFrames(std::vector<uint8_t>& frames, uint16_t count)
+{
+  // worst case, nothing repeats
+  for (uint32_t index = 0; index < (uint32_t)count * ClipPixels * 3; index++) {
+    frames.push_back(random(256));
+  }
+}
+
+std::vector<uint8_t> hostEncodeClip(const std::vector<uint8_t>& frames, uint8_t fps, uint8_t repeat, uint8_t tolerance)
+{
+  ClipEncoder encoder;
+  encoder.begin(ClipPixels, fps, repeat, tolerance);
+  for (size_t first = 0; first < frames.size(); first += ClipPixels * 3) {
+    encoder.addFrame(&frames[first]);
+  }
+  return encoder.getData();
+}
+
+void hostInstallDemoClips()
+{
+  static std::vector<uint8_t> bank;
+  std::vector<uint8_t>        comet, rainbow;
+  hostCometFrames(comet, 150);
+  hostRainbowFrames(rainbow, 86);
+  bank = buildClipBank({hostEncodeClip(comet, 60, 2, 0), hostEncodeClip(rainbow, 30, 1, 0)});
+  hostSetPartition(bank.data(), bank.size());
+}
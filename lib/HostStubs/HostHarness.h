@@ -0,0 +1,101 @@
+#ifndef __host_harness_h__
+#define __host_harness_h__
+
+#include <chrono>
+#include <stdint.h>
+#include <vector>
+
+#include "ClipBank.h"
+#include "FastRandom.h"
+#include "HostRuntime.h"
+#include "I2SSampler.h"
+#include "Tunables.h"
+
+// Helpers shared by the benchmark in HostMain.cpp and the suites under test/: heap allocation counts,
+// the firmware's tasks run a frame or a message at a time, the sampler fed from a HostI2SSource, the
+// Serial protocol from the host's side, audio recordings and their replay, and the demo clips.
+
+// firmware entry points and state
+void              setup();
+extern uint8_t    program;
+extern Tunables   tunables;
+void              i2sWriterTask(void* param);
+void              beginAudioAnalysis();
+extern FastRandom effectRandom;
+extern ClipBank   clipBank;
+
+static const int     ProgramCount = 11;
+static const uint8_t OffProgram   = 7;
+
+#ifndef STRIP_COUNT
+#define STRIP_COUNT 1
+#endif
+#ifndef STRIP_LENGTH
+#define STRIP_LENGTH 300
+#endif
+#ifndef AUDIO_DECIMATION
+#define AUDIO_DECIMATION 4
+#endif
+static const uint32_t SampleRate   = 44100;
+// rate and block size of the analysis, as the firmware has them
+static const uint32_t AnalysisRate = SampleRate / AUDIO_DECIMATION;
+static const int32_t  BlockSamples = 1024 / AUDIO_DECIMATION;
+
+// heap allocations made through new, and through malloc with glibc, since the start
+uint64_t hostGetAllocations();
+double   hostSecondsSince(std::chrono::steady_clock::time_point start);
+
+// run a task of the firmware until it blocks for good
+void hostRunTask(const char* name);
+// program of the firmware after frames more frames of the led task
+uint8_t hostRunLedFrames(uint32_t frames = 3);
+
+// feed source through sampler from the reader task at the firmware's decimation, drain consumes the
+// blocks the way the writer task would whenever the reader is about to read more data
+bool hostRunSampler(I2SSampler& sampler, bool agc, HostI2SSource& source, void (*drain)(I2SSampler& sampler));
+
+// messages of the control protocol appended to stream
+void hostSendMessage(std::vector<uint8_t>& stream, uint8_t type, const uint8_t* payload, uint16_t size);
+void hostSendParam(std::vector<uint8_t>& stream, uint8_t id, int32_t value);
+// a whole frame of pixels in chunks of at most MaxChunkPixels
+void hostSendFrame(std::vector<uint8_t>& stream, const uint8_t* pixels, uint16_t count);
+// the messages in what the firmware sent as type then payload, its text output in between is skipped
+// like a real host would
+std::vector<std::vector<uint8_t>> hostReceiveMessages(const std::vector<uint8_t>& stream);
+// the firmware's control task asked to start or stop capturing the audio blocks
+void hostSetCapture(bool enabled);
+
+// the samples a host gets from the capture of everything source plays through the sampler
+std::vector<int16_t> hostRecordCapture(HostI2SSource& source);
+// a capture or a 16 bit WAV file as the samples the writer task gets, the WAV at the microphone's rate
+// is decimated like the sampler does it
+bool hostLoadRecording(const char* path, std::vector<int16_t>& samples);
+
+// audio programs the replay plays, in order
+static const uint8_t ReplayPrograms[] = {1, 2, 5, 6, 8};
+
+struct HostReplay
+{
+  // hash of everything shown up to each frame of the first run, program after program
+  std::vector<uint32_t> hashes;
+  // both runs showed the same frames
+  bool repeated;
+  // the capture made during the first run gave back the samples that were played
+  bool captured;
+};
+
+// Every audio program plays samples twice through the firmware's writer task, in step with the led
+// task, starting from the settled off program with the same random numbers and the analysis reset.
+HostReplay hostReplayPrograms(const std::vector<int16_t>& samples, uint32_t frames);
+
+// demo clips, each frame is ClipPixels r, g, b triples
+static const uint16_t ClipPixels = 300;
+
+void                 hostCometFrames(std::vector<uint8_t>& frames, uint16_t count);
+void                 hostRainbowFrames(std::vector<uint8_t>& frames, uint16_t count);
+void                 hostNoiseFrames(std::vector<uint8_t>& frames, uint16_t count);
+std::vector<uint8_t> hostEncodeClip(const std::vector<uint8_t>& frames, uint8_t fps, uint8_t repeat, uint8_t tolerance);
+// a comet and a rainbow clip in the flash partition for program 9
+void hostInstallDemoClips();
+
+#endif
@@ -0,0 +1,311 @@
+#include <chrono>
+#include <stdio.h>
+
+#include <Arduino.h>
+
+#include "ColorLut.h"
+#include "EffectRegistry.h"
+#include "HostHarness.h"
+#include "HostRuntime.h"
+#include "I2SSampler.h"
+#include "LevelMeter.h"
+#include "PixelFrame.h"
+#include "SpectrumAnalyzer.h"
+#include "StripGroup.h"
+#include "Telemetry.h"
+
+// Headless benchmark of the firmware: every program runs for a number of frames on the host and the
+// audio path is fed from a synthetic signal or a WAV file.
+//
+//   program [--frames N] [--wav file.wav] [--seconds S] [--replay capture.bin|file.wav] [--golden frames.bin]
+//
+// The dispatch line compares the per-frame cost of the effect registry with the switch it replaced.
+// The strip table compares one long strip with the same pixels spread over parallel strips. With
+// --replay a recording (a capture or a WAV file) plays into every audio program twice and the frames
+// are compared, with --golden also to an earlier run, or a click track does when only --golden is
+// given; the exit code is 1 if they differ. Program 9 plays demo clips from the partition. The checks
+// of the modules and of the firmware are the suites under test/, run by pio test -e native.
+
+#ifndef PIO_UNIT_TESTING
+
+static void benchmarkPrograms(uint32_t frames)
+{
+  HostTask* led_task = hostFindTask("Led Task");
+  if (led_task == NULL) {
+    printf("Led Task was not created by setup()\n");
+    return;
+  }
+  printf("program  frames  ns/frame  allocs/frame  virtual ms\n");
+  for (int index = 0; index < ProgramCount; index++) {
+    program                  = index;
+    uint64_t allocations     = hostGetAllocations();
+    uint32_t virtual_start   = millis();
+    hostSetFrameLimit(frames);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try {
+      led_task->function(led_task->param);
+    }
+    catch (const HostStop&) {
+    }
+    double   seconds  = hostSecondsSince(start);
+    uint32_t rendered = hostGetFrameCount();
+    printf("%7d  %6lu  %8.0f  %12.2f  %10lu\n", index, (unsigned long)rendered, seconds * 1e9 / rendered,
+           (double)(hostGetAllocations() - allocations) / rendered, (unsigned long)(millis() - virtual_start));
+  }
+  hostSetFrameLimit(0);
+}
+
+// effect that draws a single pixel, so the dispatch is most of the work
+struct DispatchCanvas
+{
+  RgbColor pixels[16];
+
+  void SetPixelColor(uint16_t index, const RgbColor& color)
+  {
+    pixels[index] = color;
+  }
+};
+
+template <uint8_t T_PIXEL>
+struct DotEffect : EffectBase<60>
+{
+  struct State
+  {
+    uint8_t level;
+  };
+
+  template <typename T_CANVAS>
+  static void render(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    canvas.SetPixelColor(T_PIXEL, RgbColor(state.level++));
+  }
+};
+
+typedef EffectRegistry<DispatchCanvas, DotEffect<0>, DotEffect<1>, DotEffect<2>, DotEffect<3>, DotEffect<4>, DotEffect<5>, DotEffect<6>,
+                       DotEffect<7>, DotEffect<8>, DotEffect<9>>
+  DotEffects;
+
+// the same effects the way ledConfigTask ran them before, a setup flag per program cleared by the next one
+static void switchFrame(volatile uint8_t& selected, DispatchCanvas& canvas, bool* done, uint8_t* level)
+{
+  uint8_t index = selected;
+  switch (index) {
+    case 0:
+    case 1:
+    case 2:
+    case 3:
+    case 4:
+    case 5:
+    case 6:
+    case 7:
+    case 8:
+    case 9:
+      if (!done[index]) {
+        done[(index + 9) % 10] = false;
+        done[index]            = true;
+        level[index]           = 0;
+      }
+      canvas.SetPixelColor(index, RgbColor(level[index]++));
+      break;
+  }
+}
+
+static void benchmarkDispatch(uint32_t frames)
+{
+  static DispatchCanvas canvas;
+  static DotEffects     effects;
+  volatile uint8_t      selected = 0;
+  bool                  done[10] = {false};
+  uint8_t               level[10];
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t index = 0; index < frames; index++) {
+    selected = index * 10 / frames;
+    switchFrame(selected, canvas, done, level);
+  }
+  double switch_seconds = hostSecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t index = 0; index < frames; index++) {
+    selected = index * 10 / frames;
+    if (selected != effects.getCurrent())
+      effects.select(selected, canvas, index);
+    effects.update(index);
+    effects.render(canvas, index);
+  }
+  double registry_seconds = hostSecondsSince(start);
+  printf("dispatch: switch %.1f ns/frame, registry %.1f ns/frame\n", switch_seconds * 1e9 / frames, registry_seconds * 1e9 / frames);
+}
+
+// time a WS2812 strip of pixels is busy with a frame: 24 bits at 800 kHz per pixel plus the latch
+static double wireUs(uint32_t pixels)
+{
+  return pixels * 30.0 + 300.0;
+}
+
+// a rainbow moving over the whole canvas, so every pixel is converted and sent on every frame
+template <uint8_t T_STRIP_COUNT, uint16_t T_STRIP_LENGTH>
+static void benchmarkStrips(uint32_t frames)
+{
+  typedef StripGroup<NeoPixelBus<NeoGrbFeature, NeoEsp32I2s0X8Ws2812xMethod>, T_STRIP_COUNT, T_STRIP_LENGTH> Group;
+  const uint16_t                                       PixelCount = T_STRIP_COUNT * T_STRIP_LENGTH;
+  static const uint8_t                                 Pins[8]    = {4, 16, 17, 18, 19, 21, 22, 23};
+  static Group                                         group(Pins);
+  static PixelFrame<Group, PixelCount>                 frame(group);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t index = 0; index < frames; index++) {
+    for (uint16_t pixel = 0; pixel < PixelCount; pixel++) {
+      frame.SetPixelColor(pixel, ColorLut::hue(pixel + index, 127));
+    }
+    frame.Show();
+  }
+  double seconds = hostSecondsSince(start);
+  // the strips of a group are sent at the same time, so the longest one sets the frame time
+  double wire_us = wireUs(T_STRIP_LENGTH);
+  printf("%6u  %6u  %6u  %8.0f  %10.2f  %6.1f\n", T_STRIP_COUNT, T_STRIP_LENGTH, PixelCount, seconds * 1e9 / frames, wire_us / 1000.0,
+         1e6 / wire_us);
+}
+
+// the writer task's work on every block
+static LevelMeter       s_meter;
+static SpectrumAnalyzer s_spectrum;
+static uint32_t         s_blocks = 0;
+
+static void drainAnalysis(I2SSampler& sampler)
+{
+  const int16_t* block;
+  while ((block = sampler.tryAcquireBlock()) != NULL) {
+    s_meter.addBlock(block);
+    s_spectrum.process(block, sampler.getBufferSizeInSamples());
+    sampler.releaseBlock();
+    s_blocks++;
+  }
+}
+
+static void benchmarkAudio(HostI2SSource& source, bool agc)
+{
+  I2SSampler sampler;
+  s_blocks = 0;
+  s_meter.begin(BlockSamples, 4);
+  s_spectrum.begin(AnalysisRate, 15, 60.0f, 16000.0f);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if (!hostRunSampler(sampler, agc, source, drainAnalysis))
+    return;
+  double seconds = hostSecondsSince(start);
+  printf("audio %s: %lu samples, %lu blocks, %lu overruns, %.1f Msamples/s, rms %.0f, peak %ld\n", agc ? "agc  " : "fixed",
+         (unsigned long)source.getSampleCount(), (unsigned long)s_blocks, (unsigned long)sampler.getOverrunCount(),
+         source.getSampleCount() / seconds / 1e6, s_meter.getRMS(), (long)s_meter.getPeak());
+}
+
+// The recording through every audio program twice, compared run against run and with golden to the
+// frames stored by an earlier run, or stored if there are none yet.
+static bool replayRecording(const std::vector<int16_t>& samples, uint32_t frames, const char* golden)
+{
+  std::chrono::steady_clock::time_point start  = std::chrono::steady_clock::now();
+  HostReplay                            replay = hostReplayPrograms(samples, frames);
+  double                                seconds = hostSecondsSince(start);
+
+  bool        matched = true;
+  const char* state   = "no golden file";
+  if (golden != NULL) {
+    std::vector<uint32_t> stored(replay.hashes.size() + 1);
+    FILE*                 file = fopen(golden, "rb");
+    if (file != NULL) {
+      stored.resize(fread(stored.data(), sizeof(uint32_t), stored.size(), file));
+      fclose(file);
+      matched = stored == replay.hashes;
+      state   = matched ? "matches the golden file" : "differs from the golden file";
+      for (size_t index = 0; index < replay.hashes.size() && index < stored.size(); index++) {
+        if (stored[index] != replay.hashes[index]) {
+          printf("replay: program %u differs from frame %lu\n", ReplayPrograms[index / frames], (unsigned long)(index % frames));
+          break;
+        }
+      }
+    }
+    else if ((file = fopen(golden, "wb")) != NULL) {
+      fwrite(replay.hashes.data(), sizeof(uint32_t), replay.hashes.size(), file);
+      fclose(file);
+      state = "golden file written";
+    }
+  }
+  bool passed = replay.repeated && replay.captured && matched;
+  printf("replay: %s, %u programs x %lu frames over %.1f s of audio, repeated %s, capture %s, %s, %.1f us/frame\n", passed ? "ok  " : "FAIL",
+         (unsigned)sizeof(ReplayPrograms), (unsigned long)frames, (float)samples.size() / AnalysisRate, replay.repeated ? "ok" : "FAIL",
+         replay.captured ? "ok" : "FAIL", state, seconds * 1e6 / (2 * sizeof(ReplayPrograms) * frames));
+  return passed;
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t    frames  = 1000;
+  float       seconds = 10.0f;
+  const char* wav     = NULL;
+  const char* replay  = NULL;
+  const char* golden  = NULL;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--frames") == 0)
+      frames = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--seconds") == 0)
+      seconds = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "--wav") == 0)
+      wav = argv[i + 1];
+    else if (strcmp(argv[i], "--replay") == 0)
+      replay = argv[i + 1];
+    else if (strcmp(argv[i], "--golden") == 0)
+      golden = argv[i + 1];
+  }
+
+  hostInstallDemoClips();
+  hostSetSerialQuiet(true);
+  setup();
+  benchmarkPrograms(frames);
+  benchmarkDispatch(10000000);
+
+  bool replay_passed = true;
+  if (replay != NULL || golden != NULL) {
+    // a click track recorded through the capture unless a recording is given
+    std::vector<int16_t> recording;
+    if (replay == NULL) {
+      HostI2SSource clicks;
+      clicks.generate(HostSignal_Clicks, 2.0f, 0.02f, SampleRate * 15, SampleRate);
+      recording = hostRecordCapture(clicks);
+    }
+    else if (!hostLoadRecording(replay, recording)) {
+      printf("could not load %s\n", replay);
+      return 1;
+    }
+    replay_passed = replayRecording(recording, 600, golden);
+  }
+
+  printf("strips  length  pixels  ns/frame  wire ms/frame  max fps\n");
+  benchmarkStrips<1, 300>(frames);
+  benchmarkStrips<1, 600>(frames);
+  benchmarkStrips<2, 300>(frames);
+  benchmarkStrips<1, 1200>(frames);
+  benchmarkStrips<4, 300>(frames);
+  benchmarkStrips<1, 2400>(frames);
+  benchmarkStrips<8, 300>(frames);
+
+  HostI2SSource source;
+  if (wav != NULL) {
+    if (!source.loadWav(wav)) {
+      printf("could not load %s\n", wav);
+      return 1;
+    }
+  }
+  else {
+    // a quiet tone then louder noise, around the levels the microphone sees in a room
+    source.generate(HostSignal_Sine, 440.0f, 0.002f, SampleRate * seconds / 2, SampleRate);
+    source.generate(HostSignal_Noise, 0.0f, 0.01f, SampleRate * seconds / 2, SampleRate);
+  }
+  benchmarkAudio(source, false);
+  benchmarkAudio(source, true);
+
+  // with TELEMETRY_ENABLED=1 finish with one dump covering the whole run
+  hostSetSerialQuiet(false);
+  TELEMETRY_POLL();
+  return replay_passed ? 0 : 1;
+}
+
+#endif
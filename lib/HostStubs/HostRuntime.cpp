@@ -0,0 +1,676 @@
+#include <chrono>
+#include <random>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <Arduino.h>
+#include <driver/i2s.h>
+#include <esp_heap_caps.h>
+#include <esp_partition.h>
+#include <freertos/queue.h>
+#include <freertos/timers.h>
+
+#include "HostRuntime.h"
+
+HostSerial Serial;
+HostEsp    ESP;
+
+static uint32_t              s_now_ms      = 0;
+static uint32_t              s_frames      = 0;
+static uint32_t              s_frame_limit = 0;
+static void (*s_frame_hook)()              = NULL;
+static bool                  s_serial_quiet = false;
+static bool                  s_timeouts_stop = false;
+static uint32_t              s_shown_hash    = 2166136261u;
+static std::vector<uint8_t>  s_shown_pixels;
+// bytes waiting to be read from Serial, and where the firmware's output goes when it is captured
+static std::vector<uint8_t>  s_serial_input;
+static size_t                s_serial_read  = 0;
+static std::vector<uint8_t>* s_serial_capture = NULL;
+static std::function<void()> s_serial_receive;
+static int                   s_pins[64]    = {0};
+// pin interrupts attached by the firmware
+struct HostInterrupt
+{
+  void (*handler)(void*);
+  void* arg;
+  int   mode;
+};
+static HostInterrupt               s_interrupts[64] = {};
+static std::vector<StaticTimer_t*> s_timers;
+static std::vector<HostTask> s_tasks;
+static std::mt19937          s_random;
+static HostI2SSource*        s_i2s_source  = NULL;
+static void (*s_i2s_read_hook)()           = NULL;
+// handle of the I2S event queue
+static int s_i2s_queue;
+// the data partition and the memory that backs it
+static esp_partition_t s_partition      = {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, 0x3d0000, 0, "spiffs", false};
+static const uint8_t*  s_partition_data = NULL;
+
+static const std::chrono::steady_clock::time_point s_start = std::chrono::steady_clock::now();
+
+// move virtual time forward by ms, firing the software timers that expire on the way
+static void advanceMs(uint32_t ms)
+{
+  uint32_t target = s_now_ms + ms;
+  while (true) {
+    StaticTimer_t* next = NULL;
+    for (StaticTimer_t* timer : s_timers) {
+      if (timer->active && (int32_t)(target - timer->expiry) >= 0 && (next == NULL || (int32_t)(next->expiry - timer->expiry) > 0))
+        next = timer;
+    }
+    if (next == NULL)
+      break;
+    if ((int32_t)(next->expiry - s_now_ms) > 0)
+      s_now_ms = next->expiry;
+    next->active = next->auto_reload;
+    next->expiry = s_now_ms + next->period;
+    next->callback((TimerHandle_t)next);
+  }
+  s_now_ms = target;
+}
+
+// runtime control
+
+HostTask* hostFindTask(const char* name)
+{
+  for (size_t i = s_tasks.size(); i > 0; i--) {
+    if (strcmp(s_tasks[i - 1].name, name) == 0)
+      return &s_tasks[i - 1];
+  }
+  return NULL;
+}
+
+void hostSetFrameLimit(uint32_t frames)
+{
+  s_frame_limit = frames;
+  s_frames      = 0;
+}
+
+uint32_t hostGetFrameCount()
+{
+  return s_frames;
+}
+
+void hostSetFrameHook(void (*hook)())
+{
+  s_frame_hook = hook;
+}
+
+void hostAdvanceMs(uint32_t ms)
+{
+  advanceMs(ms);
+}
+
+void hostSetTimeoutsStop(bool stop)
+{
+  s_timeouts_stop = stop;
+}
+
+void hostSetPin(uint8_t pin, int level)
+{
+  int                  previous  = s_pins[pin & 63];
+  const HostInterrupt& interrupt = s_interrupts[pin & 63];
+  s_pins[pin & 63]               = level;
+  if (interrupt.handler == NULL || level == previous)
+    return;
+  if (interrupt.mode == CHANGE || (interrupt.mode == RISING && level == HIGH) || (interrupt.mode == FALLING && level == LOW))
+    interrupt.handler(interrupt.arg);
+}
+
+void hostSetSerialQuiet(bool quiet)
+{
+  s_serial_quiet = quiet;
+}
+
+void hostSerialInput(const uint8_t* data, size_t size)
+{
+  // drop what was read already so a long stream does not keep growing the buffer
+  s_serial_input.erase(s_serial_input.begin(), s_serial_input.begin() + s_serial_read);
+  s_serial_read = 0;
+  s_serial_input.insert(s_serial_input.end(), data, data + size);
+  if (s_serial_receive)
+    s_serial_receive();
+}
+
+void hostSetSerialCapture(std::vector<uint8_t>* capture)
+{
+  s_serial_capture = capture;
+}
+
+uint32_t hostGetShownHash()
+{
+  return s_shown_hash;
+}
+
+void hostResetShownHash()
+{
+  s_shown_hash = 2166136261u;
+}
+
+const std::vector<uint8_t>& hostGetShownPixels()
+{
+  return s_shown_pixels;
+}
+
+void hostRecordShow(const void* pixels, size_t size)
+{
+  const uint8_t* bytes = (const uint8_t*)pixels;
+  s_shown_pixels.assign(bytes, bytes + size);
+  for (size_t index = 0; index < size; index++) {
+    s_shown_hash = (s_shown_hash ^ bytes[index]) * 16777619u;
+  }
+}
+
+void hostSetI2SSource(HostI2SSource* source)
+{
+  s_i2s_source = source;
+}
+
+void hostSetI2SReadHook(void (*hook)())
+{
+  s_i2s_read_hook = hook;
+}
+
+void hostSetPartition(const uint8_t* data, uint32_t size)
+{
+  s_partition_data = data;
+  s_partition.size = size;
+}
+
+// Arduino
+
+uint32_t millis()
+{
+  return s_now_ms;
+}
+
+uint32_t micros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - s_start).count();
+}
+
+void delay(uint32_t ms)
+{
+  advanceMs(ms);
+}
+
+long random(long max)
+{
+  return max > 0 ? s_random() % max : 0;
+}
+
+long random(long min, long max)
+{
+  return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed)
+{
+  s_random.seed(seed);
+}
+
+uint32_t esp_random()
+{
+  return s_random();
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+int analogRead(uint8_t pin)
+{
+  return s_random() & 0xfff;
+}
+
+int digitalRead(uint8_t pin)
+{
+  return s_pins[pin & 63];
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode)
+{
+  s_interrupts[pin & 63] = {handler, arg, mode};
+}
+
+void detachInterrupt(uint8_t pin)
+{
+  s_interrupts[pin & 63] = {};
+}
+
+uint32_t getCpuFrequencyMhz()
+{
+  return 1000;
+}
+
+void HostSerial::begin(unsigned long baud)
+{
+}
+
+size_t HostSerial::print(const char* text)
+{
+  return write((const uint8_t*)text, strlen(text));
+}
+
+size_t HostSerial::println(const char* text)
+{
+  return print(text) + print("\n");
+}
+
+size_t HostSerial::printf(const char* format, ...)
+{
+  if (s_serial_quiet && s_serial_capture == NULL)
+    return 0;
+  char    text[512];
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  return written > 0 ? write((const uint8_t*)text, std::min((size_t)written, sizeof(text) - 1)) : 0;
+}
+
+size_t HostSerial::write(const uint8_t* buffer, size_t size)
+{
+  if (s_serial_capture != NULL) {
+    s_serial_capture->insert(s_serial_capture->end(), buffer, buffer + size);
+    return size;
+  }
+  return s_serial_quiet ? size : fwrite(buffer, 1, size, stdout);
+}
+
+size_t HostSerial::write(uint8_t value)
+{
+  return write(&value, 1);
+}
+
+void HostSerial::flush()
+{
+  fflush(stdout);
+}
+
+int HostSerial::available()
+{
+  return s_serial_input.size() - s_serial_read;
+}
+
+int HostSerial::availableForWrite()
+{
+  // stdout never pushes back
+  return 4096;
+}
+
+int HostSerial::read()
+{
+  return s_serial_read < s_serial_input.size() ? s_serial_input[s_serial_read++] : -1;
+}
+
+size_t HostSerial::read(uint8_t* buffer, size_t size)
+{
+  size = std::min(size, s_serial_input.size() - s_serial_read);
+  memcpy(buffer, s_serial_input.data() + s_serial_read, size);
+  s_serial_read += size;
+  return size;
+}
+
+size_t HostSerial::setRxBufferSize(size_t size)
+{
+  return size;
+}
+
+size_t HostSerial::setTxBufferSize(size_t size)
+{
+  return size;
+}
+
+void HostSerial::onReceive(std::function<void()> callback)
+{
+  s_serial_receive = callback;
+}
+
+void HostEsp::restart()
+{
+  fprintf(stderr, "ESP.restart() called\n");
+  exit(1);
+}
+
+uint32_t HostEsp::getCycleCount()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_start).count();
+}
+
+// FreeRTOS
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority,
+                                   TaskHandle_t* handle, BaseType_t core)
+{
+  // handles are indexes so they survive the list growing
+  HostTask record = {task, param, name, core, 0};
+  s_tasks.push_back(record);
+  if (handle != NULL)
+    *handle = (TaskHandle_t)(uintptr_t)s_tasks.size();
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority, TaskHandle_t* handle)
+{
+  return xTaskCreatePinnedToCore(task, name, stack_depth, param, priority, handle, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t task, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority,
+                                           StackType_t* stack, StaticTask_t* tcb, BaseType_t core)
+{
+  if (stack == NULL || tcb == NULL)
+    return NULL;
+  TaskHandle_t handle;
+  xTaskCreatePinnedToCore(task, name, stack_depth, param, priority, &handle, core);
+  return handle;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t task, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority, StackType_t* stack,
+                               StaticTask_t* tcb)
+{
+  return xTaskCreateStaticPinnedToCore(task, name, stack_depth, param, priority, stack, tcb, tskNO_AFFINITY);
+}
+
+BaseType_t xTaskNotify(TaskHandle_t handle, uint32_t value, eNotifyAction action)
+{
+  uintptr_t index = (uintptr_t)handle;
+  if (index == 0 || index > s_tasks.size())
+    return pdFAIL;
+  s_tasks[index - 1].notifications = action == eIncrement ? s_tasks[index - 1].notifications + 1 : value;
+  return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+  return xTaskNotify(handle, 0, eIncrement);
+}
+
+// a frame of the led task is over and the time has moved on to the next one
+static void endFrame()
+{
+  s_frames++;
+  if (s_frame_hook != NULL)
+    s_frame_hook();
+  if (s_frame_limit > 0 && s_frames >= s_frame_limit)
+    throw HostStop();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+  // nothing else runs while a task waits on the host, so a wait either times out or never ends
+  if (ticks_to_wait == portMAX_DELAY || (ticks_to_wait > 0 && s_timeouts_stop))
+    throw HostStop();
+  advanceMs(ticks_to_wait);
+  // only the led task waits with a timeout outside of hostSetTimeoutsStop(), when it idles
+  if (ticks_to_wait > 0)
+    endFrame();
+  return 0;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  advanceMs(ticks);
+}
+
+void vTaskDelayUntil(TickType_t* previous_wake, TickType_t period)
+{
+  *previous_wake += period;
+  if ((int32_t)(*previous_wake - s_now_ms) > 0)
+    advanceMs(*previous_wake - s_now_ms);
+  endFrame();
+}
+
+TickType_t xTaskGetTickCount()
+{
+  return s_now_ms;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  return NULL;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle)
+{
+  return 0;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks_to_wait)
+{
+  if (queue == &s_i2s_queue) {
+    // a DMA buffer is ready as long as the source has audio left
+    if (s_i2s_source == NULL || s_i2s_source->isFinished())
+      throw HostStop();
+    i2s_event_t* event = (i2s_event_t*)item;
+    event->type        = I2S_EVENT_RX_DONE;
+    event->size        = 0;
+    return pdPASS;
+  }
+  StaticQueue_t* state = (StaticQueue_t*)queue;
+  if (state->count > 0) {
+    memcpy(item, state->storage + state->head * state->item_size, state->item_size);
+    state->head = (state->head + 1) % state->length;
+    state->count--;
+    return pdPASS;
+  }
+  if (ticks_to_wait == portMAX_DELAY || (ticks_to_wait > 0 && s_timeouts_stop))
+    throw HostStop();
+  advanceMs(ticks_to_wait);
+  return pdFALSE;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t* storage, StaticQueue_t* queue)
+{
+  if (storage == NULL || queue == NULL || length == 0)
+    return NULL;
+  *queue = {storage, length, item_size, 0, 0};
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait)
+{
+  // nothing drains the queue while the sender waits, so a full queue stays full
+  StaticQueue_t* state = (StaticQueue_t*)queue;
+  if (state->count == state->length)
+    return pdFAIL;
+  memcpy(state->storage + (state->head + state->count) % state->length * state->item_size, item, state->item_size);
+  state->count++;
+  return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higher_priority_task_woken)
+{
+  if (higher_priority_task_woken != NULL)
+    *higher_priority_task_woken = pdFALSE;
+  return xQueueSend(queue, item, 0);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  return ((StaticQueue_t*)queue)->count;
+}
+
+// software timers
+
+TimerHandle_t xTimerCreateStatic(const char* name, TickType_t period, UBaseType_t auto_reload, void* id, TimerCallbackFunction_t callback,
+                                 StaticTimer_t* timer)
+{
+  if (timer == NULL || callback == NULL)
+    return NULL;
+  *timer = {callback, id, period, 0, auto_reload != pdFALSE, false};
+  if (std::find(s_timers.begin(), s_timers.end(), timer) == s_timers.end())
+    s_timers.push_back(timer);
+  return (TimerHandle_t)timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+  StaticTimer_t* state = (StaticTimer_t*)timer;
+  state->expiry        = s_now_ms + state->period;
+  state->active        = true;
+  return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+  ((StaticTimer_t*)timer)->active = false;
+  return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks_to_wait)
+{
+  ((StaticTimer_t*)timer)->period = period;
+  return xTimerStart(timer, ticks_to_wait);
+}
+
+BaseType_t xTimerChangePeriodFromISR(TimerHandle_t timer, TickType_t period, BaseType_t* higher_priority_task_woken)
+{
+  if (higher_priority_task_woken != NULL)
+    *higher_priority_task_woken = pdFALSE;
+  return xTimerChangePeriod(timer, period, 0);
+}
+
+void* pvTimerGetTimerID(TimerHandle_t timer)
+{
+  return ((StaticTimer_t*)timer)->id;
+}
+
+// I2S driver
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t* config, int queue_size, QueueHandle_t* queue)
+{
+  if (queue != NULL)
+    *queue = &s_i2s_queue;
+  return ESP_OK;
+}
+
+esp_err_t i2s_set_pin(i2s_port_t port, const i2s_pin_config_t* pins)
+{
+  return ESP_OK;
+}
+
+esp_err_t i2s_read(i2s_port_t port, void* dest, size_t size, size_t* bytes_read, TickType_t ticks_to_wait)
+{
+  if (s_i2s_read_hook != NULL)
+    s_i2s_read_hook();
+  *bytes_read = s_i2s_source != NULL ? s_i2s_source->read(dest, size) : 0;
+  return ESP_OK;
+}
+
+// partitions
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label)
+{
+  if (s_partition.size == 0 || type != s_partition.type || (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != s_partition.subtype))
+    return NULL;
+  if (label != NULL && strcmp(label, s_partition.label) != 0)
+    return NULL;
+  return &s_partition;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size, spi_flash_mmap_memory_t memory,
+                             const void** out_ptr, spi_flash_mmap_handle_t* out_handle)
+{
+  if (partition != &s_partition || offset + size > s_partition.size)
+    return ESP_FAIL;
+  *out_ptr    = s_partition_data + offset;
+  *out_handle = 1;
+  return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle)
+{
+}
+
+// heap
+
+void heap_caps_get_info(multi_heap_info_t* info, uint32_t caps)
+{
+  *info = multi_heap_info_t();
+}
+
+// I2S source
+
+void HostI2SSource::generate(HostSignal signal, float frequency, float amplitude, uint32_t sample_count, uint32_t sample_rate)
+{
+  std::mt19937                          noise(1234);
+  std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+  uint32_t                              click_period = frequency > 0 ? (uint32_t)(sample_rate / frequency) : sample_rate;
+  for (uint32_t i = 0; i < sample_count; i++) {
+    float value = 0.0f;
+    switch (signal) {
+      case HostSignal_Sine:
+        value = sinf(2.0f * (float)M_PI * frequency * i / sample_rate);
+        break;
+      case HostSignal_Noise:
+        value = uniform(noise);
+        break;
+      case HostSignal_Clicks:
+        // short decaying burst at the start of every period
+        value = (i % click_period) < 64 ? uniform(noise) * (1.0f - (i % click_period) / 64.0f) : 0.0f;
+        break;
+      default:
+        break;
+    }
+    // 24 bit data in the top of the 32 bit word
+    m_words.push_back((int32_t)(value * amplitude * 8388607.0f) * 256);
+  }
+}
+
+bool HostI2SSource::loadWav(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+  char     riff[12];
+  uint16_t channels = 0;
+  uint16_t bits     = 0;
+  bool     loaded   = false;
+  if (fread(riff, 1, 12, file) == 12 && memcmp(riff, "RIFF", 4) == 0 && memcmp(riff + 8, "WAVE", 4) == 0) {
+    char     id[4];
+    uint32_t size;
+    while (fread(id, 1, 4, file) == 4 && fread(&size, 4, 1, file) == 1) {
+      if (memcmp(id, "fmt ", 4) == 0) {
+        uint8_t format[16];
+        if (size < 16 || fread(format, 1, 16, file) != 16)
+          break;
+        channels = format[2] | (format[3] << 8);
+        bits     = format[14] | (format[15] << 8);
+        fseek(file, size - 16 + (size & 1), SEEK_CUR);
+      }
+      else if (memcmp(id, "data", 4) == 0 && channels > 0 && bits == 16) {
+        int16_t frame[8];
+        for (uint32_t offset = 0; offset + channels * 2 <= size && channels <= 8; offset += channels * 2) {
+          if (fread(frame, 2, channels, file) != channels)
+            break;
+          m_words.push_back((int32_t)frame[0] * 65536);
+        }
+        loaded = true;
+        break;
+      }
+      else {
+        fseek(file, size + (size & 1), SEEK_CUR);
+      }
+    }
+  }
+  fclose(file);
+  return loaded;
+}
+
+size_t HostI2SSource::read(void* dest, size_t size)
+{
+  size_t count = size / sizeof(int32_t);
+  if (count > m_words.size() - m_position)
+    count = m_words.size() - m_position;
+  memcpy(dest, m_words.data() + m_position, count * sizeof(int32_t));
+  m_position += count;
+  return count * sizeof(int32_t);
+}
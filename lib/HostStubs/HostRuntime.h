@@ -0,0 +1,102 @@
+#ifndef __host_runtime_h__
+#define __host_runtime_h__
+
+#include <stdint.h>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+
+// Control surface of the host stand-ins.
+//
+// Time is virtual: millis() and the tick count only move when the firmware sleeps (vTaskDelay,
+// vTaskDelayUntil, delay), so animations run at their real speed however fast the host is. micros()
+// is the real host clock so the firmware's own phase timings stay meaningful. Software timers fire
+// whenever virtual time passes their expiry. Tasks are only recorded when created; the runner calls
+// the task functions itself and stops their endless loops by letting the stand-ins throw HostStop,
+// either after a number of frames (one vTaskDelayUntil, or timed notification wait of the idling led
+// task, per frame) or when a task would block forever. A timed wait always lasts its whole timeout.
+
+struct HostStop
+{
+};
+
+struct HostTask
+{
+  TaskFunction_t function;
+  void*          param;
+  const char*    name;
+  BaseType_t     core;
+  uint32_t       notifications;
+};
+
+// most recent task created with xTaskCreate / xTaskCreatePinnedToCore under name, NULL if there is none
+HostTask* hostFindTask(const char* name);
+// throw HostStop at the end of a frame once frames frames have been started, 0 for no limit
+void     hostSetFrameLimit(uint32_t frames);
+// called at the end of every frame, once the time has moved on to the start of the next one
+void     hostSetFrameHook(void (*hook)());
+uint32_t hostGetFrameCount();
+void     hostAdvanceMs(uint32_t ms);
+// timed waits throw HostStop instead of letting the time pass, to run a task until it has nothing left to do
+void hostSetTimeoutsStop(bool stop);
+// level returned by digitalRead(pin), an interrupt attached to pin runs right away if it changed
+void hostSetPin(uint8_t pin, int level);
+// hide the firmware's Serial output
+void hostSetSerialQuiet(bool quiet);
+// bytes for Serial to receive, after the ones not read yet
+void hostSerialInput(const uint8_t* data, size_t size);
+// append everything the firmware sends over Serial to capture instead of printing it, NULL to print again
+void hostSetSerialCapture(std::vector<uint8_t>* capture);
+// FNV-1a hash over the pixels of every strip Show() since the last reset, to compare runs frame by frame
+uint32_t hostGetShownHash();
+void     hostResetShownHash();
+// pixels of the last strip Show()
+const std::vector<uint8_t>& hostGetShownPixels();
+// called by the NeoPixelBus stand-in
+void hostRecordShow(const void* pixels, size_t size);
+
+enum HostSignal
+{
+  HostSignal_Silence,
+  HostSignal_Sine,
+  HostSignal_Noise,
+  HostSignal_Clicks
+};
+
+// Audio served by i2s_read(), as the raw left aligned 32 bit words the ICS-43434 produces.
+class HostI2SSource
+{
+private:
+  std::vector<int32_t> m_words;
+  size_t               m_position = 0;
+
+public:
+  // append sample_count samples of signal, amplitude is relative to full scale, frequency is the
+  // tone frequency or the click rate in Hz
+  void generate(HostSignal signal, float frequency, float amplitude, uint32_t sample_count, uint32_t sample_rate);
+  // append the first channel of a 16 bit PCM WAV file
+  bool loadWav(const char* path);
+  size_t read(void* dest, size_t size);
+  void   rewind()
+  {
+    m_position = 0;
+  }
+  size_t getSampleCount() const
+  {
+    return m_words.size();
+  }
+  bool isFinished() const
+  {
+    return m_position >= m_words.size();
+  }
+};
+
+// source used by i2s_read(), the I2S event queue blocks forever (throws HostStop) once it is finished
+void hostSetI2SSource(HostI2SSource* source);
+// called before every i2s_read(), e.g. to drain the sampler the way the writer task would
+void hostSetI2SReadHook(void (*hook)());
+
+// contents of the spiffs data partition, size 0 (the default) means the partition table has none
+void hostSetPartition(const uint8_t* data, uint32_t size);
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef __host_neopixelanimator_h__
+#define __host_neopixelanimator_h__
+
+#include <functional>
+
+#include <NeoPixelBus.h>
+
+// NeoPixelAnimator with the same millisecond timing and callback order as the library
+
+enum AnimationState
+{
+  AnimationState_Started,
+  AnimationState_Progress,
+  AnimationState_Completed
+};
+
+struct AnimationParam
+{
+  float          progress;
+  uint16_t       index;
+  AnimationState state;
+};
+
+typedef std::function<void(const AnimationParam& param)> AnimUpdateCallback;
+
+class NeoPixelAnimator
+{
+private:
+  struct AnimationContext
+  {
+    uint16_t           duration  = 0;
+    uint16_t           remaining = 0;
+    AnimUpdateCallback callback;
+  };
+
+  uint16_t          m_count;
+  AnimationContext* m_animations;
+  uint16_t          m_active    = 0;
+  uint32_t          m_last_tick = 0;
+
+public:
+  NeoPixelAnimator(uint16_t countAnimations) : m_count(countAnimations), m_animations(new AnimationContext[countAnimations])
+  {
+  }
+  ~NeoPixelAnimator()
+  {
+    delete[] m_animations;
+  }
+
+  bool IsAnimating() const
+  {
+    return m_active > 0;
+  }
+  bool IsAnimationActive(uint16_t index) const
+  {
+    return m_animations[index].remaining != 0;
+  }
+
+  bool NextAvailableAnimation(uint16_t* indexAvailable, uint16_t indexStart = 0)
+  {
+    for (uint16_t index = indexStart; index < m_count; index++) {
+      if (!IsAnimationActive(index)) {
+        *indexAvailable = index;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void StartAnimation(uint16_t index, uint16_t duration, AnimUpdateCallback animUpdate)
+  {
+    if (index >= m_count)
+      return;
+    if (m_active == 0)
+      m_last_tick = millis();
+    StopAnimation(index);
+    m_animations[index].duration  = duration > 0 ? duration : 1;
+    m_animations[index].remaining = m_animations[index].duration;
+    m_animations[index].callback  = animUpdate;
+    m_active++;
+  }
+
+  void StopAnimation(uint16_t index)
+  {
+    if (IsAnimationActive(index)) {
+      m_active--;
+      m_animations[index].remaining = 0;
+    }
+  }
+
+  void RestartAnimation(uint16_t index)
+  {
+    if (m_animations[index].duration == 0)
+      return;
+    if (m_animations[index].remaining == 0)
+      m_active++;
+    m_animations[index].remaining = m_animations[index].duration;
+  }
+
+  void UpdateAnimations()
+  {
+    uint32_t now   = millis();
+    uint32_t delta = now - m_last_tick;
+    if (m_active == 0 || delta == 0)
+      return;
+    for (uint16_t index = 0; index < m_count; index++) {
+      AnimationContext& animation = m_animations[index];
+      AnimationParam    param;
+      param.index = index;
+      if (animation.remaining > delta) {
+        param.state    = animation.remaining == animation.duration ? AnimationState_Started : AnimationState_Progress;
+        param.progress = (float)(animation.duration - animation.remaining) / animation.duration;
+        animation.callback(param);
+        animation.remaining -= delta;
+      }
+      else if (animation.remaining > 0) {
+        param.state    = AnimationState_Completed;
+        param.progress = 1.0f;
+        m_active--;
+        animation.remaining = 0;
+        animation.callback(param);
+      }
+    }
+    m_last_tick = now;
+  }
+};
+
+#endif
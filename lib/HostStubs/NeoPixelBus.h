@@ -0,0 +1,132 @@
+#ifndef __host_neopixelbus_h__
+#define __host_neopixelbus_h__
+
+#include <Arduino.h>
+
+#include "HostRuntime.h"
+
+// NeoPixelBus subset used by the firmware. The strip keeps its pixels in memory, counts the frames it
+// was asked to push and adds them to the host's hash of everything shown.
+
+struct HtmlColor
+{
+  HtmlColor(uint32_t color) : Color(color)
+  {
+  }
+  uint32_t Color;
+};
+
+struct RgbColor
+{
+  RgbColor() : R(0), G(0), B(0)
+  {
+  }
+  RgbColor(uint8_t brightness) : R(brightness), G(brightness), B(brightness)
+  {
+  }
+  RgbColor(uint8_t r, uint8_t g, uint8_t b) : R(r), G(g), B(b)
+  {
+  }
+  RgbColor(const HtmlColor& color) : R(color.Color >> 16), G(color.Color >> 8), B(color.Color)
+  {
+  }
+
+  bool operator==(const RgbColor& other) const
+  {
+    return R == other.R && G == other.G && B == other.B;
+  }
+  bool operator!=(const RgbColor& other) const
+  {
+    return !(*this == other);
+  }
+
+  void Darken(uint8_t delta)
+  {
+    R = R > delta ? R - delta : 0;
+    G = G > delta ? G - delta : 0;
+    B = B > delta ? B - delta : 0;
+  }
+
+  static RgbColor LinearBlend(const RgbColor& left, const RgbColor& right, float progress)
+  {
+    return RgbColor(left.R + (right.R - left.R) * progress, left.G + (right.G - left.G) * progress, left.B + (right.B - left.B) * progress);
+  }
+
+  uint8_t R;
+  uint8_t G;
+  uint8_t B;
+};
+
+struct NeoGrbFeature
+{
+};
+struct NeoWs2812xMethod
+{
+};
+struct NeoEsp32I2s0X8Ws2812xMethod
+{
+};
+
+template <typename T_COLOR_FEATURE, typename T_METHOD>
+class NeoPixelBus
+{
+private:
+  uint16_t  m_count;
+  RgbColor* m_pixels;
+  uint32_t  m_show_count = 0;
+
+public:
+  NeoPixelBus(uint16_t countPixels, uint8_t pin) : m_count(countPixels), m_pixels(new RgbColor[countPixels])
+  {
+  }
+  ~NeoPixelBus()
+  {
+    delete[] m_pixels;
+  }
+
+  void Begin()
+  {
+  }
+  void Show(bool maintainBufferConsistency = true)
+  {
+    m_show_count++;
+    hostRecordShow(m_pixels, m_count * sizeof(RgbColor));
+  }
+  bool CanShow() const
+  {
+    return true;
+  }
+  uint16_t PixelCount() const
+  {
+    return m_count;
+  }
+
+  void SetPixelColor(uint16_t indexPixel, const RgbColor& color)
+  {
+    if (indexPixel < m_count)
+      m_pixels[indexPixel] = color;
+  }
+  template <typename T_COLOROBJECT>
+  T_COLOROBJECT GetPixelColor(uint16_t indexPixel) const
+  {
+    return indexPixel < m_count ? m_pixels[indexPixel] : RgbColor(0);
+  }
+  void ClearTo(const RgbColor& color, uint16_t first, uint16_t last)
+  {
+    for (uint16_t pixel = first; pixel <= last && pixel < m_count; pixel++) {
+      m_pixels[pixel] = color;
+    }
+  }
+  void RotateRight(uint16_t rotationCount)
+  {
+    std::rotate(m_pixels, m_pixels + m_count - rotationCount % m_count, m_pixels + m_count);
+  }
+
+  // frames pushed since Begin(), host only
+  uint32_t ShowCount() const
+  {
+    return m_show_count;
+  }
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef __host_i2s_h__
+#define __host_i2s_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// legacy ESP-IDF I2S driver subset, i2s_read() is served by the host I2S source (see HostRuntime.h)
+
+typedef int i2s_port_t;
+#define I2S_NUM_0 0
+#define I2S_NUM_1 1
+
+typedef int i2s_mode_t;
+#define I2S_MODE_MASTER 1
+#define I2S_MODE_SLAVE 2
+#define I2S_MODE_TX 4
+#define I2S_MODE_RX 8
+
+typedef int i2s_bits_per_sample_t;
+#define I2S_BITS_PER_SAMPLE_16BIT 16
+#define I2S_BITS_PER_SAMPLE_32BIT 32
+
+typedef int i2s_channel_fmt_t;
+#define I2S_CHANNEL_FMT_RIGHT_LEFT 0
+#define I2S_CHANNEL_FMT_ONLY_RIGHT 3
+#define I2S_CHANNEL_FMT_ONLY_LEFT 4
+
+typedef int i2s_comm_format_t;
+#define I2S_COMM_FORMAT_STAND_I2S 1
+
+#define ESP_INTR_FLAG_LEVEL1 2
+#define I2S_PIN_NO_CHANGE -1
+
+#define GPIO_NUM_4 4
+#define GPIO_NUM_13 13
+#define GPIO_NUM_25 25
+#define GPIO_NUM_32 32
+#define GPIO_NUM_33 33
+
+typedef struct
+{
+  i2s_mode_t            mode;
+  int                   sample_rate;
+  i2s_bits_per_sample_t bits_per_sample;
+  i2s_channel_fmt_t     channel_format;
+  i2s_comm_format_t     communication_format;
+  int                   intr_alloc_flags;
+  int                   dma_buf_count;
+  int                   dma_buf_len;
+  bool                  use_apll;
+  bool                  tx_desc_auto_clear;
+  int                   fixed_mclk;
+} i2s_config_t;
+
+typedef struct
+{
+  int bck_io_num;
+  int ws_io_num;
+  int data_out_num;
+  int data_in_num;
+} i2s_pin_config_t;
+
+typedef enum
+{
+  I2S_EVENT_DMA_ERROR,
+  I2S_EVENT_TX_DONE,
+  I2S_EVENT_RX_DONE
+} i2s_event_type_t;
+
+typedef struct
+{
+  i2s_event_type_t type;
+  size_t           size;
+} i2s_event_t;
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t* config, int queue_size, QueueHandle_t* queue);
+esp_err_t i2s_set_pin(i2s_port_t port, const i2s_pin_config_t* pins);
+esp_err_t i2s_read(i2s_port_t port, void* dest, size_t size, size_t* bytes_read, TickType_t ticks_to_wait);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef __host_esp_err_h__
+#define __host_esp_err_h__
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NOT_FOUND 0x105
+
+#endif
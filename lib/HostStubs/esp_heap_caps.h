@@ -0,0 +1,25 @@
+#ifndef __host_esp_heap_caps_h__
+#define __host_esp_heap_caps_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ESP-IDF heap capabilities API subset for the heap guard. The host heap is not walked, the reported
+// heap is empty so the guard goes by its operator new count alone.
+
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+typedef struct
+{
+  size_t total_free_bytes;
+  size_t total_allocated_bytes;
+  size_t largest_free_block;
+  size_t minimum_free_bytes;
+  size_t allocated_blocks;
+  size_t free_blocks;
+  size_t total_blocks;
+} multi_heap_info_t;
+
+void heap_caps_get_info(multi_heap_info_t* info, uint32_t caps);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __host_esp_partition_h__
+#define __host_esp_partition_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// ESP-IDF partition API subset. There is a single data partition of subtype spiffs, its contents are
+// set with hostSetPartition() (see HostRuntime.h) and mapping it returns that memory directly.
+
+typedef enum
+{
+  ESP_PARTITION_TYPE_APP  = 0x00,
+  ESP_PARTITION_TYPE_DATA = 0x01
+} esp_partition_type_t;
+
+typedef enum
+{
+  ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+  ESP_PARTITION_SUBTYPE_ANY         = 0xff
+} esp_partition_subtype_t;
+
+typedef enum
+{
+  SPI_FLASH_MMAP_DATA,
+  SPI_FLASH_MMAP_INST
+} spi_flash_mmap_memory_t;
+
+typedef uint32_t spi_flash_mmap_handle_t;
+
+typedef struct
+{
+  esp_partition_type_t    type;
+  esp_partition_subtype_t subtype;
+  uint32_t                address;
+  uint32_t                size;
+  char                    label[17];
+  bool                    encrypted;
+} esp_partition_t;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label);
+esp_err_t              esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size, spi_flash_mmap_memory_t memory,
+                                          const void** out_ptr, spi_flash_mmap_handle_t* out_handle);
+void                   spi_flash_munmap(spi_flash_mmap_handle_t handle);
+
+#endif
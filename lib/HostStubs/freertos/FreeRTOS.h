@@ -0,0 +1,68 @@
+#ifndef __host_freertos_h__
+#define __host_freertos_h__
+
+#include <stdint.h>
+
+// FreeRTOS API subset used by the firmware. Tasks are only recorded, the host runner calls the task
+// functions itself, and time is virtual: it only advances when a task sleeps (see HostRuntime.h).
+
+typedef void*    TaskHandle_t;
+typedef void*    QueueHandle_t;
+typedef uint32_t TickType_t;
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void (*TaskFunction_t)(void*);
+// stack depths are in bytes like on the ESP32
+typedef uint8_t StackType_t;
+typedef struct
+{
+  void* reserved;
+} StaticTask_t;
+// a static queue holds its own state on the host
+typedef struct
+{
+  uint8_t* storage;
+  uint32_t length;
+  uint32_t item_size;
+  uint32_t head;
+  uint32_t count;
+} StaticQueue_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) / portTICK_PERIOD_MS)
+#define tskNO_AFFINITY 0x7fffffff
+// interrupts run to completion on the host, there is never a task to switch to
+#define portYIELD_FROM_ISR() \
+  do {                       \
+  } while (0)
+
+enum eNotifyAction
+{
+  eNoAction,
+  eSetBits,
+  eIncrement
+};
+
+BaseType_t   xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority, TaskHandle_t* handle);
+BaseType_t   xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority,
+                                     TaskHandle_t* handle, BaseType_t core);
+TaskHandle_t xTaskCreateStatic(TaskFunction_t task, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority, StackType_t* stack,
+                               StaticTask_t* tcb);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t task, const char* name, uint32_t stack_depth, void* param, UBaseType_t priority,
+                                           StackType_t* stack, StaticTask_t* tcb, BaseType_t core);
+BaseType_t   xTaskNotify(TaskHandle_t handle, uint32_t value, eNotifyAction action);
+BaseType_t   xTaskNotifyGive(TaskHandle_t handle);
+uint32_t     ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+void         vTaskDelay(TickType_t ticks);
+void         vTaskDelayUntil(TickType_t* previous_wake, TickType_t period);
+TickType_t   xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+UBaseType_t  uxTaskGetStackHighWaterMark(TaskHandle_t handle);
+BaseType_t   xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks_to_wait);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __host_freertos_queue_h__
+#define __host_freertos_queue_h__
+
+#include "FreeRTOS.h"
+
+// static queues, copied in and out like on the device; xQueueReceive is declared in FreeRTOS.h
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t* storage, StaticQueue_t* queue);
+BaseType_t    xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait);
+BaseType_t    xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higher_priority_task_woken);
+UBaseType_t   uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef __host_freertos_timers_h__
+#define __host_freertos_timers_h__
+
+#include "FreeRTOS.h"
+
+// Software timers. The callbacks run on the host when virtual time passes their expiry, in order, as
+// if the timer task had been waiting for them.
+
+typedef struct HostTimer* TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+typedef struct
+{
+  TimerCallbackFunction_t callback;
+  void*                   id;
+  TickType_t              period;
+  TickType_t              expiry;
+  bool                    auto_reload;
+  bool                    active;
+} StaticTimer_t;
+
+TimerHandle_t xTimerCreateStatic(const char* name, TickType_t period, UBaseType_t auto_reload, void* id, TimerCallbackFunction_t callback,
+                                 StaticTimer_t* timer);
+BaseType_t    xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait);
+BaseType_t    xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait);
+BaseType_t    xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks_to_wait);
+BaseType_t    xTimerChangePeriodFromISR(TimerHandle_t timer, TickType_t period, BaseType_t* higher_priority_task_woken);
+void*         pvTimerGetTimerID(TimerHandle_t timer);
+
+#endif
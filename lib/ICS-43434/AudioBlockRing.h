@@ -0,0 +1,111 @@
+#ifndef __audio_block_ring_h__
+#define __audio_block_ring_h__
+
+#include <atomic>
+#include <stdint.h>
+
+// Lock-free single producer / single consumer ring of fixed size sample blocks.
+//
+// The producer always owns the slot returned by writeSlot() and publishes it with commitWrite().
+// The consumer owns the slot returned by tryAcquire() until it calls release(). Both sides only
+// ever store their own counter, so no locks are needed. When the consumer falls behind the newest
+// block is dropped (and counted) instead of overwriting a block the consumer may be reading. The
+// blocks live in storage the caller provides, normally a static array, so the ring never allocates.
+class AudioBlockRing
+{
+private:
+  int16_t* m_storage               = nullptr;
+  uint32_t m_block_count           = 0;
+  int32_t  m_block_size_in_samples = 0;
+  // free running counters, the slot index is counter & (block count - 1)
+  std::atomic<uint32_t> m_head{0}; // blocks published by the producer
+  std::atomic<uint32_t> m_tail{0}; // blocks released by the consumer
+  std::atomic<uint32_t> m_overruns{0};
+
+  int16_t* slot(uint32_t counter) const
+  {
+    return m_storage + (counter & (m_block_count - 1)) * m_block_size_in_samples;
+  }
+
+public:
+  // use block_count blocks of storage (a power of two so the counters can wrap), one of them is always
+  // owned by the producer, storage has to hold block_count * block_size_in_samples samples
+  bool begin(int16_t* storage, uint32_t block_count, int32_t block_size_in_samples)
+  {
+    if (storage == nullptr || block_count < 2 || (block_count & (block_count - 1)) != 0 || block_size_in_samples <= 0)
+      return false;
+    m_storage               = storage;
+    m_block_count           = block_count;
+    m_block_size_in_samples = block_size_in_samples;
+    m_head.store(0);
+    m_tail.store(0);
+    m_overruns.store(0);
+    return true;
+  }
+
+  int32_t getBlockSizeInSamples() const
+  {
+    return m_block_size_in_samples;
+  }
+
+  // number of blocks dropped because the consumer was not keeping up
+  uint32_t getOverrunCount() const
+  {
+    return m_overruns.load(std::memory_order_relaxed);
+  }
+
+  // number of published blocks waiting for the consumer
+  uint32_t available() const
+  {
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+  }
+
+  // producer: the block currently being filled
+  int16_t* writeSlot() const
+  {
+    return slot(m_head.load(std::memory_order_relaxed));
+  }
+
+  // producer: position of writeSlot() in the ring, for data kept next to the blocks
+  uint32_t writeIndex() const
+  {
+    return m_head.load(std::memory_order_relaxed) & (m_block_count - 1);
+  }
+
+  // consumer: position of the block tryAcquire() returns
+  uint32_t readIndex() const
+  {
+    return m_tail.load(std::memory_order_relaxed) & (m_block_count - 1);
+  }
+
+  // producer: publish the filled block, returns false (and counts an overrun) if the ring was full
+  bool commitWrite()
+  {
+    uint32_t head = m_head.load(std::memory_order_relaxed);
+    uint32_t tail = m_tail.load(std::memory_order_acquire);
+    // keep one slot back so the producer never writes into a block the consumer holds
+    if (head + 1 - tail >= m_block_count) {
+      m_overruns.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer: oldest published block or nullptr if there is nothing new
+  const int16_t* tryAcquire() const
+  {
+    uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail == m_head.load(std::memory_order_acquire))
+      return nullptr;
+    return slot(tail);
+  }
+
+  // consumer: hand the acquired block back to the producer
+  void release()
+  {
+    m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+};
+
+#endif
@@ -0,0 +1,39 @@
+#include "AudioBlockSource.h"
+
+bool AudioBlockSource::beginBlocks(int16_t* block_storage, int32_t buffer_size_in_bytes, uint32_t block_count, TaskHandle_t writer_task_handle)
+{
+  m_writer_task_handle     = writer_task_handle;
+  m_buffer_size_in_samples = buffer_size_in_bytes / sizeof(int16_t);
+  m_buffer_size_in_bytes   = buffer_size_in_bytes;
+  m_sequence               = 0;
+  if (block_count > MaxBlocks || !m_ring.begin(block_storage, block_count, m_buffer_size_in_samples))
+    return false;
+  m_current_audio_buffer = m_ring.writeSlot();
+  m_audio_buffer_pos     = 0;
+  return true;
+}
+
+void AudioBlockSource::publishBlock(uint32_t time_ms)
+{
+  m_stamps[m_ring.writeIndex()] = {m_sequence++, time_ms};
+  // publish the block, if the writer task is behind it is dropped and counted as an overrun
+  if (m_ring.commitWrite() && m_writer_task_handle != NULL) {
+    // tell the writer task there is a block waiting
+    xTaskNotifyGive(m_writer_task_handle);
+  }
+  // move on to the next free block
+  m_current_audio_buffer = m_ring.writeSlot();
+  m_audio_buffer_pos     = 0;
+}
+
+const int16_t* AudioBlockSource::acquireBlock(TickType_t ticks_to_wait)
+{
+  const int16_t* block = m_ring.tryAcquire();
+  while (block == NULL) {
+    // the producer gives a notification for every published block
+    if (ulTaskNotifyTake(pdTRUE, ticks_to_wait) == 0)
+      return m_ring.tryAcquire();
+    block = m_ring.tryAcquire();
+  }
+  return block;
+}
@@ -0,0 +1,87 @@
+#ifndef __audio_block_source_h__
+#define __audio_block_source_h__
+
+#include <Arduino.h>
+
+#include "AudioBlockRing.h"
+
+// Blocks of 16 bit samples handed from a producer to the writer task.
+//
+// I2SSampler fills the blocks from the microphone and AudioReplay from recorded audio, the writer
+// task reads either of them through this class. Every block carries the number of blocks produced
+// before it, dropped ones included, and the millis() at which its last sample was taken, so a
+// consumer sees gaps and places the block in time however late it gets to it.
+class AudioBlockSource
+{
+public:
+  // blocks per ring the stamps have room for
+  static const uint32_t MaxBlocks = 16;
+
+private:
+  struct Stamp
+  {
+    uint32_t sequence;
+    uint32_t time_ms;
+  };
+
+  AudioBlockRing m_ring;
+  Stamp          m_stamps[MaxBlocks];
+  // blocks completed so far, published or dropped
+  uint32_t m_sequence = 0;
+  // task notified for every published block, may be NULL when the consumer polls
+  TaskHandle_t m_writer_task_handle = NULL;
+
+protected:
+  // block currently being filled by the producer
+  int16_t* m_current_audio_buffer = NULL;
+  // current position in the audio buffer
+  int32_t m_audio_buffer_pos = 0;
+  // size of the audio blocks in bytes
+  int32_t m_buffer_size_in_bytes = 0;
+  // size of the audio blocks in samples
+  int32_t m_buffer_size_in_samples = 0;
+
+  // block_storage holds block_count blocks of buffer_size_in_bytes, it is used in place for as long as the source runs
+  bool beginBlocks(int16_t* block_storage, int32_t buffer_size_in_bytes, uint32_t block_count, TaskHandle_t writer_task_handle);
+  // the current block is full and its last sample was taken at time_ms
+  void publishBlock(uint32_t time_ms);
+
+public:
+  int32_t getBufferSizeInBytes() const
+  {
+    return m_buffer_size_in_bytes;
+  }
+  int32_t getBufferSizeInSamples() const
+  {
+    return m_buffer_size_in_samples;
+  }
+  // blocks dropped because the writer task did not keep up
+  uint32_t getOverrunCount() const
+  {
+    return m_ring.getOverrunCount();
+  }
+  // next captured block, waits up to ticks_to_wait for one to arrive, NULL on timeout
+  const int16_t* acquireBlock(TickType_t ticks_to_wait);
+  // next captured block or NULL if none is ready
+  const int16_t* tryAcquireBlock()
+  {
+    return m_ring.tryAcquire();
+  }
+  // position of the acquired block among all the blocks produced
+  uint32_t getBlockSequence() const
+  {
+    return m_stamps[m_ring.readIndex()].sequence;
+  }
+  // millis() of the last sample of the acquired block
+  uint32_t getBlockTimeMs() const
+  {
+    return m_stamps[m_ring.readIndex()].time_ms;
+  }
+  // give the acquired block back to the producer
+  void releaseBlock()
+  {
+    m_ring.release();
+  }
+};
+
+#endif
@@ -0,0 +1,27 @@
+#include <string.h>
+
+#include "AudioReplay.h"
+
+bool AudioReplay::begin(const int16_t* samples, uint32_t sample_count, uint32_t sample_rate, uint32_t start_ms, int16_t* block_storage,
+                        int32_t buffer_size_in_bytes, uint32_t block_count, TaskHandle_t writer_task_handle)
+{
+  m_samples      = samples;
+  m_sample_count = sample_count;
+  m_sample_rate  = sample_rate;
+  m_start_ms     = start_ms;
+  m_position     = 0;
+  return samples != NULL && sample_rate > 0 && beginBlocks(block_storage, buffer_size_in_bytes, block_count, writer_task_handle);
+}
+
+uint32_t AudioReplay::advanceTo(uint32_t now_ms)
+{
+  uint32_t published = 0;
+  while (!isFinished() && (int32_t)(now_ms - getBlockEndMs()) >= 0) {
+    uint32_t end_ms = getBlockEndMs();
+    memcpy(m_current_audio_buffer, m_samples + m_position, m_buffer_size_in_bytes);
+    m_position += m_buffer_size_in_samples;
+    publishBlock(end_ms);
+    published++;
+  }
+  return published;
+}
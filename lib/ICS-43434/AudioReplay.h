@@ -0,0 +1,42 @@
+#ifndef __audio_replay_h__
+#define __audio_replay_h__
+
+#include "AudioBlockSource.h"
+
+// Recorded audio handed to the writer task through the same blocks as I2SSampler.
+//
+// The samples are what the writer task gets from the sampler, 16 bit blocks as a capture recorded
+// them or a 16 bit WAV. advanceTo() publishes every block that has ended by now_ms, stamped with the
+// time it ends at, so driven from the led task's clock the blocks arrive when the microphone would
+// have delivered them and every replay of a recording feeds the programs the same blocks at the same
+// times. Each block is copied from the recording into the ring as it is published, so the writer
+// task releases it like a sampler block and the recording itself is never written.
+class AudioReplay : public AudioBlockSource
+{
+private:
+  const int16_t* m_samples      = NULL;
+  uint32_t       m_sample_count = 0;
+  uint32_t       m_sample_rate  = 0;
+  uint32_t       m_start_ms     = 0;
+  // first sample of the next block
+  uint32_t m_position = 0;
+
+  uint32_t getBlockEndMs() const
+  {
+    return m_start_ms + (uint32_t)((uint64_t)(m_position + m_buffer_size_in_samples) * 1000 / m_sample_rate);
+  }
+
+public:
+  // play sample_count samples from start_ms, block_storage holds block_count blocks of buffer_size_in_bytes
+  bool begin(const int16_t* samples, uint32_t sample_count, uint32_t sample_rate, uint32_t start_ms, int16_t* block_storage,
+             int32_t buffer_size_in_bytes, uint32_t block_count, TaskHandle_t writer_task_handle);
+  // publish the blocks that ended by now_ms, returns how many
+  uint32_t advanceTo(uint32_t now_ms);
+  // the rest of the recording is shorter than a block
+  bool isFinished() const
+  {
+    return m_position + m_buffer_size_in_samples > m_sample_count;
+  }
+};
+
+#endif
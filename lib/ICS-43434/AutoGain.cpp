@@ -0,0 +1,128 @@
+#include <math.h>
+
+#include "AutoGain.h"
+#include "SampleConvert.h"
+
+// gain equivalent to the old fixed >> 11
+static const float UnityGain = 2097152.0f; // 2^21
+// gain applied while the gate is closed, relative to the AGC gain
+static const int GateShift = 4; // -24dB
+
+AutoGain::AutoGain()
+{
+  setRange(15, 5);
+  m_gain         = (int32_t)UnityGain;
+  m_applied_gain = m_gain;
+  m_chunk_gain   = m_gain;
+}
+
+void AutoGain::setTarget(float target_level, float headroom_db)
+{
+  m_target_level = target_level;
+  m_limit_level  = 32767.0f * powf(10.0f, -headroom_db / 20.0f);
+  m_limit        = (int32_t)m_limit_level;
+}
+
+void AutoGain::setRange(uint8_t min_shift, uint8_t max_shift)
+{
+  // a shift of s is a gain of 2^(32 - s), keep it below 2^31 so it fits the signed multiply
+  max_shift  = max_shift < 2 ? 2 : max_shift;
+  m_min_gain = (int32_t)(1UL << (32 - min_shift));
+  m_max_gain = (int32_t)(1UL << (32 - max_shift));
+}
+
+int32_t AutoGain::chunkGain(const int32_t* src, size_t count)
+{
+  // the gain that puts the peak of the chunk right at the limit, if that is below the AGC gain the
+  // chunk gets it instead of clipping
+  int32_t gain = m_applied_gain;
+  int32_t peak = peakOfWords(src, count);
+  if (peak > 0) {
+    int64_t limit_gain = ((int64_t)m_limit << 32) / peak;
+    if (limit_gain < gain) {
+      gain = (int32_t)limit_gain;
+      m_limited_chunks++;
+    }
+  }
+  m_chunk_gain = gain;
+  return gain;
+}
+
+void AutoGain::addLevel(uint32_t abs_sum, int32_t peak, size_t count, int32_t gain)
+{
+  float to_input = UnityGain / gain;
+  m_level_sum += abs_sum * to_input;
+  m_level_peak = peak * to_input > m_level_peak ? peak * to_input : m_level_peak;
+  m_sample_count += count;
+}
+
+void AutoGain::convert(const int32_t* src, int16_t* dst, size_t count)
+{
+  int32_t  gain     = chunkGain(src, count);
+  uint32_t abs_sum  = 0;
+  int32_t  out_peak = 0;
+  convertSamplesWithGain(src, dst, count, gain, abs_sum, out_peak);
+  addLevel(abs_sum, out_peak, count, gain);
+}
+
+void AutoGain::scale(const int32_t* src, int16_t* dst, size_t count)
+{
+  uint32_t abs_sum  = 0;
+  int32_t  out_peak = 0;
+  convertSamplesWithGain(src, dst, count, chunkGain(src, count), abs_sum, out_peak);
+}
+
+void AutoGain::measure(const int16_t* samples, size_t count)
+{
+  // the decimator delays the samples by less than a chunk, the gain of the last one is close enough
+  uint32_t abs_sum = 0;
+  int32_t  peak    = 0;
+  levelOfSamples(samples, count, abs_sum, peak);
+  addLevel(abs_sum, peak, count, m_chunk_gain);
+}
+
+void AutoGain::endBlock()
+{
+  if (m_sample_count == 0)
+    return;
+
+  // level of the block referred back to the input, in units of the unity gain output
+  float in_level = m_level_sum / m_sample_count;
+  float in_peak  = m_level_peak;
+  m_level_sum    = 0.0f;
+  m_level_peak   = 0.0f;
+  m_sample_count = 0;
+
+  // the noise floor follows quiet blocks down quickly and creeps up slowly, only with blocks that look like noise
+  // the first block starts it, half of it would leave the gate flapping open on the noise itself
+  if (m_noise_floor == 0.0f)
+    m_noise_floor = in_level;
+  else if (in_level < m_noise_floor)
+    m_noise_floor += (in_level - m_noise_floor) * 0.5f;
+  else if (in_level < m_noise_floor * m_gate_ratio * 2.0f)
+    m_noise_floor += (in_level - m_noise_floor) * 0.001f;
+  m_gate_open = in_level > m_noise_floor * m_gate_ratio;
+
+  float gain = (float)m_gain;
+  if (m_gate_open && in_level > 0.0f) {
+    // gain that would bring the block to the target level, limited by the peak headroom
+    float desired = m_target_level * UnityGain / in_level;
+    if (in_peak > 0.0f && desired > m_limit_level * UnityGain / in_peak)
+      desired = m_limit_level * UnityGain / in_peak;
+    gain += (desired - gain) * (desired < gain ? m_attack : m_release);
+  }
+  // a closed gate holds the gain so the noise is not amplified
+  gain           = gain < m_min_gain ? m_min_gain : (gain > m_max_gain ? m_max_gain : gain);
+  m_gain         = (int32_t)gain;
+  m_applied_gain = m_gate_open ? m_gain : m_gain >> GateShift;
+}
+
+float AutoGain::getGainDb() const
+{
+  return 20.0f * log10f((float)m_gain / UnityGain);
+}
+
+float AutoGain::getNoiseFloorDb() const
+{
+  return m_noise_floor > 0.0f ? 20.0f * log10f(m_noise_floor / 32768.0f) : -96.0f;
+}
@@ -0,0 +1,82 @@
+#ifndef __auto_gain_h__
+#define __auto_gain_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Block based automatic gain control with a noise gate and limiter headroom.
+//
+// convert() scales the raw I2S words while gathering the level of the block, so the AGC costs no
+// extra pass over the data. endBlock() runs once per block: it tracks the noise floor of the input,
+// moves the gain towards the target level (quickly down, slowly up), keeps the peaks below the
+// limiter threshold and closes the gate when the input is close to the noise floor. Within a block
+// convert() looks at the peak of every chunk before it converts it and turns the gain of that chunk
+// down as far as needed to stay below the threshold, so a loud onset does not clip while the AGC
+// catches up with it.
+//
+// With a decimator after it, scale() converts without measuring and measure() takes the level of what
+// comes out of the decimator, so the AGC aims at the level of the band the analysis gets instead of
+// one raised by whatever the decimator filters away.
+class AutoGain
+{
+private:
+  // gain applied to the raw 32 bit words, output = input * gain / 2^32
+  int32_t m_gain;
+  int32_t m_min_gain;
+  int32_t m_max_gain;
+  // gain actually used, m_gain or attenuated while the gate is closed
+  int32_t m_applied_gain;
+  // average absolute output sample value the AGC aims for
+  float m_target_level = 1500.0f;
+  // peaks above this output value pull the gain down immediately, no output sample goes beyond it
+  float   m_limit_level = 16384.0f;
+  int32_t m_limit       = 16384;
+  // fraction of the distance to the desired gain covered per block
+  float m_attack  = 0.5f;
+  float m_release = 0.02f;
+  // input referred noise floor estimate and gate threshold above it
+  float m_noise_floor = 0.0f;
+  float m_gate_ratio  = 2.0f;
+  bool  m_gate_open   = true;
+  // level of the block being converted, referred back to the input in units of the unity gain output
+  float  m_level_sum    = 0.0f;
+  float  m_level_peak   = 0.0f;
+  size_t m_sample_count = 0;
+  // chunks converted with less than the AGC gain to stay below the limit
+  uint32_t m_limited_chunks = 0;
+  // gain of the last chunk scaled, measure() refers its samples back to the input with it
+  int32_t m_chunk_gain;
+
+  // the AGC gain, or less if the peak of the chunk would go beyond the limit with it
+  int32_t chunkGain(const int32_t* src, size_t count);
+  void    addLevel(uint32_t abs_sum, int32_t peak, size_t count, int32_t gain);
+
+public:
+  AutoGain();
+  // target is the average absolute output sample value, headroom the limiter threshold below full scale in dB
+  void setTarget(float target_level, float headroom_db);
+  // gain limits as the equivalent right shift of the raw words (11 is the old fixed >> 11)
+  void setRange(uint8_t min_shift, uint8_t max_shift);
+  // scale count raw words into dst, with less gain if they would go beyond the limit
+  void convert(const int32_t* src, int16_t* dst, size_t count);
+  // convert() without gathering the level, measure() the samples once they are decimated
+  void scale(const int32_t* src, int16_t* dst, size_t count);
+  // gather the level of count samples that went through scale() and a decimator
+  void measure(const int16_t* samples, size_t count);
+  // update the gain from the level of the samples converted since the last call
+  void endBlock();
+  // current gain in dB relative to the old fixed >> 11
+  float getGainDb() const;
+  // input referred noise floor in dB relative to the output full scale at the old >> 11
+  float getNoiseFloorDb() const;
+  uint32_t getLimitedChunks() const
+  {
+    return m_limited_chunks;
+  }
+  bool isGateOpen() const
+  {
+    return m_gate_open;
+  }
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include <string.h>
+
+#include "Decimator.h"
+#include "SampleConvert.h"
+
+// Kaiser windowed sincs, beta 6, rounded to Q15 with the sum of the taps kept at exactly 1
+const int16_t Decimator::s_short_taps[ShortPairs] = {9853, -2056, 417, -22};
+const int16_t Decimator::s_long_taps[LongPairs]   = {10351, -3246, 1721, -1015, 606, -349, 187, -89, 34, -8};
+
+bool Decimator::begin(uint8_t factor)
+{
+  uint8_t stage_count = 0;
+  while ((1 << stage_count) < factor)
+    stage_count++;
+  if ((1 << stage_count) != factor || stage_count > MaxStages)
+    return false;
+  for (uint8_t index = 0; index < stage_count; index++) {
+    // the delay line starts out silent, the first output comes with the first input
+    int pairs = index + 1 < stage_count ? ShortPairs : LongPairs;
+    memset(m_stages[index].even, 0, sizeof(m_stages[index].even));
+    memset(m_stages[index].odd, 0, sizeof(m_stages[index].odd));
+    m_stages[index].even_fill = 2 * pairs - 1;
+    m_stages[index].odd_fill  = 2 * pairs - 1;
+  }
+  m_stage_count = stage_count;
+  m_factor      = factor;
+  return true;
+}
+
+uint32_t Decimator::getDelay() const
+{
+  // half the taps of every stage, at its input rate
+  uint32_t delay = 0;
+  for (uint8_t index = 0; index < m_stage_count; index++) {
+    int pairs = index + 1 < m_stage_count ? ShortPairs : LongPairs;
+    delay += (2 * pairs - 1) << index;
+  }
+  return delay;
+}
+
+template <int T_PAIRS>
+size_t Decimator::decimate(Stage& stage, const int16_t (&taps)[T_PAIRS], const int16_t* input, size_t count, int16_t* output)
+{
+  // an output's centre is odd[T_PAIRS - 1] and its pairs of taps even[T_PAIRS - 1 - pair] and
+  // even[T_PAIRS + pair], counted from the start of its window
+  const int Reach    = 2 * T_PAIRS - 1;
+  size_t    produced = 0;
+  size_t    consumed = 0;
+  while (consumed < count) {
+    size_t         chunk   = count - consumed < ChunkSize ? count - consumed : ChunkSize;
+    const int16_t* samples = input + consumed;
+    consumed += chunk;
+    // the next input is even when both phases are as long
+    size_t index = 0;
+    if (stage.even_fill > stage.odd_fill)
+      stage.odd[stage.odd_fill++] = samples[index++];
+    for (; index + 1 < chunk; index += 2) {
+      stage.even[stage.even_fill++] = samples[index];
+      stage.odd[stage.odd_fill++]   = samples[index + 1];
+    }
+    if (index < chunk)
+      stage.even[stage.even_fill++] = samples[index];
+    // every output needs the even inputs to its last tap, the odd phase always has its centre by then;
+    // in place the outputs never overtake the inputs already dealt out
+    int outputs = stage.even_fill - Reach;
+    if (outputs <= 0)
+      continue;
+    for (int group = 0; group < outputs; group += GroupSize) {
+      // always a whole group, the sums past the last output read stale inputs and are not kept
+      const int16_t* even   = stage.even + group;
+      const int16_t* centre = stage.odd + group + T_PAIRS - 1;
+      int32_t        sums[GroupSize];
+      for (int n = 0; n < GroupSize; n++) {
+        sums[n] = ((int32_t)centre[n] << 14) + (1 << 14);
+      }
+      for (int pair = 0; pair < T_PAIRS; pair++) {
+        const int16_t* left  = even + T_PAIRS - 1 - pair;
+        const int16_t* right = even + T_PAIRS + pair;
+        int32_t        tap   = taps[pair];
+        for (int n = 0; n < GroupSize; n++) {
+          sums[n] += tap * (left[n] + right[n]);
+        }
+      }
+      int kept = outputs - group < GroupSize ? outputs - group : GroupSize;
+      for (int n = 0; n < kept; n++) {
+        output[produced++] = saturateToInt16(sums[n] >> 15);
+      }
+    }
+    // keep the inputs the next outputs start with
+    stage.even_fill -= outputs;
+    stage.odd_fill -= outputs;
+    memmove(stage.even, stage.even + outputs, stage.even_fill * sizeof(int16_t));
+    memmove(stage.odd, stage.odd + outputs, stage.odd_fill * sizeof(int16_t));
+  }
+  return produced;
+}
+
+size_t Decimator::process(int16_t* samples, size_t count, int16_t* output)
+{
+  if (m_stage_count == 0) {
+    memmove(output, samples, count * sizeof(int16_t));
+    return count;
+  }
+  for (uint8_t index = 0; index + 1 < m_stage_count; index++) {
+    count = decimate(m_stages[index], s_short_taps, samples, count, samples);
+  }
+  return decimate(m_stages[m_stage_count - 1], s_long_taps, samples, count, output);
+}
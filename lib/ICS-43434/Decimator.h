@@ -0,0 +1,70 @@
+#ifndef __decimator_h__
+#define __decimator_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming decimation by 2, 4 or 8 as a cascade of half-band FIR stages.
+//
+// Every stage low passes its input and keeps every other sample. All taps of a half-band filter at
+// an even distance from the centre are 0, so in polyphase form one phase is a plain delay and the
+// other a symmetric FIR, and only the kept outputs are computed. The last stage has 39 Q15 taps that
+// keep the passband flat to 0.01dB up to 40% of the output rate and attenuate everything that would
+// alias into it by 60dB. The stages before it only have to keep out what would alias into that
+// narrower band and get by with 15 taps, so /2 takes 5 multiplies per input sample, /4 4.5 and /8
+// 4.25. The inputs are dealt out to an even and an odd delay line and the outputs computed in groups
+// with loops of a fixed length, which the compiler unrolls or vectorises. The delay lines carry over
+// from one call to the next, the input may come in any chunks, and count inputs never give more than
+// (count + factor - 1) / factor outputs.
+class Decimator
+{
+public:
+  static const uint8_t MaxFactor = 8;
+
+private:
+  static const int MaxStages = 3;
+  // Q15 taps at the distances 1, 3, 5, .. from the centre, the centre tap is 0.5
+  static const int ShortPairs = 4;
+  static const int LongPairs  = 10;
+  static const int16_t s_short_taps[ShortPairs];
+  static const int16_t s_long_taps[LongPairs];
+  static const int ChunkSize = 256;
+  static const int GroupSize = 16;
+  // even inputs kept for the next output, the new ones of a chunk, and what a last group reads past them
+  static const int PhaseSize = 2 * LongPairs + ChunkSize / 2 + GroupSize;
+
+  struct Stage
+  {
+    // inputs 2j and 2j + 1 from the start of the next output's window
+    int16_t  even[PhaseSize];
+    int16_t  odd[PhaseSize];
+    uint16_t even_fill;
+    uint16_t odd_fill;
+  };
+
+  Stage   m_stages[MaxStages];
+  uint8_t m_stage_count = 0;
+  uint8_t m_factor      = 1;
+
+  template <int T_PAIRS>
+  static size_t decimate(Stage& stage, const int16_t (&taps)[T_PAIRS], const int16_t* input, size_t count, int16_t* output);
+
+public:
+  // factor 1, 2, 4 or 8, clears the delay lines
+  bool begin(uint8_t factor);
+  uint8_t getFactor() const
+  {
+    return m_factor;
+  }
+  // delay of the filters in input samples
+  uint32_t getDelay() const;
+  // filter count samples into output, returns the number of output samples; the stages before the
+  // last one filter in place in samples, output only gets the result and may be samples itself
+  size_t process(int16_t* samples, size_t count, int16_t* output);
+  size_t process(int16_t* samples, size_t count)
+  {
+    return process(samples, count, samples);
+  }
+};
+
+#endif
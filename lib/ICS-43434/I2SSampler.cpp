@@ -1,30 +1,70 @@
 #include "driver/i2s.h"
 #include <Arduino.h>
+#include <string.h>
 
 #include "I2SSampler.h"
+#include "SampleConvert.h"
+#include "Telemetry.h"
 
-void I2SSampler::addSample(int16_t sample)
+void I2SSampler::convert(const int32_t* samples, int16_t* destination, size_t count)
 {
-  // add the sample to the current audio buffer
-  m_current_audio_buffer[m_audio_buffer_pos] = sample;
-  m_audio_buffer_pos++;
-  // have we filled the buffer with data?
-  if (m_audio_buffer_pos == m_buffer_size_in_samples) {
-    // swap to the other buffer
-    std::swap(m_current_audio_buffer, m_captured_audio_buffer);
-    // reset the buffer position
-    m_audio_buffer_pos = 0;
-    // tell the writer task to save the data
-    xTaskNotify(m_writer_task_handle, 1, eIncrement);
+  if (m_agc_enabled) {
+    // the AGC measures the level while it converts
+    m_agc.convert(samples, destination, count);
   }
+  else {
+    // you may need to vary the shift to fit your volume, or enable the AGC
+    convertSamples(samples, destination, count, m_sample_shift);
+  }
+}
+
+void I2SSampler::completeBlock()
+{
+  if (m_agc_enabled)
+    m_agc.endBlock();
+  publishBlock(millis());
 }
 
-void I2SSampler::processI2SData(uint8_t* i2sData, size_t bytes_read)
+void I2SSampler::processI2SData(const int32_t* samples, size_t sample_count)
 {
-  int32_t* samples = (int32_t*)i2sData;
-  for (int i = 0; i < bytes_read / 4; i++) {
-    // you may need to vary the >> 11 to fit your volume - ideally we'd have some kind of AGC here
-    addSample(samples[i] >> 11);
+  if (m_decimator.getFactor() > 1) {
+    // the words are converted into a buffer of their own, the decimator filters them straight into the
+    // current block
+    const size_t ChunkSize = sizeof(m_decimated) / sizeof(m_decimated[0]);
+    while (sample_count > 0) {
+      // no more words than can come out as samples that still fit the block
+      size_t count = (m_buffer_size_in_samples - m_audio_buffer_pos) * m_decimator.getFactor();
+      count        = count < ChunkSize ? count : ChunkSize;
+      count        = count < sample_count ? count : sample_count;
+      // the AGC measures what comes out of the decimator, the band the analysis gets
+      if (m_agc_enabled)
+        m_agc.scale(samples, m_decimated, count);
+      else
+        convertSamples(samples, m_decimated, count, m_sample_shift);
+      int16_t* block     = m_current_audio_buffer + m_audio_buffer_pos;
+      size_t   decimated = m_decimator.process(m_decimated, count, block);
+      if (m_agc_enabled)
+        m_agc.measure(block, decimated);
+      m_audio_buffer_pos += decimated;
+      samples += count;
+      sample_count -= count;
+      if (m_audio_buffer_pos == m_buffer_size_in_samples)
+        completeBlock();
+    }
+    return;
+  }
+  while (sample_count > 0) {
+    // convert as much as fits straight into the current block
+    size_t count = m_buffer_size_in_samples - m_audio_buffer_pos;
+    if (count > sample_count)
+      count = sample_count;
+    convert(samples, m_current_audio_buffer + m_audio_buffer_pos, count);
+    m_audio_buffer_pos += count;
+    samples += count;
+    sample_count -= count;
+    // have we filled the block with data?
+    if (m_audio_buffer_pos == m_buffer_size_in_samples)
+      completeBlock();
   }
 }
 
@@ -38,36 +78,30 @@ void i2sReaderTask(void* param)
       if (evt.type == I2S_EVENT_RX_DONE) {
         size_t bytes_read = 0;
         do {
-          // read data from the I2S peripheral
-          uint8_t i2s_data[1024];
-          // read from i2s
-          i2s_read(sampler->getI2SPort(), i2s_data, 1024, &bytes_read, 10);
-          // process the raw data
-          sampler->processI2SData(i2s_data, bytes_read);
+          // read from i2s straight into the sampler's raw word buffer
+          i2s_read(sampler->getI2SPort(), sampler->m_raw_samples, sizeof(sampler->m_raw_samples), &bytes_read, 10);
+          TELEMETRY_SCOPE_STATIC("i2s.ingest");
+          // convert the whole chunk into the ring in one pass
+          sampler->processI2SData(sampler->m_raw_samples, bytes_read / sizeof(int32_t));
         } while (bytes_read > 0);
       }
     }
   }
 }
 
-void I2SSampler::start(i2s_port_t i2s_port, i2s_pin_config_t& i2s_pins, i2s_config_t& i2s_config, int32_t buffer_size_in_bytes,
-                       TaskHandle_t writer_task_handle)
+bool I2SSampler::start(i2s_port_t i2s_port, i2s_pin_config_t& i2s_pins, i2s_config_t& i2s_config, int16_t* block_storage, int32_t buffer_size_in_bytes,
+                       uint32_t block_count, TaskHandle_t writer_task_handle, BaseType_t reader_core)
 {
-  m_i2s_port               = i2s_port;
-  m_writer_task_handle     = writer_task_handle;
-  m_buffer_size_in_samples = buffer_size_in_bytes / sizeof(int16_t);
-  m_buffer_size_in_bytes   = buffer_size_in_bytes;
-  m_audio_buffer1          = (int16_t*)malloc(buffer_size_in_bytes);
-  m_audio_buffer2          = (int16_t*)malloc(buffer_size_in_bytes);
-
-  m_current_audio_buffer  = m_audio_buffer1;
-  m_captured_audio_buffer = m_audio_buffer2;
+  m_i2s_port = i2s_port;
+  if (!beginBlocks(block_storage, buffer_size_in_bytes, block_count, writer_task_handle))
+    return false;
 
   // install and start i2s driver
   i2s_driver_install(m_i2s_port, &i2s_config, 4, &m_i2s_queue);
   // set up the I2S pins
   i2s_set_pin(getI2SPort(), &i2s_pins);
   // start a task to read samples from the ADC
-  TaskHandle_t reader_task_handle;
-  xTaskCreatePinnedToCore(i2sReaderTask, "i2s Reader Task", 4096, this, 1, &reader_task_handle, 0);
+  m_reader_task_handle =
+    xTaskCreateStaticPinnedToCore(i2sReaderTask, "i2s Reader Task", ReaderStackSize, this, 1, m_reader_stack, &m_reader_tcb, reader_core);
+  return m_reader_task_handle != NULL;
 }
@@ -2,27 +2,31 @@
 #define __i2s_sampler_h__
 
 #include "driver/i2s.h"
+#include "AudioBlockSource.h"
+#include "AutoGain.h"
+#include "Decimator.h"
 
-class I2SSampler
+class I2SSampler : public AudioBlockSource
 {
+public:
+    // stack of the reader task in bytes
+    static const uint32_t ReaderStackSize = 4096;
+
 private:
-    // double buffer so we can be capturing samples while sending data
-    int16_t *m_audio_buffer1;
-    int16_t *m_audio_buffer2;
-    // current position in the audio buffer
-    int32_t m_audio_buffer_pos = 0;
-    // current audio buffer
-    int16_t *m_current_audio_buffer;
-    // buffer containing samples that have been captured already
-    int16_t *m_captured_audio_buffer;
-    // size of the audio buffers in bytes
-    int32_t m_buffer_size_in_bytes;
-    // size of the audio buffer in samples
-    int32_t m_buffer_size_in_samples;
-    // I2S reader task
-    TaskHandle_t m_reader_task_handle;
-    // writer task
-    TaskHandle_t m_writer_task_handle;
+    // raw 32 bit words read from the i2s driver, converted straight into the current block
+    int32_t m_raw_samples[256];
+    // the raw words converted before the decimator filters them into the current block
+    int16_t m_decimated[256];
+    Decimator m_decimator;
+    // right shift applied to the raw 24 bit samples before saturating to 16 bits
+    uint8_t m_sample_shift = 11;
+    // automatic gain control used instead of the fixed shift when enabled
+    AutoGain m_agc;
+    bool m_agc_enabled = false;
+    // I2S reader task, its stack and control block are part of the sampler
+    TaskHandle_t m_reader_task_handle = NULL;
+    StackType_t m_reader_stack[ReaderStackSize];
+    StaticTask_t m_reader_tcb;
     // i2s reader queue
     QueueHandle_t m_i2s_queue;
     // i2s port
@@ -30,22 +34,42 @@ private:
 
 protected:
     void configureI2S();
-    void processI2SData(uint8_t *i2sData, size_t bytes_read);
-    void addSample(int16_t sample);
+    void processI2SData(const int32_t *samples, size_t sample_count);
+    void convert(const int32_t *samples, int16_t *destination, size_t count);
+    void completeBlock();
     i2s_port_t getI2SPort()
     {
         return m_i2s_port;
     }
 public:
-    int32_t getBufferSizeInBytes()
+    void setSampleShift(uint8_t shift)
+    {
+        m_sample_shift = shift;
+    }
+    // the blocks get every factor'th sample of the low passed input, 1 (the default), 2, 4 or 8
+    bool setDecimation(uint8_t factor)
+    {
+        return m_decimator.begin(factor);
+    }
+    uint8_t getDecimation() const
     {
-        return m_buffer_size_in_bytes;
-    };
-    int16_t *getCapturedAudioBuffer()
+        return m_decimator.getFactor();
+    }
+    void enableAgc(bool enabled)
+    {
+        m_agc_enabled = enabled;
+    }
+    AutoGain &getAgc()
+    {
+        return m_agc;
+    }
+    TaskHandle_t getReaderTaskHandle()
     {
-        return m_captured_audio_buffer;
+        return m_reader_task_handle;
     }
-    void start(i2s_port_t i2sPort, i2s_pin_config_t &i2s_pins, i2s_config_t &i2s_config, int32_t buffer_size_in_samples, TaskHandle_t writer_task_handle);
+    // block_storage holds block_count blocks of buffer_size_in_bytes at the decimated rate, it is used in place for as long as the sampler runs
+    bool start(i2s_port_t i2sPort, i2s_pin_config_t &i2s_pins, i2s_config_t &i2s_config, int16_t *block_storage, int32_t buffer_size_in_bytes,
+               uint32_t block_count, TaskHandle_t writer_task_handle, BaseType_t reader_core = 0);
 
     friend void i2sReaderTask(void *param);
 };
@@ -0,0 +1,69 @@
+#ifndef __sample_convert_h__
+#define __sample_convert_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// clamp a 32 bit value into the int16_t range without branching
+inline int16_t saturateToInt16(int32_t value)
+{
+  value = value < INT16_MIN ? INT16_MIN : value;
+  value = value > INT16_MAX ? INT16_MAX : value;
+  return (int16_t)value;
+}
+
+// convert a run of raw 32 bit I2S words into 16 bit samples
+// the loop body is branch free (the ternaries become min/max) so the compiler can unroll or vectorize it
+inline void convertSamples(const int32_t* __restrict src, int16_t* __restrict dst, size_t count, uint8_t shift)
+{
+  for (size_t i = 0; i < count; i++) {
+    dst[i] = saturateToInt16(src[i] >> shift);
+  }
+}
+
+// largest magnitude in a run of raw 32 bit I2S words, x ^ (x >> 31) is |x| rounded down by one for
+// negative values so INT32_MIN does not overflow and the loop stays branch free
+inline int32_t peakOfWords(const int32_t* src, size_t count)
+{
+  int32_t max = 0;
+  for (size_t i = 0; i < count; i++) {
+    int32_t magnitude = src[i] ^ (src[i] >> 31);
+    max               = magnitude > max ? magnitude : max;
+  }
+  return max;
+}
+
+// scale a run of raw 32 bit I2S words by a gain (output = input * gain / 2^32) and saturate
+// the sum of absolute output values and the output peak are gathered in the same pass for the AGC
+inline void convertSamplesWithGain(const int32_t* __restrict src, int16_t* __restrict dst, size_t count, int32_t gain, uint32_t& abs_sum,
+                                   int32_t& peak)
+{
+  uint32_t sum = 0;
+  int32_t  max = 0;
+  for (size_t i = 0; i < count; i++) {
+    int16_t sample   = saturateToInt16((int32_t)(((int64_t)src[i] * gain) >> 32));
+    int32_t absolute = sample < 0 ? -sample : sample;
+    dst[i]           = sample;
+    sum += absolute;
+    max = absolute > max ? absolute : max;
+  }
+  abs_sum += sum;
+  peak = max > peak ? max : peak;
+}
+
+// sum of absolute values and peak of a run of 16 bit samples, for the AGC where it measures after the
+// decimator
+inline void levelOfSamples(const int16_t* samples, size_t count, uint32_t& abs_sum, int32_t& peak)
+{
+  uint32_t sum = 0;
+  int32_t  max = 0;
+  for (size_t i = 0; i < count; i++) {
+    int32_t absolute = samples[i] < 0 ? -samples[i] : samples[i];
+    sum += absolute;
+    max = absolute > max ? absolute : max;
+  }
+  abs_sum += sum;
+  peak = max > peak ? max : peak;
+}
+
+#endif
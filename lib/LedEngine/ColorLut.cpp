@@ -0,0 +1,69 @@
+#include <math.h>
+
+#include "ColorLut.h"
+
+RgbColor ColorLut::s_hue[256];
+uint16_t ColorLut::s_ease[TweenEase_Count][257];
+
+static float easeCurve(int ease, float progress)
+{
+  switch (ease) {
+    case TweenEase_QuadraticInOut:
+      return progress < 0.5f ? 2.0f * progress * progress : 1.0f - 2.0f * (1.0f - progress) * (1.0f - progress);
+    case TweenEase_CubicIn:
+      return progress * progress * progress;
+    case TweenEase_CubicOut:
+      return 1.0f - (1.0f - progress) * (1.0f - progress) * (1.0f - progress);
+    case TweenEase_SinusoidalInOut:
+      return 0.5f - 0.5f * cosf((float)M_PI * progress);
+    default:
+      return progress;
+  }
+}
+
+void ColorLut::begin()
+{
+  // hue wheel: six linear segments between the primaries and secondaries
+  for (int hue = 0; hue < 256; hue++) {
+    int segment  = hue * 6 / 256;
+    int position = (hue * 6 * 255 / 256) % 255;
+    int rising   = position;
+    int falling  = 255 - position;
+    switch (segment) {
+      case 0:
+        s_hue[hue] = RgbColor(255, rising, 0);
+        break;
+      case 1:
+        s_hue[hue] = RgbColor(falling, 255, 0);
+        break;
+      case 2:
+        s_hue[hue] = RgbColor(0, 255, rising);
+        break;
+      case 3:
+        s_hue[hue] = RgbColor(0, falling, 255);
+        break;
+      case 4:
+        s_hue[hue] = RgbColor(rising, 0, 255);
+        break;
+      default:
+        s_hue[hue] = RgbColor(255, 0, falling);
+        break;
+    }
+  }
+  for (int ease = 0; ease < TweenEase_Count; ease++) {
+    for (int index = 0; index <= 256; index++) {
+      float value = easeCurve(ease, index / 256.0f) * 65535.0f + 0.5f;
+      s_ease[ease][index] = value < 0.0f ? 0 : (value > 65535.0f ? 65535 : (uint16_t)value);
+    }
+  }
+}
+
+void ColorLut::buildOutputLut(uint8_t* lut, bool gamma, uint8_t brightness)
+{
+  for (int value = 0; value < 256; value++) {
+    float level = value * brightness / (255.0f * 255.0f);
+    if (gamma)
+      level = powf(level, 1.0f / 0.45f);
+    lut[value] = (uint8_t)(level * 255.0f + 0.5f);
+  }
+}
@@ -0,0 +1,76 @@
+#ifndef __color_lut_h__
+#define __color_lut_h__
+
+#include <NeoPixelBus.h>
+
+// easing curves, stored as one byte per tween
+enum TweenEase : uint8_t
+{
+  TweenEase_Linear,
+  TweenEase_QuadraticInOut,
+  TweenEase_CubicIn,
+  TweenEase_CubicOut,
+  TweenEase_SinusoidalInOut,
+  TweenEase_Count
+};
+
+// Integer colour helpers backed by tables built once by begin().
+//
+// Hues are 0..255 around the colour wheel and brightness 0..255 is the value of the brightest
+// channel, so hue(h, b) matches HslColor(h / 256.0f, 1.0f, b / 510.0f). Progress values are Q16
+// (0..65535) and blend weights Q8 (0..256).
+class ColorLut
+{
+private:
+  // fully saturated colour wheel at full brightness
+  static RgbColor s_hue[256];
+  // easing curves sampled at 257 points, Q16
+  static uint16_t s_ease[TweenEase_Count][257];
+
+public:
+  static void begin();
+
+  static RgbColor hue(uint8_t hue, uint8_t brightness)
+  {
+    const RgbColor& color = s_hue[hue];
+    uint16_t        scale = brightness + 1;
+    return RgbColor((color.R * scale) >> 8, (color.G * scale) >> 8, (color.B * scale) >> 8);
+  }
+
+  // brightness of the HslColor lightness used by the effects (0.5f is full bright)
+  static constexpr uint8_t brightnessFromLightness(float lightness)
+  {
+    return lightness >= 0.5f ? 255 : (uint8_t)(lightness * 510.0f);
+  }
+
+  // eased Q16 progress, interpolated between the table points
+  static uint16_t ease(uint8_t ease, uint16_t progress)
+  {
+    const uint16_t* table    = s_ease[ease < TweenEase_Count ? ease : (uint8_t)TweenEase_Linear];
+    uint8_t         index    = progress >> 8;
+    uint8_t         fraction = progress & 0xff;
+    return table[index] + (((table[index + 1] - table[index]) * fraction) >> 8);
+  }
+
+  // weight is Q8, 0 returns left and 256 returns right
+  static RgbColor blend(const RgbColor& left, const RgbColor& right, uint16_t weight)
+  {
+    return RgbColor(left.R + (((right.R - left.R) * weight) >> 8), left.G + (((right.G - left.G) * weight) >> 8),
+                    left.B + (((right.B - left.B) * weight) >> 8));
+  }
+
+  // output table applied to every channel when a frame is pushed: brightness scaling then optional gamma
+  static void buildOutputLut(uint8_t* lut, bool gamma, uint8_t brightness);
+};
+
+// fully saturated hues at one brightness, for effects that take their palette as a template parameter
+template <uint8_t T_BRIGHTNESS>
+struct HuePalette
+{
+  static RgbColor pick(uint8_t index)
+  {
+    return ColorLut::hue(index, T_BRIGHTNESS);
+  }
+};
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef __effect_registry_h__
+#define __effect_registry_h__
+
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+// quiet time of an effect that only changes on events, e.g. a new audio block
+const uint32_t EffectQuietForever = 0xffffffff;
+
+// Defaults of an effect type, effects derive from it and replace what they need.
+//
+// An effect is a type with only static members:
+//   Fps, Gamma                           frame rate and output gamma while it runs
+//   State                                everything the effect keeps between frames
+//   init(state, canvas, now_ms)          called when the effect is selected, state is freshly constructed
+//   update(state, now_ms)                advances timers and reacts to the music, does not draw
+//   render(state, canvas, now_ms)        draws the frame into the canvas
+//   quiet(state, now_ms)                 ms the frames stay the same unless an event wakes the render
+//                                        task, lets the render task idle; 0 when the effect cannot
+//                                        tell, the task then idles after a run of unchanged frames
+// The canvas keeps its pixels between frames, so effects can draw incrementally. Pixel counts,
+// palettes and easing curves are template parameters of the effect types, so the inner loops are
+// compiled for them.
+template <uint8_t T_FPS, bool T_GAMMA = false>
+struct EffectBase
+{
+  static const uint8_t Fps   = T_FPS;
+  static const bool    Gamma = T_GAMMA;
+
+  struct State
+  {
+  };
+
+  // the defaults take any state, so an effect can replace State and only some of the hooks
+  template <typename T_STATE, typename T_CANVAS>
+  static void init(T_STATE& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+  }
+  template <typename T_STATE>
+  static void update(T_STATE& state, uint32_t now_ms)
+  {
+  }
+  template <typename T_STATE, typename T_CANVAS>
+  static void render(T_STATE& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+  }
+  template <typename T_STATE>
+  static uint32_t quiet(const T_STATE& state, uint32_t now_ms)
+  {
+    return 0;
+  }
+};
+
+template <typename... T>
+struct EffectMaxSize;
+
+template <>
+struct EffectMaxSize<>
+{
+  static const size_t Size  = 1;
+  static const size_t Align = 1;
+};
+
+template <typename T_FIRST, typename... T_REST>
+struct EffectMaxSize<T_FIRST, T_REST...>
+{
+  typedef typename T_FIRST::State State;
+  static const size_t Size  = sizeof(State) > EffectMaxSize<T_REST...>::Size ? sizeof(State) : EffectMaxSize<T_REST...>::Size;
+  static const size_t Align = alignof(State) > EffectMaxSize<T_REST...>::Align ? alignof(State) : EffectMaxSize<T_REST...>::Align;
+};
+
+// Fixed list of effects, one of them running at a time.
+//
+// The state of the running effect lives in one arena sized for the largest State, so switching is
+// a placement new and never allocates. update() and render() each cost one indirect call into a
+// function compiled for that effect, everything below it is inlined. Effects are selected by their
+// position in T_EFFECTS.
+template <typename T_CANVAS, typename... T_EFFECTS>
+class EffectRegistry
+{
+public:
+  static const uint8_t Count = sizeof...(T_EFFECTS);
+  static const uint8_t None  = 0xff;
+  static_assert(Count > 0 && Count < None, "a registry holds 1 to 254 effects");
+
+private:
+  typedef void (*InitFunction)(void* state, T_CANVAS& canvas, uint32_t now_ms);
+  typedef void (*UpdateFunction)(void* state, uint32_t now_ms);
+  typedef void (*RenderFunction)(void* state, T_CANVAS& canvas, uint32_t now_ms);
+  typedef uint32_t (*QuietFunction)(const void* state, uint32_t now_ms);
+
+  struct Entry
+  {
+    InitFunction   init;
+    UpdateFunction update;
+    RenderFunction render;
+    QuietFunction  quiet;
+    uint8_t        fps;
+    bool           gamma;
+  };
+
+  template <typename T_EFFECT>
+  static void initEffect(void* state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    typedef typename T_EFFECT::State State;
+    static_assert(std::is_trivially_destructible<State>::value, "states are dropped without running a destructor");
+    T_EFFECT::init(*new (state) State(), canvas, now_ms);
+  }
+
+  template <typename T_EFFECT>
+  static void updateEffect(void* state, uint32_t now_ms)
+  {
+    T_EFFECT::update(*(typename T_EFFECT::State*)state, now_ms);
+  }
+
+  template <typename T_EFFECT>
+  static void renderEffect(void* state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    T_EFFECT::render(*(typename T_EFFECT::State*)state, canvas, now_ms);
+  }
+
+  template <typename T_EFFECT>
+  static uint32_t quietEffect(const void* state, uint32_t now_ms)
+  {
+    return T_EFFECT::quiet(*(const typename T_EFFECT::State*)state, now_ms);
+  }
+
+  static const Entry s_entries[Count];
+
+  alignas(EffectMaxSize<T_EFFECTS...>::Align) uint8_t m_arena[EffectMaxSize<T_EFFECTS...>::Size];
+  uint8_t m_current = None;
+
+public:
+  // switch to effect index and initialise it, false if there is no such effect
+  bool select(uint8_t index, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    if (index >= Count)
+      return false;
+    m_current = index;
+    s_entries[index].init(m_arena, canvas, now_ms);
+    return true;
+  }
+
+  // advance the running effect
+  void update(uint32_t now_ms)
+  {
+    if (m_current != None)
+      s_entries[m_current].update(m_arena, now_ms);
+  }
+
+  // draw the running effect into canvas
+  void render(T_CANVAS& canvas, uint32_t now_ms)
+  {
+    if (m_current != None)
+      s_entries[m_current].render(m_arena, canvas, now_ms);
+  }
+
+  // how long the running effect stays the same, 0 before the first select()
+  uint32_t getQuietMs(uint32_t now_ms) const
+  {
+    return m_current != None ? s_entries[m_current].quiet(m_arena, now_ms) : 0;
+  }
+
+  // running effect, None before the first select()
+  uint8_t getCurrent() const
+  {
+    return m_current;
+  }
+  static uint8_t getFps(uint8_t index)
+  {
+    return index < Count ? s_entries[index].fps : 0;
+  }
+  static bool getGamma(uint8_t index)
+  {
+    return index < Count && s_entries[index].gamma;
+  }
+  static size_t getArenaSize()
+  {
+    return sizeof(m_arena);
+  }
+};
+
+template <typename T_CANVAS, typename... T_EFFECTS>
+const typename EffectRegistry<T_CANVAS, T_EFFECTS...>::Entry EffectRegistry<T_CANVAS, T_EFFECTS...>::s_entries[Count] = {
+  {initEffect<T_EFFECTS>, updateEffect<T_EFFECTS>, renderEffect<T_EFFECTS>, quietEffect<T_EFFECTS>, T_EFFECTS::Fps, T_EFFECTS::Gamma}...};
+
+#endif
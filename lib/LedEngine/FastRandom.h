@@ -0,0 +1,139 @@
+#ifndef __fast_random_h__
+#define __fast_random_h__
+
+#include <NeoPixelBus.h>
+
+// Small pseudo random generator for the effects, xoshiro128** over 16 bytes of state.
+//
+// Bounded values use Lemire's multiply and shift: the high word of next() * range is uniform over
+// [0, range) once the rare low words under 2^32 % range are drawn again, so there is no modulo bias
+// and the one division that threshold takes only happens when a low word falls under range. The
+// fills work out the threshold once for the whole batch. Nothing here blocks or allocates, every
+// effect splits its own generator off a seeded one when it starts.
+class FastRandom
+{
+private:
+  uint32_t m_state[4];
+
+  static uint32_t rotl(uint32_t value, int shift)
+  {
+    return (value << shift) | (value >> (32 - shift));
+  }
+
+  // splitmix32 step, spreads a 32 bit seed over the state
+  static uint32_t mix(uint32_t& seed)
+  {
+    uint32_t z = (seed += 0x9e3779b9);
+    z          = (z ^ (z >> 16)) * 0x85ebca6b;
+    z          = (z ^ (z >> 13)) * 0xc2b2ae35;
+    return z ^ (z >> 16);
+  }
+
+  static uint32_t threshold(uint32_t range)
+  {
+    return range > 0 ? (0u - range) % range : 0;
+  }
+
+  uint32_t draw(uint32_t range, uint32_t threshold)
+  {
+    uint64_t product = (uint64_t)next() * range;
+    while ((uint32_t)product < threshold) {
+      product = (uint64_t)next() * range;
+    }
+    return product >> 32;
+  }
+
+public:
+  explicit FastRandom(uint32_t value = 1)
+  {
+    seed(value);
+  }
+
+  // splitmix outputs of consecutive inputs are never all zero, which xoshiro could not leave
+  void seed(uint32_t value)
+  {
+    for (int word = 0; word < 4; word++) {
+      m_state[word] = mix(value);
+    }
+  }
+
+  // a generator of its own, seeded from this one
+  FastRandom split()
+  {
+    return FastRandom(next());
+  }
+
+  uint32_t next()
+  {
+    uint32_t result = rotl(m_state[1] * 5, 7) * 9;
+    uint32_t t      = m_state[1] << 9;
+    m_state[2] ^= m_state[0];
+    m_state[3] ^= m_state[1];
+    m_state[1] ^= m_state[2];
+    m_state[0] ^= m_state[3];
+    m_state[2] ^= t;
+    m_state[3] = rotl(m_state[3], 11);
+    return result;
+  }
+
+  // uniform in [0, range), 0 for an empty range
+  uint32_t below(uint32_t range)
+  {
+    uint64_t product = (uint64_t)next() * range;
+    if ((uint32_t)product < range) {
+      uint32_t limit = threshold(range);
+      while ((uint32_t)product < limit) {
+        product = (uint64_t)next() * range;
+      }
+    }
+    return product >> 32;
+  }
+
+  // uniform in [min, max) like random(min, max), min for an empty range
+  uint32_t between(uint32_t min, uint32_t max)
+  {
+    return max > min ? min + below(max - min) : min;
+  }
+
+  // channels uniform in [0, peak)
+  RgbColor color(uint8_t peak)
+  {
+    uint8_t channels[3];
+    fill(channels, 3, peak);
+    return RgbColor(channels[0], channels[1], channels[2]);
+  }
+
+  // count values uniform in [0, range), e.g. pixel indices
+  template <typename T>
+  void fill(T* values, size_t count, uint32_t range)
+  {
+    uint32_t limit = threshold(range);
+    for (size_t index = 0; index < count; index++) {
+      values[index] = draw(range, limit);
+    }
+  }
+
+  // count values uniform in [min, max), e.g. durations
+  template <typename T>
+  void fill(T* values, size_t count, uint32_t min, uint32_t max)
+  {
+    uint32_t range = max > min ? max - min : 0;
+    uint32_t limit = threshold(range);
+    for (size_t index = 0; index < count; index++) {
+      values[index] = min + draw(range, limit);
+    }
+  }
+
+  // count colours with channels uniform in [0, peak)
+  void fillColors(RgbColor* colors, size_t count, uint8_t peak)
+  {
+    uint32_t limit = threshold(peak);
+    for (size_t index = 0; index < count; index++) {
+      colors[index].R = draw(peak, limit);
+      colors[index].G = draw(peak, limit);
+      colors[index].B = draw(peak, limit);
+    }
+  }
+};
+
+#endif
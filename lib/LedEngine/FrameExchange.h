@@ -0,0 +1,58 @@
+#ifndef __frame_exchange_h__
+#define __frame_exchange_h__
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free triple buffer handing whole frames from one producer to one consumer.
+//
+// The producer always owns a back buffer and the consumer a front buffer; the third buffer sits in
+// the middle and is swapped atomically by both sides, so neither ever waits for the other. When the
+// consumer is slower it simply skips to the newest frame and the skipped frame is reported as dropped.
+template <typename T, size_t T_COUNT>
+class FrameExchange
+{
+private:
+  static const uint8_t IndexMask = 0x03;
+  static const uint8_t FreshBit  = 0x04;
+
+  T m_buffers[3][T_COUNT];
+  // index of the middle buffer, FreshBit is set while it holds a frame the consumer has not taken
+  std::atomic<uint8_t> m_middle{2};
+  uint8_t              m_back  = 0;
+  uint8_t              m_front = 1;
+
+public:
+  // producer: buffer to fill with the next frame
+  T* back()
+  {
+    return m_buffers[m_back];
+  }
+
+  // producer: hand the back buffer over, returns true if the previous frame was never taken
+  bool publish()
+  {
+    uint8_t previous = m_middle.exchange(m_back | FreshBit, std::memory_order_acq_rel);
+    m_back           = previous & IndexMask;
+    return (previous & FreshBit) != 0;
+  }
+
+  // consumer: take the newest published frame, false if nothing new arrived since the last call
+  bool acquire()
+  {
+    if ((m_middle.load(std::memory_order_acquire) & FreshBit) == 0)
+      return false;
+    // only the consumer clears FreshBit so the exchange is guaranteed to return a fresh frame
+    m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+    return true;
+  }
+
+  // consumer: the frame taken by the last successful acquire()
+  const T* front() const
+  {
+    return m_buffers[m_front];
+  }
+};
+
+#endif
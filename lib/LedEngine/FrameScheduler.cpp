@@ -0,0 +1,86 @@
+#include "FrameScheduler.h"
+
+void FrameScheduler::record(FramePhaseStats& stats, uint32_t elapsed_us)
+{
+  stats.last_us = elapsed_us;
+  stats.max_us  = elapsed_us > stats.max_us ? elapsed_us : stats.max_us;
+  stats.total_us += elapsed_us;
+}
+
+void FrameScheduler::begin(uint16_t fps)
+{
+  setTarget(fps);
+  resetStats();
+  m_last_wake = xTaskGetTickCount();
+}
+
+void FrameScheduler::setTarget(uint16_t fps, uint32_t budget_us)
+{
+  m_fps          = fps > 0 ? fps : 1;
+  m_period_ticks = pdMS_TO_TICKS(1000 / m_fps);
+  m_period_ticks = m_period_ticks > 0 ? m_period_ticks : 1;
+  m_budget_us    = budget_us > 0 ? budget_us : 1000000UL / m_fps;
+}
+
+void FrameScheduler::setMaxIdle(uint32_t max_idle_ms)
+{
+  m_max_idle_ms = max_idle_ms;
+}
+
+void FrameScheduler::beginFrame()
+{
+  m_load.wake();
+  m_frame_start_us = micros();
+  m_phase_start_us = m_frame_start_us;
+}
+
+void FrameScheduler::endPhase(FramePhase phase)
+{
+  uint32_t now = micros();
+  record(m_phases[phase], now - m_phase_start_us);
+  m_phase_start_us = now;
+}
+
+void FrameScheduler::waitNextFrame(bool changed, uint32_t quiet_ms)
+{
+  uint32_t elapsed_us = micros() - m_frame_start_us;
+  record(m_frame, elapsed_us);
+  m_frames++;
+  if (elapsed_us > m_budget_us)
+    m_budget_exceeds++;
+  m_load.sleep();
+
+  m_unchanged = changed ? 0 : (m_unchanged < UnchangedFrames ? m_unchanged + 1 : m_unchanged);
+  uint32_t idle_ms = quiet_ms;
+  if (m_unchanged >= UnchangedFrames && idle_ms == 0)
+    idle_ms = UnchangedPeriodMs;
+  idle_ms = idle_ms < m_max_idle_ms ? idle_ms : m_max_idle_ms;
+  if (pdMS_TO_TICKS(idle_ms) > m_period_ticks) {
+    // notifications that came in while the frame was drawn end the wait right away
+    m_idle_frames++;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(idle_ms));
+    m_last_wake = xTaskGetTickCount();
+    return;
+  }
+
+  // the frame ran into the next period, start a new schedule rather than rushing the missed frames:
+  // the next frame starts right away and the ones after it a period apart
+  if (xTaskGetTickCount() - m_last_wake >= m_period_ticks) {
+    m_overruns++;
+    m_last_wake = xTaskGetTickCount() - m_period_ticks;
+  }
+  vTaskDelayUntil(&m_last_wake, m_period_ticks);
+}
+
+void FrameScheduler::resetStats()
+{
+  for (int phase = 0; phase < FramePhase_Count; phase++) {
+    m_phases[phase] = FramePhaseStats();
+  }
+  m_frame          = FramePhaseStats();
+  m_frames         = 0;
+  m_overruns       = 0;
+  m_budget_exceeds = 0;
+  m_idle_frames    = 0;
+  m_load.reset();
+}
@@ -0,0 +1,116 @@
+#ifndef __frame_scheduler_h__
+#define __frame_scheduler_h__
+
+#include <Arduino.h>
+
+#include "TaskLoad.h"
+
+// phases of a frame that are timed separately
+enum FramePhase
+{
+  FramePhase_Update, // effect state / animations
+  FramePhase_Render, // drawing into the frame
+  FramePhase_Show,   // pushing the frame to the strip
+  FramePhase_Count
+};
+
+struct FramePhaseStats
+{
+  uint32_t last_us;
+  uint32_t max_us;
+  uint64_t total_us;
+};
+
+// Fixed timestep frame pacing for the render task.
+//
+// waitNextFrame() sleeps with vTaskDelayUntil so frames start on a fixed period regardless of how
+// long the previous one took. A frame that runs past its period is counted as an overrun, the next
+// one starts at once and the schedule restarts from there instead of bursting to catch up. Each frame can be split into phases
+// with endPhase() to find out where the time goes, and frames over the program's budget are counted.
+//
+// A frame that showed nothing new, or a program that says it will not change for a while, lets the
+// task idle: it then waits on its task notification instead of the next period, so input, a Serial
+// request or an audio block wakes it at once. It sleeps until the program's deadline, or, when the
+// program gives none, for UnchangedPeriodMs once UnchangedFrames frames in a row showed nothing new,
+// and never longer than the max idle time. The schedule starts again from the wake up.
+class FrameScheduler
+{
+public:
+  // frames in a row without a change before the frame rate drops to one per UnchangedPeriodMs
+  static const uint16_t UnchangedFrames   = 30;
+  static const uint16_t UnchangedPeriodMs = 100;
+
+private:
+  TickType_t m_last_wake    = 0;
+  TickType_t m_period_ticks = 1;
+  uint16_t   m_fps          = 0;
+  uint32_t   m_budget_us    = 0;
+  uint32_t   m_max_idle_ms  = 0;
+  uint16_t   m_unchanged    = 0;
+  // start of the current frame and of the current phase
+  uint32_t m_frame_start_us = 0;
+  uint32_t m_phase_start_us = 0;
+  // statistics since the last reset
+  FramePhaseStats m_phases[FramePhase_Count];
+  FramePhaseStats m_frame;
+  uint32_t        m_frames         = 0;
+  uint32_t        m_overruns       = 0;
+  uint32_t        m_budget_exceeds = 0;
+  uint32_t        m_idle_frames    = 0;
+  TaskLoad        m_load;
+
+  static void record(FramePhaseStats& stats, uint32_t elapsed_us);
+
+public:
+  // target frame rate, the budget defaults to the whole frame period
+  void begin(uint16_t fps);
+  // change the frame rate and budget, e.g. when the program changes
+  void setTarget(uint16_t fps, uint32_t budget_us = 0);
+  // longest idle sleep, 0 keeps the task on its frame period
+  void setMaxIdle(uint32_t max_idle_ms);
+  // start timing a frame, called right after waking up
+  void beginFrame();
+  // the time since the last phase (or the start of the frame) belongs to phase
+  void endPhase(FramePhase phase);
+  // finish the frame and sleep until the next one is due, or idle when the frame did not change or
+  // the program stays the same for quiet_ms, see EffectQuietForever
+  void waitNextFrame(bool changed = true, uint32_t quiet_ms = 0);
+  void resetStats();
+
+  uint16_t getFps() const
+  {
+    return m_fps;
+  }
+  uint32_t getFrames() const
+  {
+    return m_frames;
+  }
+  uint32_t getOverruns() const
+  {
+    return m_overruns;
+  }
+  uint32_t getBudgetExceeds() const
+  {
+    return m_budget_exceeds;
+  }
+  // frames followed by an idle sleep
+  uint32_t getIdleFrames() const
+  {
+    return m_idle_frames;
+  }
+  // busy time and wake ups of the render task
+  const TaskLoad& getLoad() const
+  {
+    return m_load;
+  }
+  const FramePhaseStats& getPhaseStats(FramePhase phase) const
+  {
+    return m_phases[phase];
+  }
+  const FramePhaseStats& getFrameStats() const
+  {
+    return m_frame;
+  }
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef __layer_blend_h__
+#define __layer_blend_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// how the incoming layer is combined with the outgoing one during a transition
+enum BlendMode : uint8_t
+{
+  BlendMode_Alpha, // crossfade, the weights of both layers add up to one
+  BlendMode_Add,   // both layers at full strength in the middle of the transition, summed and saturated
+  BlendMode_Max,   // the brighter of the two faded layers per channel
+  BlendMode_Count
+};
+
+// Two-layer blends over packed r, g, b bytes.
+//
+// Every 32 bit word is split into two words of two 16 bit lanes (bytes 0 and 2, bytes 1 and 3), so one
+// multiply scales two channels and the lanes have room for the carries: 255 * 256 still fits in 16
+// bits. Nothing depends on which channel a byte holds, so the layers are processed as flat word
+// arrays without any per pixel work. Weights are Q8, 0..256.
+class LayerBlend
+{
+private:
+  static const uint32_t LaneMask = 0x00ff00ff;
+
+  // both lanes times weight, still in 16 bit lanes
+  static uint32_t scaleLanes(uint32_t lanes, uint16_t weight)
+  {
+    return ((lanes * weight) >> 8) & LaneMask;
+  }
+
+  static uint32_t saturateLanes(uint32_t lanes)
+  {
+    // lanes hold at most 510, bit 8 is set on overflow
+    uint32_t overflow = (lanes >> 8) & 0x00010001;
+    return (lanes | overflow * 0xff) & LaneMask;
+  }
+
+  static uint32_t maxLanes(uint32_t left, uint32_t right)
+  {
+    // 256 + left - right never borrows across lanes, bit 8 is set where left >= right
+    uint32_t mask = (((left | 0x01000100) - right) >> 8 & 0x00010001) * 0xff;
+    return (left & mask) | (right & ~mask);
+  }
+
+public:
+  // weights of the outgoing and incoming layer at transition progress weight
+  static void transitionWeights(BlendMode mode, uint16_t weight, uint16_t& outgoing, uint16_t& incoming)
+  {
+    outgoing = 256 - weight;
+    incoming = weight;
+    if (mode == BlendMode_Add) {
+      outgoing = outgoing >= 128 ? 256 : outgoing * 2;
+      incoming = incoming >= 128 ? 256 : incoming * 2;
+    }
+  }
+
+  // result = outgoing * (256 - weight) + incoming * weight, exact at both ends
+  static void alpha(const uint32_t* outgoing, const uint32_t* incoming, uint32_t* result, size_t words, uint16_t weight)
+  {
+    uint16_t keep = 256 - weight;
+    for (size_t index = 0; index < words; index++) {
+      uint32_t a  = outgoing[index];
+      uint32_t b  = incoming[index];
+      uint32_t rb = (((a & LaneMask) * keep + (b & LaneMask) * weight) >> 8) & LaneMask;
+      uint32_t g  = (((a >> 8) & LaneMask) * keep + ((b >> 8) & LaneMask) * weight) & ~LaneMask;
+      result[index] = rb | g;
+    }
+  }
+
+  // result = min(255, outgoing * outgoing_weight + incoming * incoming_weight)
+  static void add(const uint32_t* outgoing, const uint32_t* incoming, uint32_t* result, size_t words, uint16_t outgoing_weight,
+                  uint16_t incoming_weight)
+  {
+    for (size_t index = 0; index < words; index++) {
+      uint32_t a  = outgoing[index];
+      uint32_t b  = incoming[index];
+      uint32_t rb = saturateLanes(scaleLanes(a & LaneMask, outgoing_weight) + scaleLanes(b & LaneMask, incoming_weight));
+      uint32_t g  = saturateLanes(scaleLanes((a >> 8) & LaneMask, outgoing_weight) + scaleLanes((b >> 8) & LaneMask, incoming_weight));
+      result[index] = rb | (g << 8);
+    }
+  }
+
+  // result = max(outgoing * outgoing_weight, incoming * incoming_weight)
+  static void max(const uint32_t* outgoing, const uint32_t* incoming, uint32_t* result, size_t words, uint16_t outgoing_weight,
+                  uint16_t incoming_weight)
+  {
+    for (size_t index = 0; index < words; index++) {
+      uint32_t a  = outgoing[index];
+      uint32_t b  = incoming[index];
+      uint32_t rb = maxLanes(scaleLanes(a & LaneMask, outgoing_weight), scaleLanes(b & LaneMask, incoming_weight));
+      uint32_t g  = maxLanes(scaleLanes((a >> 8) & LaneMask, outgoing_weight), scaleLanes((b >> 8) & LaneMask, incoming_weight));
+      result[index] = rb | (g << 8);
+    }
+  }
+
+  // blend a transition at progress weight (Q8) from outgoing to incoming
+  static void transition(BlendMode mode, const uint32_t* outgoing, const uint32_t* incoming, uint32_t* result, size_t words, uint16_t weight)
+  {
+    uint16_t outgoing_weight, incoming_weight;
+    transitionWeights(mode, weight, outgoing_weight, incoming_weight);
+    switch (mode) {
+      case BlendMode_Add:
+        add(outgoing, incoming, result, words, outgoing_weight, incoming_weight);
+        break;
+      case BlendMode_Max:
+        max(outgoing, incoming, result, words, outgoing_weight, incoming_weight);
+        break;
+      default:
+        alpha(outgoing, incoming, result, words, weight);
+        break;
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef __layer_compositor_h__
+#define __layer_compositor_h__
+
+#include "ColorLut.h"
+#include "LayerBlend.h"
+#include "PixelLayer.h"
+
+// Program switches as transitions between two effects.
+//
+// T_EFFECTS is an EffectRegistry drawing into PixelLayer<T_PIXEL_COUNT>. The compositor holds two of
+// them, each with its own layer: selecting a program starts it in the idle registry on a black layer
+// while the running one keeps going, and for the duration of the transition both are rendered and
+// blended into the frame. Once it is over the incoming effect is the only one left running. A
+// duration of 0, and the first program, cut straight to the new effect. Without T_LIVE_OUTGOING there
+// is only one registry, which saves an effect arena: the outgoing layer then fades out as it was
+// when the switch happened.
+//
+// Effects that want gamma correction get it per layer, before the blend: a crossfade between a gamma
+// and a linear effect then fades between what each of them looks like on its own, instead of jumping
+// when the output gamma of the frame switches. The frame itself is left linear.
+template <typename T_EFFECTS, uint16_t T_PIXEL_COUNT, bool T_LIVE_OUTGOING = true>
+class LayerCompositor
+{
+public:
+  typedef PixelLayer<T_PIXEL_COUNT> Layer;
+
+private:
+  // words of both layers gamma corrected at a time during a transition
+  static const size_t ChunkWords = 32;
+
+  T_EFFECTS m_effects[T_LIVE_OUTGOING ? 2 : 1];
+  Layer     m_layers[2];
+  Layer     m_blended;
+  // whether the effect of each layer wants gamma correction, and the table that does it
+  bool    m_gamma[2] = {false, false};
+  uint8_t m_gamma_lut[256];
+  // slot shown when no transition runs, and the outgoing one during a transition
+  uint8_t   m_active      = 0;
+  bool      m_transition  = false;
+  uint32_t  m_start_ms    = 0;
+  uint16_t  m_duration_ms = 0;
+  BlendMode m_mode        = BlendMode_Alpha;
+
+  uint8_t incoming() const
+  {
+    return m_active ^ 1;
+  }
+
+  // registry drawing into the layer of slot
+  T_EFFECTS& registry(uint8_t slot)
+  {
+    return m_effects[T_LIVE_OUTGOING ? slot : 0];
+  }
+  const T_EFFECTS& registry(uint8_t slot) const
+  {
+    return m_effects[T_LIVE_OUTGOING ? slot : 0];
+  }
+
+  // count words of the layer of slot from first as they go out: the layer itself, or its gamma
+  // corrected copy in scratch
+  const uint32_t* outputWords(uint8_t slot, size_t first, size_t count, uint32_t* scratch) const
+  {
+    const uint32_t* words = m_layers[slot].getWords() + first;
+    if (!m_gamma[slot])
+      return words;
+    const uint8_t* bytes     = (const uint8_t*)words;
+    uint8_t*       corrected = (uint8_t*)scratch;
+    for (size_t index = 0; index < count * 4; index++) {
+      corrected[index] = m_gamma_lut[bytes[index]];
+    }
+    return scratch;
+  }
+
+  // Q8 progress of the transition, 256 once it is over
+  uint16_t progress(uint32_t now_ms) const
+  {
+    uint32_t elapsed = now_ms - m_start_ms;
+    return elapsed >= m_duration_ms ? 256 : elapsed * 256 / m_duration_ms;
+  }
+
+public:
+  LayerCompositor()
+  {
+    ColorLut::buildOutputLut(m_gamma_lut, true, 255);
+  }
+
+  // how the following program switches blend, a duration of 0 switches on the next frame
+  void setTransition(BlendMode mode, uint16_t duration_ms)
+  {
+    m_mode        = mode < BlendMode_Count ? mode : BlendMode_Alpha;
+    m_duration_ms = duration_ms;
+  }
+
+  // start effect index, false if there is no such effect. A switch during a transition drops the
+  // outgoing effect and fades from the incoming one.
+  bool select(uint8_t index, uint32_t now_ms)
+  {
+    if (index >= T_EFFECTS::Count)
+      return false;
+    if (m_transition)
+      m_active = incoming();
+    bool    cut  = m_duration_ms == 0 || registry(m_active).getCurrent() == T_EFFECTS::None;
+    uint8_t slot = cut ? m_active : incoming();
+    m_layers[slot].Clear();
+    m_gamma[slot] = T_EFFECTS::getGamma(index);
+    registry(slot).select(index, m_layers[slot], now_ms);
+    m_transition = !cut;
+    m_start_ms   = now_ms;
+    return true;
+  }
+
+  void update(uint32_t now_ms)
+  {
+    if (T_LIVE_OUTGOING || !m_transition)
+      registry(m_active).update(now_ms);
+    if (m_transition)
+      registry(incoming()).update(now_ms);
+  }
+
+  void render(uint32_t now_ms)
+  {
+    if (T_LIVE_OUTGOING || !m_transition)
+      registry(m_active).render(m_layers[m_active], now_ms);
+    if (m_transition)
+      registry(incoming()).render(m_layers[incoming()], now_ms);
+  }
+
+  // blend the layers into frame, which only marks the pixels that changed
+  template <typename T_FRAME>
+  void compose(T_FRAME& frame, uint32_t now_ms)
+  {
+    if (m_transition) {
+      uint16_t weight = progress(now_ms);
+      if (weight < 256) {
+        uint32_t outgoing_words[ChunkWords];
+        uint32_t incoming_words[ChunkWords];
+        for (size_t first = 0; first < Layer::WordCount; first += ChunkWords) {
+          size_t count = Layer::WordCount - first < ChunkWords ? Layer::WordCount - first : ChunkWords;
+          LayerBlend::transition(m_mode, outputWords(m_active, first, count, outgoing_words), outputWords(incoming(), first, count, incoming_words),
+                                 m_blended.getWords() + first, count, weight);
+        }
+        frame.SetPixels(m_blended.getBytes());
+        return;
+      }
+      m_active     = incoming();
+      m_transition = false;
+    }
+    frame.SetPixels((const uint8_t*)outputWords(m_active, 0, Layer::WordCount, m_blended.getWords()));
+  }
+
+  // how long the frames stay the same, 0 during a transition
+  uint32_t getQuietMs(uint32_t now_ms) const
+  {
+    return m_transition ? 0 : registry(m_active).getQuietMs(now_ms);
+  }
+
+  // the selected effect, the incoming one during a transition
+  uint8_t getCurrent() const
+  {
+    return registry(m_transition ? incoming() : m_active).getCurrent();
+  }
+  bool isTransitioning() const
+  {
+    return m_transition;
+  }
+  BlendMode getMode() const
+  {
+    return m_mode;
+  }
+  uint16_t getDuration() const
+  {
+    return m_duration_ms;
+  }
+};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef __particle_system_h__
+#define __particle_system_h__
+
+#include <NeoPixelBus.h>
+
+// what happens to a particle that moves off the end of the strip
+enum ParticleEdge : uint8_t
+{
+  ParticleEdge_Drop, // it is dropped
+  ParticleEdge_Wrap, // it comes back at the other end
+};
+
+// Fixed pool of moving, fading lights kept as structure of arrays.
+//
+// Positions are Q16 pixels and velocities Q16 pixels per ms, so a light can move slower than a pixel
+// per frame. The life of a particle runs down from 65535 at a fixed rate and scales its colour.
+// Update() moves and ages all of them in one pass and fills the place of a dead one with the last
+// one, so the live particles stay at the front of the arrays. Render() adds every particle to the two
+// pixels it lies between, weighted by how close it is to each, so it glides instead of jumping from
+// pixel to pixel. Once the pool is full a new particle takes the place of the faintest one.
+template <uint16_t T_CAPACITY, ParticleEdge T_EDGE = ParticleEdge_Drop>
+class ParticleSystem
+{
+public:
+  static const int32_t One = 65536;
+
+private:
+  int32_t  m_position[T_CAPACITY];
+  int32_t  m_velocity[T_CAPACITY];
+  RgbColor m_color[T_CAPACITY];
+  uint16_t m_life[T_CAPACITY];
+  // life lost per ms, 0 for a particle that does not fade
+  uint16_t m_decay[T_CAPACITY];
+  uint16_t m_count   = 0;
+  uint32_t m_last_ms = 0;
+
+  uint16_t Faintest() const
+  {
+    uint16_t faintest = 0;
+    for (uint16_t index = 1; index < m_count; index++) {
+      if (m_life[index] < m_life[faintest])
+        faintest = index;
+    }
+    return faintest;
+  }
+
+  template <typename T_CANVAS>
+  static void AddPixel(T_CANVAS& canvas, int32_t pixel, const RgbColor& color, uint16_t weight)
+  {
+    int32_t count = canvas.PixelCount();
+    if (T_EDGE == ParticleEdge_Wrap) {
+      if (pixel < 0)
+        pixel += count;
+      else if (pixel >= count)
+        pixel -= count;
+    }
+    if (weight == 0 || pixel < 0 || pixel >= count)
+      return;
+    RgbColor current = canvas.GetPixelColor(pixel);
+    uint16_t red     = current.R + ((color.R * weight) >> 8);
+    uint16_t green   = current.G + ((color.G * weight) >> 8);
+    uint16_t blue    = current.B + ((color.B * weight) >> 8);
+    canvas.SetPixelColor(pixel, RgbColor(red < 255 ? red : 255, green < 255 ? green : 255, blue < 255 ? blue : 255));
+  }
+
+public:
+  // drop every particle, the next Update() ages them from now_ms
+  void Clear(uint32_t now_ms)
+  {
+    m_count   = 0;
+    m_last_ms = now_ms;
+  }
+
+  uint16_t Count() const
+  {
+    return m_count;
+  }
+
+  // a particle at the Q16 position moving at velocity Q16 pixels per ms, fading out from color over
+  // life_ms or never for 0
+  void Spawn(int32_t position, int32_t velocity, const RgbColor& color, uint16_t life_ms)
+  {
+    uint16_t index    = m_count < T_CAPACITY ? m_count++ : Faintest();
+    m_position[index] = position;
+    m_velocity[index] = velocity;
+    m_color[index]    = color;
+    m_life[index]     = 65535;
+    m_decay[index]    = life_ms > 0 ? 65535 / life_ms : 0;
+  }
+
+  // move and age every particle by the time since the last update, the ones that faded out or left
+  // the pixel_count pixels are dropped
+  void Update(uint32_t now_ms, uint16_t pixel_count)
+  {
+    uint32_t elapsed = now_ms - m_last_ms;
+    int32_t  end     = (int32_t)pixel_count << 16;
+    m_last_ms        = now_ms;
+    uint16_t index   = 0;
+    while (index < m_count) {
+      uint32_t age      = m_decay[index] * elapsed;
+      int32_t  position = m_position[index] + m_velocity[index] * (int32_t)elapsed;
+      bool     inside   = position > -One && position < end;
+      if (T_EDGE == ParticleEdge_Wrap && (position < 0 || position >= end)) {
+        position %= end;
+        if (position < 0)
+          position += end;
+        inside = true;
+      }
+      if (inside && age < m_life[index]) {
+        m_position[index] = position;
+        m_life[index] -= age;
+        index++;
+        continue;
+      }
+      m_count--;
+      m_position[index] = m_position[m_count];
+      m_velocity[index] = m_velocity[m_count];
+      m_color[index]    = m_color[m_count];
+      m_life[index]     = m_life[m_count];
+      m_decay[index]    = m_decay[m_count];
+    }
+  }
+
+  // add every particle to canvas at its colour scaled by its life
+  template <typename T_CANVAS>
+  void Render(T_CANVAS& canvas) const
+  {
+    for (uint16_t index = 0; index < m_count; index++) {
+      Splat(canvas, m_position[index], m_color[index], m_life[index] >> 8);
+    }
+  }
+
+  // add color at level to the pixels on both sides of the Q16 position, the nearer one gets more
+  template <typename T_CANVAS>
+  static void Splat(T_CANVAS& canvas, int32_t position, const RgbColor& color, uint8_t level)
+  {
+    int32_t  pixel = position >> 16;
+    uint16_t next  = ((position & 0xffff) * (level + 1)) >> 16;
+    AddPixel(canvas, pixel, color, level + 1 - next);
+    AddPixel(canvas, pixel + 1, color, next);
+  }
+};
+
+#endif
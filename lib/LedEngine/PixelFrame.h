@@ -0,0 +1,179 @@
+#ifndef __pixel_frame_h__
+#define __pixel_frame_h__
+
+#include <NeoPixelBus.h>
+#include <string.h>
+
+#include "ColorLut.h"
+
+// Frame layer between the effects and the strip.
+//
+// Effects draw linear colours into the frame's canvas. Writes that do not change a pixel are
+// dropped and the changed pixels are tracked as one dirty range, so Show() only converts and pushes
+// the strip (~9ms for 300 WS2812) when something actually changed. On the way out every channel
+// goes through one brightness / gamma table, instead of each effect correcting its own pixels; at
+// full brightness without gamma the table is the identity and the canvas is pushed as it is.
+// T_STRIP is a NeoPixelBus or anything with the same SetPixelColor / Show interface, such as a mock
+// strip on the host.
+template <typename T_STRIP, uint16_t T_PIXEL_COUNT>
+class PixelFrame
+{
+private:
+  T_STRIP& m_strip;
+  RgbColor m_canvas[T_PIXEL_COUNT];
+  // brightness and gamma applied to each channel when the canvas is pushed
+  uint8_t m_output_lut[256];
+  bool    m_gamma      = false;
+  uint8_t m_brightness = 255;
+  bool    m_identity   = true;
+  // changed pixels since the last Show(), empty when m_dirty_first > m_dirty_last
+  uint16_t m_dirty_first;
+  uint16_t m_dirty_last;
+  uint32_t m_frames_shown   = 0;
+  uint32_t m_frames_skipped = 0;
+
+  void markDirty(uint16_t first, uint16_t last)
+  {
+    m_dirty_first = first < m_dirty_first ? first : m_dirty_first;
+    m_dirty_last  = last > m_dirty_last ? last : m_dirty_last;
+  }
+
+  void resetDirty()
+  {
+    m_dirty_first = 0xffff;
+    m_dirty_last  = 0;
+  }
+
+public:
+  PixelFrame(T_STRIP& strip) : m_strip(strip)
+  {
+    for (uint16_t pixel = 0; pixel < T_PIXEL_COUNT; pixel++) {
+      m_canvas[pixel] = RgbColor(0);
+    }
+    ColorLut::buildOutputLut(m_output_lut, m_gamma, m_brightness);
+    resetDirty();
+  }
+
+  uint16_t PixelCount() const
+  {
+    return T_PIXEL_COUNT;
+  }
+
+  RgbColor GetPixelColor(uint16_t indexPixel) const
+  {
+    return indexPixel < T_PIXEL_COUNT ? m_canvas[indexPixel] : RgbColor(0);
+  }
+
+  void SetPixelColor(uint16_t indexPixel, const RgbColor& color)
+  {
+    if (indexPixel < T_PIXEL_COUNT && m_canvas[indexPixel] != color) {
+      m_canvas[indexPixel] = color;
+      markDirty(indexPixel, indexPixel);
+    }
+  }
+
+  // set count pixels from first to color, only the changed span is marked dirty
+  void Fill(uint16_t first, uint16_t count, const RgbColor& color)
+  {
+    uint16_t end = first + count;
+    end          = end > T_PIXEL_COUNT ? T_PIXEL_COUNT : end;
+    while (first < end && m_canvas[first] == color)
+      first++;
+    while (end > first && m_canvas[end - 1] == color)
+      end--;
+    if (first < end) {
+      for (uint16_t pixel = first; pixel < end; pixel++) {
+        m_canvas[pixel] = color;
+      }
+      markDirty(first, end - 1);
+    }
+  }
+
+  void Fill(const RgbColor& color)
+  {
+    Fill(0, T_PIXEL_COUNT, color);
+  }
+
+  void RotateRight(uint16_t rotationCount)
+  {
+    rotationCount %= T_PIXEL_COUNT;
+    if (rotationCount != 0) {
+      std::rotate(m_canvas, m_canvas + T_PIXEL_COUNT - rotationCount, m_canvas + T_PIXEL_COUNT);
+      markDirty(0, T_PIXEL_COUNT - 1);
+    }
+  }
+
+  // replace the whole canvas with packed r, g, b pixels, only the changed span is marked dirty
+  void SetPixels(const uint8_t* pixels)
+  {
+    static_assert(sizeof(RgbColor) == 3, "the canvas is copied as packed r, g, b bytes");
+    uint8_t* canvas = (uint8_t*)m_canvas;
+    size_t   first  = 0;
+    size_t   end    = T_PIXEL_COUNT * 3;
+    while (first < end && canvas[first] == pixels[first])
+      first++;
+    while (end > first && canvas[end - 1] == pixels[end - 1])
+      end--;
+    if (first < end) {
+      memcpy(canvas + first, pixels + first, end - first);
+      markDirty(first / 3, (end - 1) / 3);
+    }
+  }
+
+  // brightness scaling and gamma correction of the whole frame
+  void SetOutput(bool gamma, uint8_t brightness)
+  {
+    if (gamma != m_gamma || brightness != m_brightness) {
+      m_gamma      = gamma;
+      m_brightness = brightness;
+      m_identity   = !gamma && brightness == 255;
+      ColorLut::buildOutputLut(m_output_lut, m_gamma, m_brightness);
+      Invalidate();
+    }
+  }
+
+  // push every pixel again on the next Show()
+  void Invalidate()
+  {
+    markDirty(0, T_PIXEL_COUNT - 1);
+  }
+
+  bool IsDirty() const
+  {
+    return m_dirty_first <= m_dirty_last;
+  }
+
+  // convert the changed pixels and push the strip if anything changed since the last frame, returns true if it was pushed
+  bool Show()
+  {
+    if (!IsDirty()) {
+      m_frames_skipped++;
+      return false;
+    }
+    if (m_identity) {
+      for (uint16_t pixel = m_dirty_first; pixel <= m_dirty_last; pixel++) {
+        m_strip.SetPixelColor(pixel, m_canvas[pixel]);
+      }
+    } else {
+      for (uint16_t pixel = m_dirty_first; pixel <= m_dirty_last; pixel++) {
+        const RgbColor& color = m_canvas[pixel];
+        m_strip.SetPixelColor(pixel, RgbColor(m_output_lut[color.R], m_output_lut[color.G], m_output_lut[color.B]));
+      }
+    }
+    m_strip.Show();
+    resetDirty();
+    m_frames_shown++;
+    return true;
+  }
+
+  uint32_t getFramesShown() const
+  {
+    return m_frames_shown;
+  }
+  uint32_t getFramesSkipped() const
+  {
+    return m_frames_skipped;
+  }
+};
+
+#endif
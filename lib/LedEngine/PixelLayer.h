@@ -0,0 +1,107 @@
+#ifndef __pixel_layer_h__
+#define __pixel_layer_h__
+
+#include <NeoPixelBus.h>
+#include <string.h>
+
+// Canvas of one effect, composited into the frame by LayerBlend.
+//
+// It offers the drawing calls of PixelFrame, so effects render into a layer the same way, but keeps
+// no dirty range: the pixels are packed r, g, b bytes in 32 bit words so the blends can work on four
+// bytes at a time. The words past the last pixel stay zero.
+template <uint16_t T_PIXEL_COUNT>
+class PixelLayer
+{
+public:
+  static const size_t ByteCount = T_PIXEL_COUNT * 3;
+  static const size_t WordCount = (ByteCount + 3) / 4;
+
+private:
+  uint32_t m_words[WordCount];
+
+  uint8_t* bytes()
+  {
+    return (uint8_t*)m_words;
+  }
+  const uint8_t* bytes() const
+  {
+    return (const uint8_t*)m_words;
+  }
+
+public:
+  PixelLayer()
+  {
+    Clear();
+  }
+
+  uint16_t PixelCount() const
+  {
+    return T_PIXEL_COUNT;
+  }
+
+  RgbColor GetPixelColor(uint16_t indexPixel) const
+  {
+    if (indexPixel >= T_PIXEL_COUNT)
+      return RgbColor(0);
+    const uint8_t* pixel = bytes() + indexPixel * 3;
+    return RgbColor(pixel[0], pixel[1], pixel[2]);
+  }
+
+  void SetPixelColor(uint16_t indexPixel, const RgbColor& color)
+  {
+    if (indexPixel < T_PIXEL_COUNT) {
+      uint8_t* pixel = bytes() + indexPixel * 3;
+      pixel[0]       = color.R;
+      pixel[1]       = color.G;
+      pixel[2]       = color.B;
+    }
+  }
+
+  void Fill(uint16_t first, uint16_t count, const RgbColor& color)
+  {
+    uint16_t end = first + count;
+    end          = end > T_PIXEL_COUNT ? T_PIXEL_COUNT : end;
+    for (uint16_t pixel = first; pixel < end; pixel++) {
+      SetPixelColor(pixel, color);
+    }
+  }
+
+  void Fill(const RgbColor& color)
+  {
+    Fill(0, T_PIXEL_COUNT, color);
+  }
+
+  // replace every pixel with packed r, g, b bytes
+  void SetPixels(const uint8_t* pixels)
+  {
+    memcpy(bytes(), pixels, ByteCount);
+  }
+
+  void Clear()
+  {
+    memset(m_words, 0, sizeof(m_words));
+  }
+
+  void RotateRight(uint16_t rotationCount)
+  {
+    rotationCount %= T_PIXEL_COUNT;
+    if (rotationCount != 0)
+      std::rotate(bytes(), bytes() + ByteCount - rotationCount * 3, bytes() + ByteCount);
+  }
+
+  const uint32_t* getWords() const
+  {
+    return m_words;
+  }
+  uint32_t* getWords()
+  {
+    return m_words;
+  }
+  // the pixels as r, g, b bytes
+  const uint8_t* getBytes() const
+  {
+    return bytes();
+  }
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef __pixel_tweens_h__
+#define __pixel_tweens_h__
+
+#include <NeoPixelBus.h>
+
+#include "ColorLut.h"
+
+// Per pixel colour tweens kept as structure of arrays.
+//
+// This replaces one NeoPixelAnimator channel plus a capturing callback per pixel: the start and end
+// colours, start time, duration and easing of every pixel live in flat arrays and UpdateTweens()
+// advances all of them in a single integer loop, without callbacks or allocations.
+template <uint16_t T_PIXEL_COUNT>
+class PixelTweens
+{
+private:
+  RgbColor m_start_color[T_PIXEL_COUNT];
+  RgbColor m_end_color[T_PIXEL_COUNT];
+  uint32_t m_start_ms[T_PIXEL_COUNT];
+  // 0 when the pixel is not animating
+  uint16_t m_duration_ms[T_PIXEL_COUNT];
+  // 2^32 / duration so the progress needs no division
+  uint32_t m_progress_step[T_PIXEL_COUNT];
+  uint8_t  m_ease[T_PIXEL_COUNT];
+  uint16_t m_active = 0;
+
+public:
+  PixelTweens()
+  {
+    for (uint16_t pixel = 0; pixel < T_PIXEL_COUNT; pixel++) {
+      m_duration_ms[pixel] = 0;
+    }
+  }
+
+  // blend pixel from startColor to endColor over duration_ms starting at now_ms, replacing any running tween
+  void StartTween(uint16_t pixel, const RgbColor& startColor, const RgbColor& endColor, uint16_t duration_ms, TweenEase ease, uint32_t now_ms)
+  {
+    if (m_duration_ms[pixel] == 0)
+      m_active++;
+    duration_ms            = duration_ms > 0 ? duration_ms : 1;
+    m_start_color[pixel]   = startColor;
+    m_end_color[pixel]     = endColor;
+    m_start_ms[pixel]      = now_ms;
+    m_duration_ms[pixel]   = duration_ms;
+    m_progress_step[pixel] = 0xffffffffUL / duration_ms;
+    m_ease[pixel]          = ease;
+  }
+
+  void StopAll()
+  {
+    for (uint16_t pixel = 0; pixel < T_PIXEL_COUNT; pixel++) {
+      m_duration_ms[pixel] = 0;
+    }
+    m_active = 0;
+  }
+
+  bool IsAnimating() const
+  {
+    return m_active > 0;
+  }
+
+  // write the current colour of every animating pixel into frame
+  template <typename T_FRAME>
+  void UpdateTweens(T_FRAME& frame, uint32_t now_ms)
+  {
+    if (m_active == 0)
+      return;
+    for (uint16_t pixel = 0; pixel < T_PIXEL_COUNT; pixel++) {
+      uint16_t duration = m_duration_ms[pixel];
+      if (duration == 0)
+        continue;
+      uint32_t elapsed = now_ms - m_start_ms[pixel];
+      if (elapsed >= duration) {
+        // finished, land exactly on the end colour
+        frame.SetPixelColor(pixel, m_end_color[pixel]);
+        m_duration_ms[pixel] = 0;
+        m_active--;
+        continue;
+      }
+      // elapsed < duration so the product stays below 2^32
+      uint16_t progress = (elapsed * m_progress_step[pixel]) >> 16;
+      uint16_t weight   = (ColorLut::ease(m_ease[pixel], progress) + 128) >> 8;
+      frame.SetPixelColor(pixel, ColorLut::blend(m_start_color[pixel], m_end_color[pixel], weight));
+    }
+  }
+};
+
+#endif
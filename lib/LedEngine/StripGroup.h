@@ -0,0 +1,110 @@
+#ifndef __strip_group_h__
+#define __strip_group_h__
+
+#include <NeoPixelBus.h>
+#include <new>
+
+// One logical strip made of several physical strips, each on its own pin.
+//
+// The effects render once into a canvas of the total length and the group spreads it over the
+// strips: strip n shows canvas pixels [n * T_STRIP_LENGTH, (n + 1) * T_STRIP_LENGTH), reversed for the
+// strips that are mounted the other way round. Show() hands every strip its frame before returning.
+// With a parallel method (NeoEsp32I2s0X8Ws2812xMethod drives up to 8 pins from one DMA stream, the
+// RMT methods send every channel in the background) the strips go out at the same time, so a frame
+// takes as long as one strip instead of all of them.
+template <typename T_STRIP, uint8_t T_STRIP_COUNT, uint16_t T_STRIP_LENGTH>
+class StripGroup
+{
+private:
+  // the strips are constructed in place, only their pixel buffers come from the heap, once at boot
+  alignas(T_STRIP) uint8_t m_storage[T_STRIP_COUNT][sizeof(T_STRIP)];
+  T_STRIP*                 m_strips[T_STRIP_COUNT];
+  bool                     m_reversed[T_STRIP_COUNT];
+
+public:
+  // pins[n] drives strip n, reversed may be NULL when every strip starts at its pin
+  StripGroup(const uint8_t* pins, const bool* reversed = NULL)
+  {
+    for (uint8_t strip = 0; strip < T_STRIP_COUNT; strip++) {
+      m_strips[strip]   = new (m_storage[strip]) T_STRIP(T_STRIP_LENGTH, pins[strip]);
+      m_reversed[strip] = reversed != NULL && reversed[strip];
+    }
+  }
+
+  void Begin()
+  {
+    for (uint8_t strip = 0; strip < T_STRIP_COUNT; strip++) {
+      m_strips[strip]->Begin();
+    }
+  }
+
+  // the parallel methods only start sending once every strip of the group has been shown
+  void Show()
+  {
+    for (uint8_t strip = 0; strip < T_STRIP_COUNT; strip++) {
+      m_strips[strip]->Show();
+    }
+  }
+
+  bool CanShow() const
+  {
+    for (uint8_t strip = 0; strip < T_STRIP_COUNT; strip++) {
+      if (!m_strips[strip]->CanShow())
+        return false;
+    }
+    return true;
+  }
+
+  uint16_t PixelCount() const
+  {
+    return T_STRIP_COUNT * T_STRIP_LENGTH;
+  }
+
+  void SetPixelColor(uint16_t indexPixel, const RgbColor& color)
+  {
+    uint8_t  strip = indexPixel / T_STRIP_LENGTH;
+    uint16_t pixel = indexPixel % T_STRIP_LENGTH;
+    if (strip < T_STRIP_COUNT)
+      m_strips[strip]->SetPixelColor(m_reversed[strip] ? T_STRIP_LENGTH - 1 - pixel : pixel, color);
+  }
+
+  // copy a whole canvas, one strip at a time without the per pixel division
+  void SetPixelColors(const RgbColor* canvas)
+  {
+    for (uint8_t strip = 0; strip < T_STRIP_COUNT; strip++, canvas += T_STRIP_LENGTH) {
+      T_STRIP& output = *m_strips[strip];
+      if (m_reversed[strip]) {
+        for (uint16_t pixel = 0; pixel < T_STRIP_LENGTH; pixel++) {
+          output.SetPixelColor(T_STRIP_LENGTH - 1 - pixel, canvas[pixel]);
+        }
+      }
+      else {
+        for (uint16_t pixel = 0; pixel < T_STRIP_LENGTH; pixel++) {
+          output.SetPixelColor(pixel, canvas[pixel]);
+        }
+      }
+    }
+  }
+
+  T_STRIP& getStrip(uint8_t strip)
+  {
+    return *m_strips[strip];
+  }
+};
+
+// copy a frame of count pixels to a strip, used by StripTransmitter
+template <typename T_STRIP>
+void copyFrameToStrip(T_STRIP& strip, const RgbColor* frame, uint16_t count)
+{
+  for (uint16_t pixel = 0; pixel < count; pixel++) {
+    strip.SetPixelColor(pixel, frame[pixel]);
+  }
+}
+
+template <typename T_STRIP, uint8_t T_STRIP_COUNT, uint16_t T_STRIP_LENGTH>
+void copyFrameToStrip(StripGroup<T_STRIP, T_STRIP_COUNT, T_STRIP_LENGTH>& group, const RgbColor* frame, uint16_t count)
+{
+  group.SetPixelColors(frame);
+}
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef __strip_transmitter_h__
+#define __strip_transmitter_h__
+
+#include <Arduino.h>
+#include <NeoPixelBus.h>
+
+#include "FrameExchange.h"
+#include "StripGroup.h"
+#include "Telemetry.h"
+
+// Transmit stage of the render pipeline.
+//
+// The render task draws into the staging buffer through SetPixelColor() and Show() publishes it
+// through a lock-free triple buffer. A separate task, pinned to its own core, takes the newest frame
+// and pushes it to the strip, so the render task can compute frame N+1 while frame N is still on the
+// wire. It looks like a strip to PixelFrame, so the effects do not know about the pipeline.
+template <typename T_STRIP, uint16_t T_PIXEL_COUNT>
+class StripTransmitter
+{
+public:
+  // stack of the transmit task in bytes
+  static const uint32_t StackSize = 2048;
+
+private:
+  T_STRIP& m_strip;
+  // pixels written by the render task, kept between frames so partial updates accumulate
+  RgbColor                                m_staging[T_PIXEL_COUNT];
+  FrameExchange<RgbColor, T_PIXEL_COUNT> m_exchange;
+  TaskHandle_t                            m_task_handle = NULL;
+  StackType_t                             m_stack[StackSize];
+  StaticTask_t                            m_tcb;
+  // statistics, the counters are written by one task each
+  volatile uint32_t m_frames_published = 0;
+  volatile uint32_t m_frames_dropped   = 0;
+  volatile uint32_t m_frames_sent      = 0;
+  volatile uint32_t m_wait_us          = 0;
+  volatile uint32_t m_show_us          = 0;
+  uint32_t          m_stats_start_ms   = 0;
+
+  static void transmitTask(void* param)
+  {
+    StripTransmitter* transmitter = (StripTransmitter*)param;
+    // initialise the output from this task so its interrupt lands on the transmit core
+    transmitter->m_strip.Begin();
+    transmitter->m_strip.Show();
+    while (true) {
+      uint32_t start = micros();
+      while (!transmitter->m_exchange.acquire()) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      }
+      uint32_t        ready = micros();
+      TELEMETRY_SCOPE_STATIC("strip.show");
+      copyFrameToStrip(transmitter->m_strip, transmitter->m_exchange.front(), T_PIXEL_COUNT);
+      transmitter->m_strip.Show();
+      transmitter->m_wait_us += ready - start;
+      transmitter->m_show_us += micros() - ready;
+      transmitter->m_frames_sent++;
+    }
+  }
+
+public:
+  StripTransmitter(T_STRIP& strip) : m_strip(strip)
+  {
+    for (uint16_t pixel = 0; pixel < T_PIXEL_COUNT; pixel++) {
+      m_staging[pixel] = RgbColor(0);
+    }
+  }
+
+  // start the transmit task on core
+  bool start(BaseType_t core, UBaseType_t priority)
+  {
+    m_stats_start_ms = millis();
+    m_task_handle = xTaskCreateStaticPinnedToCore(transmitTask, "Strip Transmit Task", StackSize, this, priority, m_stack, &m_tcb, core);
+    return m_task_handle != NULL;
+  }
+
+  TaskHandle_t getTaskHandle() const
+  {
+    return m_task_handle;
+  }
+
+  uint16_t PixelCount() const
+  {
+    return T_PIXEL_COUNT;
+  }
+
+  void SetPixelColor(uint16_t indexPixel, const RgbColor& color)
+  {
+    m_staging[indexPixel] = color;
+  }
+
+  // hand the staged frame to the transmit task, never blocks
+  void Show()
+  {
+    memcpy(m_exchange.back(), m_staging, sizeof(m_staging));
+    if (m_exchange.publish())
+      m_frames_dropped++;
+    m_frames_published++;
+    if (m_task_handle != NULL)
+      xTaskNotifyGive(m_task_handle);
+  }
+
+  uint32_t getFramesPublished() const
+  {
+    return m_frames_published;
+  }
+  // frames replaced by a newer one before the transmit task got to them
+  uint32_t getFramesDropped() const
+  {
+    return m_frames_dropped;
+  }
+  uint32_t getFramesSent() const
+  {
+    return m_frames_sent;
+  }
+  // frames pushed to the strip per second since the last reset
+  float getFps() const
+  {
+    uint32_t elapsed = millis() - m_stats_start_ms;
+    return elapsed > 0 ? m_frames_sent * 1000.0f / elapsed : 0.0f;
+  }
+  // time the transmit task spent waiting for a frame and pushing frames
+  uint32_t getWaitUs() const
+  {
+    return m_wait_us;
+  }
+  uint32_t getShowUs() const
+  {
+    return m_show_us;
+  }
+  // percent of the time since the last reset the transmit task spent pushing frames
+  float getLoad() const
+  {
+    uint32_t elapsed = millis() - m_stats_start_ms;
+    return elapsed > 0 ? m_show_us / (elapsed * 10.0f) : 0.0f;
+  }
+  void resetStats()
+  {
+    m_frames_published = 0;
+    m_frames_dropped   = 0;
+    m_frames_sent      = 0;
+    m_wait_us          = 0;
+    m_show_us          = 0;
+    m_stats_start_ms   = millis();
+  }
+};
+
+#endif
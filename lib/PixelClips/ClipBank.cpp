@@ -0,0 +1,57 @@
+#include "ClipBank.h"
+
+bool ClipBank::begin(const char* label)
+{
+  end();
+  const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, label);
+  if (partition == NULL)
+    return false;
+  const void* data;
+  if (esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &data, &m_handle) != ESP_OK)
+    return false;
+  if (!begin((const uint8_t*)data, partition->size)) {
+    spi_flash_munmap(m_handle);
+    m_handle = 0;
+    return false;
+  }
+  return true;
+}
+
+bool ClipBank::begin(const uint8_t* data, size_t size)
+{
+  if (size < ClipBankHeaderSize)
+    return false;
+  for (int index = 0; index < 4; index++) {
+    if (data[index] != ClipBankMagic[index])
+      return false;
+  }
+  uint16_t count = clipReadU16(data + 6);
+  if (clipReadU16(data + 4) != ClipBankVersion || ClipBankHeaderSize + count * 8 > size)
+    return false;
+  m_data       = data;
+  m_size       = size;
+  m_clip_count = count;
+  return true;
+}
+
+void ClipBank::end()
+{
+  if (m_handle != 0)
+    spi_flash_munmap(m_handle);
+  m_handle     = 0;
+  m_data       = nullptr;
+  m_size       = 0;
+  m_clip_count = 0;
+}
+
+bool ClipBank::getClip(uint16_t index, PixelClip& clip) const
+{
+  if (index >= m_clip_count)
+    return false;
+  const uint8_t* entry  = m_data + ClipBankHeaderSize + index * 8;
+  uint32_t       offset = clipReadU32(entry);
+  uint32_t       size   = clipReadU32(entry + 4);
+  if (offset > m_size || size > m_size - offset)
+    return false;
+  return clip.open(m_data + offset, size);
+}
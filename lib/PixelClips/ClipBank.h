@@ -0,0 +1,34 @@
+#ifndef __clip_bank_h__
+#define __clip_bank_h__
+
+#include <esp_partition.h>
+
+#include "PixelClip.h"
+
+// Clips stored in a data partition and read through a memory mapping, so playing a clip copies
+// nothing into RAM. The bank is written raw to the partition, see tools/clip_encoder.cpp.
+class ClipBank
+{
+private:
+  const uint8_t*          m_data       = nullptr;
+  size_t                  m_size       = 0;
+  uint16_t                m_clip_count = 0;
+  spi_flash_mmap_handle_t m_handle     = 0;
+
+public:
+  // map the first data partition of subtype spiffs (the one min_spiffs.csv reserves) or the one
+  // named label, false if there is no partition or it does not hold a bank
+  bool begin(const char* label = NULL);
+  // use a bank that is already in memory
+  bool begin(const uint8_t* data, size_t size);
+  void end();
+
+  uint16_t getClipCount() const
+  {
+    return m_clip_count;
+  }
+  // view of clip index, false if it is missing or damaged
+  bool getClip(uint16_t index, PixelClip& clip) const;
+};
+
+#endif
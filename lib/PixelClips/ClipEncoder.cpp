@@ -0,0 +1,117 @@
+#include "ClipEncoder.h"
+
+#include <stdlib.h>
+
+static void appendU16(std::vector<uint8_t>& data, uint16_t value)
+{
+  data.push_back(value & 0xff);
+  data.push_back(value >> 8);
+}
+
+static void appendU32(std::vector<uint8_t>& data, uint32_t value)
+{
+  appendU16(data, value & 0xffff);
+  appendU16(data, value >> 16);
+}
+
+void ClipEncoder::begin(uint16_t pixel_count, uint8_t fps, uint8_t repeat, uint8_t tolerance)
+{
+  m_pixel_count = pixel_count;
+  m_frame_count = 0;
+  m_tolerance   = tolerance;
+  m_decoded.assign(pixel_count * 3, 0);
+  m_data.assign(ClipMagic, ClipMagic + 4);
+  appendU16(m_data, pixel_count);
+  appendU16(m_data, 0); // frame count, filled in by addFrame()
+  m_data.push_back(fps);
+  m_data.push_back(repeat);
+  appendU16(m_data, 0);
+}
+
+bool ClipEncoder::isUnchanged(const uint8_t* rgb, uint16_t pixel) const
+{
+  // the first frame is a key frame that never skips
+  if (m_frame_count == 0)
+    return false;
+  for (int channel = 0; channel < 3; channel++) {
+    if (abs(rgb[pixel * 3 + channel] - m_decoded[pixel * 3 + channel]) > m_tolerance)
+      return false;
+  }
+  return true;
+}
+
+bool ClipEncoder::isSame(const uint8_t* rgb, uint16_t first, uint16_t second) const
+{
+  return rgb[first * 3] == rgb[second * 3] && rgb[first * 3 + 1] == rgb[second * 3 + 1] && rgb[first * 3 + 2] == rgb[second * 3 + 2];
+}
+
+void ClipEncoder::keep(const uint8_t* rgb, uint16_t first, uint16_t count)
+{
+  for (int index = first * 3; index < (first + count) * 3; index++) {
+    m_decoded[index] = rgb[index];
+  }
+}
+
+bool ClipEncoder::addFrame(const uint8_t* rgb)
+{
+  if (m_frame_count == 0xffff)
+    return false;
+  uint16_t pixel = 0;
+  while (pixel < m_pixel_count) {
+    uint16_t left = m_pixel_count - pixel < ClipOpMaxPixels ? m_pixel_count - pixel : ClipOpMaxPixels;
+
+    // pixels the previous frame already has
+    uint16_t count = 0;
+    while (count < left && isUnchanged(rgb, pixel + count))
+      count++;
+    if (count > 0) {
+      m_data.push_back(ClipOp_Skip | (count - 1));
+      pixel += count;
+      continue;
+    }
+
+    // a colour repeated over two pixels or more is cheaper as a run
+    count = 1;
+    while (count < left && isSame(rgb, pixel, pixel + count))
+      count++;
+    if (count >= 2) {
+      m_data.push_back(ClipOp_Run | (count - 1));
+      m_data.insert(m_data.end(), rgb + pixel * 3, rgb + pixel * 3 + 3);
+      keep(rgb, pixel, count);
+      pixel += count;
+      continue;
+    }
+
+    // literal colours up to the next unchanged pixel or run of three
+    count = 1;
+    while (count < left && !isUnchanged(rgb, pixel + count) &&
+           !(count + 2 < left && isSame(rgb, pixel + count, pixel + count + 1) && isSame(rgb, pixel + count, pixel + count + 2)))
+      count++;
+    m_data.push_back(ClipOp_Literal | (count - 1));
+    m_data.insert(m_data.end(), rgb + pixel * 3, rgb + (pixel + count) * 3);
+    keep(rgb, pixel, count);
+    pixel += count;
+  }
+  m_data.push_back(ClipOp_End);
+  m_frame_count++;
+  m_data[6] = m_frame_count & 0xff;
+  m_data[7] = m_frame_count >> 8;
+  return true;
+}
+
+std::vector<uint8_t> buildClipBank(const std::vector<std::vector<uint8_t>>& clips)
+{
+  std::vector<uint8_t> bank(ClipBankMagic, ClipBankMagic + 4);
+  appendU16(bank, ClipBankVersion);
+  appendU16(bank, clips.size());
+  uint32_t offset = ClipBankHeaderSize + clips.size() * 8;
+  for (const std::vector<uint8_t>& clip : clips) {
+    appendU32(bank, offset);
+    appendU32(bank, clip.size());
+    offset += clip.size();
+  }
+  for (const std::vector<uint8_t>& clip : clips) {
+    bank.insert(bank.end(), clip.begin(), clip.end());
+  }
+  return bank;
+}
@@ -0,0 +1,45 @@
+#ifndef __clip_encoder_h__
+#define __clip_encoder_h__
+
+#include <stdint.h>
+#include <vector>
+
+#include "PixelClip.h"
+
+// Builds clips in the format of PixelClip.h from full RGB frames, used by tools/clip_encoder.cpp and
+// the host runner. Each frame is stored as the ops that turn the previous decoded frame into it:
+// unchanged pixels are skipped, repeated colours become runs and the rest is stored literally.
+class ClipEncoder
+{
+private:
+  std::vector<uint8_t> m_data;
+  // the frame as the player will have decoded it, r, g, b per pixel
+  std::vector<uint8_t> m_decoded;
+  uint16_t             m_pixel_count = 0;
+  uint16_t             m_frame_count = 0;
+  uint8_t              m_tolerance   = 0;
+
+  bool isUnchanged(const uint8_t* rgb, uint16_t pixel) const;
+  bool isSame(const uint8_t* rgb, uint16_t first, uint16_t second) const;
+  void keep(const uint8_t* rgb, uint16_t first, uint16_t count);
+
+public:
+  // tolerance is the largest difference per channel that still counts as unchanged, 0 is lossless
+  void begin(uint16_t pixel_count, uint8_t fps, uint8_t repeat, uint8_t tolerance = 0);
+  // append a frame of pixel_count r, g, b triples, false once the clip holds 65535 frames
+  bool addFrame(const uint8_t* rgb);
+  uint16_t getFrameCount() const
+  {
+    return m_frame_count;
+  }
+  // the encoded clip
+  const std::vector<uint8_t>& getData() const
+  {
+    return m_data;
+  }
+};
+
+// put encoded clips together into a bank for ClipBank
+std::vector<uint8_t> buildClipBank(const std::vector<std::vector<uint8_t>>& clips);
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef __clip_player_h__
+#define __clip_player_h__
+
+#include <NeoPixelBus.h>
+
+#include "PixelClip.h"
+
+// Decodes a clip frame by frame straight into a strip or frame.
+//
+// T_TARGET needs PixelCount() and SetPixelColor(index, RgbColor). Skipped pixels are not touched, so
+// with a PixelFrame only the pixels that changed end up in the dirty range. Pixels beyond the end of
+// the target are dropped and a target longer than the clip keeps its extra pixels.
+template <typename T_TARGET>
+class ClipPlayer
+{
+private:
+  PixelClip      m_clip;
+  const uint8_t* m_cursor = nullptr;
+  uint16_t       m_frame  = 0;
+  uint16_t       m_plays  = 0;
+
+public:
+  void start(const PixelClip& clip)
+  {
+    m_clip   = clip;
+    m_cursor = clip.isOpen() ? clip.getFrames() : nullptr;
+    m_frame  = 0;
+    m_plays  = 0;
+  }
+
+  // decode the next frame into target, false once the clip has played its repeats or if it is corrupt
+  bool nextFrame(T_TARGET& target)
+  {
+    if (m_cursor == nullptr)
+      return false;
+    if (m_frame == m_clip.getFrameCount()) {
+      m_plays++;
+      if (m_clip.getRepeat() != 0 && m_plays >= m_clip.getRepeat()) {
+        m_cursor = nullptr;
+        return false;
+      }
+      m_cursor = m_clip.getFrames();
+      m_frame  = 0;
+    }
+    if (!decodeFrame(target)) {
+      m_cursor = nullptr;
+      return false;
+    }
+    m_frame++;
+    return true;
+  }
+
+  // frames from the next one on that leave the target as it is, up to limit and the end of the clip,
+  // so a player can sleep through them
+  uint16_t countUnchangedFrames(uint16_t limit) const
+  {
+    if (m_cursor == nullptr)
+      return 0;
+    const uint8_t* cursor = m_cursor;
+    const uint8_t* end    = m_clip.getEnd();
+    uint16_t       frames = 0;
+    while (frames < limit && m_frame + frames < m_clip.getFrameCount() && cursor < end) {
+      uint8_t op = *cursor++ & ClipOpMask;
+      if (op == ClipOp_End)
+        frames++;
+      else if (op != ClipOp_Skip)
+        break;
+    }
+    return frames;
+  }
+
+  bool isPlaying() const
+  {
+    return m_cursor != nullptr;
+  }
+  uint16_t getFrame() const
+  {
+    return m_frame;
+  }
+
+private:
+  bool decodeFrame(T_TARGET& target)
+  {
+    const uint8_t* cursor = m_cursor;
+    const uint8_t* end    = m_clip.getEnd();
+    uint16_t       pixels = m_clip.getPixelCount();
+    uint16_t       limit  = target.PixelCount() < pixels ? target.PixelCount() : pixels;
+    uint16_t       pixel  = 0;
+    while (cursor < end) {
+      uint8_t op    = *cursor++;
+      uint8_t count = (op & ~ClipOpMask) + 1;
+      switch (op & ClipOpMask) {
+        case ClipOp_End:
+          m_cursor = cursor;
+          return true;
+        case ClipOp_Skip:
+          break;
+        case ClipOp_Run: {
+          if (end - cursor < 3)
+            return false;
+          RgbColor color(cursor[0], cursor[1], cursor[2]);
+          cursor += 3;
+          for (uint16_t index = pixel; index < pixel + count && index < limit; index++) {
+            target.SetPixelColor(index, color);
+          }
+          break;
+        }
+        default: {
+          if (end - cursor < 3 * count)
+            return false;
+          for (uint16_t index = pixel; index < pixel + count; index++, cursor += 3) {
+            if (index < limit)
+              target.SetPixelColor(index, RgbColor(cursor[0], cursor[1], cursor[2]));
+          }
+          break;
+        }
+      }
+      pixel += count;
+      if (pixel > pixels)
+        return false;
+    }
+    // ran off the end of the clip without an end op
+    return false;
+  }
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef __pixel_clip_h__
+#define __pixel_clip_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pre-rendered pixel animation, played back from memory mapped flash.
+//
+// A clip is a 12 byte header followed by its frames, little endian:
+//   "CLIP", pixel count (u16), frame count (u16), fps (u8), repeat count (u8, 0 = forever), reserved (u16)
+// Every frame is a list of ops that rewrite the previous frame, ended by ClipOp_End. The low six bits
+// of an op byte hold its pixel count minus one:
+//   ClipOp_Skip    keep the next n pixels as they are
+//   ClipOp_Run     the next 3 bytes (r, g, b) are repeated over n pixels
+//   ClipOp_Literal n colours of 3 bytes follow
+// The first frame never skips, so it decodes over anything and the clip can restart from it.
+//
+// Clips are stored together in a bank: "CLPB", version (u16), clip count (u16), then an offset and
+// size (u32 each, from the start of the bank) for every clip.
+enum ClipOp
+{
+  ClipOp_Skip    = 0x00,
+  ClipOp_Run     = 0x40,
+  ClipOp_Literal = 0x80,
+  ClipOp_End     = 0xc0
+};
+
+const uint8_t  ClipOpMask         = 0xc0;
+const uint8_t  ClipOpMaxPixels    = 64;
+const size_t   ClipHeaderSize     = 12;
+const uint8_t  ClipMagic[4]       = {'C', 'L', 'I', 'P'};
+const uint8_t  ClipBankMagic[4]   = {'C', 'L', 'P', 'B'};
+const uint16_t ClipBankVersion    = 1;
+const size_t   ClipBankHeaderSize = 8;
+
+static inline uint16_t clipReadU16(const uint8_t* data)
+{
+  return data[0] | (data[1] << 8);
+}
+
+static inline uint32_t clipReadU32(const uint8_t* data)
+{
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// read-only view of an encoded clip, the data is used in place and never copied
+class PixelClip
+{
+private:
+  const uint8_t* m_data        = nullptr;
+  size_t         m_size        = 0;
+  uint16_t       m_pixel_count = 0;
+  uint16_t       m_frame_count = 0;
+  uint8_t        m_fps         = 0;
+  uint8_t        m_repeat      = 0;
+
+public:
+  // check the header, false if data does not hold a clip
+  bool open(const uint8_t* data, size_t size)
+  {
+    m_data = nullptr;
+    if (data == nullptr || size < ClipHeaderSize)
+      return false;
+    for (int index = 0; index < 4; index++) {
+      if (data[index] != ClipMagic[index])
+        return false;
+    }
+    m_pixel_count = clipReadU16(data + 4);
+    m_frame_count = clipReadU16(data + 6);
+    m_fps         = data[8];
+    m_repeat      = data[9];
+    if (m_pixel_count == 0 || m_frame_count == 0 || m_fps == 0)
+      return false;
+    m_data = data;
+    m_size = size;
+    return true;
+  }
+
+  bool isOpen() const
+  {
+    return m_data != nullptr;
+  }
+  uint16_t getPixelCount() const
+  {
+    return m_pixel_count;
+  }
+  uint16_t getFrameCount() const
+  {
+    return m_frame_count;
+  }
+  uint8_t getFps() const
+  {
+    return m_fps;
+  }
+  // number of times the clip plays before the next one, 0 repeats it forever
+  uint8_t getRepeat() const
+  {
+    return m_repeat;
+  }
+  const uint8_t* getFrames() const
+  {
+    return m_data + ClipHeaderSize;
+  }
+  const uint8_t* getEnd() const
+  {
+    return m_data + m_size;
+  }
+};
+
+#endif
@@ -0,0 +1,36 @@
+#include <string.h>
+
+#include "AudioCapture.h"
+
+static void writeUint16(uint8_t* data, uint16_t value)
+{
+  data[0] = value;
+  data[1] = value >> 8;
+}
+
+static void writeUint32(uint8_t* data, uint32_t value)
+{
+  writeUint16(data, value);
+  writeUint16(data + 2, value >> 16);
+}
+
+bool AudioCapture::send(const int16_t* samples, uint16_t count, uint32_t sequence, uint32_t time_ms)
+{
+  if ((size_t)Serial.availableForWrite() < getBlockBytes(count)) {
+    m_blocks_dropped++;
+    return false;
+  }
+  // the payload is built where encode() expects it, the samples are little endian like the ESP32
+  uint8_t* payload = m_message + 4;
+  for (uint16_t first = 0; first < count; first += MaxChunkSamples) {
+    uint16_t chunk = count - first < MaxChunkSamples ? count - first : MaxChunkSamples;
+    writeUint32(payload, sequence);
+    writeUint32(payload + 4, time_ms);
+    writeUint16(payload + 8, first);
+    writeUint16(payload + 10, count);
+    memcpy(payload + HeaderSize, samples + first, chunk * sizeof(int16_t));
+    Serial.write(m_message, ControlProtocol::encode(ControlMessage_AudioBlock, payload, HeaderSize + chunk * sizeof(int16_t), m_message));
+  }
+  m_blocks_sent++;
+  return true;
+}
@@ -0,0 +1,47 @@
+#ifndef __audio_capture_h__
+#define __audio_capture_h__
+
+#include <Arduino.h>
+
+#include "ControlProtocol.h"
+
+// Audio blocks streamed out over Serial as AudioBlock messages, for recording on a host.
+//
+// A block goes out as a few messages of at most MaxChunkSamples samples, each carrying the block's
+// sequence number and time so a recording shows where blocks are missing. The samples are copied
+// once, straight into the message buffer, and the whole block is dropped when the Serial transmit
+// buffer has no room for it, so the writer task never waits on the UART. Undecimated blocks of 1024
+// samples at 44.1 kHz take ~91 KB/s including the framing, just under the 92 KB/s of 921600 baud,
+// the default 11 kHz a quarter of that.
+class AudioCapture
+{
+private:
+  static const uint16_t HeaderSize      = ControlProtocol::AudioHeaderSize;
+  static const uint16_t MaxChunkSamples = ControlProtocol::MaxChunkSamples;
+
+  uint8_t  m_message[ControlProtocol::MaxPayload + ControlProtocol::Overhead];
+  uint32_t m_blocks_sent    = 0;
+  uint32_t m_blocks_dropped = 0;
+
+public:
+  // bytes on the wire for a block of count samples
+  static size_t getBlockBytes(uint16_t count)
+  {
+    uint16_t chunks = (count + MaxChunkSamples - 1) / MaxChunkSamples;
+    return count * sizeof(int16_t) + chunks * (HeaderSize + ControlProtocol::Overhead);
+  }
+
+  // send a block of count samples, false if Serial had no room for all of it and nothing was sent
+  bool send(const int16_t* samples, uint16_t count, uint32_t sequence, uint32_t time_ms);
+
+  uint32_t getBlocksSent() const
+  {
+    return m_blocks_sent;
+  }
+  uint32_t getBlocksDropped() const
+  {
+    return m_blocks_dropped;
+  }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include <string.h>
+
+#include "AudioCaptureReader.h"
+
+static uint32_t readUint32(const uint8_t* data)
+{
+  return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint16_t readUint16(const uint8_t* data)
+{
+  return data[0] | data[1] << 8;
+}
+
+void AudioCaptureReader::addChunk(const uint8_t* payload, uint16_t length)
+{
+  if (length < ControlProtocol::AudioHeaderSize || (length - ControlProtocol::AudioHeaderSize) % sizeof(int16_t) != 0)
+    return;
+  uint32_t sequence = readUint32(payload);
+  uint32_t time_ms  = readUint32(payload + 4);
+  uint16_t first    = readUint16(payload + 8);
+  uint16_t size     = readUint16(payload + 10);
+  uint16_t count    = (length - ControlProtocol::AudioHeaderSize) / sizeof(int16_t);
+  if (!m_started) {
+    if (size == 0)
+      return;
+    m_started        = true;
+    m_block_size     = size;
+    m_first_sequence = sequence;
+    m_first_time_ms  = time_ms;
+    m_last_sequence  = sequence;
+  }
+  // chunks from before the first block or of another block size do not fit the recording
+  if (size != m_block_size || (int32_t)(sequence - m_first_sequence) < 0 || first + count > size)
+    return;
+  size_t start = (size_t)(sequence - m_first_sequence) * size + first;
+  if (m_samples.size() < start + count)
+    m_samples.resize((size_t)(sequence - m_first_sequence + 1) * size, 0);
+  memcpy(&m_samples[start], payload + ControlProtocol::AudioHeaderSize, count * sizeof(int16_t));
+  if (first + count == size)
+    m_blocks++;
+  if ((int32_t)(sequence - m_last_sequence) > 0)
+    m_last_sequence = sequence;
+}
+
+void AudioCaptureReader::feed(const uint8_t* data, size_t size)
+{
+  while (size > 0 || m_parser.hasMessage()) {
+    size_t used = m_parser.feed(data, size);
+    data += used;
+    size -= used;
+    if (m_parser.hasMessage() && m_parser.getType() == ControlMessage_AudioBlock)
+      addChunk(m_parser.getPayload(), m_parser.getLength());
+  }
+}
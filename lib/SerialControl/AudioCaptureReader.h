@@ -0,0 +1,63 @@
+#ifndef __audio_capture_reader_h__
+#define __audio_capture_reader_h__
+
+#include <stdint.h>
+#include <vector>
+
+#include "ControlProtocol.h"
+
+// Rebuilds the audio from a capture, the raw bytes the firmware sent over Serial while capturing.
+// Used by tools/audio_capture.cpp and the host runner.
+//
+// The samples are placed by sequence number from the first block received, so blocks that were
+// dropped or lost to a bad crc stay silent and the recording keeps its timing. Everything else on
+// the line, text output and other messages, is skipped.
+class AudioCaptureReader
+{
+private:
+  ControlParser        m_parser;
+  std::vector<int16_t> m_samples;
+  uint16_t             m_block_size     = 0;
+  uint32_t             m_first_sequence = 0;
+  uint32_t             m_first_time_ms  = 0;
+  uint32_t             m_blocks         = 0;
+  uint32_t             m_last_sequence  = 0;
+  bool                 m_started        = false;
+
+  void addChunk(const uint8_t* payload, uint16_t length);
+
+public:
+  // parse the next bytes of the capture
+  void feed(const uint8_t* data, size_t size);
+
+  // samples from the first block received to the last, silence where blocks are missing
+  const std::vector<int16_t>& getSamples() const
+  {
+    return m_samples;
+  }
+  uint16_t getBlockSize() const
+  {
+    return m_block_size;
+  }
+  // millis() at the end of the first block
+  uint32_t getFirstTimeMs() const
+  {
+    return m_first_time_ms;
+  }
+  // blocks whose last chunk arrived
+  uint32_t getBlocks() const
+  {
+    return m_blocks;
+  }
+  // blocks between the first and the last one that never completed
+  uint32_t getMissingBlocks() const
+  {
+    return m_started ? m_last_sequence - m_first_sequence + 1 - m_blocks : 0;
+  }
+  uint32_t getCrcErrors() const
+  {
+    return m_parser.getCrcErrors();
+  }
+};
+
+#endif
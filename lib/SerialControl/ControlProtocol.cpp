@@ -0,0 +1,158 @@
+#include <string.h>
+
+#include "ControlProtocol.h"
+
+// CRC-16/CCITT-FALSE a nibble at a time, 32 bytes of table instead of 512
+static const uint16_t CrcNibbles[16] = {0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+                                        0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef};
+
+uint16_t ControlProtocol::crc16(uint16_t crc, const uint8_t* data, size_t size)
+{
+  for (size_t index = 0; index < size; index++) {
+    crc = (crc << 4) ^ CrcNibbles[(crc >> 12) ^ (data[index] >> 4)];
+    crc = (crc << 4) ^ CrcNibbles[(crc >> 12) ^ (data[index] & 0x0f)];
+  }
+  return crc;
+}
+
+uint16_t ControlProtocol::maxLength(uint8_t type)
+{
+  switch (type) {
+    case ControlMessage_SetParam:
+      return 5;
+    case ControlMessage_Program:
+    case ControlMessage_Capture:
+      return 1;
+    case ControlMessage_Pixels:
+      return 2 + MaxChunkPixels * 3;
+    case ControlMessage_Status:
+      return 0;
+    case ControlMessage_Ack:
+      return 2;
+    case ControlMessage_AudioBlock:
+      return AudioHeaderSize + MaxChunkSamples * 2;
+    default:
+      // StatusReply is the longest fixed size message
+      return 12;
+  }
+}
+
+size_t ControlProtocol::encode(uint8_t type, const uint8_t* payload, uint16_t size, uint8_t* out)
+{
+  out[0] = StartByte;
+  out[1] = type;
+  out[2] = size & 0xff;
+  out[3] = size >> 8;
+  memmove(out + 4, payload, size);
+  uint16_t crc    = crc16(0xffff, out + 1, size + 3);
+  out[4 + size]   = crc & 0xff;
+  out[5 + size]   = crc >> 8;
+  return size + Overhead;
+}
+
+size_t ControlParser::parse(const uint8_t* data, size_t size)
+{
+  size_t used = 0;
+  while (used < size && !m_complete && !m_false_start) {
+    uint8_t byte = data[used];
+    switch (m_state) {
+      case State_Start:
+        if (byte == ControlProtocol::StartByte) {
+          m_state      = State_Type;
+          m_crc        = 0xffff;
+          m_frame_size = 0;
+        }
+        else
+          m_skipped++;
+        used++;
+        break;
+      case State_Type:
+        m_type                  = byte;
+        m_frame[m_frame_size++] = byte;
+        m_state                 = State_Length0;
+        used++;
+        break;
+      case State_Length0:
+        m_length                = byte;
+        m_frame[m_frame_size++] = byte;
+        m_state                 = State_Length1;
+        used++;
+        break;
+      case State_Length1:
+        m_length |= byte << 8;
+        m_frame[m_frame_size++] = byte;
+        used++;
+        if (m_length > ControlProtocol::maxLength(m_type)) {
+          // cannot be a frame of ours
+          m_crc_errors++;
+          m_false_start = true;
+        }
+        else {
+          m_crc   = ControlProtocol::crc16(m_crc, m_frame, PayloadOffset);
+          m_state = m_length > 0 ? State_Payload : State_Crc0;
+        }
+        break;
+      case State_Payload: {
+        // the payload is copied in blocks, this is where the pixels go through
+        size_t left  = PayloadOffset + m_length - m_frame_size;
+        size_t count = size - used < left ? size - used : left;
+        memcpy(m_frame + m_frame_size, data + used, count);
+        m_crc = ControlProtocol::crc16(m_crc, data + used, count);
+        m_frame_size += count;
+        used += count;
+        if (count == left)
+          m_state = State_Crc0;
+        break;
+      }
+      case State_Crc0:
+        m_frame[m_frame_size++] = byte;
+        m_state                 = State_Crc1;
+        used++;
+        break;
+      case State_Crc1:
+        m_frame[m_frame_size++] = byte;
+        used++;
+        if ((m_frame[m_frame_size - 2] | byte << 8) == m_crc) {
+          m_messages++;
+          m_complete = true;
+          m_state    = State_Start;
+        }
+        else {
+          m_crc_errors++;
+          m_false_start = true;
+        }
+        break;
+    }
+  }
+  return used;
+}
+
+void ControlParser::rescan()
+{
+  // the rejected frame started before what is left, so both fit where the frame was
+  uint16_t left = m_rescan_size - m_rescan_used;
+  memmove(m_rescan + m_frame_size, m_rescan + m_rescan_used, left);
+  memcpy(m_rescan, m_frame, m_frame_size);
+  m_rescan_size = m_frame_size + left;
+  m_rescan_used = 0;
+  m_frame_size  = 0;
+  m_false_start = false;
+  m_state       = State_Start;
+}
+
+size_t ControlParser::feed(const uint8_t* data, size_t size)
+{
+  m_complete  = false;
+  size_t used = 0;
+  while (!m_complete) {
+    if (m_rescan_used < m_rescan_size)
+      m_rescan_used += parse(m_rescan + m_rescan_used, m_rescan_size - m_rescan_used);
+    else if (used < size)
+      used += parse(data + used, size - used);
+    else
+      break;
+    if (m_false_start)
+      rescan();
+  }
+  return used;
+}
@@ -0,0 +1,140 @@
+#ifndef __control_protocol_h__
+#define __control_protocol_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary control protocol spoken over Serial.
+//
+// Every message is framed as
+//   0xA5 | type (1) | length (2, LE) | payload (length bytes) | crc (2, LE)
+// where crc is CRC-16/CCITT-FALSE over type, length and payload. Bytes outside a valid frame, such
+// as the firmware's own text output, are skipped. A 0xA5 in that text starts a frame that fails on
+// its length, which is capped per message type, or on its crc; the parser then scans again from the
+// byte after that false start, so a real frame it swallowed is still found.
+enum ControlMessage : uint8_t
+{
+  ControlMessage_SetParam    = 0x01, // id (1), value (4, LE signed) -> Ack
+  ControlMessage_Program     = 0x02, // program (1) -> Ack
+  ControlMessage_Pixels      = 0x03, // first pixel (2, LE), r g b bytes; the chunk ending on the last pixel completes the frame, no reply unless it is rejected
+  ControlMessage_Status      = 0x04, // -> StatusReply
+  ControlMessage_Capture     = 0x05, // enable (1) -> Ack; the firmware streams its audio blocks as AudioBlock messages while enabled
+  ControlMessage_Ack         = 0x81, // request type (1), ControlStatus (1)
+  ControlMessage_StatusReply = 0x84, // messages (4), crc errors (4), frames (4), all LE
+  ControlMessage_AudioBlock  = 0x85, // sequence (4), time ms (4), first sample (2), block samples (2), int16 samples, all LE
+};
+
+enum ControlStatus : uint8_t
+{
+  ControlStatus_Ok,
+  ControlStatus_UnknownMessage,
+  ControlStatus_BadLength,
+  ControlStatus_BadValue,
+  ControlStatus_Unsupported,
+};
+
+class ControlProtocol
+{
+public:
+  static const uint8_t  StartByte  = 0xa5;
+  static const uint16_t MaxPayload = 1024;
+  // start byte, type, length and crc
+  static const uint16_t Overhead = 6;
+  // pixels of a Pixels message that still fit MaxPayload
+  static const uint16_t MaxChunkPixels = (MaxPayload - 2) / 3;
+  // sequence, time, first sample and block size in front of the samples of an AudioBlock message
+  static const uint16_t AudioHeaderSize = 12;
+  // samples of an AudioBlock message that still fit MaxPayload
+  static const uint16_t MaxChunkSamples = (MaxPayload - AudioHeaderSize) / 2;
+
+  // longest payload a message of type can have, unknown types are capped at the longest fixed size
+  // message so that a newer host still gets its UnknownMessage ack
+  static uint16_t maxLength(uint8_t type);
+  // continue crc over size bytes of data, a message starts from 0xffff
+  static uint16_t crc16(uint16_t crc, const uint8_t* data, size_t size);
+  // frame size bytes of payload into out, which needs size + Overhead bytes, returns the bytes written;
+  // the payload may already be in place at out + 4
+  static size_t encode(uint8_t type, const uint8_t* payload, uint16_t size, uint8_t* out);
+};
+
+// Incremental parser of the framing, fed with whatever the UART has.
+class ControlParser
+{
+private:
+  enum State : uint8_t
+  {
+    State_Start,
+    State_Type,
+    State_Length0,
+    State_Length1,
+    State_Payload,
+    State_Crc0,
+    State_Crc1,
+  };
+
+  // a frame without its start byte: type, length, payload and crc
+  static const uint16_t FrameBytes    = ControlProtocol::MaxPayload + ControlProtocol::Overhead - 1;
+  static const uint16_t PayloadOffset = 3;
+
+  // the frame being received, kept whole so that a false start can be scanned again
+  uint8_t  m_frame[FrameBytes];
+  uint16_t m_frame_size = 0;
+  // bytes after a false start, scanned before any new data
+  uint8_t  m_rescan[FrameBytes];
+  uint16_t m_rescan_size = 0;
+  uint16_t m_rescan_used = 0;
+  State    m_state       = State_Start;
+  bool     m_complete    = false;
+  bool     m_false_start = false;
+  uint8_t  m_type        = 0;
+  uint16_t m_length      = 0;
+  uint16_t m_crc         = 0;
+  uint32_t m_messages    = 0;
+  uint32_t m_crc_errors  = 0;
+  uint32_t m_skipped     = 0;
+
+  // run the framing over data until a message completes or a frame turns out to be a false start
+  size_t parse(const uint8_t* data, size_t size);
+  // queue the bytes of the rejected frame in front of what is left to scan again
+  void rescan();
+
+public:
+  // consume data up to the end of the next complete message, returns the bytes used; check
+  // hasMessage() after every call and call again while it holds, even with no data left, as bytes of
+  // a false start can hold more than one message
+  size_t feed(const uint8_t* data, size_t size);
+  // the last feed() completed a valid message
+  bool hasMessage() const
+  {
+    return m_complete;
+  }
+  uint8_t getType() const
+  {
+    return m_type;
+  }
+  const uint8_t* getPayload() const
+  {
+    return m_frame + PayloadOffset;
+  }
+  uint16_t getLength() const
+  {
+    return m_length;
+  }
+
+  uint32_t getMessages() const
+  {
+    return m_messages;
+  }
+  // frames dropped for a bad crc or a length over the longest message of their type
+  uint32_t getCrcErrors() const
+  {
+    return m_crc_errors;
+  }
+  // bytes outside of any frame
+  uint32_t getSkipped() const
+  {
+    return m_skipped;
+  }
+};
+
+#endif
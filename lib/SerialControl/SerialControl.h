@@ -0,0 +1,292 @@
+#ifndef __serial_control_h__
+#define __serial_control_h__
+
+#include <Arduino.h>
+#include <atomic>
+
+#include "ControlProtocol.h"
+#include "FrameExchange.h"
+#include "TaskLoad.h"
+
+// Control of the running firmware over Serial: parameters, program switches, streamed frames and
+// audio capture.
+//
+// A task of its own sleeps until the UART has data, parses it and answers; it never touches the
+// render state. Parameters are edited in a staged copy and published whole through a triple buffer,
+// program requests are a single atomic, and streamed frames are assembled in the back buffer of a
+// second triple buffer, so the render task picks all of them up between two frames without waiting.
+// The render task is notified of each of them, so it may idle in between.
+// T_PARAMS is a plain struct, the setter validates and stores one value of it. T_STREAM_PIXELS is 0
+// when there is no room for streaming, Pixels messages are then rejected.
+template <typename T_PARAMS, uint16_t T_STREAM_PIXELS>
+class SerialControl
+{
+public:
+  typedef bool (*ParamSetter)(T_PARAMS& params, uint8_t id, int32_t value);
+
+  static const uint32_t StackSize  = 3072;
+  static const uint8_t  NoProgram  = 0xff;
+  static const uint32_t FrameBytes = T_STREAM_PIXELS * 3;
+
+private:
+  static const uint32_t NoFrame = 0xffffffff;
+
+  ControlParser                                             m_parser;
+  T_PARAMS                                                  m_staged;
+  FrameExchange<T_PARAMS, 1>                                m_params;
+  FrameExchange<uint8_t, (FrameBytes > 0 ? FrameBytes : 1)> m_frames;
+  ParamSetter                                               m_setter         = NULL;
+  uint8_t                                                   m_program_count  = 0;
+  uint8_t                                                   m_stream_program = NoProgram;
+  std::atomic<uint8_t>                                      m_program{NoProgram};
+  std::atomic<bool>                                         m_capture{false};
+  // next byte of the frame being streamed, NoFrame until a chunk starts at pixel 0
+  uint32_t     m_stream_next     = NoFrame;
+  uint32_t     m_frames_streamed = 0;
+  TaskHandle_t m_task_handle     = NULL;
+  TaskHandle_t m_render_task     = NULL;
+  TaskLoad     m_load;
+  StackType_t  m_stack[StackSize];
+  StaticTask_t m_tcb;
+
+  static void task(void* param)
+  {
+    SerialControl* control = (SerialControl*)param;
+    while (true) {
+      control->m_load.wake();
+      control->poll();
+      control->m_load.sleep();
+      // the receive callback wakes the task, several notifications only cost one more empty poll
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+  }
+
+  static int32_t readInt32(const uint8_t* data)
+  {
+    return (int32_t)(data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24);
+  }
+
+  static void writeUint32(uint8_t* data, uint32_t value)
+  {
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+  }
+
+  void reply(uint8_t type, const uint8_t* payload, uint16_t size)
+  {
+    uint8_t message[16 + ControlProtocol::Overhead];
+    Serial.write(message, ControlProtocol::encode(type, payload, size, message));
+  }
+
+  void wakeRender()
+  {
+    if (m_render_task != NULL)
+      xTaskNotifyGive(m_render_task);
+  }
+
+  void ack(uint8_t type, ControlStatus status)
+  {
+    uint8_t payload[2] = {type, status};
+    reply(ControlMessage_Ack, payload, sizeof(payload));
+  }
+
+  ControlStatus setParam(const uint8_t* payload, uint16_t length)
+  {
+    if (length != 5)
+      return ControlStatus_BadLength;
+    // the setter works on a copy so a rejected value leaves nothing behind
+    T_PARAMS params = m_staged;
+    if (m_setter == NULL || !m_setter(params, payload[0], readInt32(payload + 1)))
+      return ControlStatus_BadValue;
+    m_staged         = params;
+    *m_params.back() = m_staged;
+    m_params.publish();
+    wakeRender();
+    return ControlStatus_Ok;
+  }
+
+  ControlStatus selectProgram(const uint8_t* payload, uint16_t length)
+  {
+    if (length != 1)
+      return ControlStatus_BadLength;
+    if (payload[0] >= m_program_count)
+      return ControlStatus_BadValue;
+    m_program.store(payload[0], std::memory_order_release);
+    wakeRender();
+    return ControlStatus_Ok;
+  }
+
+  ControlStatus setCapture(const uint8_t* payload, uint16_t length)
+  {
+    if (length != 1)
+      return ControlStatus_BadLength;
+    m_capture.store(payload[0] != 0, std::memory_order_relaxed);
+    return ControlStatus_Ok;
+  }
+
+  ControlStatus streamPixels(const uint8_t* payload, uint16_t length)
+  {
+    if (FrameBytes == 0)
+      return ControlStatus_Unsupported;
+    if (length < 2 || (length - 2) % 3 != 0)
+      return ControlStatus_BadLength;
+    uint32_t first = (payload[0] | payload[1] << 8) * 3;
+    uint32_t size  = length - 2;
+    if (first + size > FrameBytes)
+      return ControlStatus_BadValue;
+    // a frame is only shown once its chunks arrived in order from pixel 0 to the end
+    if (first == 0)
+      m_stream_next = 0;
+    if (first != m_stream_next)
+      return ControlStatus_Ok;
+    memcpy(m_frames.back() + first, payload + 2, size);
+    m_stream_next += size;
+    if (m_stream_next == FrameBytes) {
+      m_frames.publish();
+      m_frames_streamed++;
+      m_stream_next = NoFrame;
+      // streamed frames take over the strip
+      if (m_stream_program != NoProgram)
+        m_program.store(m_stream_program, std::memory_order_release);
+      wakeRender();
+    }
+    return ControlStatus_Ok;
+  }
+
+  void handle(uint8_t type, const uint8_t* payload, uint16_t length)
+  {
+    switch (type) {
+      case ControlMessage_SetParam:
+        ack(type, setParam(payload, length));
+        break;
+      case ControlMessage_Program:
+        ack(type, selectProgram(payload, length));
+        break;
+      case ControlMessage_Pixels: {
+        // no reply on the fast path, only when a chunk is rejected
+        ControlStatus status = streamPixels(payload, length);
+        if (status != ControlStatus_Ok)
+          ack(type, status);
+        break;
+      }
+      case ControlMessage_Capture:
+        ack(type, setCapture(payload, length));
+        break;
+      case ControlMessage_Status: {
+        uint8_t status[12];
+        writeUint32(status, m_parser.getMessages());
+        writeUint32(status + 4, m_parser.getCrcErrors());
+        writeUint32(status + 8, m_frames_streamed);
+        reply(ControlMessage_StatusReply, status, sizeof(status));
+        break;
+      }
+      default:
+        ack(type, ControlStatus_UnknownMessage);
+        break;
+    }
+  }
+
+public:
+  // defaults are the parameters until the first SetParam, stream_program is selected by streamed frames
+  void begin(const T_PARAMS& defaults, ParamSetter setter, uint8_t program_count, uint8_t stream_program)
+  {
+    m_staged         = defaults;
+    m_setter         = setter;
+    m_program_count  = program_count;
+    m_stream_program = stream_program;
+  }
+
+  // start the parser task, false if it could not be created
+  bool start(BaseType_t core, UBaseType_t priority)
+  {
+    m_task_handle = xTaskCreateStaticPinnedToCore(task, "Serial Control", StackSize, this, priority, m_stack, &m_tcb, core);
+    if (m_task_handle == NULL)
+      return false;
+    Serial.onReceive([this]() { xTaskNotifyGive(m_task_handle); });
+    return true;
+  }
+
+  // task notified of new parameters, programs and frames, e.g. the render task while it idles
+  void setRenderTask(TaskHandle_t task)
+  {
+    m_render_task = task;
+  }
+
+  // parse everything Serial holds, never blocks
+  void poll()
+  {
+    uint8_t buffer[256];
+    int     available;
+    while ((available = Serial.available()) > 0) {
+      size_t         size = Serial.read(buffer, (size_t)available < sizeof(buffer) ? available : sizeof(buffer));
+      const uint8_t* data = buffer;
+      while (size > 0 || m_parser.hasMessage()) {
+        size_t used = m_parser.feed(data, size);
+        data += used;
+        size -= used;
+        if (m_parser.hasMessage())
+          handle(m_parser.getType(), m_parser.getPayload(), m_parser.getLength());
+      }
+    }
+  }
+
+  // render task, between two frames: the newest parameters, false if none were set since the last call
+  bool takeParams(T_PARAMS& params)
+  {
+    if (!m_params.acquire())
+      return false;
+    params = *m_params.front();
+    return true;
+  }
+
+  // render task, between two frames: the program asked for since the last call
+  bool takeProgram(uint8_t& program)
+  {
+    uint8_t requested = m_program.exchange(NoProgram, std::memory_order_acquire);
+    if (requested == NoProgram)
+      return false;
+    program = requested;
+    return true;
+  }
+
+  // render task: the newest streamed frame as r, g, b bytes, false if none arrived since the last call
+  bool takeFrame(const uint8_t*& pixels)
+  {
+    if (FrameBytes == 0 || !m_frames.acquire())
+      return false;
+    pixels = m_frames.front();
+    return true;
+  }
+
+  // the host asked for the audio blocks
+  bool isCapturing() const
+  {
+    return m_capture.load(std::memory_order_relaxed);
+  }
+
+  TaskHandle_t getTaskHandle() const
+  {
+    return m_task_handle;
+  }
+  // busy time and wake ups of the parser task
+  const TaskLoad& getLoad() const
+  {
+    return m_load;
+  }
+  void resetLoad()
+  {
+    m_load.reset();
+  }
+  uint32_t getFramesStreamed() const
+  {
+    return m_frames_streamed;
+  }
+  const ControlParser& getParser() const
+  {
+    return m_parser;
+  }
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "MemoryBudget.h"
+
+MemoryBudget* MemoryBudget::s_first = nullptr;
+
+MemoryBudget::MemoryBudget(const char* name, size_t bytes) : m_name(name), m_bytes(bytes), m_next(s_first)
+{
+  s_first = this;
+}
+
+size_t MemoryBudget::getTotal()
+{
+  size_t total = 0;
+  for (const MemoryBudget* entry = s_first; entry != nullptr; entry = entry->m_next) {
+    total += entry->m_bytes;
+  }
+  return total;
+}
+
+void MemoryBudget::print()
+{
+  for (const MemoryBudget* entry = s_first; entry != nullptr; entry = entry->m_next) {
+    Serial.printf("  %-16s %7u bytes\n", entry->m_name, (unsigned)entry->m_bytes);
+  }
+  Serial.printf("  %-16s %7u bytes\n", "total", (unsigned)getTotal());
+}
+
+#if HEAP_GUARD_ENABLED
+
+#include <atomic>
+#include <esp_heap_caps.h>
+#include <new>
+
+static std::atomic<uint32_t> s_allocations{0};
+static std::atomic<bool>     s_armed{false};
+static size_t                s_armed_blocks = 0;
+
+static size_t allocatedBlocks()
+{
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+  return info.allocated_blocks;
+}
+
+void* operator new(size_t size)
+{
+  if (s_armed.load(std::memory_order_relaxed))
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* memory = malloc(size);
+  if (memory == NULL)
+    abort();
+  return memory;
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+  free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+  free(memory);
+}
+
+void HeapGuard::arm()
+{
+  if (s_armed.load())
+    return;
+  s_armed_blocks = allocatedBlocks();
+  s_allocations.store(0);
+  s_armed.store(true);
+}
+
+bool HeapGuard::isArmed()
+{
+  return s_armed.load();
+}
+
+void HeapGuard::check()
+{
+  if (!s_armed.load())
+    return;
+  uint32_t allocations = s_allocations.load(std::memory_order_relaxed);
+  size_t   blocks      = allocatedBlocks();
+  if (allocations == 0 && blocks <= s_armed_blocks)
+    return;
+  Serial.printf("Heap guard: %u new, %u heap blocks, %u at boot\n", (unsigned)allocations, (unsigned)blocks, (unsigned)s_armed_blocks);
+  Serial.flush();
+  abort();
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef __memory_budget_h__
+#define __memory_budget_h__
+
+#include <Arduino.h>
+
+// Static memory of the firmware and a guard against allocations once it runs.
+//
+// Buffers, arenas and task stacks are all sized at compile time. MEMORY_BUDGET names the large
+// blocks so MemoryBudget::print() can list where the RAM goes at boot, and main.cpp checks their
+// sum against a limit at compile time.
+//
+//   MEMORY_BUDGET(frameBudget, "frame", sizeof(frame));
+//   MemoryBudget::print();                              // one line per block and the total
+//
+// Build with -DHEAP_GUARD_ENABLED=1 to check the steady state on the device: HEAP_GUARD_ARM() takes a
+// snapshot of the heap once boot is done, from then on every operator new is counted and
+// HEAP_GUARD_CHECK() stops the firmware with a report if anything was allocated or the heap holds
+// more blocks than at the snapshot. The host runner counts allocations on its own.
+#ifndef HEAP_GUARD_ENABLED
+#define HEAP_GUARD_ENABLED 0
+#endif
+
+class MemoryBudget
+{
+private:
+  const char*   m_name;
+  size_t        m_bytes;
+  MemoryBudget* m_next;
+
+  static MemoryBudget* s_first;
+
+public:
+  // entries are made by static constructors, before any task runs
+  MemoryBudget(const char* name, size_t bytes);
+
+  const char* getName() const
+  {
+    return m_name;
+  }
+  size_t getBytes() const
+  {
+    return m_bytes;
+  }
+  const MemoryBudget* getNext() const
+  {
+    return m_next;
+  }
+
+  static const MemoryBudget* getFirst()
+  {
+    return s_first;
+  }
+  static size_t getTotal();
+  static void   print();
+};
+
+#define MEMORY_BUDGET(var, name, bytes) MemoryBudget var(name, bytes)
+
+#if HEAP_GUARD_ENABLED
+
+class HeapGuard
+{
+public:
+  // snapshot the heap, later calls do nothing
+  static void arm();
+  static bool isArmed();
+  // halt with a report if anything was allocated since arm()
+  static void check();
+};
+
+#define HEAP_GUARD_ARM() HeapGuard::arm()
+#define HEAP_GUARD_CHECK() HeapGuard::check()
+
+#else
+
+#define HEAP_GUARD_ARM() ((void)0)
+#define HEAP_GUARD_CHECK() ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __task_load_h__
+#define __task_load_h__
+
+#include <Arduino.h>
+
+// Share of the CPU a task takes and how often it wakes up.
+//
+// The task calls wake() when it returns from blocking and sleep() right before it blocks again, the
+// time in between adds up until reset(). It costs two micros() per wake up, so unlike the telemetry
+// it is always built in. The figures are read from other tasks, a torn read only mixes two
+// consecutive wake ups.
+class TaskLoad
+{
+private:
+  volatile uint32_t m_wakeups  = 0;
+  volatile uint32_t m_busy_us  = 0;
+  uint32_t          m_wake_us  = 0;
+  uint32_t          m_start_us = 0;
+
+public:
+  void wake()
+  {
+    m_wake_us = micros();
+    m_wakeups++;
+  }
+  void sleep()
+  {
+    m_busy_us += micros() - m_wake_us;
+  }
+  void reset()
+  {
+    m_wakeups  = 0;
+    m_busy_us  = 0;
+    m_start_us = micros();
+  }
+
+  uint32_t getWakeups() const
+  {
+    return m_wakeups;
+  }
+  uint32_t getBusyUs() const
+  {
+    return m_busy_us;
+  }
+  // percent of the time since reset() the task was running
+  float getLoad() const
+  {
+    uint32_t elapsed = micros() - m_start_us;
+    return elapsed > 0 ? m_busy_us * 100.0f / elapsed : 0.0f;
+  }
+  // wake ups per second since reset()
+  float getWakeupRate() const
+  {
+    uint32_t elapsed = micros() - m_start_us;
+    return elapsed > 0 ? m_wakeups * 1e6f / elapsed : 0.0f;
+  }
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "Telemetry.h"
+
+#if TELEMETRY_ENABLED
+
+#include <stdio.h>
+
+std::atomic<TelemetrySection*> Telemetry::s_sections{nullptr};
+std::atomic<TelemetryCounter*> Telemetry::s_counters{nullptr};
+std::atomic<TelemetryGauge*>   Telemetry::s_gauges{nullptr};
+
+uint32_t          Telemetry::s_period_ms      = 1000;
+uint32_t          Telemetry::s_last_dump_ms   = 0;
+uint32_t          Telemetry::s_sequence       = 0;
+uint32_t          Telemetry::s_late_dumps     = 0;
+uint32_t          Telemetry::s_scope_cycles   = 0;
+bool              Telemetry::s_dumping        = false;
+bool              Telemetry::s_header_pending = false;
+TelemetrySection* Telemetry::s_next_section   = nullptr;
+TelemetryCounter* Telemetry::s_next_counter   = nullptr;
+TelemetryGauge*   Telemetry::s_next_gauge     = nullptr;
+char              Telemetry::s_line[96];
+int               Telemetry::s_line_length = 0;
+
+// sections and counters register themselves from static constructors and from the first call of a
+// function with a TELEMETRY_SCOPE_STATIC, which can happen on any task while a dump is being written
+template <typename T>
+void Telemetry::prepend(std::atomic<T*>& head, T* item)
+{
+  T* first = head.load(std::memory_order_relaxed);
+  do {
+    item->m_next = first;
+  } while (!head.compare_exchange_weak(first, item, std::memory_order_release, std::memory_order_relaxed));
+}
+
+TelemetrySection::TelemetrySection(const char* name, bool listed) : m_name(name)
+{
+  for (int bucket = 0; bucket < TelemetryBuckets; bucket++) {
+    m_buckets[bucket].store(0, std::memory_order_relaxed);
+    m_last_buckets[bucket] = 0;
+  }
+  if (listed)
+    Telemetry::prepend(Telemetry::s_sections, this);
+}
+
+TelemetryCounter::TelemetryCounter(const char* name) : m_name(name)
+{
+  Telemetry::prepend(Telemetry::s_counters, this);
+}
+
+TelemetryGauge::TelemetryGauge(const char* name, uint32_t (*read)()) : m_name(name), m_read(read)
+{
+  Telemetry::prepend(Telemetry::s_gauges, this);
+}
+
+TelemetryGauge::TelemetryGauge(const char* name, int32_t (*read)()) : m_name(name), m_read_signed(read)
+{
+  Telemetry::prepend(Telemetry::s_gauges, this);
+}
+
+void Telemetry::begin(uint32_t period_ms)
+{
+  s_period_ms    = period_ms;
+  s_last_dump_ms = millis();
+  // cost of an empty scope, which is what every TELEMETRY_SCOPE adds to the code it times
+  const int        CalibrationScopes = 64;
+  TelemetrySection calibration("telemetry.calibration", false);
+  uint32_t         start = TelemetrySection::cycles();
+  for (int scope = 0; scope < CalibrationScopes; scope++) {
+    TelemetryScope timed(calibration);
+  }
+  s_scope_cycles = (TelemetrySection::cycles() - start) / CalibrationScopes;
+}
+
+int Telemetry::formatSection(TelemetrySection& section)
+{
+  // durations over the period since the last dump
+  uint32_t deltas[TelemetryBuckets];
+  for (int bucket = 0; bucket < TelemetryBuckets; bucket++) {
+    uint32_t value                = section.m_buckets[bucket].load(std::memory_order_relaxed);
+    deltas[bucket]                = value - section.m_last_buckets[bucket];
+    section.m_last_buckets[bucket] = value;
+  }
+  uint32_t count        = section.m_count.load(std::memory_order_relaxed);
+  uint32_t total_cycles = section.m_total_cycles.load(std::memory_order_relaxed);
+  uint32_t max_cycles   = section.m_max_cycles.exchange(0, std::memory_order_relaxed);
+  uint32_t period_count = count - section.m_last_count;
+  uint32_t period_total = total_cycles - section.m_last_total_cycles;
+  section.m_last_count        = count;
+  section.m_last_total_cycles = total_cycles;
+
+  // upper bounds of the buckets holding the median and the 99th percentile
+  uint32_t p50_cycles = 0;
+  uint32_t p99_cycles = 0;
+  uint32_t seen       = 0;
+  for (int bucket = 0; bucket < TelemetryBuckets && seen < period_count; bucket++) {
+    seen += deltas[bucket];
+    uint32_t bound = bucket < 31 ? 1UL << bucket : 0xffffffffUL;
+    if (p50_cycles == 0 && seen * 2 >= period_count)
+      p50_cycles = bound;
+    if (p99_cycles == 0 && seen * 100ULL >= period_count * 99ULL)
+      p99_cycles = bound;
+  }
+
+  float us_per_cycle = 1.0f / getCpuFrequencyMhz();
+  float avg_us       = period_count > 0 ? period_total * us_per_cycle / period_count : 0.0f;
+  return snprintf(s_line, sizeof(s_line), "S,%lu,%s,%lu,%.1f,%.1f,%.1f,%.1f\n", (unsigned long)s_sequence, section.m_name,
+                  (unsigned long)period_count, avg_us, p50_cycles * us_per_cycle, p99_cycles * us_per_cycle, max_cycles * us_per_cycle);
+}
+
+bool Telemetry::formatNextLine()
+{
+  if (s_header_pending) {
+    s_header_pending = false;
+    s_line_length    = snprintf(s_line, sizeof(s_line), "T,%lu,%lu,%lu,%lu,%lu\n", (unsigned long)s_sequence, (unsigned long)s_last_dump_ms,
+                                (unsigned long)getCpuFrequencyMhz(), (unsigned long)s_scope_cycles, (unsigned long)s_late_dumps);
+    return true;
+  }
+  if (s_next_section != nullptr) {
+    s_line_length  = formatSection(*s_next_section);
+    s_next_section = s_next_section->m_next;
+    return true;
+  }
+  if (s_next_counter != nullptr) {
+    s_line_length  = snprintf(s_line, sizeof(s_line), "C,%lu,%s,%lu\n", (unsigned long)s_sequence, s_next_counter->m_name,
+                              (unsigned long)s_next_counter->getValue());
+    s_next_counter = s_next_counter->m_next;
+    return true;
+  }
+  if (s_next_gauge != nullptr) {
+    if (s_next_gauge->m_read_signed != nullptr)
+      s_line_length = snprintf(s_line, sizeof(s_line), "G,%lu,%s,%ld\n", (unsigned long)s_sequence, s_next_gauge->m_name,
+                               (long)s_next_gauge->m_read_signed());
+    else
+      s_line_length = snprintf(s_line, sizeof(s_line), "G,%lu,%s,%lu\n", (unsigned long)s_sequence, s_next_gauge->m_name,
+                               (unsigned long)s_next_gauge->m_read());
+    s_next_gauge  = s_next_gauge->m_next;
+    return true;
+  }
+  return false;
+}
+
+void Telemetry::poll()
+{
+  TELEMETRY_SCOPE_STATIC("telemetry.poll");
+  uint32_t now = millis();
+  if (now - s_last_dump_ms >= s_period_ms) {
+    s_last_dump_ms = now;
+    if (s_dumping) {
+      // the UART has not drained the previous dump yet, skip this one
+      s_late_dumps++;
+    }
+    else {
+      s_sequence++;
+      s_dumping        = true;
+      s_header_pending = true;
+      s_next_section   = s_sections.load(std::memory_order_acquire);
+      s_next_counter   = s_counters.load(std::memory_order_acquire);
+      s_next_gauge     = s_gauges.load(std::memory_order_acquire);
+      s_line_length    = 0;
+    }
+  }
+  while (s_dumping) {
+    if (s_line_length == 0 && !formatNextLine()) {
+      s_dumping = false;
+      break;
+    }
+    // a truncated line still ends the record
+    if (s_line_length >= (int)sizeof(s_line)) {
+      s_line_length              = sizeof(s_line) - 1;
+      s_line[s_line_length - 1] = '\n';
+    }
+    if (Serial.availableForWrite() < s_line_length)
+      break;
+    Serial.write((const uint8_t*)s_line, s_line_length);
+    s_line_length = 0;
+  }
+}
+
+#endif
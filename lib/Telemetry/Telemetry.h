@@ -0,0 +1,219 @@
+#ifndef __telemetry_h__
+#define __telemetry_h__
+
+#include <Arduino.h>
+
+// On-device profiling of tasks, frames and audio blocks.
+//
+// Build with -DTELEMETRY_ENABLED=1 to turn it on, as the esp32doit-devkit-v1-telemetry environment
+// does. Otherwise every TELEMETRY_* macro expands to nothing and the module adds no code or data to
+// the firmware, so instrumentation can stay in place.
+//
+//   TELEMETRY_SECTION(showSection, "led.show");     // named section with a duration histogram
+//   TELEMETRY_SCOPE(showSection);                   // time the rest of the enclosing block
+//   TELEMETRY_SCOPE_STATIC("strip.show");           // both in one, for code in headers and libraries
+//   TELEMETRY_COUNTER(timeouts, "audio.timeouts");  // event counter
+//   TELEMETRY_ADD(timeouts, 1);
+//   TELEMETRY_GAUGE(stack, "stack.led", [] { return (uint32_t)uxTaskGetStackHighWaterMark(ledTaskHandle); });
+//   TELEMETRY_BEGIN(1000);                          // dump a snapshot every second
+//   TELEMETRY_POLL();                               // from a low priority task, writes what fits into Serial
+#ifndef TELEMETRY_ENABLED
+#define TELEMETRY_ENABLED 0
+#endif
+
+#if TELEMETRY_ENABLED
+
+#include <atomic>
+
+// durations are kept in log2 buckets of cpu cycles, bucket b counts durations below 2^b cycles
+const int TelemetryBuckets = 32;
+
+// Timed section of code.
+//
+// record() only does relaxed atomic increments on the section's own histogram, so it never blocks,
+// never allocates and costs the same on every call. Sections are meant to be recorded from one task,
+// the dumper reads them from another and keeps its own copy of the last snapshot to report deltas.
+class TelemetrySection
+{
+private:
+  const char*           m_name;
+  TelemetrySection*     m_next = nullptr;
+  std::atomic<uint32_t> m_buckets[TelemetryBuckets];
+  std::atomic<uint32_t> m_count{0};
+  std::atomic<uint32_t> m_total_cycles{0}; // wraps, only differences over a dump period are used
+  std::atomic<uint32_t> m_max_cycles{0};   // since the last dump
+  // last snapshot, only touched by the dumper
+  uint32_t m_last_buckets[TelemetryBuckets];
+  uint32_t m_last_count        = 0;
+  uint32_t m_last_total_cycles = 0;
+
+  friend class Telemetry;
+
+public:
+  // listed sections show up in the dumps
+  TelemetrySection(const char* name, bool listed = true);
+
+  static uint32_t cycles()
+  {
+    return ESP.getCycleCount();
+  }
+
+  void record(uint32_t elapsed_cycles)
+  {
+    int bucket = elapsed_cycles == 0 ? 0 : 32 - __builtin_clz(elapsed_cycles);
+    if (bucket >= TelemetryBuckets)
+      bucket = TelemetryBuckets - 1;
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_total_cycles.fetch_add(elapsed_cycles, std::memory_order_relaxed);
+    if (elapsed_cycles > m_max_cycles.load(std::memory_order_relaxed))
+      m_max_cycles.store(elapsed_cycles, std::memory_order_relaxed);
+  }
+
+  const char* getName() const
+  {
+    return m_name;
+  }
+  uint32_t getCount() const
+  {
+    return m_count.load(std::memory_order_relaxed);
+  }
+};
+
+// times from construction to the end of the enclosing block
+class TelemetryScope
+{
+private:
+  TelemetrySection& m_section;
+  uint32_t          m_start;
+
+public:
+  TelemetryScope(TelemetrySection& section) : m_section(section), m_start(TelemetrySection::cycles())
+  {
+  }
+  ~TelemetryScope()
+  {
+    m_section.record(TelemetrySection::cycles() - m_start);
+  }
+};
+
+// event counter, e.g. timeouts or dropped blocks
+class TelemetryCounter
+{
+private:
+  const char*           m_name;
+  TelemetryCounter*     m_next = nullptr;
+  std::atomic<uint32_t> m_value{0};
+
+  friend class Telemetry;
+
+public:
+  TelemetryCounter(const char* name);
+
+  void add(uint32_t count)
+  {
+    m_value.fetch_add(count, std::memory_order_relaxed);
+  }
+  uint32_t getValue() const
+  {
+    return m_value.load(std::memory_order_relaxed);
+  }
+};
+
+// value read by the dumper, for counters that already exist elsewhere and for stack high water marks
+class TelemetryGauge
+{
+private:
+  const char*     m_name;
+  TelemetryGauge* m_next = nullptr;
+  // one of the two is set, signed gauges for values such as a gain in dB
+  uint32_t (*m_read)()       = nullptr;
+  int32_t (*m_read_signed)() = nullptr;
+
+  friend class Telemetry;
+
+public:
+  TelemetryGauge(const char* name, uint32_t (*read)());
+  TelemetryGauge(const char* name, int32_t (*read)());
+};
+
+// Periodic CSV dump of every section, counter and gauge.
+//
+// poll() writes whole lines only while they fit into the Serial transmit buffer and carries on with
+// the rest of the dump on the next call, so the caller never waits on the UART. A period that starts
+// while the previous dump is still being written is counted as late and skipped. Lines:
+//   T,seq,ms,cpu_mhz,scope_overhead_cycles,late_dumps
+//   S,seq,name,count,avg_us,p50_us,p99_us,max_us   (durations over the last period, pNN are bucket bounds)
+//   C,seq,name,value                               (counters, events since boot)
+//   G,seq,name,value                               (gauges, read when the line is written)
+class Telemetry
+{
+private:
+  // registered items, prepended by the constructors which may run on any task
+  static std::atomic<TelemetrySection*> s_sections;
+  static std::atomic<TelemetryCounter*> s_counters;
+  static std::atomic<TelemetryGauge*>   s_gauges;
+
+  static uint32_t s_period_ms;
+  static uint32_t s_last_dump_ms;
+  static uint32_t s_sequence;
+  static uint32_t s_late_dumps;
+  static uint32_t s_scope_cycles;
+  // position in the dump being written, the header comes first
+  static bool              s_dumping;
+  static bool              s_header_pending;
+  static TelemetrySection* s_next_section;
+  static TelemetryCounter* s_next_counter;
+  static TelemetryGauge*   s_next_gauge;
+  // formatted line waiting for room in the transmit buffer
+  static char s_line[96];
+  static int  s_line_length;
+
+  template <typename T>
+  static void prepend(std::atomic<T*>& head, T* item);
+  static bool formatNextLine();
+  static int  formatSection(TelemetrySection& section);
+
+  friend class TelemetrySection;
+  friend class TelemetryCounter;
+  friend class TelemetryGauge;
+
+public:
+  // measure the cost of a scope and dump every period_ms
+  static void begin(uint32_t period_ms);
+  // start a dump when it is due and write as much of it as Serial takes without blocking
+  static void poll();
+  // cycles spent by an empty TELEMETRY_SCOPE, measured by begin()
+  static uint32_t getScopeOverheadCycles()
+  {
+    return s_scope_cycles;
+  }
+};
+
+#define TELEMETRY_CONCAT_(a, b) a##b
+#define TELEMETRY_CONCAT(a, b) TELEMETRY_CONCAT_(a, b)
+#define TELEMETRY_SECTION(var, name) TelemetrySection var(name)
+#define TELEMETRY_SCOPE(section) TelemetryScope TELEMETRY_CONCAT(telemetry_scope_, __LINE__)(section)
+#define TELEMETRY_SCOPE_STATIC(name)                                         \
+  static TelemetrySection TELEMETRY_CONCAT(telemetry_section_, __LINE__)(name); \
+  TELEMETRY_SCOPE(TELEMETRY_CONCAT(telemetry_section_, __LINE__))
+#define TELEMETRY_COUNTER(var, name) TelemetryCounter var(name)
+#define TELEMETRY_ADD(counter, count) (counter).add(count)
+#define TELEMETRY_GAUGE(var, name, ...) TelemetryGauge var(name, __VA_ARGS__)
+#define TELEMETRY_BEGIN(period_ms) Telemetry::begin(period_ms)
+#define TELEMETRY_POLL() Telemetry::poll()
+
+#else
+
+#define TELEMETRY_SECTION(var, name)
+#define TELEMETRY_SCOPE(section)
+#define TELEMETRY_SCOPE_STATIC(name)
+#define TELEMETRY_COUNTER(var, name)
+#define TELEMETRY_ADD(counter, count) ((void)0)
+#define TELEMETRY_GAUGE(var, name, ...)
+#define TELEMETRY_BEGIN(period_ms) ((void)0)
+#define TELEMETRY_POLL() ((void)0)
+
+#endif
+
+#endif
@@ -1,51 +1,116 @@
+#include "AudioCapture.h"
+#include "BeatTracker.h"
+#include "ButtonInput.h"
+#include "ClipBank.h"
+#include "ClipPlayer.h"
+#include "ColorLut.h"
+#include "EffectRegistry.h"
+#include "FastRandom.h"
+#include "FrameScheduler.h"
 #include "I2SSampler.h"
+#include "LayerCompositor.h"
+#include "LevelMeter.h"
+#include "MemoryBudget.h"
+#include "ParticleSystem.h"
+#include "PixelFrame.h"
+#include "PixelTweens.h"
+#include "SerialControl.h"
+#include "StripGroup.h"
+#include "StripTransmitter.h"
+#include "TaskLoad.h"
+#include "SpectrumAnalyzer.h"
+#include "Telemetry.h"
+#include "Tunables.h"
 #include <Arduino.h>
-#include <NeoPixelAnimator.h>
 #include <NeoPixelBus.h>
+#include <type_traits>
 
 #define BUTTON_PIN GPIO_NUM_13
+// program of the led task, only changed between two frames
 uint8_t program = 0;
+// short press: next program, double press: previous program, long press: off and back; the
+// streaming program is only selected by streamed frames
+ButtonInput   button;
+const uint8_t OffProgram    = 7;
+uint8_t       resumeProgram = 0;
 
-const uint16_t PixelCount        = 300;                    // make sure to set this to the number of pixels in your strip
-const uint8_t  PixelPin          = 4;                      // make sure to set this to the correct pin, ignored for Esp8266
-const uint8_t  AnimationChannels = 1;                      // we only need one as all the pixels are animated at once
-const uint16_t AnimCount         = PixelCount / 5 * 2 + 1; // we only need enough animations for the tail and one extra
-const uint16_t PixelFadeDuration = 300;                    // third of a second
-const uint16_t TailLength        = 20;                     // length of the tail, must be shorter than PixelCount
-const float    MaxLightness      = 0.4f;                   // max lightness at the head of the tail (0.5f is full bright)
+// the canvas is STRIP_COUNT strips of STRIP_LENGTH pixels laid end to end, e.g. -DSTRIP_COUNT=8 for 2400 pixels
+#ifndef STRIP_COUNT
+#define STRIP_COUNT 1
+#endif
+#ifndef STRIP_LENGTH
+#define STRIP_LENGTH 300
+#endif
+const uint8_t  StripCount        = STRIP_COUNT;
+const uint16_t StripLength       = STRIP_LENGTH;
+const uint16_t PixelCount        = StripCount * StripLength;
+const uint8_t  StripPins[8]      = {4, 16, 17, 18, 19, 21, 22, 23}; // the first StripCount are used
+const uint16_t PixelFadeDuration = 300;  // third of a second
+const uint16_t TailLength        = 20;   // length of the tail, must be shorter than PixelCount
+constexpr float MaxLightness     = 0.4f; // max lightness at the head of the tail (0.5f is full bright)
+// defaults of the settings that can be changed over Serial
+const uint8_t  SampleShift        = 11;   // raw microphone words to 16 bit samples while the AGC is off
+const uint16_t LevelFullScaleRms  = 3000; // RMS that lights the whole level bar
+const uint16_t TransitionDuration = 800;  // crossfade between programs
+const uint16_t MaxIdleDuration    = 1000; // the render task wakes at least once a second
+const uint8_t  Brightness         = 255;  // full scale, the frame is pushed as the programs draw it
+// the control protocol needs the speed to stream whole frames, 300 pixels at ~100 fps
+const uint32_t SerialBaud         = 921600;
+const size_t   SerialRxBufferSize = 2048;
+// room for two captured audio blocks, so the writer task hands a block over without waiting
+const size_t   SerialTxBufferSize = 4096;
 
 // one second divide by the number of pixels = loop once a second
-const uint16_t NextPixelMoveDuration = 2000 / PixelCount; // how fast we move through the pixels
+const uint16_t NextPixelMoveDuration = PixelCount < 2000 ? 2000 / PixelCount : 1; // how fast we move through the pixels
 
-NeoGamma<NeoGammaTableMethod>                colorGamma;
-NeoPixelBus<NeoGrbFeature, NeoWs2812xMethod> strip(PixelCount, PixelPin);
-NeoPixelAnimator                             animations(PixelCount);
-RgbColor                                     CylonEyeColor(HtmlColor(0x7f0000));
+// several strips go out in parallel through the 8 channel I2S0 method, I2S1 is taken by the microphone
+typedef std::conditional<StripCount == 1, NeoWs2812xMethod, NeoEsp32I2s0X8Ws2812xMethod>::type StripMethod;
+typedef StripGroup<NeoPixelBus<NeoGrbFeature, StripMethod>, StripCount, StripLength>           Strips;
+static_assert(StripCount >= 1 && StripCount <= 8, "the parallel method drives 1 to 8 strips");
 
-// NeoPixelAnimator animations(2); // only ever need 2 animations
-uint16_t         lastPixel = 0; // track the eye position
-int8_t           moveDir   = 1; // track the direction of movement
-AnimEaseFunction moveEase  = NeoEase::SinusoidalInOut;
+Strips strip(StripPins);
 
-boolean fadeToColor = true; // general purpose variable used to store effect state
-struct MyAnimationState
-{
-  RgbColor StartingColor;
-  RgbColor EndingColor;
-  uint16_t IndexPixel;
-};
-MyAnimationState animationState[AnimCount];
-MyAnimationState animationStateTwo[PixelCount];
-uint16_t         frontPixel = 0; // the front of the loop
-RgbColor         frontColor;     // the color at the front of the loop
+// core affinity: the led task renders on one core while the strip is pushed from the other,
+// the i2s reader shares the transmit core as both mostly wait on hardware
+const BaseType_t AudioCore    = 0;
+const BaseType_t RenderCore   = 1;
+const BaseType_t TransmitCore = 0;
+const BaseType_t ControlCore  = 0;
+// frames are handed to the transmit task through a lock-free triple buffer
+StripTransmitter<Strips, PixelCount> transmitter(strip);
+// the effects draw into layers that are blended into the frame, unchanged frames are not pushed to the strip
+PixelFrame<StripTransmitter<Strips, PixelCount>, PixelCount> frame(transmitter);
+typedef PixelLayer<PixelCount>                                Canvas;
+// frame pacing of the led task, pushing a 300 pixel strip takes ~9ms so 100 fps is the ceiling of the transmit task
+FrameScheduler scheduler;
+// pre-rendered clips in the spiffs partition, played by program 9
+ClipBank clipBank;
+
+// one pixel rotation step of program 5
+const uint16_t RotateStepDuration = 66;
 
-// Led Task Handle
-TaskHandle_t ledTaskHandle = NULL;
+// Led Task Handle, the stacks and control blocks of the tasks are static
+const uint32_t LedStackSize  = 4096;
+TaskHandle_t   ledTaskHandle = NULL;
+StackType_t    ledStack[LedStackSize];
+StaticTask_t   ledTcb;
 // Led Sound Task Handle
-TaskHandle_t writer_task_handle = NULL;
+const uint32_t WriterStackSize    = 4096;
+TaskHandle_t   writer_task_handle = NULL;
+StackType_t    writerStack[WriterStackSize];
+StaticTask_t   writerTcb;
+// the analysis gets the microphone at 44.1kHz / AUDIO_DECIMATION, up to 5.5kHz at the default /4; the
+// filters take about what the beat tracker and level meter save at the lower rate, and the spectrum
+// of program 8 needs half the FFTs (see test_decimator_cost)
+#ifndef AUDIO_DECIMATION
+#define AUDIO_DECIMATION 4
+#endif
+const uint32_t MicSampleRate      = 44100;
+const uint8_t  AudioDecimation    = AUDIO_DECIMATION;
+const uint32_t AnalysisSampleRate = MicSampleRate / AudioDecimation;
 // i2s config - this is set up to read fro the left channel
 i2s_config_t i2s_config = {.mode                 = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
-                           .sample_rate          = 44100,
+                           .sample_rate          = MicSampleRate,
                            .bits_per_sample      = I2S_BITS_PER_SAMPLE_32BIT,
                            .channel_format       = I2S_CHANNEL_FMT_ONLY_RIGHT,
                            .communication_format = i2s_comm_format_t(I2S_COMM_FORMAT_STAND_I2S),
@@ -59,456 +124,931 @@ i2s_config_t i2s_config = {.mode                 = (i2s_mode_t)(I2S_MODE_MASTER
 // i2s pins
 i2s_pin_config_t i2s_pins = {.bck_io_num = GPIO_NUM_32, .ws_io_num = GPIO_NUM_25, .data_out_num = I2S_PIN_NO_CHANGE, .data_in_num = GPIO_NUM_33};
 
+// points at sampler once it is started
+I2SSampler  sampler;
 I2SSampler* i2s_sampler = NULL;
+// audio blocks handed from the i2s reader task to the writer task, ~23ms each: 1024 samples at 44.1kHz,
+// 256 at the default 11kHz
+const int32_t  AudioBlockSizeInBytes = 2048 / AudioDecimation;
+const uint32_t AudioBlockCount       = 8;
+int16_t        audioBlocks[AudioBlockCount * AudioBlockSizeInBytes / sizeof(int16_t)];
+// spectrum analyzer used by the multi-band program
+const int        SpectrumBands = 15; // 300 pixels / 15 = 20 pixel segments
+SpectrumAnalyzer spectrum;
+// running level of the audio, averaged over 4 blocks (~93ms) like the old 8192 byte buffer
+const int  LevelWindowBlocks = 4;
+LevelMeter levelMeter;
+// beat grid of the music, programs 1, 2 and 5 follow it while it is locked
+BeatTracker beats;
+// audio blocks sent over Serial while the host asks for them
+AudioCapture capture;
+// the analysis stands still once no block came in for this long, e.g. while the i2s reader is not started
+const uint32_t    AudioStoppedMs   = 250;
+volatile uint32_t lastAudioBlockMs = 0;
+TaskLoad          writerLoad;
+// the host asked for the audio blocks over Serial
+bool IsCapturingAudio();
 
-float calculateRMS(int16_t* buffer, int32_t num_samples)
-{
-  double sum = 0;
-  for (int i = 0; i < num_samples; i++) {
-    sum += buffer[i] * buffer[i];
-  }
-  return sqrt(sum / num_samples);
-}
+// profiling dumped over Serial every second when built with TELEMETRY_ENABLED=1 (env:esp32doit-devkit-v1-telemetry)
+const uint32_t TelemetryPeriodMs = 1000;
+TELEMETRY_SECTION(ledAnimateSection, "led.animate");
+TELEMETRY_SECTION(ledShowSection, "led.show");
+TELEMETRY_SECTION(audioBlockSection, "audio.block");
+TELEMETRY_SECTION(clipDecodeSection, "clip.decode");
+TELEMETRY_COUNTER(audioTimeouts, "audio.timeouts");
+TELEMETRY_GAUGE(audioOverruns, "audio.overruns", [] { return i2s_sampler != NULL ? i2s_sampler->getOverrunCount() : 0; });
+TELEMETRY_GAUGE(framesSkipped, "frames.skipped", [] { return frame.getFramesSkipped(); });
+TELEMETRY_GAUGE(framesOverrun, "frames.overrun", [] { return scheduler.getOverruns(); });
+TELEMETRY_GAUGE(framesDropped, "frames.dropped", [] { return transmitter.getFramesDropped(); });
+TELEMETRY_GAUGE(buttonDropped, "button.dropped", [] { return button.getDropped(); });
+TELEMETRY_GAUGE(captureDropped, "capture.dropped", [] { return capture.getBlocksDropped(); });
+// gain of the AGC in tenths of a dB relative to the fixed >> 11
+TELEMETRY_GAUGE(agcGain, "agc.gain", [] { return i2s_sampler != NULL ? (int32_t)lroundf(i2s_sampler->getAgc().getGainDb() * 10) : 0; });
+// free stack of every task in bytes, 0 for tasks that are not running
+TELEMETRY_GAUGE(ledStackGauge, "stack.led", [] { return ledTaskHandle != NULL ? (uint32_t)uxTaskGetStackHighWaterMark(ledTaskHandle) : 0; });
+TELEMETRY_GAUGE(writerStackGauge, "stack.writer",
+                [] { return writer_task_handle != NULL ? (uint32_t)uxTaskGetStackHighWaterMark(writer_task_handle) : 0; });
+TELEMETRY_GAUGE(readerStackGauge, "stack.reader", [] {
+  return i2s_sampler != NULL && i2s_sampler->getReaderTaskHandle() != NULL ? (uint32_t)uxTaskGetStackHighWaterMark(i2s_sampler->getReaderTaskHandle()) : 0;
+});
+TELEMETRY_GAUGE(transmitStackGauge, "stack.transmit",
+                [] { return transmitter.getTaskHandle() != NULL ? (uint32_t)uxTaskGetStackHighWaterMark(transmitter.getTaskHandle()) : 0; });
+// wake ups of the tasks since the last frame statistics, their load in permille
+TELEMETRY_GAUGE(ledWakeups, "wakeups.led", [] { return scheduler.getLoad().getWakeups(); });
+TELEMETRY_GAUGE(ledLoad, "load.led", [] { return (uint32_t)(scheduler.getLoad().getLoad() * 10); });
+TELEMETRY_GAUGE(writerWakeups, "wakeups.writer", [] { return writerLoad.getWakeups(); });
+TELEMETRY_GAUGE(writerLoadGauge, "load.writer", [] { return (uint32_t)(writerLoad.getLoad() * 10); });
 
-void setLedsByRMS(float rms)
+bool IsAudioStopped(uint32_t now_ms)
 {
-  // Mapear el RMS al rango de 0 a PixelCount (300 LEDs)
-  uint16_t numLedsOn = map(rms, 0, 3000, 0, PixelCount); // Ajusta el límite máximo (3000) según el nivel de RMS esperado
-
-  for (uint16_t i = 0; i < PixelCount; i++) {
-    if (i < numLedsOn) {
-      // Progresión de verde a rojo: cambia el valor RGB según la posición
-      uint8_t red   = map(i, 0, PixelCount - 1, 0, 255);
-      uint8_t green = map(i, 0, PixelCount - 1, 255, 0);
-      strip.SetPixelColor(i, RgbColor(red, green, 0));
-    }
-    else {
-      // Apagar el LED si está fuera del rango
-      strip.SetPixelColor(i, RgbColor(0, 0, 0));
-    }
-  }
-  strip.Show();
+  return now_ms - lastAudioBlockMs > AudioStoppedMs;
 }
 
+// consumes the blocks of the sampler, or of a replay of recorded audio
 void i2sWriterTask(void* param)
 {
-  I2SSampler* sampler = (I2SSampler*)param;
+  AudioBlockSource* source = (AudioBlockSource*)param;
   while (true) {
-    if (program != 6) {
-      vTaskDelay(10);
+    // wait for the next captured block, every block is consumed exactly once
+    const int16_t* audio_buffer = source->acquireBlock(pdMS_TO_TICKS(100));
+    writerLoad.wake();
+    if (audio_buffer == NULL) {
+      TELEMETRY_ADD(audioTimeouts, 1);
+      writerLoad.sleep();
       continue;
     }
 
-    int16_t* audio_buffer = sampler->getCapturedAudioBuffer();
-    int32_t  buffer_size  = sampler->getBufferSizeInBytes() / sizeof(int16_t);
-    float    rms          = calculateRMS(audio_buffer, buffer_size);
-    // Llamar a la función para actualizar los LEDs según el RMS
-    setLedsByRMS(rms);
-    vTaskDelay(50);
+    TELEMETRY_SCOPE(audioBlockSection);
+    int32_t buffer_size = source->getBufferSizeInSamples();
+    if (IsCapturingAudio())
+      capture.send(audio_buffer, buffer_size, source->getBlockSequence(), source->getBlockTimeMs());
+    // the beats are placed at the time the block was completed, however late the task got to it
+    beats.process(audio_buffer, buffer_size, source->getBlockTimeMs());
+    // program 6 reads the meter from the led task at the strip refresh rate
+    levelMeter.addBlock(audio_buffer);
+    if (program == 8) {
+      // analyse the most recent samples of the block, the led task draws the bands
+      spectrum.process(audio_buffer, buffer_size);
+    }
+    // keep draining blocks in the other programs so the ring does not overrun
+    source->releaseBlock();
+    lastAudioBlockMs = millis();
+    // programs 6 and 8 only change with the audio, the led task may be idling until the next block
+    if ((program == 6 || program == 8) && ledTaskHandle != NULL)
+      xTaskNotifyGive(ledTaskHandle);
+    writerLoad.sleep();
   }
 }
 
-void FadeAll(uint8_t darkenBy)
+// settings of the programs, only changed by the led task between two frames
+Tunables tunables = {MaxLightness, TailLength, PixelFadeDuration, LevelFullScaleRms, SampleShift, TransitionDuration, BlendMode_Alpha, MaxIdleDuration, Brightness};
+
+// validates and stores one setting received over Serial
+bool setTunable(Tunables& params, uint8_t id, int32_t value)
 {
-  RgbColor color;
-  for (uint16_t indexPixel = 0; indexPixel < strip.PixelCount(); indexPixel++) {
-    color = strip.GetPixelColor<RgbColor>(indexPixel);
-    color.Darken(darkenBy);
-    strip.SetPixelColor(indexPixel, color);
+  switch (id) {
+    case TunableId_MaxLightness:
+      if (value < 0 || value > 500)
+        return false;
+      params.max_lightness = value / 1000.0f;
+      return true;
+    case TunableId_TailLength:
+      if (value < 1 || value >= PixelCount)
+        return false;
+      params.tail_length = value;
+      return true;
+    case TunableId_PixelFadeDuration:
+      if (value < 1 || value > 60000)
+        return false;
+      params.pixel_fade_ms = value;
+      return true;
+    case TunableId_LevelFullScale:
+      if (value < 1 || value > 32767)
+        return false;
+      params.level_full_scale = value;
+      return true;
+    case TunableId_SampleShift:
+      if (value < 0 || value > 16)
+        return false;
+      params.sample_shift = value;
+      return true;
+    case TunableId_TransitionDuration:
+      if (value < 0 || value > 60000)
+        return false;
+      params.transition_ms = value;
+      return true;
+    case TunableId_TransitionMode:
+      if (value < 0 || value >= BlendMode_Count)
+        return false;
+      params.transition_mode = value;
+      return true;
+    case TunableId_MaxIdleDuration:
+      if (value < 0 || value > 60000)
+        return false;
+      params.max_idle_ms = value;
+      return true;
+    case TunableId_Brightness:
+      if (value < 0 || value > 255)
+        return false;
+      params.brightness = value;
+      return true;
+    default:
+      return false;
   }
 }
 
-void FadeAnimUpdate(const AnimationParam& param)
+// durations written for 120 bpm follow the tempo of the music while the beat tracker is locked
+uint16_t TempoDuration(uint16_t duration, uint32_t now_ms)
 {
-  if (param.state == AnimationState_Completed) {
-    FadeAll(10);
-    if (program == 1)
-      animations.RestartAnimation(param.index);
-    else
-      animations.StopAnimation(param.index);
-  }
+  return beats.isLocked(now_ms) ? duration * beats.getBeatPeriodMs() / 500 : duration;
 }
 
-void MoveAnimUpdate(const AnimationParam& param)
+// seeded from the hardware RNG in setup(), every effect that starts splits its own generator off it
+FastRandom effectRandom;
+// random values are drawn this many pixels at a time
+const uint16_t RandomBatch = 32;
+
+// values in the batch that starts at first of count
+uint16_t RandomBatchSize(uint16_t first, uint16_t count)
 {
-  // apply the movement animation curve
-  float progress = moveEase(param.progress);
+  return count - first < RandomBatch ? count - first : RandomBatch;
+}
 
-  // use the curved progress to calculate the pixel to effect
-  uint16_t nextPixel;
-  if (moveDir > 0)
-    nextPixel = progress * PixelCount;
-  else
-    nextPixel = (1.0f - progress) * PixelCount;
+// Q16 progress of a timer that started at start_ms, 65535 once it has run for duration_ms
+uint16_t TimerProgress(uint32_t start_ms, uint16_t duration_ms, uint32_t now_ms)
+{
+  uint32_t elapsed = now_ms - start_ms;
+  return elapsed >= duration_ms ? 65535 : elapsed * 65535 / duration_ms;
+}
 
-  if (lastPixel != nextPixel)
-    for (uint16_t i = lastPixel + moveDir; i != nextPixel; i += moveDir)
-      strip.SetPixelColor(i, CylonEyeColor);
-  strip.SetPixelColor(nextPixel, CylonEyeColor);
+// program 0: every pixel blends to its own random colour, a new set starts once all of them arrived
+template <uint16_t T_PIXEL_COUNT, uint8_t T_PEAK>
+struct TwinkleEffect : EffectBase<60>
+{
+  struct State
+  {
+    PixelTweens<T_PIXEL_COUNT> tweens;
+    FastRandom                 random;
+  };
 
-  lastPixel = nextPixel;
+  template <typename T_CANVAS>
+  static void init(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    state.random = effectRandom.split();
+    RgbColor colors[RandomBatch];
+    for (uint16_t first = 0; first < T_PIXEL_COUNT; first += RandomBatch) {
+      uint16_t count = RandomBatchSize(first, T_PIXEL_COUNT);
+      state.random.fillColors(colors, count, 255);
+      for (uint16_t index = 0; index < count; index++) {
+        canvas.SetPixelColor(first + index, colors[index]);
+      }
+    }
+  }
 
-  if (param.state == AnimationState_Completed) {
-    // reverse direction of movement
-    moveDir *= -1;
+  template <typename T_CANVAS>
+  static void render(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    if (!state.tweens.IsAnimating()) {
+      static const TweenEase Easings[] = {TweenEase_CubicIn, TweenEase_CubicOut, TweenEase_QuadraticInOut};
+      uint16_t               times[RandomBatch];
+      RgbColor               colors[RandomBatch];
+      uint8_t                easings[RandomBatch];
+      for (uint16_t first = 0; first < T_PIXEL_COUNT; first += RandomBatch) {
+        uint16_t count = RandomBatchSize(first, T_PIXEL_COUNT);
+        state.random.fill(times, count, 500, 800);
+        state.random.fillColors(colors, count, T_PEAK);
+        state.random.fill(easings, count, 3);
+        for (uint16_t index = 0; index < count; index++) {
+          uint16_t pixel = first + index;
+          state.tweens.StartTween(pixel, canvas.GetPixelColor(pixel), colors[index], times[index], Easings[easings[index]], now_ms);
+        }
+      }
+    }
+    state.tweens.UpdateTweens(canvas, now_ms);
+  }
+};
 
-    // Change the color for the next movement randomly
-    CylonEyeColor = RgbColor(random(255), random(255), random(255));
+// program 1: an eye sweeping from end to end over a fading trail, on the beat while the tracker is locked
+template <uint16_t T_PIXEL_COUNT, TweenEase T_EASE, uint16_t T_SWEEP_MS, uint16_t T_FADE_MS, uint8_t T_FADE_BY>
+struct CylonEffect : EffectBase<60>
+{
+  // the trail fades out as if it was darkened by T_FADE_BY every T_FADE_MS, so it is longer the
+  // faster the eye moves
+  static const uint16_t TrailMs = T_FADE_MS * 255 / T_FADE_BY;
 
-    if (program == 1)
-      animations.RestartAnimation(param.index);
-    else
-      animations.StopAnimation(param.index);
+  struct State
+  {
+    ParticleSystem<T_PIXEL_COUNT> trail;
+    RgbColor                      color;
+    RgbColor                      eye_color;
+    uint32_t                      sweep_start_ms;
+    int32_t                       eye;
+    uint16_t                      sweep_ms;
+    int8_t                        direction;
+    FastRandom                    random;
+  };
+
+  template <typename T_CANVAS>
+  static void init(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    state.random         = effectRandom.split();
+    state.color          = RgbColor(HtmlColor(0x7f0000));
+    state.eye_color      = state.color;
+    state.sweep_start_ms = now_ms;
+    state.sweep_ms       = T_SWEEP_MS;
+    state.direction      = 1;
+    state.trail.Clear(now_ms);
   }
-}
 
-void BlendAnimUpdate(const AnimationParam& param)
+  static void update(State& state, uint32_t now_ms)
+  {
+    state.trail.Update(now_ms, T_PIXEL_COUNT);
+
+    uint16_t progress = ColorLut::ease(T_EASE, TimerProgress(state.sweep_start_ms, state.sweep_ms, now_ms));
+    if (state.direction < 0)
+      progress = 65535 - progress;
+    int32_t eye = (int32_t)(((uint64_t)progress * ((T_PIXEL_COUNT - 1) << 16)) / 65535);
+    // every pixel the eye moved off keeps its colour and fades out
+    int32_t step = eye > state.eye ? 1 : -1;
+    for (int32_t pixel = state.eye >> 16; pixel != eye >> 16; pixel += step) {
+      state.trail.Spawn(pixel << 16, 0, state.eye_color, TrailMs);
+    }
+    state.eye       = eye;
+    state.eye_color = state.color;
+
+    if (now_ms - state.sweep_start_ms >= state.sweep_ms) {
+      // reverse direction and change the color for the next movement randomly
+      state.direction *= -1;
+      state.color          = state.random.color(255);
+      state.sweep_start_ms = now_ms;
+      // on the beat every sweep takes two beats and ends on one
+      state.sweep_ms = beats.isLocked(now_ms) ? beats.getMsToBeat(now_ms, 2) : T_SWEEP_MS;
+    }
+  }
+
+  template <typename T_CANVAS>
+  static void render(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    canvas.Fill(RgbColor(0));
+    state.trail.Render(canvas);
+    ParticleSystem<T_PIXEL_COUNT>::Splat(canvas, state.eye, state.eye_color, 255);
+  }
+};
+
+// program 2: the whole strip fades to a random colour and back to black, one fade per beat while the tracker is locked
+template <typename T_PALETTE>
+struct FadeInOutEffect : EffectBase<30>
 {
-  RgbColor updatedColor = RgbColor::LinearBlend(animationState[param.index].StartingColor, animationState[param.index].EndingColor, param.progress);
+  struct State
+  {
+    RgbColor       from;
+    RgbColor       to;
+    RgbColor       current;
+    uint32_t       start_ms;
+    uint16_t       duration_ms;
+    bool           animating;
+    bool           fade_to_color;
+    BeatSubscriber beats;
+    FastRandom     random;
+  };
 
-  // apply the color to the strip
-  for (uint16_t pixel = 0; pixel < PixelCount; pixel++) {
-    strip.SetPixelColor(pixel, updatedColor);
+  template <typename T_CANVAS>
+  static void init(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    state.random        = effectRandom.split();
+    state.current       = canvas.GetPixelColor(0);
+    state.fade_to_color = true;
   }
-}
 
-void BlendAnimUpdateTwo(const AnimationParam& param)
+  // duration 0 picks a random fade time
+  static void start(State& state, uint32_t now_ms, uint16_t duration = 0)
+  {
+    if (state.fade_to_color) {
+      state.to          = T_PALETTE::pick(state.random.below(256));
+      state.duration_ms = duration != 0 ? duration : state.random.between(800, 2000);
+    }
+    else {
+      state.to          = RgbColor(0);
+      state.duration_ms = duration != 0 ? duration : state.random.between(600, 700);
+    }
+    state.from          = state.current;
+    state.start_ms      = now_ms;
+    state.animating     = true;
+    state.fade_to_color = !state.fade_to_color;
+  }
+
+  static void update(State& state, uint32_t now_ms)
+  {
+    if (beats.isLocked(now_ms)) {
+      // a new colour on one beat, faded out on the next
+      if (state.beats.poll(beats, now_ms))
+        start(state, now_ms, beats.getBeatPeriodMs() * 3 / 4);
+    }
+    else if (!state.animating)
+      start(state, now_ms);
+
+    if (state.animating) {
+      uint16_t progress = TimerProgress(state.start_ms, state.duration_ms, now_ms);
+      state.current     = ColorLut::blend(state.from, state.to, (progress + 128) >> 8);
+      state.animating   = progress < 65535;
+    }
+  }
+
+  template <typename T_CANVAS>
+  static void render(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    canvas.Fill(state.current);
+  }
+
+  // on the beat the strip holds its colour from the end of a fade to the next beat
+  static uint32_t quiet(const State& state, uint32_t now_ms)
+  {
+    return !state.animating && beats.isLocked(now_ms) ? beats.getMsToBeat(now_ms) : 0;
+  }
+};
+
+// program 3: a pixel runs along the strip leaving a fading trail, the colour changes on every lap
+template <uint16_t T_PIXEL_COUNT, typename T_PALETTE, uint16_t T_STEP_MS>
+struct LoopEffect : EffectBase<100, true>
 {
-  RgbColor updatedColor =
-    RgbColor::LinearBlend(animationStateTwo[param.index].StartingColor, animationStateTwo[param.index].EndingColor, param.progress);
-  // apply the color to the strip
-  strip.SetPixelColor(param.index, updatedColor);
-}
+  struct State
+  {
+    ParticleSystem<T_PIXEL_COUNT> trail;
+    RgbColor                      front_color;
+    uint32_t                      step_start_ms;
+    uint16_t                      front_pixel;
+    FastRandom                    random;
+  };
 
-void PickRandom(float luminance)
+  template <typename T_CANVAS>
+  static void init(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    state.random        = effectRandom.split();
+    state.front_color   = T_PALETTE::pick(state.random.below(256));
+    state.step_start_ms = now_ms;
+    state.trail.Clear(now_ms);
+  }
+
+  static void update(State& state, uint32_t now_ms)
+  {
+    state.trail.Update(now_ms, T_PIXEL_COUNT);
+    // at most one step per frame
+    if (now_ms - state.step_start_ms < T_STEP_MS)
+      return;
+    state.step_start_ms = now_ms;
+    state.front_pixel   = (state.front_pixel + 1) % T_PIXEL_COUNT;
+    if (state.front_pixel == 0) {
+      // we looped, lets pick a new front color
+      state.front_color = T_PALETTE::pick(state.random.below(256));
+    }
+    // the compositor does the gamma correction for this program
+    state.trail.Spawn((int32_t)state.front_pixel << 16, 0, state.front_color, tunables.pixel_fade_ms);
+  }
+
+  template <typename T_CANVAS>
+  static void render(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    canvas.Fill(RgbColor(0));
+    state.trail.Render(canvas);
+  }
+};
+
+// program 4: a random set of pixels blends to random colours while the rest fade out
+template <uint16_t T_PIXEL_COUNT, typename T_PALETTE>
+struct SparkleEffect : EffectBase<60>
 {
-  // Crear un array para rastrear los píxeles seleccionados
-  bool selectedPixels[PixelCount] = {false};
+  struct State
+  {
+    PixelTweens<T_PIXEL_COUNT> tweens;
+    bool                       selected[T_PIXEL_COUNT];
+    FastRandom                 random;
+  };
 
-  // pick random count of pixels to animate
-  uint16_t count = random(PixelCount);
-  while (count > 0) {
-    // pick a random pixel
-    uint16_t pixel = random(PixelCount);
+  template <typename T_CANVAS>
+  static void init(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    state.random = effectRandom.split();
+  }
 
-    // pick random time and random color
-    // we use HslColor object as it allows us to easily pick a color
-    // with the same saturation and luminance
-    uint16_t time                          = random(100, 400);
-    animationStateTwo[pixel].StartingColor = strip.GetPixelColor<RgbColor>(pixel);
-    animationStateTwo[pixel].EndingColor   = HslColor(random(360) / 360.0f, 1.0f, luminance);
+  template <typename T_CANVAS>
+  static void render(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    if (!state.tweens.IsAnimating()) {
+      memset(state.selected, 0, sizeof(state.selected));
+      uint16_t pixels[RandomBatch];
+      uint16_t times[RandomBatch];
+      uint8_t  hues[RandomBatch];
+      // pick random count of pixels to animate
+      uint16_t remaining = state.random.below(T_PIXEL_COUNT);
+      while (remaining > 0) {
+        // pick random pixels, times and colors
+        uint16_t count = RandomBatchSize(0, remaining);
+        state.random.fill(pixels, count, T_PIXEL_COUNT);
+        state.random.fill(times, count, 100, 400);
+        state.random.fill(hues, count, 256);
+        for (uint16_t index = 0; index < count; index++) {
+          uint16_t pixel = pixels[index];
+          state.tweens.StartTween(pixel, canvas.GetPixelColor(pixel), T_PALETTE::pick(hues[index]), times[index], TweenEase_Linear, now_ms);
+          state.selected[pixel] = true;
+        }
+        remaining -= count;
+      }
+      // Incluir los píxeles no seleccionados en la animación con el color apagado
+      for (uint16_t first = 0; first < T_PIXEL_COUNT; first += RandomBatch) {
+        uint16_t count = RandomBatchSize(first, T_PIXEL_COUNT);
+        state.random.fill(times, count, 100, 400);
+        for (uint16_t index = 0; index < count; index++) {
+          uint16_t pixel = first + index;
+          if (!state.selected[pixel])
+            state.tweens.StartTween(pixel, canvas.GetPixelColor(pixel), RgbColor(0, 0, 0), times[index], TweenEase_Linear, now_ms);
+        }
+      }
+    }
+    state.tweens.UpdateTweens(canvas, now_ms);
+  }
+};
 
-    animations.StartAnimation(pixel, time, BlendAnimUpdateTwo);
+// program 5: a tail of one hue rotating around the strip, at the pace of the music if it has a beat
+template <uint16_t T_PIXEL_COUNT, uint16_t T_STEP_MS>
+struct RotateEffect : EffectBase<60, true>
+{
+  typedef ParticleSystem<T_PIXEL_COUNT, ParticleEdge_Wrap> Trail;
 
-    // Marcar el píxel como seleccionado
-    selectedPixels[pixel] = true;
+  struct State
+  {
+    Trail    trail;
+    RgbColor color;
+    uint32_t last_ms;
+    int32_t  head;
+    uint8_t  hue;
+  };
 
-    count--;
+  template <typename T_CANVAS>
+  static void init(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    // using the hue table as it makes it easy to pick from similiar saturated colors
+    state.hue     = effectRandom.below(256);
+    state.last_ms = now_ms;
+    state.trail.Clear(now_ms);
   }
 
-  // Incluir los píxeles no seleccionados en la animación con el color apagado
-  for (uint16_t pixel = 0; pixel < PixelCount; pixel++) {
-    if (!selectedPixels[pixel]) {
-      animationStateTwo[pixel].StartingColor = strip.GetPixelColor<RgbColor>(pixel);
-      animationStateTwo[pixel].EndingColor   = RgbColor(0, 0, 0);
-      uint16_t time                          = random(100, 400);
-      animations.StartAnimation(pixel, time, BlendAnimUpdateTwo);
+  static void update(State& state, uint32_t now_ms)
+  {
+    state.trail.Update(now_ms, T_PIXEL_COUNT);
+    // the head moves a pixel every step, the pixels it moves off fade out over the length of the
+    // tail, so the length and brightness of the tail follow the settings
+    uint32_t step_ms    = TempoDuration(T_STEP_MS, now_ms);
+    uint32_t tail_ms    = tunables.tail_length * step_ms;
+    uint8_t  brightness = ColorLut::brightnessFromLightness(tunables.max_lightness);
+    // the compositor does the gamma correction for this program
+    state.color  = ColorLut::hue(state.hue, brightness);
+    int32_t head = state.head + (int32_t)(((now_ms - state.last_ms) << 16) / step_ms);
+    for (int32_t pixel = state.head >> 16; pixel < head >> 16; pixel++) {
+      state.trail.Spawn((pixel % T_PIXEL_COUNT) << 16, 0, state.color, tail_ms < 65535 ? tail_ms : 65535);
     }
+    state.head    = head % ((int32_t)T_PIXEL_COUNT << 16);
+    state.last_ms = now_ms;
   }
-}
 
-void FadeInFadeOutRinseRepeat(float luminance)
+  template <typename T_CANVAS>
+  static void render(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    canvas.Fill(RgbColor(0));
+    state.trail.Render(canvas);
+    Trail::Splat(canvas, state.head, state.color, 255);
+  }
+};
+
+// program 6: a bar from green to red as long as the level of the audio
+template <uint16_t T_PIXEL_COUNT>
+struct LevelEffect : EffectBase<60>
 {
-  if (fadeToColor) {
-    RgbColor target                 = HslColor(random(360) / 360.0f, 1.0f, luminance);
-    uint16_t time                   = random(800, 2000);
-    animationState[0].StartingColor = strip.GetPixelColor<RgbColor>(0);
-    animationState[0].EndingColor   = target;
-    animations.StartAnimation(0, time, BlendAnimUpdate);
-  }
-  else {
-    uint16_t time                   = random(600, 700);
-    animationState[0].StartingColor = strip.GetPixelColor<RgbColor>(0);
-    animationState[0].EndingColor   = RgbColor(0);
-    animations.StartAnimation(0, time, BlendAnimUpdate);
-  }
-  fadeToColor = !fadeToColor;
-}
+  template <typename T_CANVAS>
+  static void render(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    // Mapear el RMS al rango de 0 a PixelCount
+    // clamped while still a long: a loud block maps past the strip, far enough to wrap a uint16_t
+    long     mapped    = map(levelMeter.getRMS(), 0, tunables.level_full_scale, 0, T_PIXEL_COUNT);
+    uint16_t numLedsOn = mapped < 0 ? 0 : (mapped > T_PIXEL_COUNT ? T_PIXEL_COUNT : mapped);
+
+    for (uint16_t i = 0; i < numLedsOn; i++) {
+      // Progresión de verde a rojo: cambia el valor RGB según la posición
+      uint8_t red   = map(i, 0, T_PIXEL_COUNT - 1, 0, 255);
+      uint8_t green = map(i, 0, T_PIXEL_COUNT - 1, 255, 0);
+      canvas.SetPixelColor(i, RgbColor(red, green, 0));
+    }
+    // Apagar los LEDs fuera del rango
+    canvas.Fill(numLedsOn, T_PIXEL_COUNT - numLedsOn, RgbColor(0, 0, 0));
+  }
+
+  // the bar stands still without audio, the writer task wakes the led task with the next block
+  static uint32_t quiet(const State& state, uint32_t now_ms)
+  {
+    return IsAudioStopped(now_ms) ? EffectQuietForever : 0;
+  }
+};
 
-void FadeOutAnimUpdate(const AnimationParam& param)
+// program 7: all pixels off
+struct OffEffect : EffectBase<10>
 {
-  RgbColor updatedColor = RgbColor::LinearBlend(animationState[param.index].StartingColor, animationState[param.index].EndingColor, param.progress);
-  // apply the color to the strip
-  strip.SetPixelColor(animationState[param.index].IndexPixel, colorGamma.Correct(updatedColor));
-}
+  template <typename T_CANVAS>
+  static void init(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    canvas.Fill(RgbColor(0));
+  }
+
+  static uint32_t quiet(const State& state, uint32_t now_ms)
+  {
+    return EffectQuietForever;
+  }
+};
 
-void LoopAnimUpdate(const AnimationParam& param)
+// program 8: every band of the spectrum drives a segment of the strip, lit from its start proportionally to the band level
+template <uint16_t T_PIXEL_COUNT, uint8_t T_BAND_COUNT>
+struct SpectrumEffect : EffectBase<60>
 {
-  if (param.state == AnimationState_Completed) {
-    // done, time to restart this position tracking animation/timer
-    animations.RestartAnimation(param.index);
-
-    // pick the next pixel inline to start animating
-    //
-    frontPixel = (frontPixel + 1) % PixelCount; // increment and wrap
-    if (frontPixel == 0) {
-      // we looped, lets pick a new front color
-      frontColor = HslColor(random(360) / 360.0f, 1.0f, 0.25f);
-      // check if program has changed
-      if (program != 3) {
-        animations.StopAnimation(param.index);
-        return;
-      }
+  template <typename T_CANVAS>
+  static void render(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    // the bands are analysed by the i2s writer task, a torn read only mixes two consecutive blocks
+    const uint8_t* bands         = spectrum.getBands();
+    const uint16_t SegmentLength = T_PIXEL_COUNT / T_BAND_COUNT;
+    for (uint8_t band = 0; band < T_BAND_COUNT; band++) {
+      uint16_t start     = band * SegmentLength;
+      uint16_t numLedsOn = (bands[band] * SegmentLength + 254) / 255;
+      // colour from red for the bass to blue for the treble
+      RgbColor color = ColorLut::hue(band * 179 / T_BAND_COUNT, 127);
+      canvas.Fill(start, numLedsOn, color);
+      canvas.Fill(start + numLedsOn, SegmentLength - numLedsOn, RgbColor(0));
     }
+  }
 
-    uint16_t indexAnim;
-    // do we have an animation available to use to animate the next front pixel?
-    // if you see skipping, then either you are going to fast or need to increase
-    // the number of animation channels
-    if (animations.NextAvailableAnimation(&indexAnim, 1)) {
-      animationState[indexAnim].StartingColor = frontColor;
-      animationState[indexAnim].EndingColor   = RgbColor(0, 0, 0);
-      animationState[indexAnim].IndexPixel    = frontPixel;
+  // the bands stand still without audio, the writer task wakes the led task with the next block
+  static uint32_t quiet(const State& state, uint32_t now_ms)
+  {
+    return IsAudioStopped(now_ms) ? EffectQuietForever : 0;
+  }
+};
 
-      animations.StartAnimation(indexAnim, PixelFadeDuration, FadeOutAnimUpdate);
+// program 9: pre-rendered clips in the spiffs partition decoded straight into the canvas at their own frame rate
+template <typename T_CANVAS>
+struct ClipEffect : EffectBase<30>
+{
+  struct State
+  {
+    ClipPlayer<T_CANVAS> player;
+    uint16_t             next_clip;
+    // the clip plays by the clock: frames decoded since it started at start_ms
+    uint32_t start_ms;
+    uint32_t frames;
+    uint8_t  fps;
+  };
+
+  // start playing the next clip of the bank, false if there is none
+  static bool startNextClip(State& state, uint32_t now_ms)
+  {
+    PixelClip clip;
+    for (uint16_t tries = 0; tries < clipBank.getClipCount(); tries++) {
+      uint16_t index  = state.next_clip;
+      state.next_clip = (state.next_clip + 1) % clipBank.getClipCount();
+      if (clipBank.getClip(index, clip)) {
+        state.player.start(clip);
+        state.start_ms = now_ms;
+        state.frames   = 0;
+        state.fps      = clip.getFps() > 0 ? clip.getFps() : 1;
+        scheduler.setTarget(clip.getFps());
+        return true;
+      }
     }
+    return false;
   }
-}
 
-void LoopAnimUpdateTwo(const AnimationParam& param)
-{
-  // wait for this animation to complete,
-  // we are using it as a timer of sorts
-  if (param.state == AnimationState_Completed) {
-    // done, time to restart this position tracking animation/timer
-    animations.RestartAnimation(param.index);
+  static void init(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    canvas.Fill(RgbColor(0));
+    if (!startNextClip(state, now_ms))
+      Serial.println("No clips in flash");
+  }
 
-    // rotate the complete strip one pixel to the right on every update
-    strip.RotateRight(1);
+  static void render(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    TELEMETRY_SCOPE(clipDecodeSection);
+    // decode every frame due by now, so a clip keeps its length when a frame comes late
+    uint32_t due = (uint64_t)(now_ms - state.start_ms) * state.fps / 1000 + 1;
+    while (state.frames < due) {
+      if (!state.player.nextFrame(canvas)) {
+        // move on to the next clip when this one has played its repeats
+        if (state.player.isPlaying() || !startNextClip(state, now_ms) || !state.player.nextFrame(canvas))
+          return;
+        due = 1;
+      }
+      state.frames++;
+    }
   }
-}
 
-void DrawTailPixels()
+  // sleep through the frames ahead that change nothing, but not past the next one that does
+  static uint32_t quiet(const State& state, uint32_t now_ms)
+  {
+    if (!state.player.isPlaying())
+      return 0;
+    uint32_t frame   = state.frames + state.player.countUnchangedFrames(state.fps);
+    uint32_t due_ms  = state.start_ms + ((uint64_t)frame * 1000 + state.fps - 1) / state.fps;
+    int32_t  wait_ms = (int32_t)(due_ms - now_ms);
+    return wait_ms > 1 ? wait_ms : 1;
+  }
+};
+
+// newest frame streamed over Serial, false if none arrived since the last call
+bool TakeStreamedFrame(const uint8_t*& pixels);
+
+// program 10: frames streamed over Serial, shown as they arrive
+struct StreamEffect : EffectBase<100>
 {
-  // using Hsl as it makes it easy to pick from similiar saturated colors
-  float hue = random(360) / 360.0f;
-  for (uint16_t index = 0; index < strip.PixelCount() && index <= TailLength; index++) {
-    float    lightness = index * MaxLightness / TailLength;
-    RgbColor color     = HslColor(hue, 1.0f, lightness);
+  template <typename T_CANVAS>
+  static void render(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    const uint8_t* pixels;
+    if (TakeStreamedFrame(pixels))
+      canvas.SetPixels(pixels);
+  }
 
-    strip.SetPixelColor(index, colorGamma.Correct(color));
+  // the control task wakes the led task with every streamed frame
+  static uint32_t quiet(const State& state, uint32_t now_ms)
+  {
+    return EffectQuietForever;
   }
+};
+
+// the programs, in order
+typedef EffectRegistry<Canvas,
+                       TwinkleEffect<PixelCount, 128>,
+                       CylonEffect<PixelCount, TweenEase_SinusoidalInOut, 1500, 20, 10>,
+                       FadeInOutEffect<HuePalette<ColorLut::brightnessFromLightness(0.2f)>>,
+                       LoopEffect<PixelCount, HuePalette<ColorLut::brightnessFromLightness(0.25f)>, NextPixelMoveDuration>,
+                       SparkleEffect<PixelCount, HuePalette<ColorLut::brightnessFromLightness(0.2f)>>,
+                       RotateEffect<PixelCount, RotateStepDuration>,
+                       LevelEffect<PixelCount>,
+                       OffEffect,
+                       SpectrumEffect<PixelCount, SpectrumBands>,
+                       ClipEffect<Canvas>,
+                       StreamEffect>
+      Effects;
+const uint8_t StreamProgram  = Effects::Count - 1;
+const uint8_t ButtonPrograms = Effects::Count - 1;
+// the rest of the 320 KB of DRAM is left to the core, the strip buffers and the drivers
+const size_t StaticMemoryLimit = 160 * 1024;
+const size_t StaticMemoryOther = sizeof(frame) + sizeof(transmitter) + sizeof(ledStack) + sizeof(ledTcb) + sizeof(writerStack) + sizeof(writerTcb) +
+                                 sizeof(sampler) + sizeof(audioBlocks) + sizeof(spectrum) + sizeof(levelMeter) + sizeof(beats) +
+                                 sizeof(button) + sizeof(capture);
+
+// control over Serial, with frame streaming when its buffers fit the budget next to the smaller compositor
+typedef LayerCompositor<Effects, PixelCount, false>   FrozenCompositor;
+typedef SerialControl<Tunables, PixelCount>            StreamingControl;
+typedef std::conditional<StaticMemoryOther + sizeof(StreamingControl) + sizeof(FrozenCompositor) <= StaticMemoryLimit, StreamingControl,
+                         SerialControl<Tunables, 0>>::type Control;
+Control control;
+
+bool TakeStreamedFrame(const uint8_t*& pixels)
+{
+  return control.takeFrame(pixels);
 }
 
-void SetRandomSeed()
+bool IsCapturingAudio()
 {
-  uint32_t seed;
-  seed = analogRead(0);
-  delay(1);
-  for (int shifts = 3; shifts < 31; shifts += 3) {
-    seed ^= analogRead(0) << shifts;
-    delay(1);
-  }
-  randomSeed(seed);
+  return control.isCapturing();
 }
 
-void SetupAnimationSet()
+TELEMETRY_GAUGE(controlStackGauge, "stack.control",
+                [] { return control.getTaskHandle() != NULL ? (uint32_t)uxTaskGetStackHighWaterMark(control.getTaskHandle()) : 0; });
+TELEMETRY_GAUGE(controlErrors, "control.crc_errors", [] { return control.getParser().getCrcErrors(); });
+
+// switching programs crossfades from the running one, which keeps running through the transition
+// when a second effect arena fits the budget and otherwise fades out as it was
+typedef LayerCompositor<Effects, PixelCount, true> LiveCompositor;
+typedef std::conditional<StaticMemoryOther + sizeof(Control) + sizeof(LiveCompositor) <= StaticMemoryLimit, LiveCompositor, FrozenCompositor>::type
+           Compositor;
+Compositor effects;
+
+// everything the firmware uses at runtime, listed at boot
+MEMORY_BUDGET(frameBudget, "frame", sizeof(frame));
+MEMORY_BUDGET(transmitterBudget, "transmitter", sizeof(transmitter));
+MEMORY_BUDGET(effectsBudget, "effects", sizeof(effects));
+MEMORY_BUDGET(ledStackBudget, "stack.led", sizeof(ledStack) + sizeof(ledTcb));
+MEMORY_BUDGET(writerStackBudget, "stack.writer", sizeof(writerStack) + sizeof(writerTcb));
+MEMORY_BUDGET(samplerBudget, "sampler", sizeof(sampler));
+MEMORY_BUDGET(audioBlocksBudget, "audio.blocks", sizeof(audioBlocks));
+MEMORY_BUDGET(spectrumBudget, "spectrum", sizeof(spectrum));
+MEMORY_BUDGET(levelMeterBudget, "level", sizeof(levelMeter));
+MEMORY_BUDGET(beatsBudget, "beats", sizeof(beats));
+MEMORY_BUDGET(buttonBudget, "button", sizeof(button));
+MEMORY_BUDGET(controlBudget, "control", sizeof(control));
+MEMORY_BUDGET(captureBudget, "capture", sizeof(capture));
+const size_t StaticMemoryBytes = StaticMemoryOther + sizeof(control) + sizeof(effects);
+static_assert(StaticMemoryBytes <= StaticMemoryLimit, "static memory over budget, fewer pixels or smaller effect states");
+
+void printFrameStats()
 {
-  // setup some animations
-  for (uint16_t pixel = 0; pixel < PixelCount; pixel++) {
-    const uint8_t    peak          = 128;
-    uint16_t         time          = random(500, 800);
-    RgbColor         originalColor = strip.GetPixelColor<RgbColor>(pixel);
-    RgbColor         targetColor   = RgbColor(random(peak), random(peak), random(peak));
-    AnimEaseFunction easing;
-    switch (random(3)) {
-      case 0:
-        easing = NeoEase::CubicIn;
-        break;
-      case 1:
-        easing = NeoEase::CubicOut;
-        break;
-      case 2:
-        easing = NeoEase::QuadraticInOut;
-        break;
-    }
-    AnimUpdateCallback animUpdate = [=](const AnimationParam& param) {
-      float    progress     = easing(param.progress);
-      RgbColor updatedColor = RgbColor::LinearBlend(originalColor, targetColor, progress);
-      strip.SetPixelColor(pixel, updatedColor);
-    };
-    animations.StartAnimation(pixel, time, animUpdate);
+  uint32_t frames = scheduler.getFrames();
+  if (frames == 0)
+    return;
+  Serial.printf("Frames shown %lu, skipped %lu, overruns %lu, over budget %lu at %u fps\n", (unsigned long)frame.getFramesShown(),
+                (unsigned long)frame.getFramesSkipped(), (unsigned long)scheduler.getOverruns(), (unsigned long)scheduler.getBudgetExceeds(),
+                scheduler.getFps());
+  const char* phaseNames[FramePhase_Count] = {"update", "render", "show"};
+  for (int phase = 0; phase < FramePhase_Count; phase++) {
+    const FramePhaseStats& stats = scheduler.getPhaseStats((FramePhase)phase);
+    Serial.printf("  %s avg %lu us, max %lu us\n", phaseNames[phase], (unsigned long)(stats.total_us / frames), (unsigned long)stats.max_us);
   }
+  // the render task never waits on the transmit task, the transmit task waits for new frames
+  Serial.printf("Transmit %.1f fps, sent %lu, dropped %lu, waiting %lu ms, pushing %lu ms\n", transmitter.getFps(),
+                (unsigned long)transmitter.getFramesSent(), (unsigned long)transmitter.getFramesDropped(), (unsigned long)(transmitter.getWaitUs() / 1000),
+                (unsigned long)(transmitter.getShowUs() / 1000));
+  // the transmit task wakes once per frame sent
+  const TaskLoad& led_load     = scheduler.getLoad();
+  const TaskLoad& control_load = control.getLoad();
+  Serial.printf("CPU led %.1f%% %.1f wakeups/s (%lu idle), transmit %.1f%%, writer %.1f%% %.1f wakeups/s, control %.1f%% %.1f wakeups/s\n",
+                led_load.getLoad(), led_load.getWakeupRate(), (unsigned long)scheduler.getIdleFrames(), transmitter.getLoad(), writerLoad.getLoad(),
+                writerLoad.getWakeupRate(), control_load.getLoad(), control_load.getWakeupRate());
+  scheduler.resetStats();
+  transmitter.resetStats();
+  writerLoad.reset();
+  control.resetLoad();
 }
 
-void SetupAnimations()
+// program after a press
+uint8_t nextProgram(uint8_t current, ButtonEvent event, uint8_t count)
 {
-  // fade all pixels providing a tail that is longer the faster
-  // the pixel moves.
-  animations.StartAnimation(0, 20, FadeAnimUpdate);
+  switch (event) {
+    case ButtonEvent_Short:
+      return current + 1 < count ? current + 1 : 0;
+    case ButtonEvent_Double:
+      return current > 0 && current <= count ? current - 1 : count - 1;
+    case ButtonEvent_Long:
+      if (current == OffProgram)
+        return resumeProgram;
+      resumeProgram = current;
+      return OffProgram;
+    default:
+      return current;
+  }
+}
 
-  // take several seconds to move eye fron one side to the other
-  animations.StartAnimation(1, 1500, MoveAnimUpdate);
+// settings that are not read by the programs themselves
+void applyTunables()
+{
+  effects.setTransition((BlendMode)tunables.transition_mode, tunables.transition_ms);
+  scheduler.setMaxIdle(tunables.max_idle_ms);
+  sampler.setSampleShift(tunables.sample_shift);
+  frame.SetOutput(false, tunables.brightness);
 }
 
 void ledConfigTask(void* pvParameters)
 {
-  bool setup0done = false;
-  bool setup1done = false;
-  bool setup2done = false;
-  bool setup3done = false;
-  bool setup4done = false;
-  bool setup5done = false;
-  bool setup6done = false;
-  bool setup7done = false;
+  scheduler.begin(Effects::getFps(0));
+  applyTunables();
   while (true) {
-    switch (program) {
-      case 0:
-        if (!setup0done) {
-          Serial.println("Running Setup 0");
-          SetRandomSeed();
-          for (uint16_t pixel = 0; pixel < PixelCount; pixel++) {
-            RgbColor color = RgbColor(random(255), random(255), random(255));
-            strip.SetPixelColor(pixel, color);
-          }
-          setup0done = true;
-        }
-        if (animations.IsAnimating()) {
-          animations.UpdateAnimations();
-          strip.Show();
-        }
-        else
-          SetupAnimationSet();
-        break;
-      case 1:
-        if (!setup1done) {
-          Serial.println("Running Setup 1");
-          SetupAnimations();
-          setup0done = false;
-          setup1done = true;
-        }
-        animations.UpdateAnimations();
-        strip.Show();
-        break;
-      case 2:
-        if (!setup2done) {
-          Serial.println("Running Setup 2");
-          SetRandomSeed();
-          setup1done = false;
-          setup2done = true;
-        }
-        if (animations.IsAnimating()) {
-          animations.UpdateAnimations();
-          strip.Show();
-        }
-        else
-          FadeInFadeOutRinseRepeat(0.2f);
-        break;
-      case 3:
-        if (!setup3done) {
-          Serial.println("Running Setup 3");
-          SetRandomSeed();
-          setup2done = false;
-          setup3done = true;
-          animations.StartAnimation(0, NextPixelMoveDuration, LoopAnimUpdate);
-        }
-        animations.UpdateAnimations();
-        strip.Show();
-        break;
-      case 4:
-        if (!setup4done) {
-          Serial.println("Running Setup 4");
-          SetRandomSeed();
-          setup3done = false;
-          setup4done = true;
-        }
-        if (animations.IsAnimating()) {
-          animations.UpdateAnimations();
-          strip.Show();
-        }
-        else {
-          PickRandom(0.2f); // 0.0 = black, 0.25 is normal, 0.5 is bright
-        }
-        break;
-      case 5:
-        if (!setup5done) {
-          Serial.println("Running Setup 5");
-          SetRandomSeed();
-          setup4done = false;
-          setup5done = true;
-          DrawTailPixels();
-          animations.StartAnimation(0, 66, LoopAnimUpdateTwo);
-        }
-        animations.UpdateAnimations();
-        strip.Show();
-        break;
-      case 6:
-        if (!setup6done) {
-          Serial.println("Running Setup 6");
-          setup5done = false;
-          setup6done = true;
-        }
-        break;
-      case 7:
-        if (!setup7done) {
-          Serial.println("Running Setup 7");
-          setup6done = false;
-          // switch all pixels off
-          for (uint16_t pixel = 0; pixel < PixelCount; pixel++) {
-            strip.SetPixelColor(pixel, RgbColor(0));
-          }
-          strip.Show();
-          setup7done = true;
-        }
-        break;
-      case 8:
-        // return to setup 0
-        setup7done = false;
-        program    = 0;
-        break;
+    scheduler.beginFrame();
+    // presses and Serial requests since the last frame, the program and the settings only change here
+    ButtonEvent event;
+    while (button.receive(event)) {
+      printFrameStats();
+      program = nextProgram(program, event, ButtonPrograms);
     }
-    vTaskDelay(1);
+    control.takeProgram(program);
+    if (control.takeParams(tunables))
+      applyTunables();
+    if (program >= Effects::Count)
+      program = 0;
+    uint8_t selected = program;
+    if (selected != effects.getCurrent()) {
+      Serial.printf("Running Setup %u\n", selected);
+      // every program runs at its own frame rate, the incoming one sets it for the transition
+      scheduler.setTarget(Effects::getFps(selected));
+      effects.select(selected, millis());
+    }
+    effects.update(millis());
+    scheduler.endPhase(FramePhase_Update);
+    {
+      TELEMETRY_SCOPE(ledAnimateSection);
+      effects.render(millis());
+      effects.compose(frame, millis());
+    }
+    scheduler.endPhase(FramePhase_Render);
+    bool changed;
+    {
+      TELEMETRY_SCOPE(ledShowSection);
+      changed = frame.Show();
+    }
+    scheduler.endPhase(FramePhase_Show);
+    // idle while the program has nothing new to show, presses, Serial requests and audio blocks wake the task
+    scheduler.waitNextFrame(changed, effects.getQuietMs(millis()));
   }
 }
 
+// the analysis of the audio starts over, the host does this before every replay of a recording
+void beginAudioAnalysis()
+{
+  spectrum.begin(AnalysisSampleRate, SpectrumBands, 60.0f, 16000.0f);
+  levelMeter.begin(AudioBlockSizeInBytes / sizeof(int16_t), LevelWindowBlocks);
+  beats.begin(AnalysisSampleRate);
+}
+
 void setup()
 {
-  Serial.begin(115200);
+  Serial.setRxBufferSize(SerialRxBufferSize);
+  Serial.setTxBufferSize(SerialTxBufferSize);
+  Serial.begin(SerialBaud);
   while (!Serial)
     ; // wait for serial attach
 
+  ColorLut::begin();
+  effectRandom.seed(esp_random());
+  beginAudioAnalysis();
+  if (clipBank.begin())
+    Serial.printf("%u clips in flash\n", clipBank.getClipCount());
+  if (!button.begin(BUTTON_PIN, HIGH))
+    Serial.println("Failed to set up the button");
+  control.begin(tunables, setTunable, Effects::Count, StreamProgram);
+  TELEMETRY_BEGIN(TelemetryPeriodMs);
+  Serial.println("Static memory");
+  MemoryBudget::print();
+
   //   // Inicializar el sampler I2S
-  //   i2s_sampler = new I2SSampler();
+  //   i2s_sampler = &sampler;
 
-  //   // Iniciar el muestreo desde el micrófono
-  //   i2s_sampler->start(I2S_NUM_1, i2s_pins, i2s_config, 8192, writer_task_handle); // Buffer reducido para mayor rapidez
+  //   // let the AGC bring every site to roughly the same level, the RMS bar maps 0..3000
+  //   i2s_sampler->enableAgc(true);
+  //   i2s_sampler->getAgc().setTarget(1500, 6);
+  //   i2s_sampler->setDecimation(AudioDecimation);
 
-  //   if (xTaskCreate(i2sWriterTask, "I2S Writer Task", 4096, i2s_sampler, 1, &writer_task_handle) != pdPASS) {
+  //   // the writer task has to exist before the sampler starts so it receives the block notifications
+  //   writer_task_handle = xTaskCreateStatic(i2sWriterTask, "I2S Writer Task", WriterStackSize, (AudioBlockSource*)i2s_sampler, 1, writerStack,
+  //                                          &writerTcb);
+  //   if (writer_task_handle == NULL) {
   //     Serial.println("Failed to create Sound Led Task");
   //     ESP.restart();
   //   }
   //   else
   //     Serial.println("Sound Task Created");
 
-  strip.Begin();
-  strip.Show();
+  //   // Iniciar el muestreo desde el micrófono
+  //   if (!i2s_sampler->start(I2S_NUM_1, i2s_pins, i2s_config, audioBlocks, AudioBlockSizeInBytes, AudioBlockCount, writer_task_handle, AudioCore)) {
+  //     Serial.println("Failed to start I2S Sampler");
+  //     ESP.restart();
+  //   }
+
+  // the transmit task initialises the strip on its own core
+  if (!transmitter.start(TransmitCore, 2)) {
+    Serial.println("Failed to create Strip Transmit Task");
+    ESP.restart();
+  }
+
+  // the control task sleeps until Serial receives something
+  if (!control.start(ControlCore, 1)) {
+    Serial.println("Failed to create Serial Control Task");
+    ESP.restart();
+  }
 
   // create task to run the animations
-  if (xTaskCreate(ledConfigTask, "Led Task", 4096, NULL, 1, &ledTaskHandle) != pdPASS) {
+  ledTaskHandle = xTaskCreateStaticPinnedToCore(ledConfigTask, "Led Task", LedStackSize, NULL, 1, ledStack, &ledTcb, RenderCore);
+  if (ledTaskHandle == NULL) {
     Serial.println("Failed to create Led Task");
     ESP.restart();
   }
   else
     Serial.println("Led Task Created");
+  // the led task idles while nothing changes, input and requests wake it
+  button.setListener(ledTaskHandle);
+  control.setRenderTask(ledTaskHandle);
 }
 
 void loop()
 {
-  if (digitalRead(BUTTON_PIN) == HIGH) {
-    program++;
-    while (digitalRead(BUTTON_PIN) == HIGH)
-      vTaskDelay(10);
-  }
-
+  // the dump only writes what fits into the Serial buffer, the rest goes out on the next pass
+  TELEMETRY_POLL();
+  // boot is over once the transmit task has set up the strip and sent a frame, nothing is allocated after that
+  if (transmitter.getFramesSent() > 0)
+    HEAP_GUARD_ARM();
+  HEAP_GUARD_CHECK();
   vTaskDelay(10);
 }
\ No newline at end of file
@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "BeatTracker.h"
+#include "HostHarness.h"
+#include "I2SSampler.h"
+#include "LevelMeter.h"
+#include "SpectrumAnalyzer.h"
+
+// The analysis of the sampler's blocks: the level meter against the full buffer RMS it replaced, the
+// fixed point FFT against a double precision DFT, the spectrum of blocks longer than a window, and the
+// beat tracker against click tracks at known tempos and after the blocks stopped.
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// the level the way the writer task computed it before, over the whole buffer on every call
+static float calculateRMS(const int16_t* buffer, int32_t num_samples)
+{
+  double sum = 0;
+  for (int i = 0; i < num_samples; i++) {
+    sum += buffer[i] * buffer[i];
+  }
+  return sqrt(sum / num_samples);
+}
+
+static const int32_t MeterBlock  = 256;
+static const int     MeterWindow = 4;
+
+// blocks of silence, quiet and loud noise, a sine and full scale, changing every few blocks
+static std::vector<int16_t> meterSignal(uint32_t blocks)
+{
+  std::vector<int16_t> samples(blocks * MeterBlock);
+  FastRandom           random(3);
+  for (uint32_t block = 0; block < blocks; block++) {
+    int kind = (block / 3) % 5;
+    for (int32_t index = 0; index < MeterBlock; index++) {
+      int32_t noise = (int32_t)random.below(65536) - 32768;
+      int32_t value = kind == 0 ? 0 : kind == 1 ? noise / 200 : kind == 2 ? noise : kind == 3 ? lrintf(12000.0f * sinf(index * 0.3f)) : -32768;
+      samples[block * MeterBlock + index] = value;
+    }
+  }
+  return samples;
+}
+
+// After every block the meter's RMS is the RMS of the buffer of its window, the up to 4 latest
+// blocks, give or take the half LSB its integer mean square drops. The peak is the block's when it rises.
+static void test_level_matches_rms()
+{
+  const uint32_t       Blocks  = 200;
+  std::vector<int16_t> samples = meterSignal(Blocks);
+  LevelMeter           meter;
+  TEST_ASSERT_TRUE(meter.begin(MeterBlock, MeterWindow));
+  float worst = 0;
+  for (uint32_t block = 0; block < Blocks; block++) {
+    const int16_t* first = &samples[block * MeterBlock];
+    meter.addBlock(first);
+    uint32_t window    = block + 1 < MeterWindow ? block + 1 : MeterWindow;
+    float    reference = calculateRMS(first + MeterBlock - window * MeterBlock, window * MeterBlock);
+    worst              = fmaxf(worst, fabsf(meter.getRMS() - reference));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f + reference * 1e-5f, reference, meter.getRMS());
+    int32_t block_peak = 0;
+    for (int32_t index = 0; index < MeterBlock; index++) {
+      block_peak = std::max(block_peak, abs(first[index]));
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL(block_peak, meter.getPeak());
+  }
+  printf("level: worst RMS difference %.3f over %lu blocks\n", worst, (unsigned long)Blocks);
+}
+
+// levels of the cost benchmark, kept so the optimizer cannot drop the work being timed
+static volatile float s_level_sink;
+
+// the cost of a level per block: the whole window scanned again against one pass over the new block,
+// printed for comparison only since host timings say little about the ESP32
+static void test_level_cost()
+{
+  const uint32_t       Blocks  = 200;
+  const uint32_t       Repeats = 200;
+  std::vector<int16_t> samples = meterSignal(Blocks);
+  LevelMeter           meter;
+  meter.begin(MeterBlock, MeterWindow);
+  float                                 sum   = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t repeat = 0; repeat < Repeats; repeat++) {
+    for (uint32_t block = MeterWindow; block < Blocks; block++) {
+      sum += calculateRMS(&samples[(block - MeterWindow + 1) * MeterBlock], MeterWindow * MeterBlock);
+    }
+  }
+  double scan_ns = hostSecondsSince(start) * 1e9 / (Repeats * (Blocks - MeterWindow));
+  start          = std::chrono::steady_clock::now();
+  for (uint32_t repeat = 0; repeat < Repeats; repeat++) {
+    for (uint32_t block = MeterWindow; block < Blocks; block++) {
+      meter.addBlock(&samples[block * MeterBlock]);
+      sum += meter.getRMS();
+    }
+  }
+  double meter_ns = hostSecondsSince(start) * 1e9 / (Repeats * (Blocks - MeterWindow));
+  s_level_sink = sum;
+  printf("level: calculateRMS over the window %.0f ns/block, meter %.0f ns/block\n", scan_ns, meter_ns);
+}
+
+static const int FftSize = SpectrumAnalyzer::FftSize;
+
+// FftSize samples of a sine at bin frequency (in bins, fractional ones leak) and amplitude, plus noise
+static void spectrumSignal(int16_t* samples, float bin, float amplitude, float noise, uint32_t seed)
+{
+  FastRandom random(seed);
+  for (int n = 0; n < FftSize; n++) {
+    float value = amplitude * sinf(2.0f * (float)M_PI * bin * n / FftSize) + noise * ((int32_t)random.below(65536) - 32768);
+    samples[n]  = value > 32767 ? 32767 : (value < -32768 ? -32768 : lrintf(value));
+  }
+}
+
+// largest distance in LSB of the analyzer's bins from the DFT of the hann windowed samples over FftSize
+static double binError(SpectrumAnalyzer& analyzer, const int16_t* samples)
+{
+  analyzer.process(samples);
+  double worst = 0;
+  for (int k = 1; k < FftSize / 2; k++) {
+    double re = 0, im = 0;
+    for (int n = 0; n < FftSize; n++) {
+      double windowed = samples[n] * (0.5 - 0.5 * cos(2.0 * M_PI * n / FftSize));
+      re += windowed * cos(2.0 * M_PI * k * n / FftSize);
+      im -= windowed * sin(2.0 * M_PI * k * n / FftSize);
+    }
+    int32_t bin_re, bin_im;
+    analyzer.getBin(k, bin_re, bin_im);
+    worst = fmax(worst, fmax(fabs(bin_re - re / FftSize), fabs(bin_im - im / FftSize)));
+  }
+  return worst;
+}
+
+// every bin of a full scale sine, tones in noise, quiet noise and silence within 4 LSB of the DFT,
+// 66 dB under a full scale sine and below the floor of the bands
+static void test_fft_matches_dft()
+{
+  static SpectrumAnalyzer analyzer;
+  static int16_t          samples[FftSize];
+  TEST_ASSERT_TRUE(analyzer.begin(AnalysisRate, 15, 60.0f, 16000.0f));
+  const float Signals[][3] = {{20.0f, 32767.0f, 0.0f}, {37.3f, 16000.0f, 0.2f}, {3.5f, 0.0f, 0.01f}, {0.0f, 0.0f, 0.0f}, {101.7f, 2000.0f, 0.5f}};
+  double      worst        = 0;
+  for (int signal = 0; signal < 5; signal++) {
+    spectrumSignal(samples, Signals[signal][0], Signals[signal][1], Signals[signal][2], signal + 1);
+    worst = fmax(worst, binError(analyzer, samples));
+  }
+  printf("fft: worst bin error %.2f LSB against the DFT, full scale 8192\n", worst);
+  TEST_ASSERT_LESS_THAN_FLOAT(4.0f, worst);
+}
+
+// a full scale sine on a bin peaks at a quarter of full scale, what the dB scale of the bands assumes
+static void test_fft_full_scale()
+{
+  static SpectrumAnalyzer analyzer;
+  static int16_t          samples[FftSize];
+  TEST_ASSERT_TRUE(analyzer.begin(AnalysisRate, 15, 60.0f, 16000.0f));
+  spectrumSignal(samples, 20.0f, 32767.0f, 0.0f, 1);
+  analyzer.process(samples);
+  int32_t re, im;
+  analyzer.getBin(20, re, im);
+  TEST_ASSERT_FLOAT_WITHIN(8192 * 0.01f, 8192.0f, sqrtf((float)re * re + (float)im * im));
+}
+
+// the bands that light up for a block of two windows with a tone in one half only
+static int loudestBand(bool first_half)
+{
+  static SpectrumAnalyzer analyzer;
+  static int16_t          block[2 * FftSize];
+  analyzer.begin(AnalysisRate, 15, 60.0f, 16000.0f);
+  analyzer.setResponse(256, 256);
+  memset(block, 0, sizeof(block));
+  spectrumSignal(first_half ? block : block + FftSize, 40.0f, 16000.0f, 0.0f, 1);
+  analyzer.process(block, 2 * FftSize);
+  int loudest = 0;
+  for (int band = 1; band < analyzer.getBandCount(); band++) {
+    loudest = analyzer.getBands()[band] > analyzer.getBands()[loudest] ? band : loudest;
+  }
+  return analyzer.getBands()[loudest] > 0 ? loudest : -1;
+}
+
+// a block longer than a window is analysed whole, a tone in its first half shows like one in its second
+static void test_spectrum_whole_block()
+{
+  int first  = loudestBand(true);
+  int second = loudestBand(false);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, first);
+  TEST_ASSERT_EQUAL(second, first);
+}
+
+// the beat tracker fed with block end times on the audio clock
+static BeatTracker s_beats;
+static uint32_t    s_beat_samples   = 0;
+static uint32_t    s_beat_locked_ms = 0;
+
+static void drainBeats(I2SSampler& sampler)
+{
+  const int16_t* block;
+  while ((block = sampler.tryAcquireBlock()) != NULL) {
+    int32_t size = sampler.getBufferSizeInSamples();
+    s_beat_samples += size;
+    uint32_t end_ms = (uint64_t)s_beat_samples * 1000 / AnalysisRate;
+    s_beats.process(block, size, end_ms);
+    if (s_beats.isLocked(end_ms) && s_beat_locked_ms == 0)
+      s_beat_locked_ms = end_ms;
+    sampler.releaseBlock();
+  }
+}
+
+// 20 s click track at bpm, the tracker has to lock, find the tempo and put its beats on the clicks
+static void checkBeats(float bpm)
+{
+  HostI2SSource source;
+  source.generate(HostSignal_Clicks, bpm / 60.0f, 0.02f, SampleRate * 20, SampleRate);
+  I2SSampler sampler;
+  s_beats.begin(AnalysisRate);
+  s_beat_samples   = 0;
+  s_beat_locked_ms = 0;
+  TEST_ASSERT_TRUE(hostRunSampler(sampler, false, source, drainBeats));
+
+  // distance of the predicted beats from the clicks over the last beats of the track
+  uint32_t click_period = (uint32_t)(SampleRate * 60.0f / bpm);
+  uint32_t end_ms       = (uint64_t)s_beat_samples * 1000 / AnalysisRate;
+  uint32_t period_ms    = s_beats.getBeatPeriodMs();
+  float    worst_ms     = 0.0f;
+  for (uint32_t now = end_ms - 8 * period_ms; now < end_ms; now++) {
+    if (s_beats.getBeatPhase(now) > s_beats.getBeatPhase(now + 1)) {
+      // a beat falls between now and now + 1
+      uint32_t beat_sample  = (uint64_t)(now + 1) * SampleRate / 1000;
+      uint32_t click_offset = beat_sample % click_period;
+      float    error_ms     = (click_offset < click_period / 2 ? click_offset : click_period - click_offset) * 1000.0f / SampleRate;
+      if (error_ms > worst_ms)
+        worst_ms = error_ms;
+    }
+  }
+  printf("beats %3.0f bpm: %.1f bpm, confidence %.2f, locked after %lu ms, %lu onsets, worst beat error %.1f ms\n", bpm, s_beats.getBpm(),
+         s_beats.getConfidence(), (unsigned long)s_beat_locked_ms, (unsigned long)s_beats.getOnsetCount(), worst_ms);
+  TEST_ASSERT_TRUE(s_beats.isLocked(end_ms));
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, bpm, s_beats.getBpm());
+  TEST_ASSERT_LESS_THAN_FLOAT(20.0f, worst_ms);
+}
+
+static void test_beats_70()
+{
+  checkBeats(70.0f);
+}
+
+static void test_beats_90()
+{
+  checkBeats(90.0f);
+}
+
+static void test_beats_120()
+{
+  checkBeats(120.0f);
+}
+
+static void test_beats_128()
+{
+  checkBeats(128.0f);
+}
+
+static void test_beats_140()
+{
+  checkBeats(140.0f);
+}
+
+static void test_beats_174()
+{
+  checkBeats(174.0f);
+}
+
+// When the blocks stop the grid is locked for LockTimeoutMs more, and the beats extrapolated from it
+// stay a whole number of periods apart however long ago it was published.
+static void test_beats_after_blocks_stop()
+{
+  checkBeats(120.0f);
+  uint32_t end_ms = (uint64_t)s_beat_samples * 1000 / AnalysisRate;
+  TEST_ASSERT_TRUE(s_beats.isLocked(end_ms - 10));
+  TEST_ASSERT_TRUE(s_beats.isLocked(end_ms + BeatTracker::LockTimeoutMs - 1));
+  TEST_ASSERT_FALSE(s_beats.isLocked(end_ms + BeatTracker::LockTimeoutMs));
+
+  // 40 minutes on, where the elapsed us no longer fit 32 bits
+  const uint32_t Later     = 40 * 60 * 1000;
+  uint32_t       period_ms = s_beats.getBeatPeriodMs();
+  uint32_t       beats     = s_beats.getBeatIndex(end_ms + Later) - s_beats.getBeatIndex(end_ms);
+  TEST_ASSERT_UINT32_WITHIN(1, (uint32_t)(Later * s_beats.getBpm() / 60000.0), beats);
+  TEST_ASSERT_LESS_OR_EQUAL(period_ms + 1, s_beats.getMsToBeat(end_ms + Later));
+  // the next beat after 40 minutes, getMsToBeat() rounds down
+  uint32_t next_ms = end_ms + Later + s_beats.getMsToBeat(end_ms + Later) + 1;
+  TEST_ASSERT_EQUAL_UINT32(s_beats.getBeatIndex(end_ms + Later) + 1, s_beats.getBeatIndex(next_ms));
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_level_matches_rms);
+  RUN_TEST(test_level_cost);
+  RUN_TEST(test_fft_matches_dft);
+  RUN_TEST(test_fft_full_scale);
+  RUN_TEST(test_spectrum_whole_block);
+  RUN_TEST(test_beats_70);
+  RUN_TEST(test_beats_90);
+  RUN_TEST(test_beats_120);
+  RUN_TEST(test_beats_128);
+  RUN_TEST(test_beats_140);
+  RUN_TEST(test_beats_174);
+  RUN_TEST(test_beats_after_blocks_stop);
+  return UNITY_END();
+}
@@ -0,0 +1,651 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "AudioBlockRing.h"
+#include "AutoGain.h"
+#include "BeatTracker.h"
+#include "Decimator.h"
+#include "HostHarness.h"
+#include "LevelMeter.h"
+#include "SampleConvert.h"
+#include "SpectrumAnalyzer.h"
+
+// The microphone's side of the audio path: the block ring between the reader and the writer task,
+// the conversion of the I2S words against the per-sample path it replaced, the AGC's settling times
+// and its limiter, the decimation filters against their passband and stopband, and what they cost next to the
+// analysis they save.
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static const uint32_t RingBlocks      = 8;
+static const int32_t  RingBlockSamples = 64;
+static int16_t        s_ring_storage[RingBlocks * RingBlockSamples];
+
+// block number sequence in the first two samples, the others derived from it so a block written
+// over while it is read shows
+static void fillBlock(int16_t* block, uint32_t sequence)
+{
+  block[0] = (int16_t)sequence;
+  block[1] = (int16_t)(sequence >> 16);
+  for (int32_t index = 2; index < RingBlockSamples; index++) {
+    block[index] = (int16_t)(sequence * 31 + index);
+  }
+}
+
+// the block number held by block, -1 if its samples do not agree on one
+static int64_t blockSequence(const int16_t* block)
+{
+  uint32_t sequence = (uint16_t)block[0] | (uint32_t)(uint16_t)block[1] << 16;
+  for (int32_t index = 2; index < RingBlockSamples; index++) {
+    if (block[index] != (int16_t)(sequence * 31 + index))
+      return -1;
+  }
+  return sequence;
+}
+
+// A full ring refuses the block and counts it, one slot always stays with the producer, and a
+// released block makes room again.
+static void test_ring_overrun()
+{
+  AudioBlockRing ring;
+  TEST_ASSERT_TRUE(ring.begin(s_ring_storage, RingBlocks, RingBlockSamples));
+  for (uint32_t block = 0; block < RingBlocks - 1; block++) {
+    fillBlock(ring.writeSlot(), block);
+    TEST_ASSERT_TRUE(ring.commitWrite());
+  }
+  TEST_ASSERT_EQUAL_UINT32(RingBlocks - 1, ring.available());
+  TEST_ASSERT_FALSE(ring.commitWrite());
+  TEST_ASSERT_FALSE(ring.commitWrite());
+  TEST_ASSERT_EQUAL_UINT32(2, ring.getOverrunCount());
+  TEST_ASSERT_EQUAL(0, blockSequence(ring.tryAcquire()));
+  ring.release();
+  fillBlock(ring.writeSlot(), RingBlocks - 1);
+  TEST_ASSERT_TRUE(ring.commitWrite());
+  for (uint32_t block = 1; block < RingBlocks; block++) {
+    TEST_ASSERT_EQUAL(block, blockSequence(ring.tryAcquire()));
+    ring.release();
+  }
+  TEST_ASSERT_NULL(ring.tryAcquire());
+  TEST_ASSERT_EQUAL_UINT32(2, ring.getOverrunCount());
+}
+
+// A producer thread that waits for room hands every block over exactly once and in order, and
+// none of them is written over while the consumer thread reads it.
+static void test_ring_threads_in_order()
+{
+  const uint32_t Blocks = 200000;
+  AudioBlockRing ring;
+  TEST_ASSERT_TRUE(ring.begin(s_ring_storage, RingBlocks, RingBlockSamples));
+  std::thread producer([&ring]() {
+    for (uint32_t block = 0; block < Blocks; block++) {
+      while (ring.available() >= RingBlocks - 1) {
+        std::this_thread::yield();
+      }
+      fillBlock(ring.writeSlot(), block);
+      ring.commitWrite();
+    }
+  });
+  uint32_t received = 0;
+  uint32_t broken   = 0;
+  while (received < Blocks) {
+    const int16_t* block = ring.tryAcquire();
+    if (block == NULL) {
+      std::this_thread::yield();
+      continue;
+    }
+    broken += blockSequence(block) != received;
+    ring.release();
+    received++;
+  }
+  producer.join();
+  TEST_ASSERT_EQUAL_UINT32(0, broken);
+  TEST_ASSERT_EQUAL_UINT32(0, ring.getOverrunCount());
+  TEST_ASSERT_NULL(ring.tryAcquire());
+}
+
+// A producer that never waits, like the reader task, against a consumer that falls behind: every
+// block is either received once, in order and intact, or counted as an overrun. The threads take
+// turns, the producer writes three blocks while the consumer holds the one it acquired, then the
+// consumer checks and releases it and acquires the next, so the counts do not depend on scheduling.
+static void test_ring_threads_overrun()
+{
+  const uint32_t Rounds         = 10000;
+  const uint32_t BlocksPerRound = 3;
+  // the ring fills with 3 + 3 + 2 blocks in the first rounds, after that the one slot the consumer
+  // releases each round takes a block and the other two are dropped
+  const uint32_t Received = 8 + (Rounds - 3);
+  const uint32_t Dropped  = Rounds * BlocksPerRound - Received;
+  AudioBlockRing ring;
+  TEST_ASSERT_TRUE(ring.begin(s_ring_storage, RingBlocks, RingBlockSamples));
+  std::atomic<uint32_t> produced{0};
+  std::atomic<uint32_t> consumed{0};
+  uint32_t              committed = 0;
+  std::thread           producer([&]() {
+    uint32_t block = 0;
+    for (uint32_t round = 0; round < Rounds; round++) {
+      while (consumed.load(std::memory_order_acquire) != round) {
+        std::this_thread::yield();
+      }
+      for (uint32_t index = 0; index < BlocksPerRound; index++) {
+        fillBlock(ring.writeSlot(), block++);
+        committed += ring.commitWrite();
+      }
+      produced.store(round + 1, std::memory_order_release);
+    }
+  });
+  uint32_t       received = 0;
+  uint32_t       broken   = 0;
+  int64_t        last     = -1;
+  const int16_t* held     = NULL;
+  // checks the held block after the producer had its turn, so a block written over shows
+  auto releaseHeld = [&]() {
+    int64_t sequence = blockSequence(held);
+    broken += sequence <= last;
+    last = sequence;
+    ring.release();
+    received++;
+  };
+  for (uint32_t round = 0; round < Rounds; round++) {
+    while (produced.load(std::memory_order_acquire) != round + 1) {
+      std::this_thread::yield();
+    }
+    if (held != NULL)
+      releaseHeld();
+    held = ring.tryAcquire();
+    consumed.store(round + 1, std::memory_order_release);
+  }
+  producer.join();
+  for (; held != NULL; held = ring.tryAcquire()) {
+    releaseHeld();
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, broken);
+  TEST_ASSERT_EQUAL_UINT32(Received, committed);
+  TEST_ASSERT_EQUAL_UINT32(Received, received);
+  TEST_ASSERT_EQUAL_UINT32(Dropped, ring.getOverrunCount());
+}
+
+// the reader task the way it converted the words before: a copy of every chunk on the stack, then
+// one call per sample into a pair of swapped buffers
+struct PerSampleReader
+{
+  int16_t  buffers[2][1024];
+  int16_t* current   = buffers[0];
+  int16_t* captured  = buffers[1];
+  int32_t  position  = 0;
+  uint32_t completed = 0;
+
+  __attribute__((noinline)) void addSample(int16_t sample)
+  {
+    current[position++] = sample;
+    if (position == 1024) {
+      std::swap(current, captured);
+      position = 0;
+      completed++;
+    }
+  }
+
+  void read(const int32_t* words, size_t count)
+  {
+    uint8_t chunk[1024];
+    memcpy(chunk, words, count * sizeof(int32_t));
+    const int32_t* samples = (const int32_t*)chunk;
+    for (size_t index = 0; index < count; index++) {
+      addSample(samples[index] >> 11);
+    }
+  }
+};
+
+// and the way it does now, whole chunks converted straight into the ring's write slot
+struct ChunkReader
+{
+  AudioBlockRing ring;
+  int32_t        position = 0;
+
+  void read(const int32_t* words, size_t count)
+  {
+    while (count > 0) {
+      size_t run = std::min<size_t>(1024 - position, count);
+      convertSamples(words, ring.writeSlot() + position, run, 11);
+      position += run;
+      words += run;
+      count -= run;
+      if (position == 1024) {
+        ring.commitWrite();
+        ring.tryAcquire();
+        ring.release();
+        position = 0;
+      }
+    }
+  }
+};
+
+// 10 s of noise at the microphone's level, as raw 24 bit words left aligned in 32 bits
+static std::vector<int32_t> microphoneWords(float amplitude)
+{
+  HostI2SSource source;
+  source.generate(HostSignal_Noise, 0.0f, amplitude, SampleRate * 10, SampleRate);
+  std::vector<int32_t> words(source.getSampleCount());
+  source.read(words.data(), words.size() * sizeof(int32_t));
+  return words;
+}
+
+// Within the 16 bit range both paths give the same samples, beyond it the conversion saturates where
+// the old path wrapped around.
+static void test_convert_matches_per_sample()
+{
+  std::vector<int32_t> words = microphoneWords(0.01f);
+  static PerSampleReader old_reader;
+  std::vector<int16_t>   converted(1024);
+  for (size_t first = 0; first + 1024 <= words.size(); first += 1024) {
+    for (size_t chunk = 0; chunk < 1024; chunk += 256) {
+      old_reader.read(&words[first + chunk], 256);
+    }
+    convertSamples(&words[first], converted.data(), 1024, 11);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(old_reader.captured, converted.data(), 1024);
+  }
+  const int32_t Loud[] = {INT32_MAX, INT32_MIN, 1 << 27, -(1 << 27)};
+  int16_t       clipped[4];
+  convertSamples(Loud, clipped, 4, 11);
+  TEST_ASSERT_EQUAL_INT16(INT16_MAX, clipped[0]);
+  TEST_ASSERT_EQUAL_INT16(INT16_MIN, clipped[1]);
+  TEST_ASSERT_EQUAL_INT16(INT16_MAX, clipped[2]);
+  TEST_ASSERT_EQUAL_INT16(INT16_MIN, clipped[3]);
+}
+
+// the cost per sample of both paths over the same chunks of 256 words the I2S driver hands out, printed
+// for comparison only since host timings say little about the ESP32
+static void test_convert_cost()
+{
+  std::vector<int32_t>   words = microphoneWords(0.01f);
+  static PerSampleReader old_reader;
+  static ChunkReader     chunk_reader;
+  static int16_t         storage[8 * 1024];
+  chunk_reader.ring.begin(storage, 8, 1024);
+  double ns[2];
+  for (int pass = 0; pass < 2; pass++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int repeat = 0; repeat < 10; repeat++) {
+      for (size_t first = 0; first + 256 <= words.size(); first += 256) {
+        if (pass == 0)
+          old_reader.read(&words[first], 256);
+        else
+          chunk_reader.read(&words[first], 256);
+      }
+    }
+    ns[pass] = hostSecondsSince(start) * 1e9 / (10.0 * words.size());
+  }
+  printf("convert: per sample %.2f ns/sample, whole chunks %.2f ns/sample, %.1f times faster\n", ns[0], ns[1], ns[0] / ns[1]);
+}
+
+// The AGC the way the sampler drives it: chunks of 256 words, endBlock() after every block of 1024
+// samples. The average absolute value of every block goes into levels.
+struct AgcRun
+{
+  std::vector<float> levels;
+  int32_t            peak = 0;
+};
+
+static const size_t AgcBlock    = 1024;
+static const float  AgcTarget   = 1500.0f;
+static const float  AgcHeadroom = 6.0f;
+static const float  AgcBlockMs  = AgcBlock * 1000.0f / SampleRate;
+
+static AgcRun runAgc(AutoGain& agc, const std::vector<int32_t>& words)
+{
+  AgcRun  run;
+  int16_t block[AgcBlock];
+  for (size_t first = 0; first + AgcBlock <= words.size(); first += AgcBlock) {
+    for (size_t chunk = 0; chunk < AgcBlock; chunk += 256) {
+      agc.convert(&words[first + chunk], block + chunk, 256);
+    }
+    agc.endBlock();
+    uint32_t sum = 0;
+    for (size_t index = 0; index < AgcBlock; index++) {
+      int32_t absolute = block[index] < 0 ? -block[index] : block[index];
+      sum += absolute;
+      run.peak = absolute > run.peak ? absolute : run.peak;
+    }
+    run.levels.push_back((float)sum / AgcBlock);
+  }
+  return run;
+}
+
+// a second of the microphone's self noise so the gate knows the floor, then a tone at each of the
+// amplitudes for the given seconds
+static std::vector<int32_t> agcSignal(const std::vector<float>& amplitudes, float seconds)
+{
+  HostI2SSource source;
+  source.generate(HostSignal_Noise, 0.0f, 0.00001f, SampleRate, SampleRate);
+  for (float amplitude : amplitudes) {
+    source.generate(HostSignal_Sine, 440.0f, amplitude, (uint32_t)(SampleRate * seconds), SampleRate);
+  }
+  std::vector<int32_t> words(source.getSampleCount());
+  source.read(words.data(), words.size() * sizeof(int32_t));
+  return words;
+}
+
+// blocks from the first one of [first, last) until the level stays within 3dB of the target
+static size_t agcSettleBlocks(const AgcRun& run, size_t first, size_t last)
+{
+  size_t settled = first;
+  for (size_t index = first; index < last; index++) {
+    if (fabsf(20.0f * log10f(run.levels[index] / AgcTarget)) > 3.0f)
+      settled = index + 1;
+  }
+  TEST_ASSERT_LESS_THAN(last, settled);
+  return settled - first;
+}
+
+static const float  AgcLoud  = 0.02f;   // -19dB of gain to the target
+static const float  AgcQuiet = 0.0002f; // +21dB
+static const size_t AgcOnset = SampleRate / AgcBlock;
+
+static void test_agc_loud()
+{
+  AutoGain agc;
+  agc.setTarget(AgcTarget, AgcHeadroom);
+  AgcRun run    = runAgc(agc, agcSignal({AgcLoud}, 4.0f));
+  size_t blocks = agcSettleBlocks(run, AgcOnset, run.levels.size());
+  printf("agc: loud tone settles in %u blocks, %.0f ms, gain %.1f dB\n", (unsigned)blocks, blocks * AgcBlockMs, agc.getGainDb());
+  TEST_ASSERT_LESS_THAN(10, blocks);
+}
+
+static void test_agc_quiet()
+{
+  AutoGain agc;
+  agc.setTarget(AgcTarget, AgcHeadroom);
+  AgcRun run    = runAgc(agc, agcSignal({AgcQuiet}, 6.0f));
+  size_t blocks = agcSettleBlocks(run, AgcOnset, run.levels.size());
+  printf("agc: quiet tone settles in %u blocks, %.0f ms, gain %.1f dB\n", (unsigned)blocks, blocks * AgcBlockMs, agc.getGainDb());
+  TEST_ASSERT_LESS_THAN(100, blocks);
+}
+
+// Quiet, loud and quiet again. The gain is up at +21dB when the loud part starts, 40dB too much:
+// the limiter keeps every sample of it below the threshold while the AGC comes down.
+static void test_agc_step()
+{
+  AutoGain agc;
+  agc.setTarget(AgcTarget, AgcHeadroom);
+  const float Seconds = 6.0f;
+  AgcRun      run     = runAgc(agc, agcSignal({AgcQuiet, AgcLoud, AgcQuiet}, Seconds));
+  size_t      part    = (size_t)(SampleRate * Seconds) / AgcBlock;
+  size_t      louder  = agcSettleBlocks(run, AgcOnset + part, AgcOnset + part * 2);
+  size_t      quieter = agcSettleBlocks(run, AgcOnset + part * 2, run.levels.size());
+  int32_t     limit   = (int32_t)(32767.0f * powf(10.0f, -AgcHeadroom / 20.0f));
+  printf("agc: 40dB louder settles in %.0f ms, 40dB quieter in %.0f ms, output peak %ld of limit %ld, %lu chunks limited\n",
+         louder * AgcBlockMs, quieter * AgcBlockMs, (long)run.peak, (long)limit, (unsigned long)agc.getLimitedChunks());
+  TEST_ASSERT_LESS_THAN(10, louder);
+  TEST_ASSERT_LESS_THAN(100, quieter);
+  TEST_ASSERT_LESS_OR_EQUAL(limit + 1, run.peak);
+  TEST_ASSERT_GREATER_THAN(0, agc.getLimitedChunks());
+}
+
+// last samples of the AGC benchmark, kept so the optimizer cannot drop the conversions being timed
+static volatile int16_t s_agc_sink;
+
+// the AGC's cost per block next to the fixed shift it replaces, printed with its share of a block's time
+static void test_agc_cost()
+{
+  std::vector<int32_t> words = agcSignal({AgcLoud, AgcQuiet}, 5.0f);
+  AutoGain             agc;
+  int16_t              block[AgcBlock];
+  size_t               blocks = words.size() / AgcBlock;
+  double               us[2];
+  for (int pass = 0; pass < 2; pass++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int repeat = 0; repeat < 10; repeat++) {
+      for (size_t first = 0; first + AgcBlock <= words.size(); first += AgcBlock) {
+        for (size_t chunk = 0; chunk < AgcBlock; chunk += 256) {
+          if (pass == 0)
+            convertSamples(&words[first + chunk], block + chunk, 256, 11);
+          else
+            agc.convert(&words[first + chunk], block + chunk, 256);
+        }
+        if (pass == 1)
+          agc.endBlock();
+        s_agc_sink = block[AgcBlock - 1];
+      }
+    }
+    us[pass] = hostSecondsSince(start) * 1e6 / (10.0 * blocks);
+  }
+  printf("agc: %.2f us/block, fixed shift %.2f us/block, %.3f%% of a %.1f ms block\n", us[1], us[0], us[1] * 100.0 / (AgcBlockMs * 1000.0),
+         AgcBlockMs);
+}
+
+// gain in dB of the decimator from a sine at frequency to where it comes out, its alias below half
+// the output rate, measured after the filters settled
+static float decimatorGain(uint8_t factor, double frequency)
+{
+  const uint32_t       Outputs   = 4096;
+  const double         Amplitude = 16000.0;
+  double               rate      = (double)SampleRate / factor;
+  double               alias     = fmod(frequency, rate);
+  Decimator            decimator;
+  std::vector<int16_t> samples((Outputs + 64) * factor);
+  alias = alias > rate / 2 ? rate - alias : alias;
+  decimator.begin(factor);
+  for (size_t index = 0; index < samples.size(); index++) {
+    samples[index] = lrint(Amplitude * sin(2.0 * M_PI * frequency * index / SampleRate));
+  }
+  size_t count = decimator.process(samples.data(), samples.size());
+  double re    = 0;
+  double im    = 0;
+  for (size_t index = 0; index < Outputs; index++) {
+    double phase = 2.0 * M_PI * alias * index / rate;
+    re += samples[count - Outputs + index] * cos(phase);
+    im += samples[count - Outputs + index] * sin(phase);
+  }
+  return 20.0 * log10(2.0 * sqrt(re * re + im * im) / Outputs / Amplitude + 1e-9);
+}
+
+// flat to 40% of the output rate, everything that would alias into that band attenuated by 58dB or more
+static void checkDecimatorResponse(uint8_t factor)
+{
+  float output_rate = (float)SampleRate / factor;
+  float ripple      = 0.0f;
+  for (float fraction = 0.02f; fraction <= 0.4f; fraction += 0.02f) {
+    ripple = fmaxf(ripple, fabsf(decimatorGain(factor, fraction * output_rate)));
+  }
+  // every frequency above 60% of the output rate whose alias falls into the passband
+  float rejection = 1000.0f;
+  for (float frequency = 0.6f * output_rate; frequency < SampleRate / 2; frequency += 0.013f * output_rate) {
+    float alias = fmodf(frequency, output_rate);
+    alias       = fminf(alias, output_rate - alias);
+    if (alias > 0.02f * output_rate && alias <= 0.4f * output_rate)
+      rejection = fminf(rejection, -decimatorGain(factor, frequency));
+  }
+  printf("decimate /%u: passband %.3f dB to %.0f Hz, stopband %.1f dB from %.0f Hz\n", factor, ripple, 0.4f * output_rate, rejection,
+         0.6f * output_rate);
+  TEST_ASSERT_LESS_THAN_FLOAT(0.1f, ripple);
+  TEST_ASSERT_GREATER_THAN_FLOAT(58.0f, rejection);
+}
+
+static void test_decimator_response_2()
+{
+  checkDecimatorResponse(2);
+}
+
+static void test_decimator_response_4()
+{
+  checkDecimatorResponse(4);
+}
+
+static void test_decimator_response_8()
+{
+  checkDecimatorResponse(8);
+}
+
+// the reader task's conversion of 256 word chunks into blocks of ~23ms through the decimator, and the
+// writer task's analysis of every block: the beat tracker, the level meter and the spectrum of program
+// 8. Returns the time per second of audio in us, spectrum says whether program 8's FFT is included.
+static double audioPathCost(const std::vector<int32_t>& words, uint8_t factor, bool spectrum)
+{
+  uint32_t                rate       = SampleRate / factor;
+  int32_t                 block_size = 1024 / factor;
+  Decimator               decimator;
+  BeatTracker             beats;
+  LevelMeter              meter;
+  static SpectrumAnalyzer analyzer;
+  decimator.begin(factor);
+  beats.begin(rate);
+  meter.begin(block_size, 4);
+  analyzer.begin(rate, 15, 60.0f, 16000.0f);
+  std::vector<int16_t> block(block_size);
+  int16_t              chunk[256];
+  int32_t              position = 0;
+  uint32_t             blocks   = 0;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t first = 0; first + 256 <= words.size(); first += 256) {
+    for (size_t done = 0; done < 256;) {
+      // like I2SSampler, no more words than can come out as samples that still fit the block
+      size_t count = std::min<size_t>((block_size - position) * factor, 256 - done);
+      if (factor == 1) {
+        convertSamples(&words[first + done], &block[position], count, 11);
+        position += count;
+      }
+      else {
+        convertSamples(&words[first + done], chunk, count, 11);
+        position += decimator.process(chunk, count, &block[position]);
+      }
+      done += count;
+      if (position == block_size) {
+        beats.process(block.data(), block_size, (uint64_t)blocks * block_size * 1000 / rate);
+        meter.addBlock(block.data());
+        if (spectrum)
+          analyzer.process(block.data(), block_size);
+        blocks++;
+        position = 0;
+      }
+    }
+  }
+  return hostSecondsSince(start) * 1e6 * rate / ((double)blocks * block_size);
+}
+
+// The decimator's cost per input sample, and what the whole audio path costs per second of audio at
+// the full and at each decimated rate, the filters included. The analysis gets cheaper with the rate:
+// the beat tracker and the level meter go over fewer samples, and the spectrum takes one 512 point
+// FFT per block of 256 samples at 11 kHz instead of two per block of 1024 at 44.1 kHz. Printed for
+// comparison only, host timings say little about the ESP32.
+static void test_decimator_cost()
+{
+  HostI2SSource noise;
+  noise.generate(HostSignal_Noise, 0.0f, 0.1f, SampleRate * 10, SampleRate);
+  std::vector<int32_t> words(noise.getSampleCount());
+  noise.read(words.data(), words.size() * sizeof(int32_t));
+  std::vector<int16_t> samples(words.size()), chunk(256);
+  for (size_t index = 0; index < words.size(); index++) {
+    samples[index] = words[index] >> 16;
+  }
+  // the first stages have 4 pairs of taps, the last one 10
+  const float   Multiplies[] = {0.0f, 5.0f, 4.5f, 4.25f};
+  const uint8_t Factors[]    = {1, 2, 4, 8};
+  for (int stages = 0; stages < 4; stages++) {
+    uint8_t   factor = Factors[stages];
+    Decimator decimator;
+    decimator.begin(factor);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t first = 0; first + 256 <= samples.size(); first += 256) {
+      memcpy(chunk.data(), &samples[first], 256 * sizeof(int16_t));
+      decimator.process(chunk.data(), 256);
+    }
+    double ns = hostSecondsSince(start) * 1e9 / samples.size();
+    printf("decimate /%u: %.2f ns/sample, %.2f multiplies/sample, audio path %.0f us/s at %lu Hz, %.0f us/s with the spectrum%s\n", factor, ns,
+           Multiplies[stages], audioPathCost(words, factor, false), (unsigned long)(SampleRate / factor), audioPathCost(words, factor, true),
+           factor == AUDIO_DECIMATION ? " (firmware)" : "");
+  }
+}
+
+// The sampler's path with decimation: the AGC scales the chunks, the decimator filters them and the
+// AGC measures what comes out of it, in blocks of AgcBlock / factor samples. measured_before runs the
+// AGC on the chunks before the decimator instead, the way convert() does without one.
+static AgcRun runAgcDecimated(AutoGain& agc, const std::vector<int32_t>& words, uint8_t factor, bool measured_before)
+{
+  AgcRun    run;
+  Decimator decimator;
+  decimator.begin(factor);
+  std::vector<int16_t> block;
+  int16_t              chunk[256];
+  for (size_t first = 0; first + 256 <= words.size(); first += 256) {
+    if (measured_before)
+      agc.convert(&words[first], chunk, 256);
+    else
+      agc.scale(&words[first], chunk, 256);
+    size_t count = decimator.process(chunk, 256);
+    if (!measured_before)
+      agc.measure(chunk, count);
+    block.insert(block.end(), chunk, chunk + count);
+    if (block.size() == AgcBlock / factor) {
+      agc.endBlock();
+      uint32_t sum = 0;
+      for (int16_t sample : block) {
+        sum += sample < 0 ? -sample : sample;
+      }
+      run.levels.push_back((float)sum / block.size());
+      block.clear();
+    }
+  }
+  return run;
+}
+
+// a tone the decimator filters away, 15dB above the one it keeps: the AGC brings what the analysis
+// gets to the target only when it measures after the decimator
+static void test_agc_after_decimator()
+{
+  const float          Seconds = 6.0f;
+  std::vector<int32_t> words   = agcSignal({AgcQuiet * 10.0f}, Seconds);
+  HostI2SSource        filtered;
+  filtered.generate(HostSignal_Silence, 0.0f, 0.0f, SampleRate, SampleRate);
+  filtered.generate(HostSignal_Sine, 15000.0f, AgcQuiet * 60.0f, (uint32_t)(SampleRate * Seconds), SampleRate);
+  std::vector<int32_t> high(filtered.getSampleCount());
+  filtered.read(high.data(), high.size() * sizeof(int32_t));
+  for (size_t index = 0; index < words.size() && index < high.size(); index++) {
+    words[index] += high[index];
+  }
+
+  AutoGain before;
+  AutoGain after;
+  before.setTarget(AgcTarget, AgcHeadroom);
+  after.setTarget(AgcTarget, AgcHeadroom);
+  AgcRun before_run = runAgcDecimated(before, words, 4, true);
+  AgcRun run        = runAgcDecimated(after, words, 4, false);
+  size_t blocks     = agcSettleBlocks(run, AgcOnset, run.levels.size());
+  printf("agc /4: measured after the decimator settles in %.0f ms at %.0f, measured before it ends at %.0f of %.0f\n", blocks * AgcBlockMs,
+         run.levels.back(), before_run.levels.back(), AgcTarget);
+  TEST_ASSERT_LESS_THAN(100, blocks);
+  TEST_ASSERT_LESS_THAN_FLOAT(AgcTarget / 3.0f, before_run.levels.back());
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_ring_overrun);
+  RUN_TEST(test_ring_threads_in_order);
+  RUN_TEST(test_ring_threads_overrun);
+  RUN_TEST(test_convert_matches_per_sample);
+  RUN_TEST(test_convert_cost);
+  RUN_TEST(test_agc_loud);
+  RUN_TEST(test_agc_quiet);
+  RUN_TEST(test_agc_step);
+  RUN_TEST(test_agc_cost);
+  RUN_TEST(test_decimator_response_2);
+  RUN_TEST(test_decimator_response_4);
+  RUN_TEST(test_decimator_response_8);
+  RUN_TEST(test_decimator_cost);
+  RUN_TEST(test_agc_after_decimator);
+  return UNITY_END();
+}
@@ -0,0 +1,98 @@
+#include <vector>
+
+#include <unity.h>
+
+#include "ButtonDecoder.h"
+
+// Press sequences with bouncing contacts through the decoder, one ms at a time.
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+struct ButtonEdge
+{
+  uint32_t ms;
+  bool     pressed;
+};
+
+typedef std::vector<ButtonEvent> Events;
+
+// the decoder the way ButtonInput drives it: edges as they come, poll() at the deadlines
+static Events decodeEdges(const std::vector<ButtonEdge>& edges, uint32_t end_ms)
+{
+  ButtonDecoder decoder;
+  Events        events;
+  bool          pressed = false;
+  size_t        next    = 0;
+  for (uint32_t now_ms = 0; now_ms <= end_ms; now_ms++) {
+    for (; next < edges.size() && edges[next].ms == now_ms; next++) {
+      pressed = edges[next].pressed;
+      decoder.edge(now_ms);
+    }
+    while (decoder.hasDeadline() && (int32_t)(now_ms - decoder.getDeadline()) >= 0) {
+      ButtonEvent event = decoder.poll(pressed, now_ms);
+      if (event == ButtonEvent_None)
+        break;
+      events.push_back(event);
+    }
+  }
+  return events;
+}
+
+// contact bounce: the level flips count times over a few ms before it settles on pressed
+static void bounce(std::vector<ButtonEdge>& edges, uint32_t ms, bool pressed, int count)
+{
+  for (int index = 0; index < count; index++) {
+    edges.push_back({ms + index * 2, (count - index) % 2 == 1 ? pressed : !pressed});
+  }
+}
+
+static void test_short_press()
+{
+  TEST_ASSERT_TRUE(decodeEdges({{100, true}, {200, false}}, 2000) == Events{ButtonEvent_Short});
+}
+
+static void test_bouncy_press()
+{
+  std::vector<ButtonEdge> edges;
+  bounce(edges, 100, true, 5);
+  bounce(edges, 300, false, 4);
+  TEST_ASSERT_TRUE(decodeEdges(edges, 2000) == Events{ButtonEvent_Short});
+}
+
+static void test_glitch_ignored()
+{
+  TEST_ASSERT_TRUE(decodeEdges({{100, true}, {105, false}}, 2000).empty());
+}
+
+static void test_long_press()
+{
+  TEST_ASSERT_TRUE(decodeEdges({{100, true}, {1500, false}}, 3000) == Events{ButtonEvent_Long});
+}
+
+static void test_double_press()
+{
+  TEST_ASSERT_TRUE(decodeEdges({{100, true}, {200, false}, {350, true}, {450, false}}, 2000) == Events{ButtonEvent_Double});
+}
+
+static void test_two_presses()
+{
+  TEST_ASSERT_TRUE(decodeEdges({{100, true}, {200, false}, {500, true}, {600, false}}, 2000) == (Events{ButtonEvent_Short, ButtonEvent_Short}));
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_short_press);
+  RUN_TEST(test_bouncy_press);
+  RUN_TEST(test_glitch_ignored);
+  RUN_TEST(test_long_press);
+  RUN_TEST(test_double_press);
+  RUN_TEST(test_two_presses);
+  return UNITY_END();
+}
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "ClipPlayer.h"
+#include "HostHarness.h"
+#include "PixelClip.h"
+
+// The clip encoder against the player: every frame comes back within the tolerance, twice over to
+// cover the restart, and decodes faster than any strip can show it.
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// decode target for the checks
+struct ClipPixelsTarget
+{
+  RgbColor pixels[ClipPixels];
+
+  uint16_t PixelCount() const
+  {
+    return ClipPixels;
+  }
+  void SetPixelColor(uint16_t index, const RgbColor& color)
+  {
+    pixels[index] = color;
+  }
+};
+
+static void checkClip(const char* name, const std::vector<uint8_t>& frames, uint8_t tolerance)
+{
+  std::vector<uint8_t> data        = hostEncodeClip(frames, 60, 0, tolerance);
+  uint16_t             frame_count = frames.size() / (ClipPixels * 3);
+  PixelClip            clip;
+  TEST_ASSERT_TRUE(clip.open(data.data(), data.size()));
+  TEST_ASSERT_EQUAL(frame_count, clip.getFrameCount());
+
+  ClipPlayer<ClipPixelsTarget> player;
+  static ClipPixelsTarget      target;
+  player.start(clip);
+  int worst = 0;
+  for (uint32_t index = 0; index < 2u * frame_count; index++) {
+    TEST_ASSERT_TRUE(player.nextFrame(target));
+    const uint8_t* expected = &frames[(index % frame_count) * ClipPixels * 3];
+    for (uint16_t pixel = 0; pixel < ClipPixels; pixel++) {
+      worst = std::max(worst, abs(target.pixels[pixel].R - expected[pixel * 3]));
+      worst = std::max(worst, abs(target.pixels[pixel].G - expected[pixel * 3 + 1]));
+      worst = std::max(worst, abs(target.pixels[pixel].B - expected[pixel * 3 + 2]));
+    }
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(tolerance, worst);
+
+  const uint32_t                        DecodeFrames = 20000;
+  std::chrono::steady_clock::time_point start        = std::chrono::steady_clock::now();
+  for (uint32_t index = 0; index < DecodeFrames; index++) {
+    player.nextFrame(target);
+  }
+  double seconds = hostSecondsSince(start);
+  printf("clip %-8s tolerance %u: %u frames, %5.1f%% of raw, %6.0f bytes/frame, %.0f frames/s\n", name, tolerance, frame_count,
+         100.0 * data.size() / frames.size(), (double)data.size() / frame_count, DecodeFrames / seconds);
+}
+
+static void test_clip_comet()
+{
+  std::vector<uint8_t> comet;
+  hostCometFrames(comet, 150);
+  checkClip("comet", comet, 0);
+}
+
+static void test_clip_rainbow()
+{
+  std::vector<uint8_t> rainbow;
+  hostRainbowFrames(rainbow, 86);
+  checkClip("rainbow", rainbow, 0);
+}
+
+static void test_clip_noise()
+{
+  std::vector<uint8_t> noise;
+  hostNoiseFrames(noise, 30);
+  checkClip("noise", noise, 0);
+}
+
+static void test_clip_tolerance()
+{
+  std::vector<uint8_t> rainbow;
+  hostRainbowFrames(rainbow, 86);
+  checkClip("rainbow", rainbow, 8);
+}
+
+// frames that change nothing are counted up to the next one that does and never past the end of the clip
+static void test_clip_unchanged_frames()
+{
+  // lit on frame 0 and 6, dark in between and after
+  const uint16_t       Frames = 10;
+  std::vector<uint8_t> frames(Frames * ClipPixels * 3, 0);
+  std::fill(frames.begin(), frames.begin() + ClipPixels * 3, 255);
+  std::fill(frames.begin() + 6 * ClipPixels * 3, frames.begin() + 7 * ClipPixels * 3, 255);
+  std::vector<uint8_t> data = hostEncodeClip(frames, 30, 0, 0);
+  PixelClip            clip;
+  TEST_ASSERT_TRUE(clip.open(data.data(), data.size()));
+
+  ClipPlayer<ClipPixelsTarget> player;
+  static ClipPixelsTarget      target;
+  player.start(clip);
+  TEST_ASSERT_EQUAL(0, player.countUnchangedFrames(Frames));
+  TEST_ASSERT_TRUE(player.nextFrame(target));
+  TEST_ASSERT_TRUE(player.nextFrame(target));
+  // frames 2 to 5 stay dark like frame 1, frame 6 lights up again
+  TEST_ASSERT_EQUAL(4, player.countUnchangedFrames(Frames));
+  TEST_ASSERT_EQUAL(2, player.countUnchangedFrames(2));
+  for (int index = 2; index < 8; index++) {
+    TEST_ASSERT_TRUE(player.nextFrame(target));
+  }
+  // frames 8 and 9, then the clip starts over
+  TEST_ASSERT_EQUAL(2, player.countUnchangedFrames(Frames));
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_clip_comet);
+  RUN_TEST(test_clip_rainbow);
+  RUN_TEST(test_clip_noise);
+  RUN_TEST(test_clip_tolerance);
+  RUN_TEST(test_clip_unchanged_frames);
+  return UNITY_END();
+}
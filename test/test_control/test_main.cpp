@@ -0,0 +1,136 @@
+#include <string.h>
+#include <vector>
+
+#include <unity.h>
+
+#include "ControlProtocol.h"
+#include "HostHarness.h"
+
+// The framing of the Serial control protocol from the host's side: the crc, messages between text
+// output and a corrupted message dropped without losing the ones after it.
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+typedef std::vector<std::vector<uint8_t>> Messages;
+
+// the check value of CRC-16/CCITT-FALSE
+static void test_crc()
+{
+  const uint8_t Check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+  TEST_ASSERT_EQUAL_UINT16(0x29b1, ControlProtocol::crc16(0xffff, Check, sizeof(Check)));
+}
+
+static void test_messages_between_text()
+{
+  std::vector<uint8_t> stream;
+  const char*          text     = "text from a terminal\n";
+  uint8_t              selected = 3;
+  stream.insert(stream.end(), text, text + strlen(text));
+  hostSendMessage(stream, ControlMessage_Program, &selected, 1);
+  stream.insert(stream.end(), text, text + strlen(text));
+  hostSendMessage(stream, ControlMessage_Status, NULL, 0);
+  Messages messages = hostReceiveMessages(stream);
+  TEST_ASSERT_EQUAL(2, messages.size());
+  TEST_ASSERT_TRUE(messages[0] == (std::vector<uint8_t>{ControlMessage_Program, 3}));
+  TEST_ASSERT_TRUE(messages[1] == std::vector<uint8_t>{ControlMessage_Status});
+}
+
+static void test_corrupted_message()
+{
+  std::vector<uint8_t> stream;
+  hostSendParam(stream, 1, 10);
+  hostSendParam(stream, 2, 20);
+  stream.back() ^= 0x55;
+  hostSendParam(stream, 3, 30);
+
+  ControlParser  parser;
+  Messages       messages;
+  const uint8_t* data = stream.data();
+  size_t         size = stream.size();
+  while (size > 0 || parser.hasMessage()) {
+    size_t used = parser.feed(data, size);
+    data += used;
+    size -= used;
+    if (parser.hasMessage())
+      messages.push_back(std::vector<uint8_t>(parser.getPayload(), parser.getPayload() + parser.getLength()));
+  }
+  TEST_ASSERT_EQUAL(2, messages.size());
+  TEST_ASSERT_EQUAL_UINT8(1, messages[0][0]);
+  TEST_ASSERT_EQUAL_UINT8(3, messages[1][0]);
+  TEST_ASSERT_EQUAL_UINT32(2, parser.getMessages());
+  TEST_ASSERT_EQUAL_UINT32(1, parser.getCrcErrors());
+}
+
+static Messages receiveInPieces(const std::vector<uint8_t>& stream, size_t piece, ControlParser& parser)
+{
+  Messages messages;
+  for (size_t first = 0; first < stream.size(); first += piece) {
+    const uint8_t* data = stream.data() + first;
+    size_t         size = stream.size() - first < piece ? stream.size() - first : piece;
+    while (size > 0 || parser.hasMessage()) {
+      size_t used = parser.feed(data, size);
+      data += used;
+      size -= used;
+      if (parser.hasMessage())
+        messages.push_back(std::vector<uint8_t>(parser.getPayload(), parser.getPayload() + parser.getLength()));
+    }
+  }
+  return messages;
+}
+
+// a start byte in the text whose length is over what its type can have is dropped at the length
+static void test_false_start_length()
+{
+  std::vector<uint8_t> stream = {'x', ControlProtocol::StartByte, ControlMessage_SetParam, 0x40, 0x00};
+  hostSendParam(stream, 1, 10);
+  ControlParser parser;
+  Messages      messages = receiveInPieces(stream, stream.size(), parser);
+  TEST_ASSERT_EQUAL(1, messages.size());
+  TEST_ASSERT_EQUAL_UINT8(1, messages[0][0]);
+  TEST_ASSERT_EQUAL_UINT32(1, parser.getCrcErrors());
+  TEST_ASSERT_EQUAL(ControlProtocol::MaxPayload, ControlProtocol::maxLength(ControlMessage_AudioBlock));
+  TEST_ASSERT_EQUAL(5, ControlProtocol::maxLength(ControlMessage_SetParam));
+}
+
+// a start byte in the text that looks like a Pixels message swallows the messages after it until
+// its crc fails, they are then found by scanning again from the byte after it, whatever the pieces
+// the stream arrives in
+static void test_false_start_rescan()
+{
+  const size_t Pieces[] = {1, 3, 7, 64, 1024};
+  for (size_t piece : Pieces) {
+    std::vector<uint8_t> stream = {'x', ControlProtocol::StartByte, ControlMessage_Pixels, 40, 0x00};
+    hostSendParam(stream, 1, 10);
+    hostSendParam(stream, 2, 20);
+    hostSendParam(stream, 3, 30);
+    const char* text = "more text\n";
+    stream.insert(stream.end(), text, text + strlen(text));
+    hostSendParam(stream, 4, 40);
+
+    ControlParser parser;
+    Messages      messages = receiveInPieces(stream, piece, parser);
+    TEST_ASSERT_EQUAL(4, messages.size());
+    for (uint8_t index = 0; index < 4; index++) {
+      TEST_ASSERT_EQUAL_UINT8(index + 1, messages[index][0]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(4, parser.getMessages());
+    TEST_ASSERT_EQUAL_UINT32(1, parser.getCrcErrors());
+  }
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_crc);
+  RUN_TEST(test_messages_between_text);
+  RUN_TEST(test_corrupted_message);
+  RUN_TEST(test_false_start_length);
+  RUN_TEST(test_false_start_rescan);
+  return UNITY_END();
+}
@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "ButtonDecoder.h"
+#include "ClipEncoder.h"
+#include "ControlProtocol.h"
+#include "HostHarness.h"
+#include "MemoryBudget.h"
+
+// The whole firmware on the host stand-ins, set up once: the steady state of every program, the
+// button and the Serial control through the tasks, the replay of a recording, the idling led task
+// and a clip that keeps its length while the task idles.
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static uint32_t readUint32(const uint8_t* data)
+{
+  return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+// every program, including the switch to it, runs for 100000 frames without a single heap allocation
+static void test_allocations()
+{
+  const uint32_t Frames      = 100000;
+  uint64_t       allocations = 0;
+  for (int index = 0; index < ProgramCount; index++) {
+    program                = index;
+    uint64_t program_start = hostGetAllocations();
+    hostRunLedFrames(Frames);
+    // throwing the HostStop that ends the run is the one allocation of the runner itself
+    allocations += hostGetAllocations() - program_start - 1;
+  }
+  printf("allocations: %llu over %lu frames of each of the %d programs, static memory %u bytes\n", (unsigned long long)allocations,
+         (unsigned long)Frames, ProgramCount, (unsigned)MemoryBudget::getTotal());
+  TEST_ASSERT_EQUAL_UINT64(0, allocations);
+}
+
+static void pressPin(uint8_t pin, uint32_t hold_ms)
+{
+  // 3 bounces at both ends, well inside the debounce time
+  for (int index = 0; index < 3; index++) {
+    hostSetPin(pin, index % 2 == 0 ? HIGH : LOW);
+    hostAdvanceMs(1);
+  }
+  hostSetPin(pin, HIGH);
+  hostAdvanceMs(hold_ms);
+  for (int index = 0; index < 3; index++) {
+    hostSetPin(pin, index % 2 == 0 ? LOW : HIGH);
+    hostAdvanceMs(1);
+  }
+  hostSetPin(pin, LOW);
+}
+
+// press sequences with bouncing contacts through the firmware's button: the pin interrupt, the
+// debounce timer and the queue to the led task, which changes the program
+static void test_button()
+{
+  const uint8_t ButtonPin = 13;
+  program                 = 2;
+  hostRunLedFrames();
+  // a short press waits out the double press gap, then the next frame switches
+  pressPin(ButtonPin, 80);
+  TEST_ASSERT_EQUAL(2, hostRunLedFrames());
+  hostAdvanceMs(ButtonDecoder::DoubleGapMs);
+  TEST_ASSERT_EQUAL(3, hostRunLedFrames());
+  pressPin(ButtonPin, 80);
+  hostAdvanceMs(50);
+  pressPin(ButtonPin, 80);
+  hostAdvanceMs(ButtonDecoder::DoubleGapMs);
+  TEST_ASSERT_EQUAL(2, hostRunLedFrames());
+  pressPin(ButtonPin, ButtonDecoder::LongPressMs + 100);
+  TEST_ASSERT_EQUAL(OffProgram, hostRunLedFrames());
+  pressPin(ButtonPin, ButtonDecoder::LongPressMs + 100);
+  TEST_ASSERT_EQUAL(2, hostRunLedFrames());
+}
+
+// frames streamed according to the firmware's status reply, -1 without a reply
+static int64_t streamedFrames(std::vector<uint8_t>& replies)
+{
+  std::vector<uint8_t> request;
+  hostSendMessage(request, ControlMessage_Status, NULL, 0);
+  replies.clear();
+  hostSerialInput(request.data(), request.size());
+  hostRunTask("Serial Control");
+  std::vector<std::vector<uint8_t>> messages = hostReceiveMessages(replies);
+  if (messages.empty() || messages.back()[0] != ControlMessage_StatusReply || messages.back().size() != 13)
+    return -1;
+  return readUint32(&messages.back()[9]);
+}
+
+// Serial loopback through the firmware: settings, a corrupted message, a program switch and the
+// status come back as expected, and the settings only change once the led task starts a frame.
+static void test_control_loopback()
+{
+  std::vector<uint8_t> replies, stream;
+  hostSetSerialCapture(&replies);
+  const char* noise = "text from a terminal\n";
+  stream.insert(stream.end(), noise, noise + strlen(noise));
+  hostSendParam(stream, TunableId_TailLength, 10);
+  hostSendParam(stream, TunableId_MaxLightness, 300);
+  hostSendParam(stream, TunableId_TailLength, 5000);
+  hostSendParam(stream, TunableId_LevelFullScale, 2000);
+  stream.back() ^= 0x55;
+  hostSendParam(stream, TunableId_PixelFadeDuration, 150);
+  uint8_t selected = 3;
+  hostSendMessage(stream, ControlMessage_Program, &selected, 1);
+  hostSendMessage(stream, ControlMessage_Status, NULL, 0);
+
+  Tunables before = tunables;
+  program         = 0;
+  hostSerialInput(stream.data(), stream.size());
+  hostRunTask("Serial Control");
+  hostSetSerialCapture(NULL);
+  // nothing changes until the next frame starts
+  TEST_ASSERT_EQUAL(0, program);
+  TEST_ASSERT_EQUAL(before.tail_length, tunables.tail_length);
+  TEST_ASSERT_EQUAL(before.pixel_fade_ms, tunables.pixel_fade_ms);
+  hostRunLedFrames();
+  TEST_ASSERT_EQUAL(3, program);
+  TEST_ASSERT_EQUAL(10, tunables.tail_length);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.3f, tunables.max_lightness);
+  TEST_ASSERT_EQUAL(150, tunables.pixel_fade_ms);
+  TEST_ASSERT_EQUAL(before.level_full_scale, tunables.level_full_scale);
+
+  std::vector<std::vector<uint8_t>> messages = hostReceiveMessages(replies);
+  const uint8_t                     Acks[][2] = {{ControlMessage_SetParam, ControlStatus_Ok},
+                                                 {ControlMessage_SetParam, ControlStatus_Ok},
+                                                 {ControlMessage_SetParam, ControlStatus_BadValue},
+                                                 {ControlMessage_SetParam, ControlStatus_Ok},
+                                                 {ControlMessage_Program, ControlStatus_Ok}};
+  TEST_ASSERT_EQUAL(6, messages.size());
+  for (size_t index = 0; index < 5; index++) {
+    TEST_ASSERT_TRUE(messages[index] == (std::vector<uint8_t>{ControlMessage_Ack, Acks[index][0], Acks[index][1]}));
+  }
+  // 6 messages, 1 crc error, no frames
+  TEST_ASSERT_EQUAL(13, messages[5].size());
+  TEST_ASSERT_EQUAL_UINT32(6, readUint32(&messages[5][1]));
+  TEST_ASSERT_EQUAL_UINT32(1, readUint32(&messages[5][5]));
+  TEST_ASSERT_EQUAL_UINT32(0, readUint32(&messages[5][9]));
+}
+
+// brightest channel the strip was last pushed with
+static uint8_t shownPeak()
+{
+  hostRunTask("Strip Transmit Task");
+  const std::vector<uint8_t>& pixels = hostGetShownPixels();
+  return pixels.empty() ? 0 : *std::max_element(pixels.begin(), pixels.end());
+}
+
+// the brightness setting scales what the strip gets, whatever the program draws
+static void test_brightness()
+{
+  std::vector<uint8_t> replies, stream;
+  hostSetSerialCapture(&replies);
+  hostSendParam(stream, TunableId_Brightness, 256);
+  hostSendParam(stream, TunableId_Brightness, 64);
+  hostSerialInput(stream.data(), stream.size());
+  hostRunTask("Serial Control");
+  hostSetSerialCapture(NULL);
+  std::vector<std::vector<uint8_t>> messages = hostReceiveMessages(replies);
+  TEST_ASSERT_EQUAL(2, messages.size());
+  TEST_ASSERT_TRUE(messages[0] == (std::vector<uint8_t>{ControlMessage_Ack, ControlMessage_SetParam, ControlStatus_BadValue}));
+  TEST_ASSERT_TRUE(messages[1] == (std::vector<uint8_t>{ControlMessage_Ack, ControlMessage_SetParam, ControlStatus_Ok}));
+
+  // the tail of program 5 is drawn brighter than 64 at its head
+  program = 5;
+  hostRunLedFrames(50);
+  TEST_ASSERT_EQUAL(64, tunables.brightness);
+  uint8_t dimmed = shownPeak();
+  TEST_ASSERT_GREATER_THAN(0, dimmed);
+  TEST_ASSERT_LESS_OR_EQUAL(64, dimmed);
+
+  stream.clear();
+  hostSendParam(stream, TunableId_Brightness, 255);
+  hostSerialInput(stream.data(), stream.size());
+  hostRunTask("Serial Control");
+  hostRunLedFrames(50);
+  TEST_ASSERT_GREATER_THAN(64, shownPeak());
+}
+
+// Frames streamed as fast as the parser takes them, a streamed frame switches to the streaming
+// program. Streaming is left out of the build when its buffers do not fit, the firmware rejects the
+// pixels then.
+static void test_control_streaming()
+{
+  std::vector<uint8_t> replies, probe;
+  const uint8_t        Start[] = {0, 0};
+  hostSetSerialCapture(&replies);
+  hostSendMessage(probe, ControlMessage_Pixels, Start, sizeof(Start));
+  hostSerialInput(probe.data(), probe.size());
+  hostRunTask("Serial Control");
+  std::vector<std::vector<uint8_t>> messages = hostReceiveMessages(replies);
+  if (!messages.empty()) {
+    hostSetSerialCapture(NULL);
+    TEST_ASSERT_EQUAL(1, messages.size());
+    TEST_ASSERT_TRUE(messages[0] == (std::vector<uint8_t>{ControlMessage_Ack, ControlMessage_Pixels, ControlStatus_Unsupported}));
+    printf("control: streaming not built in\n");
+    return;
+  }
+
+  // the frames cover the whole canvas like in main.cpp
+  const uint32_t       Frames = 10000;
+  const uint16_t       Pixels = STRIP_COUNT * STRIP_LENGTH;
+  std::vector<uint8_t> pixels(Pixels * 3), stream;
+  for (size_t index = 0; index < pixels.size(); index++) {
+    pixels[index] = index * 7;
+  }
+  hostSendFrame(stream, pixels.data(), Pixels);
+  hostSerialInput(stream.data(), stream.size());
+  hostRunTask("Serial Control");
+  int64_t streamed = streamedFrames(replies);
+  TEST_ASSERT_EQUAL(ProgramCount - 1, hostRunLedFrames());
+
+  stream.clear();
+  for (uint32_t index = 0; index < Frames; index++) {
+    pixels[0] = index;
+    hostSendFrame(stream, pixels.data(), Pixels);
+  }
+  size_t frame_bytes = stream.size() / Frames;
+  hostSerialInput(stream.data(), stream.size());
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  hostRunTask("Serial Control");
+  double seconds = hostSecondsSince(start);
+  TEST_ASSERT_EQUAL(streamed + Frames, streamedFrames(replies));
+  // the last frame is shown by the streaming program
+  TEST_ASSERT_EQUAL(ProgramCount - 1, hostRunLedFrames());
+  hostSetSerialCapture(NULL);
+
+  // 10 bits per byte on the wire
+  const uint32_t Baud = 921600;
+  printf("control: %u pixel frames parsed at %.0f frames/s, %u bytes each, %.1f frames/s at %lu baud\n", Pixels, Frames / seconds,
+         (unsigned)frame_bytes, Baud / 10.0 / frame_bytes, (unsigned long)Baud);
+}
+
+// A click track recorded through the capture plays twice into every audio program. The capture made
+// during the first run has to give back the samples that were played, and both runs have to show
+// the same frames.
+static void test_replay()
+{
+  const uint32_t Frames = 600;
+  HostI2SSource  clicks;
+  clicks.generate(HostSignal_Clicks, 2.0f, 0.02f, SampleRate * 15, SampleRate);
+  std::vector<int16_t> recording = hostRecordCapture(clicks);
+  TEST_ASSERT_FALSE(recording.empty());
+  std::chrono::steady_clock::time_point start   = std::chrono::steady_clock::now();
+  HostReplay                            replay  = hostReplayPrograms(recording, Frames);
+  double                                seconds = hostSecondsSince(start);
+  printf("replay: %u programs x %lu frames over %.1f s of audio, %.1f us/frame\n", (unsigned)sizeof(ReplayPrograms), (unsigned long)Frames,
+         (float)recording.size() / AnalysisRate, seconds * 1e6 / (2 * sizeof(ReplayPrograms) * Frames));
+  TEST_ASSERT_TRUE_MESSAGE(replay.captured, "the capture differs from the samples played");
+  TEST_ASSERT_TRUE_MESSAGE(replay.repeated, "the second run showed other frames");
+}
+
+// the led task runs until the virtual time reaches s_run_end_ms, counting its frames from s_run_start_ms
+static uint32_t s_run_start_ms = 0;
+static uint32_t s_run_end_ms   = 0;
+static uint32_t s_run_frames   = 0;
+
+static void countRunFrame()
+{
+  if ((int32_t)(millis() - s_run_start_ms) > 0)
+    s_run_frames++;
+  if ((int32_t)(millis() - s_run_end_ms) >= 0)
+    throw HostStop();
+}
+
+// wake ups of the led task per second of program, over seconds once the switch to it is over
+static float ledWakeupRate(uint8_t index, uint32_t seconds)
+{
+  // switched to from another program, so it runs at its own frame rate
+  program = index != 0 ? 0 : 1;
+  hostRunLedFrames(1);
+  program        = index;
+  s_run_start_ms = millis() + 2000;
+  s_run_end_ms   = s_run_start_ms + seconds * 1000;
+  s_run_frames   = 0;
+  hostSetFrameHook(countRunFrame);
+  hostRunTask("Led Task");
+  hostSetFrameHook(NULL);
+  return s_run_frames / (float)seconds;
+}
+
+// Every program with the led task on its frame period and then idling. Without audio programs 6 and
+// 8 stand still, 7 is off and 10 has nothing streamed, so they must drop to the one wake up per
+// max idle time; no program may wake more often than before, give or take the 5% the clip timing varies.
+static void test_idle()
+{
+  const uint32_t Seconds         = 20;
+  const uint8_t  QuietPrograms[] = {6, 7, 8, 10};
+  uint16_t       max_idle_ms     = tunables.max_idle_ms;
+  bool           passed          = true;
+  printf("program  wakeups/s  idling\n");
+  for (uint8_t index = 0; index < ProgramCount; index++) {
+    tunables.max_idle_ms = 0;
+    float before         = ledWakeupRate(index, Seconds);
+    tunables.max_idle_ms = max_idle_ms;
+    float after          = ledWakeupRate(index, Seconds);
+    bool  quiet          = std::find(std::begin(QuietPrograms), std::end(QuietPrograms), index) != std::end(QuietPrograms);
+    bool  ok             = after <= before * 1.05f && (!quiet || after <= 1100.0f / max_idle_ms);
+    printf("%7u  %9.1f  %6.1f  %s\n", index, before, after, ok ? "ok" : "FAIL");
+    passed &= ok;
+  }
+  TEST_ASSERT_TRUE_MESSAGE(passed, "a program wakes the led task more often than it should");
+}
+
+// a clip plays by the clock, not by the frames the led task renders
+static const uint8_t ClipProgram = 9;
+
+// times the looping clip showed its lit first frame
+static std::vector<uint32_t> s_clip_starts;
+static bool                  s_clip_lit = false;
+
+static void markClipStart()
+{
+  hostRunTask("Strip Transmit Task");
+  const std::vector<uint8_t>& pixels = hostGetShownPixels();
+  bool                        lit    = std::any_of(pixels.begin(), pixels.end(), [](uint8_t value) { return value > 0; });
+  if (lit && !s_clip_lit && (int32_t)(millis() - s_run_start_ms) > 0)
+    s_clip_starts.push_back(millis());
+  s_clip_lit = lit;
+  if ((int32_t)(millis() - s_run_end_ms) >= 0)
+    throw HostStop();
+}
+
+// longest difference in ms between a loop of the clip and its length
+static uint32_t clipLoopError(uint32_t loop_ms, uint32_t seconds)
+{
+  program = OffProgram;
+  hostRunLedFrames(1);
+  program        = ClipProgram;
+  s_run_start_ms = millis() + 1000;
+  s_run_end_ms   = s_run_start_ms + seconds * 1000;
+  s_clip_starts.clear();
+  s_clip_lit = false;
+  hostSetFrameHook(markClipStart);
+  hostRunTask("Led Task");
+  hostSetFrameHook(NULL);
+  TEST_ASSERT_GREATER_THAN(seconds * 1000 / loop_ms / 2, s_clip_starts.size());
+  uint32_t error = 0;
+  for (size_t index = 1; index < s_clip_starts.size(); index++) {
+    uint32_t period = s_clip_starts[index] - s_clip_starts[index - 1];
+    uint32_t off    = period > loop_ms ? period - loop_ms : loop_ms - period;
+    error           = std::max(error, off);
+  }
+  return error;
+}
+
+// a looping clip, lit on its first frame and dark for the rest of its 2 s, takes as long with the led
+// task idling through the dark stretch as without
+static void test_clip_duration()
+{
+  const uint8_t        Fps    = 30;
+  const uint16_t       Frames = 60;
+  const uint32_t       LoopMs = Frames * 1000 / Fps;
+  std::vector<uint8_t> frames(Frames * ClipPixels * 3, 0);
+  std::fill(frames.begin(), frames.begin() + ClipPixels * 3, 255);
+  std::vector<uint8_t> bank = buildClipBank({hostEncodeClip(frames, Fps, 0, 0)});
+  hostSetPartition(bank.data(), bank.size());
+  clipBank.begin();
+
+  uint16_t max_idle_ms = tunables.max_idle_ms;
+  tunables.max_idle_ms = 0;
+  uint32_t busy        = clipLoopError(LoopMs, 10);
+  tunables.max_idle_ms = max_idle_ms;
+  uint32_t idling      = clipLoopError(LoopMs, 10);
+  printf("clip: %lu ms loop, %lu ms off at most without idling, %lu ms with it\n", (unsigned long)LoopMs, (unsigned long)busy,
+         (unsigned long)idling);
+  program = OffProgram;
+  hostRunLedFrames(1);
+  hostInstallDemoClips();
+  clipBank.begin();
+  // a frame of the clip late either way, and the idle wait it catches up from
+  TEST_ASSERT_LESS_OR_EQUAL(1000 / Fps + 1, busy);
+  TEST_ASSERT_LESS_OR_EQUAL(100 + 1000 / Fps + 1, idling);
+}
+
+int main(int argc, char** argv)
+{
+  hostInstallDemoClips();
+  hostSetSerialQuiet(true);
+  setup();
+  UNITY_BEGIN();
+  RUN_TEST(test_allocations);
+  RUN_TEST(test_button);
+  RUN_TEST(test_control_loopback);
+  RUN_TEST(test_brightness);
+  RUN_TEST(test_control_streaming);
+  RUN_TEST(test_replay);
+  RUN_TEST(test_idle);
+  RUN_TEST(test_clip_duration);
+  return UNITY_END();
+}
@@ -0,0 +1,989 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "EffectRegistry.h"
+#include "ColorLut.h"
+#include "FastRandom.h"
+#include "FrameExchange.h"
+#include "FrameScheduler.h"
+#include "HostHarness.h"
+#include "LayerBlend.h"
+#include "LayerCompositor.h"
+#include "NeoPixelAnimator.h"
+#include "ParticleSystem.h"
+#include "PixelFrame.h"
+#include "PixelLayer.h"
+#include "PixelTweens.h"
+
+// The led engine on its own: the frame's dirty tracking against a mock strip, the frame pacing, the
+// hand over between the render and the transmit task, the blends and the
+// compositor, the colour tables, the effects' random generator, the particle engine and the pixel
+// tweens, each against a reference and timed against what it replaced.
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+const uint16_t                  BlendPixels = 300;
+typedef PixelLayer<BlendPixels> BlendLayer;
+
+// per channel reference of the blends
+static uint8_t blendChannel(BlendMode mode, uint8_t outgoing, uint8_t incoming, uint16_t weight)
+{
+  uint16_t outgoing_weight, incoming_weight;
+  LayerBlend::transitionWeights(mode, weight, outgoing_weight, incoming_weight);
+  switch (mode) {
+    case BlendMode_Add:
+      return std::min(255, (outgoing * outgoing_weight >> 8) + (incoming * incoming_weight >> 8));
+    case BlendMode_Max:
+      return std::max(outgoing * outgoing_weight >> 8, incoming * incoming_weight >> 8);
+    default:
+      return (outgoing * (256 - weight) + incoming * weight) >> 8;
+  }
+}
+
+// two layers holding all pairs of the extreme channel values, then random values
+static void fillBlendLayers(BlendLayer& outgoing, BlendLayer& incoming)
+{
+  uint8_t* outgoing_bytes = (uint8_t*)outgoing.getWords();
+  uint8_t* incoming_bytes = (uint8_t*)incoming.getWords();
+  for (size_t index = 0; index < BlendLayer::ByteCount; index++) {
+    outgoing_bytes[index] = index < 16 ? (index & 1 ? 255 : 0) : random(256);
+    incoming_bytes[index] = index < 16 ? (index & 2 ? 255 : 0) : random(256);
+  }
+}
+
+// every mode against the per channel reference at every weight, both ends of a crossfade are the layers themselves
+static void test_blend_modes()
+{
+  static BlendLayer outgoing, incoming, blended;
+  fillBlendLayers(outgoing, incoming);
+  for (int mode = 0; mode < BlendMode_Count; mode++) {
+    for (uint16_t weight = 0; weight <= 256; weight++) {
+      LayerBlend::transition((BlendMode)mode, outgoing.getWords(), incoming.getWords(), blended.getWords(), BlendLayer::WordCount, weight);
+      for (size_t index = 0; index < BlendLayer::ByteCount; index++) {
+        TEST_ASSERT_EQUAL_UINT8(blendChannel((BlendMode)mode, outgoing.getBytes()[index], incoming.getBytes()[index], weight),
+                                blended.getBytes()[index]);
+      }
+    }
+  }
+  LayerBlend::transition(BlendMode_Alpha, outgoing.getWords(), incoming.getWords(), blended.getWords(), BlendLayer::WordCount, 0);
+  TEST_ASSERT_EQUAL_MEMORY(outgoing.getBytes(), blended.getBytes(), BlendLayer::ByteCount);
+  LayerBlend::transition(BlendMode_Alpha, outgoing.getWords(), incoming.getWords(), blended.getWords(), BlendLayer::WordCount, 256);
+  TEST_ASSERT_EQUAL_MEMORY(incoming.getBytes(), blended.getBytes(), BlendLayer::ByteCount);
+}
+
+// strip that keeps what it was sent and counts the calls
+struct MockStrip
+{
+  RgbColor pixels[BlendPixels];
+  uint32_t pixels_set = 0;
+  uint32_t shows      = 0;
+
+  void SetPixelColor(uint16_t index, const RgbColor& color)
+  {
+    TEST_ASSERT_LESS_THAN(BlendPixels, index);
+    pixels[index] = color;
+    pixels_set++;
+  }
+  void Show()
+  {
+    shows++;
+  }
+};
+
+// writes that change nothing do not reach the strip, the ones that do push only their span
+static void test_frame_skips_unchanged()
+{
+  static MockStrip                          strip;
+  static PixelFrame<MockStrip, BlendPixels> frame(strip);
+  frame.Fill(RgbColor(0));
+  frame.SetPixelColor(5, RgbColor(0));
+  TEST_ASSERT_FALSE(frame.Show());
+  TEST_ASSERT_EQUAL_UINT32(0, strip.shows);
+
+  frame.SetPixelColor(5, RgbColor(10, 20, 30));
+  TEST_ASSERT_TRUE(frame.Show());
+  TEST_ASSERT_EQUAL_UINT32(1, strip.shows);
+  TEST_ASSERT_EQUAL_UINT32(1, strip.pixels_set);
+  TEST_ASSERT_TRUE(strip.pixels[5] == RgbColor(10, 20, 30));
+
+  // the fill only pushes 10..29, pixel 5 is not sent again
+  frame.Fill(10, 20, RgbColor(1, 2, 3));
+  frame.Fill(10, 20, RgbColor(1, 2, 3));
+  TEST_ASSERT_TRUE(frame.Show());
+  TEST_ASSERT_EQUAL_UINT32(21, strip.pixels_set);
+  TEST_ASSERT_FALSE(frame.Show());
+
+  // a fill that overlaps the same colour pushes only the pixels it changes
+  frame.Fill(0, 30, RgbColor(1, 2, 3));
+  TEST_ASSERT_TRUE(frame.Show());
+  TEST_ASSERT_EQUAL_UINT32(21 + 10, strip.pixels_set);
+
+  // the output settings change every pixel on the strip
+  frame.SetOutput(true, 128);
+  TEST_ASSERT_TRUE(frame.Show());
+  TEST_ASSERT_EQUAL_UINT32(31 + BlendPixels, strip.pixels_set);
+  TEST_ASSERT_EQUAL_UINT32(4, frame.getFramesShown());
+  TEST_ASSERT_EQUAL_UINT32(2, frame.getFramesSkipped());
+  TEST_ASSERT_EQUAL_UINT32(4, strip.shows);
+}
+
+// Random writes through every entry point of the frame, a few per frame. After every Show() the strip
+// holds the reference canvas through the output table, whatever the dirty range let through.
+static void test_frame_matches_strip()
+{
+  const uint32_t                            Frames = 20000;
+  static MockStrip                          strip;
+  static PixelFrame<MockStrip, BlendPixels> frame(strip);
+  static RgbColor                           reference[BlendPixels];
+  static uint8_t                            packed[BlendPixels * 3];
+  uint8_t                                   lut[256];
+  bool                                      gamma      = false;
+  uint8_t                                   brightness = 255;
+  FastRandom                                random(99);
+  ColorLut::buildOutputLut(lut, gamma, brightness);
+  for (uint32_t index = 0; index < Frames; index++) {
+    // mostly small changes from a few colours, so many writes repeat what is there
+    uint32_t writes = random.below(4);
+    for (uint32_t write = 0; write < writes; write++) {
+      RgbColor color = RgbColor(random.below(3) * 100);
+      uint16_t first = random.below(BlendPixels);
+      uint16_t count = random.below(16);
+      switch (random.below(16)) {
+        case 0:
+          frame.Fill(first, count, color);
+          for (uint16_t pixel = first; pixel < first + count && pixel < BlendPixels; pixel++) {
+            reference[pixel] = color;
+          }
+          break;
+        case 1:
+          memcpy(packed, reference, sizeof(packed));
+          packed[random.below(sizeof(packed))] = random.below(256);
+          frame.SetPixels(packed);
+          memcpy(reference, packed, sizeof(packed));
+          break;
+        case 2:
+          frame.RotateRight(count);
+          std::rotate(reference, reference + BlendPixels - count, reference + BlendPixels);
+          break;
+        case 3:
+          if (random.below(8) == 0) {
+            // a quarter of the settings are the identity the frame pushes without the table
+            gamma      = random.below(2) == 0;
+            brightness = random.below(2) == 0 ? 255 : random.below(256);
+            frame.SetOutput(gamma, brightness);
+            ColorLut::buildOutputLut(lut, gamma, brightness);
+          }
+          break;
+        default:
+          frame.SetPixelColor(first, color);
+          reference[first] = color;
+          break;
+      }
+    }
+    frame.Show();
+    for (uint16_t pixel = 0; pixel < BlendPixels; pixel++) {
+      const RgbColor& color = reference[pixel];
+      TEST_ASSERT_TRUE(strip.pixels[pixel] == RgbColor(lut[color.R], lut[color.G], lut[color.B]));
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(Frames, frame.getFramesShown() + frame.getFramesSkipped());
+  TEST_ASSERT_EQUAL_UINT32(frame.getFramesShown(), strip.shows);
+  printf("frame: %lu of %lu frames pushed, %.1f pixels per push of %u\n", (unsigned long)strip.shows, (unsigned long)Frames,
+         (double)strip.pixels_set / strip.shows, BlendPixels);
+}
+
+// Frame pacing in virtual time. A frame costs 1-4 ms of drawing and 9 ms of Show(), one in 50 runs
+// 25 ms long. The old loop slept one tick and drew whenever it woke, so its frames came as fast as the
+// work allowed; the scheduler starts them on its period and starts the next one right after a long one.
+struct FrameJitter
+{
+  std::vector<uint32_t> intervals;
+  double                mean;
+  double                deviation;
+};
+
+static uint32_t frameWorkMs(FastRandom& random)
+{
+  return random.below(50) == 0 ? 25 : 1 + random.below(4) + 9;
+}
+
+static FrameJitter frameJitter(std::vector<uint32_t> starts)
+{
+  FrameJitter jitter;
+  double      sum = 0, squares = 0;
+  for (size_t index = 1; index < starts.size(); index++) {
+    jitter.intervals.push_back(starts[index] - starts[index - 1]);
+    sum += jitter.intervals.back();
+    squares += (double)jitter.intervals.back() * jitter.intervals.back();
+  }
+  size_t count     = jitter.intervals.size();
+  jitter.mean      = sum / count;
+  jitter.deviation = sqrt(squares / count - jitter.mean * jitter.mean);
+  std::sort(jitter.intervals.begin(), jitter.intervals.end());
+  printf(" interval mean %.2f ms, deviation %.2f ms, min %lu ms, p50 %lu ms, p99 %lu ms, max %lu ms\n", jitter.mean, jitter.deviation,
+         (unsigned long)jitter.intervals.front(), (unsigned long)jitter.intervals[count / 2], (unsigned long)jitter.intervals[count * 99 / 100],
+         (unsigned long)jitter.intervals.back());
+  return jitter;
+}
+
+static void test_scheduler_jitter()
+{
+  const uint32_t        Frames = 5000;
+  const uint16_t        Fps    = 60;
+  std::vector<uint32_t> starts;
+  FastRandom            random(5);
+  for (uint32_t index = 0; index < Frames; index++) {
+    starts.push_back(millis());
+    hostAdvanceMs(frameWorkMs(random));
+    vTaskDelay(1);
+  }
+  printf("vTaskDelay(1) loop:");
+  FrameJitter before = frameJitter(starts);
+
+  FrameScheduler scheduler;
+  scheduler.begin(Fps);
+  starts.clear();
+  random = FastRandom(5);
+  for (uint32_t index = 0; index < Frames; index++) {
+    scheduler.beginFrame();
+    starts.push_back(millis());
+    hostAdvanceMs(frameWorkMs(random));
+    scheduler.waitNextFrame();
+  }
+  printf("scheduler at %u fps:", Fps);
+  FrameJitter after = frameJitter(starts);
+
+  // every frame on the period except the long ones, the frame after a long one starts right away
+  uint32_t period_ms = 1000 / Fps;
+  size_t   on_period = std::count(after.intervals.begin(), after.intervals.end(), period_ms);
+  TEST_ASSERT_EQUAL(Frames - 1 - scheduler.getOverruns(), on_period);
+  TEST_ASSERT_EQUAL_UINT32(25, after.intervals.back());
+  TEST_ASSERT_LESS_THAN(Frames / 25, scheduler.getOverruns());
+  TEST_ASSERT_LESS_THAN_FLOAT(before.deviation, after.deviation);
+}
+
+// Frames of 900 words, the frame number in every word so a frame written over while it is read shows.
+const size_t                                   ExchangeWords = 900;
+typedef FrameExchange<uint32_t, ExchangeWords> WordExchange;
+
+static void fillFrame(uint32_t* words, uint32_t frame)
+{
+  for (size_t index = 0; index < ExchangeWords; index++) {
+    words[index] = frame;
+  }
+}
+
+// the frame number if every word holds it, -1 for a torn frame
+static int64_t frameNumber(const uint32_t* words)
+{
+  for (size_t index = 1; index < ExchangeWords; index++) {
+    if (words[index] != words[0])
+      return -1;
+  }
+  return words[0];
+}
+
+// without a consumer in between, the newest frame is the one taken and the others are dropped
+static void test_exchange_latest_wins()
+{
+  static WordExchange exchange;
+  TEST_ASSERT_FALSE(exchange.acquire());
+  uint32_t dropped = 0;
+  for (uint32_t frame = 1; frame <= 3; frame++) {
+    fillFrame(exchange.back(), frame);
+    dropped += exchange.publish();
+  }
+  TEST_ASSERT_EQUAL_UINT32(2, dropped);
+  TEST_ASSERT_TRUE(exchange.acquire());
+  TEST_ASSERT_EQUAL_INT64(3, frameNumber(exchange.front()));
+  TEST_ASSERT_FALSE(exchange.acquire());
+  TEST_ASSERT_EQUAL_INT64(3, frameNumber(exchange.front()));
+}
+
+// The render task as a thread that never waits against a transmit thread that holds each frame for a
+// while: every frame taken is intact, newer than the one before and not written to while it is held,
+// the ones skipped are all reported as dropped and the last frame published is the last one taken.
+static void test_exchange_threads()
+{
+  const uint32_t      Frames = 100000;
+  static WordExchange exchange;
+  std::atomic<bool>   done{false};
+  uint32_t            dropped = 0;
+  std::thread         producer([&]() {
+    for (uint32_t frame = 1; frame <= Frames; frame++) {
+      fillFrame(exchange.back(), frame);
+      dropped += exchange.publish();
+      // let the consumer in now and then on a single core host as well
+      if (frame % 8 == 0)
+        std::this_thread::yield();
+    }
+    done.store(true);
+  });
+  uint32_t taken = 0, torn = 0, reused = 0, out_of_order = 0;
+  int64_t  last  = 0;
+  while (true) {
+    bool finished = done.load();
+    if (!exchange.acquire()) {
+      if (finished)
+        break;
+      std::this_thread::yield();
+      continue;
+    }
+    int64_t number = frameNumber(exchange.front());
+    // the transmit stage waits on the strip with the frame, the producer must not touch it meanwhile
+    std::this_thread::yield();
+    torn += number < 0;
+    reused += frameNumber(exchange.front()) != number;
+    out_of_order += number <= last;
+    last = number;
+    taken++;
+  }
+  producer.join();
+  printf("exchange: %lu frames, %lu taken, %lu dropped\n", (unsigned long)Frames, (unsigned long)taken, (unsigned long)dropped);
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  TEST_ASSERT_EQUAL_UINT32(0, reused);
+  TEST_ASSERT_EQUAL_UINT32(0, out_of_order);
+  TEST_ASSERT_EQUAL_INT64(Frames, last);
+  TEST_ASSERT_EQUAL_UINT32(Frames, taken + dropped);
+  TEST_ASSERT_GREATER_THAN(1, taken);
+}
+
+// single pixel effect for the compositor check: pixel 0 holds T_LEVEL and counts the frames in pixel 1
+template <uint8_t T_LEVEL, bool T_GAMMA = false>
+struct LevelDotEffect : EffectBase<60, T_GAMMA>
+{
+  struct State
+  {
+    uint8_t frames;
+  };
+
+  template <typename T_CANVAS>
+  static void render(State& state, T_CANVAS& canvas, uint32_t now_ms)
+  {
+    canvas.SetPixelColor(0, RgbColor(T_LEVEL));
+    canvas.SetPixelColor(1, RgbColor(++state.frames));
+  }
+};
+
+// frame that only keeps the canvas, for the blend checks
+struct NullStrip
+{
+  void SetPixelColor(uint16_t index, const RgbColor& color)
+  {
+  }
+  void Show()
+  {
+  }
+};
+
+typedef EffectRegistry<BlendLayer, LevelDotEffect<200>, LevelDotEffect<100>> LevelDots;
+typedef EffectRegistry<BlendLayer, LevelDotEffect<200, true>, LevelDotEffect<100>> GammaLevelDots;
+
+// the outgoing effect keeps running, the frame goes from 200 to 100 and ends on the incoming effect alone
+static void test_compositor_crossfade()
+{
+  static NullStrip                                strip;
+  static PixelFrame<NullStrip, BlendPixels>       frame(strip);
+  static LayerCompositor<LevelDots, BlendPixels> compositor;
+  compositor.setTransition(BlendMode_Alpha, 100);
+  compositor.select(0, 0);
+  compositor.render(0);
+  compositor.compose(frame, 0);
+  TEST_ASSERT_EQUAL_UINT8(200, frame.GetPixelColor(0).R);
+  TEST_ASSERT_FALSE(compositor.isTransitioning());
+  compositor.select(1, 10);
+  uint8_t last = 200;
+  for (uint32_t now_ms = 10; now_ms <= 110; now_ms += 10) {
+    compositor.update(now_ms);
+    compositor.render(now_ms);
+    compositor.compose(frame, now_ms);
+    uint8_t level = frame.GetPixelColor(0).R;
+    TEST_ASSERT_LESS_OR_EQUAL(last, level);
+    TEST_ASSERT_GREATER_OR_EQUAL(100, level);
+    last = level;
+  }
+  TEST_ASSERT_EQUAL_UINT8(100, last);
+  TEST_ASSERT_FALSE(compositor.isTransitioning());
+  TEST_ASSERT_EQUAL(1, compositor.getCurrent());
+  // the incoming effect drew all 11 frames of the transition
+  TEST_ASSERT_EQUAL_UINT8(11, frame.GetPixelColor(1).R);
+}
+
+// a gamma corrected effect fading to a linear one starts from its corrected level, without a jump
+static void test_compositor_gamma_crossfade()
+{
+  static NullStrip                                     strip;
+  static PixelFrame<NullStrip, BlendPixels>            frame(strip);
+  static LayerCompositor<GammaLevelDots, BlendPixels> compositor;
+  uint8_t                                              lut[256];
+  ColorLut::buildOutputLut(lut, true, 255);
+  compositor.setTransition(BlendMode_Alpha, 100);
+  compositor.select(0, 0);
+  compositor.render(0);
+  compositor.compose(frame, 0);
+  TEST_ASSERT_EQUAL_UINT8(lut[200], frame.GetPixelColor(0).R);
+  compositor.select(1, 10);
+  uint8_t last = lut[200];
+  for (uint32_t now_ms = 10; now_ms <= 110; now_ms += 10) {
+    compositor.update(now_ms);
+    compositor.render(now_ms);
+    compositor.compose(frame, now_ms);
+    // the corrected outgoing level blends linearly into the incoming one
+    uint32_t weight   = (now_ms - 10) * 256 / 100;
+    int32_t  expected = lut[200] + ((100 - lut[200]) * (int32_t)weight) / 256;
+    uint8_t  level    = frame.GetPixelColor(0).R;
+    TEST_ASSERT_INT_WITHIN(1, expected, level);
+    TEST_ASSERT_LESS_OR_EQUAL(last, level);
+    last = level;
+  }
+  TEST_ASSERT_EQUAL_UINT8(100, last);
+  TEST_ASSERT_FALSE(compositor.isTransitioning());
+}
+
+// HslColor to RgbColor the way NeoPixelBus converts it, in float, for the colour table checks
+static float hslChannel(float v1, float v2, float hue)
+{
+  hue = hue < 0.0f ? hue + 1.0f : (hue > 1.0f ? hue - 1.0f : hue);
+  if (hue < 1.0f / 6.0f)
+    return v1 + (v2 - v1) * 6.0f * hue;
+  if (hue < 0.5f)
+    return v2;
+  if (hue < 2.0f / 3.0f)
+    return v1 + (v2 - v1) * (2.0f / 3.0f - hue) * 6.0f;
+  return v1;
+}
+
+static RgbColor hslColor(float hue, float lightness)
+{
+  float v2 = lightness < 0.5f ? lightness * 2.0f : 1.0f;
+  float v1 = 2.0f * lightness - v2;
+  return RgbColor(hslChannel(v1, v2, hue + 1.0f / 3.0f) * 255.0f, hslChannel(v1, v2, hue) * 255.0f, hslChannel(v1, v2, hue - 1.0f / 3.0f) * 255.0f);
+}
+
+static int colorError(const RgbColor& left, const RgbColor& right)
+{
+  return std::max(std::max(abs(left.R - right.R), abs(left.G - right.G)), abs(left.B - right.B));
+}
+
+// The tables against the float paths they replaced: the hue wheel against HslColor at every hue and
+// brightness, the eased progress against the curves, the Q8 blend against LinearBlend and the output
+// table against brightness and gamma in float.
+static void test_color_lut_error()
+{
+  ColorLut::begin();
+  int hue_error = 0;
+  for (int brightness = 0; brightness < 256; brightness++) {
+    for (int hue = 0; hue < 256; hue++) {
+      hue_error = std::max(hue_error, colorError(ColorLut::hue(hue, brightness), hslColor(hue / 256.0f, brightness / 510.0f)));
+    }
+  }
+
+  int ease_error = 0;
+  for (int ease = 0; ease < TweenEase_Count; ease++) {
+    for (uint32_t progress = 0; progress < 65536; progress++) {
+      float value = progress / 65536.0f;
+      switch (ease) {
+        case TweenEase_QuadraticInOut:
+          value = value < 0.5f ? 2.0f * value * value : 1.0f - 2.0f * (1.0f - value) * (1.0f - value);
+          break;
+        case TweenEase_CubicIn:
+          value = value * value * value;
+          break;
+        case TweenEase_CubicOut:
+          value = 1.0f - (1.0f - value) * (1.0f - value) * (1.0f - value);
+          break;
+        case TweenEase_SinusoidalInOut:
+          value = 0.5f - 0.5f * cosf((float)M_PI * value);
+          break;
+      }
+      ease_error = std::max(ease_error, abs((int)ColorLut::ease(ease, progress) - (int)lroundf(value * 65535.0f)));
+    }
+  }
+
+  int        blend_error = 0;
+  FastRandom random(11);
+  for (int index = 0; index < 100000; index++) {
+    RgbColor left   = random.color(255);
+    RgbColor right  = random.color(255);
+    uint16_t weight = random.below(257);
+    blend_error     = std::max(blend_error, colorError(ColorLut::blend(left, right, weight), RgbColor::LinearBlend(left, right, weight / 256.0f)));
+  }
+
+  float   output_error = 0.0f;
+  uint8_t lut[256];
+  for (int brightness = 0; brightness < 256; brightness++) {
+    for (int gamma = 0; gamma < 2; gamma++) {
+      ColorLut::buildOutputLut(lut, gamma, brightness);
+      for (int value = 0; value < 256; value++) {
+        float level  = value / 255.0f * brightness / 255.0f;
+        level        = gamma ? powf(level, 1.0f / 0.45f) : level;
+        output_error = std::max(output_error, fabsf(lut[value] - level * 255.0f));
+      }
+    }
+  }
+  printf("color lut: hue %d, ease %d of 65535, blend %d, output %.2f worst error\n", hue_error, ease_error, blend_error, output_error);
+  TEST_ASSERT_LESS_OR_EQUAL(1, hue_error);
+  TEST_ASSERT_LESS_OR_EQUAL(4, ease_error);
+  TEST_ASSERT_LESS_OR_EQUAL(1, blend_error);
+  TEST_ASSERT_LESS_OR_EQUAL_FLOAT(0.5f, output_error);
+}
+
+// The old tail of DrawTailPixels for all 300 pixels: an HslColor per pixel from float lightness,
+// converted to RgbColor and gamma corrected through a table per pixel, against the hue table into the
+// frame and the output table applied once per frame when it is pushed. Printed for comparison only,
+// host timings say little about the ESP32.
+static void test_color_lut_cost()
+{
+  const uint32_t                            Frames = 20000;
+  static NullStrip                          strip;
+  static PixelFrame<NullStrip, BlendPixels> frame(strip);
+  static RgbColor                           pixels[BlendPixels];
+  uint8_t                                   gamma[256];
+  ColorLut::begin();
+  ColorLut::buildOutputLut(gamma, true, 255);
+  frame.SetOutput(true, 255);
+  double ns[2];
+  for (int pass = 0; pass < 2; pass++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t index = 0; index < Frames; index++) {
+      uint8_t hue = index * 7;
+      for (uint16_t pixel = 0; pixel < BlendPixels; pixel++) {
+        if (pass == 0) {
+          RgbColor color = hslColor(hue / 256.0f, pixel * 0.5f / BlendPixels);
+          pixels[pixel]  = RgbColor(gamma[color.R], gamma[color.G], gamma[color.B]);
+        }
+        else {
+          frame.SetPixelColor(pixel, ColorLut::hue(hue, pixel * 255 / BlendPixels));
+        }
+      }
+      if (pass == 1)
+        frame.Show();
+    }
+    ns[pass] = hostSecondsSince(start) * 1e9 / Frames;
+  }
+  printf("color lut: %u pixel frame %.1f us with HslColor and a gamma table per pixel, %.1f us with the tables\n", BlendPixels, ns[0] / 1000,
+         ns[1] / 1000);
+}
+
+// the cost of blending two 300 pixel layers into a frame
+static void test_blend_cost()
+{
+  const uint32_t                            Frames = 100000;
+  static BlendLayer                         outgoing, incoming, blended;
+  static NullStrip                          strip;
+  static PixelFrame<NullStrip, BlendPixels> frame(strip);
+  fillBlendLayers(outgoing, incoming);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t index = 0; index < Frames; index++) {
+    LayerBlend::transition(BlendMode_Alpha, outgoing.getWords(), incoming.getWords(), blended.getWords(), BlendLayer::WordCount, index & 0xff);
+    frame.SetPixels(blended.getBytes());
+  }
+  printf("blend: two %u pixel layers into the frame in %.2f us\n", BlendPixels, hostSecondsSince(start) * 1e6 / Frames);
+}
+
+// pixel indices spread evenly over 300 values
+static void test_random_uniform()
+{
+  const uint32_t Draws = 10000000;
+  const uint32_t Bins  = 300;
+  FastRandom     random(12345);
+  static uint32_t counts[Bins];
+  for (uint32_t draw = 0; draw < Draws; draw++) {
+    counts[random.below(Bins)]++;
+  }
+  // 299 degrees of freedom, 400 is beyond the 99.99% quantile
+  double expected = (double)Draws / Bins;
+  double chi      = 0;
+  for (uint32_t bin = 0; bin < Bins; bin++) {
+    chi += (counts[bin] - expected) * (counts[bin] - expected) / expected;
+  }
+  printf("random: chi-square %.0f over %u bins\n", chi, Bins);
+  TEST_ASSERT_LESS_THAN_FLOAT(400.0f, chi);
+}
+
+// a range of 3 * 2^30 has a third of its draws under 2^30 where a modulo would put half of them there
+static void test_random_wide_range()
+{
+  const uint32_t Draws = 10000000;
+  FastRandom     random(12345);
+  uint32_t       low = 0;
+  for (uint32_t draw = 0; draw < Draws; draw++) {
+    low += random.below(0xc0000000) < 0x40000000;
+  }
+  double third = (double)low / Draws;
+  TEST_ASSERT_FLOAT_WITHIN(0.0035f, 0.3335f, third);
+}
+
+// the fills stay in their ranges and split generators differ
+static void test_random_fill_and_split()
+{
+  FastRandom random(12345);
+  uint16_t   times[1000];
+  uint16_t   pixels[1000];
+  RgbColor   colors[1000];
+  random.fill(times, 1000, 100, 400);
+  random.fill(pixels, 1000, 300);
+  random.fillColors(colors, 1000, 128);
+  for (int index = 0; index < 1000; index++) {
+    TEST_ASSERT_TRUE(times[index] >= 100 && times[index] < 400);
+    TEST_ASSERT_LESS_THAN(300, pixels[index]);
+    TEST_ASSERT_TRUE(colors[index].R < 128 && colors[index].G < 128 && colors[index].B < 128);
+  }
+  FastRandom first  = random.split();
+  FastRandom second = random.split();
+  TEST_ASSERT_TRUE(first.next() != second.next());
+}
+
+// values of the random benchmark, kept so the optimizer cannot drop the draws being timed
+static volatile uint32_t s_random_sink;
+
+// cost per value against random()
+static void test_random_cost()
+{
+  const uint32_t Draws = 10000000;
+  FastRandom     random(12345);
+  uint16_t       pixels[1000];
+  uint32_t       sum = 0;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t draw = 0; draw < Draws; draw++) {
+    sum += random.below(300);
+  }
+  double below_ns = hostSecondsSince(start) * 1e9 / Draws;
+  start           = std::chrono::steady_clock::now();
+  for (uint32_t draw = 0; draw < Draws; draw += 1000) {
+    random.fill(pixels, 1000, 300);
+    sum += pixels[draw % 1000];
+  }
+  double fill_ns = hostSecondsSince(start) * 1e9 / Draws;
+  start          = std::chrono::steady_clock::now();
+  for (uint32_t draw = 0; draw < Draws; draw++) {
+    sum += ::random(300);
+  }
+  double arduino_ns = hostSecondsSince(start) * 1e9 / Draws;
+  s_random_sink = sum;
+  printf("random: %.2f ns/value, fill %.2f ns/value, random() %.2f ns/value\n", below_ns, fill_ns, arduino_ns);
+}
+
+// one light moving over a 300 pixel layer and fading out, drawn as a particle or by an animation
+struct Comet
+{
+  int32_t  position;
+  int32_t  velocity;
+  RgbColor color;
+};
+
+static const uint16_t ParticlePixels = 300;
+static const uint16_t CometLifeMs    = 60000;
+static const int32_t  One            = 65536;
+
+// a particle at 10.25 lights pixels 10 and 11 by 3 to 1
+static void test_particle_splat()
+{
+  static ParticleSystem<4>          pool;
+  static PixelLayer<ParticlePixels> canvas;
+  pool.Clear(0);
+  pool.Spawn(10 * One + One / 4, 0, RgbColor(200, 100, 40), 0);
+  pool.Render(canvas);
+  RgbColor near = canvas.GetPixelColor(10);
+  RgbColor far  = canvas.GetPixelColor(11);
+  TEST_ASSERT_EQUAL_UINT8(150, near.R);
+  TEST_ASSERT_EQUAL_UINT8(50, far.R);
+  TEST_ASSERT_EQUAL(100, near.G + far.G);
+  TEST_ASSERT_EQUAL(40, near.B + far.B);
+}
+
+// moves at its velocity and fades out over its life
+static void test_particle_motion()
+{
+  static ParticleSystem<4>          pool;
+  static PixelLayer<ParticlePixels> canvas;
+  pool.Clear(0);
+  pool.Spawn(10 * One, One / 4, RgbColor(255, 0, 0), 80);
+  pool.Update(40, ParticlePixels);
+  canvas.Clear();
+  pool.Render(canvas);
+  // half its life left
+  TEST_ASSERT_UINT32_WITHIN(1, 127, canvas.GetPixelColor(20).R);
+  TEST_ASSERT_EQUAL_UINT8(0, canvas.GetPixelColor(21).R);
+  pool.Update(81, ParticlePixels);
+  TEST_ASSERT_EQUAL(0, pool.Count());
+}
+
+// dropped at the end of the strip, or wrapped around
+static void test_particle_edges()
+{
+  static ParticleSystem<4>                       pool;
+  static ParticleSystem<1000, ParticleEdge_Wrap> wrapped;
+  static PixelLayer<ParticlePixels>              canvas;
+  pool.Clear(0);
+  pool.Spawn(299 * One, One / 4, RgbColor(255, 0, 0), 0);
+  pool.Update(9, ParticlePixels);
+  TEST_ASSERT_EQUAL(0, pool.Count());
+  wrapped.Clear(0);
+  wrapped.Spawn(299 * One, One / 4, RgbColor(255, 0, 0), 0);
+  wrapped.Update(8, ParticlePixels);
+  canvas.Clear();
+  wrapped.Render(canvas);
+  TEST_ASSERT_EQUAL(1, wrapped.Count());
+  TEST_ASSERT_EQUAL_UINT8(255, canvas.GetPixelColor(1).R);
+}
+
+// a full pool replaces the faintest particle
+static void test_particle_pool_full()
+{
+  static ParticleSystem<4>          pool;
+  static PixelLayer<ParticlePixels> canvas;
+  pool.Clear(0);
+  for (uint16_t index = 0; index < 4; index++) {
+    pool.Spawn(index * One, 0, RgbColor(255, 0, 0), 100 + index * 100);
+  }
+  pool.Update(50, ParticlePixels);
+  pool.Spawn(100 * One, 0, RgbColor(0, 255, 0), 100);
+  canvas.Clear();
+  pool.Render(canvas);
+  TEST_ASSERT_EQUAL(4, pool.Count());
+  TEST_ASSERT_EQUAL_UINT8(0, canvas.GetPixelColor(0).R);
+  TEST_ASSERT_GREATER_THAN(0, canvas.GetPixelColor(1).R);
+  TEST_ASSERT_EQUAL_UINT8(255, canvas.GetPixelColor(100).G);
+}
+
+static double benchmarkComets(ParticleSystem<1000, ParticleEdge_Wrap>& particles, const Comet* comets, uint16_t count, uint32_t frames)
+{
+  static PixelLayer<ParticlePixels> canvas;
+  particles.Clear(0);
+  for (uint16_t index = 0; index < count; index++) {
+    particles.Spawn(comets[index].position, comets[index].velocity, comets[index].color, CometLifeMs);
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t frame = 1; frame <= frames; frame++) {
+    canvas.Clear();
+    particles.Update(frame * 16, ParticlePixels);
+    particles.Render(canvas);
+  }
+  return hostSecondsSince(start) * 1e9 / frames;
+}
+
+static double benchmarkAnimatedComets(const Comet* comets, uint16_t count, uint32_t frames)
+{
+  static PixelLayer<ParticlePixels> canvas;
+  NeoPixelAnimator                  animations(count);
+  for (uint16_t index = 0; index < count; index++) {
+    const Comet& comet = comets[index];
+    animations.StartAnimation(index, CometLifeMs, [&comet](const AnimationParam& param) {
+      int32_t  elapsed  = param.progress * CometLifeMs;
+      int32_t  position = (comet.position + comet.velocity * elapsed) % (ParticlePixels << 16);
+      uint16_t pixel    = (position < 0 ? position + (ParticlePixels << 16) : position) >> 16;
+      RgbColor color    = RgbColor::LinearBlend(comet.color, RgbColor(0), param.progress);
+      RgbColor current  = canvas.GetPixelColor(pixel);
+      canvas.SetPixelColor(pixel, RgbColor(std::min(255, current.R + color.R), std::min(255, current.G + color.G), std::min(255, current.B + color.B)));
+    });
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    canvas.Clear();
+    hostAdvanceMs(16);
+    animations.UpdateAnimations();
+  }
+  return hostSecondsSince(start) * 1e9 / frames;
+}
+
+// comets per frame drawn by the engine against one NeoPixelAnimator channel with a callback per comet
+static void test_particle_cost()
+{
+  const uint32_t                                 Frames = 1000;
+  static ParticleSystem<1000, ParticleEdge_Wrap> wrapped;
+  // comets at up to a pixel per frame in both directions
+  static Comet comets[1000];
+  FastRandom   random(7);
+  for (Comet& comet : comets) {
+    comet.position = random.below(ParticlePixels << 16);
+    comet.velocity = (int32_t)random.below(2 * One / 16) - One / 16;
+    comet.color    = random.color(255);
+  }
+  printf("particles:");
+  const uint16_t Counts[] = {100, 300, 1000};
+  for (uint16_t count : Counts) {
+    double engine_ns   = benchmarkComets(wrapped, comets, count, Frames);
+    double animator_ns = benchmarkAnimatedComets(comets, count, Frames);
+    printf(" %u comets %.1f us/frame (animator %.1f us/frame)", count, engine_ns / 1000, animator_ns / 1000);
+  }
+  printf("\n");
+}
+
+// The random colour set of the old program 0 on all 300 pixels: each pixel tweens to its own colour
+// over 500-800 ms with one of three easings and starts over when they are all done. The tweens against
+// one NeoPixelAnimator channel per pixel with a capturing callback and a float easing, as before. The
+// captures fit the 16 bytes std::function keeps inline on the host, on the ESP32 it is 8 bytes and
+// every one of them is a heap allocation.
+const uint16_t TweenPixels = 300;
+
+struct TweenSet
+{
+  RgbColor  colors[TweenPixels];
+  uint16_t  times[TweenPixels];
+  TweenEase easings[TweenPixels];
+};
+
+static void pickTweenSet(TweenSet& set, FastRandom& random)
+{
+  const TweenEase Easings[] = {TweenEase_CubicIn, TweenEase_CubicOut, TweenEase_QuadraticInOut};
+  for (uint16_t pixel = 0; pixel < TweenPixels; pixel++) {
+    set.colors[pixel]  = random.color(128);
+    set.times[pixel]   = random.between(500, 800);
+    set.easings[pixel] = Easings[random.below(3)];
+  }
+}
+
+static float floatEase(TweenEase ease, float progress)
+{
+  switch (ease) {
+    case TweenEase_CubicIn:
+      return progress * progress * progress;
+    case TweenEase_CubicOut:
+      return (progress - 1.0f) * (progress - 1.0f) * (progress - 1.0f) + 1.0f;
+    default:
+      progress *= 2.0f;
+      if (progress < 1.0f)
+        return 0.5f * progress * progress;
+      progress -= 1.0f;
+      return -0.5f * (progress * (progress - 2.0f) - 1.0f);
+  }
+}
+
+struct TweenCost
+{
+  double   ns_per_frame;
+  uint64_t allocations;
+};
+
+static TweenCost benchmarkTweens(uint32_t frames)
+{
+  static PixelLayer<TweenPixels>  canvas;
+  static PixelTweens<TweenPixels> tweens;
+  static TweenSet                 set;
+  FastRandom                      random(3);
+  canvas.Clear();
+  tweens.StopAll();
+  std::chrono::steady_clock::time_point start       = std::chrono::steady_clock::now();
+  uint64_t                              allocations = hostGetAllocations();
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    hostAdvanceMs(16);
+    if (!tweens.IsAnimating()) {
+      pickTweenSet(set, random);
+      for (uint16_t pixel = 0; pixel < TweenPixels; pixel++) {
+        tweens.StartTween(pixel, canvas.GetPixelColor(pixel), set.colors[pixel], set.times[pixel], set.easings[pixel], millis());
+      }
+    }
+    tweens.UpdateTweens(canvas, millis());
+  }
+  return {hostSecondsSince(start) * 1e9 / frames, hostGetAllocations() - allocations};
+}
+
+static TweenCost benchmarkAnimatedTweens(uint32_t frames)
+{
+  static PixelLayer<TweenPixels> canvas;
+  static TweenSet                set;
+  NeoPixelAnimator               animations(TweenPixels);
+  FastRandom                     random(3);
+  canvas.Clear();
+  std::chrono::steady_clock::time_point start       = std::chrono::steady_clock::now();
+  uint64_t                              allocations = hostGetAllocations();
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    hostAdvanceMs(16);
+    if (!animations.IsAnimating()) {
+      pickTweenSet(set, random);
+      for (uint16_t pixel = 0; pixel < TweenPixels; pixel++) {
+        RgbColor  original = canvas.GetPixelColor(pixel);
+        RgbColor  target   = set.colors[pixel];
+        TweenEase ease     = set.easings[pixel];
+        animations.StartAnimation(pixel, set.times[pixel], [=](const AnimationParam& param) {
+          canvas.SetPixelColor(pixel, RgbColor::LinearBlend(original, target, floatEase(ease, param.progress)));
+        });
+      }
+    }
+    animations.UpdateAnimations();
+  }
+  return {hostSecondsSince(start) * 1e9 / frames, hostGetAllocations() - allocations};
+}
+
+// every pixel ends exactly on its colour and passes through the eased blend on the way
+static void test_tweens_follow_easing()
+{
+  static PixelLayer<TweenPixels>  canvas;
+  static PixelTweens<TweenPixels> tweens;
+  static TweenSet                 set;
+  FastRandom                      random(4);
+  ColorLut::begin();
+  canvas.Clear();
+  pickTweenSet(set, random);
+  for (uint16_t pixel = 0; pixel < TweenPixels; pixel++) {
+    tweens.StartTween(pixel, RgbColor(0), set.colors[pixel], set.times[pixel], set.easings[pixel], 0);
+  }
+  for (uint32_t now_ms = 0; tweens.IsAnimating(); now_ms += 16) {
+    tweens.UpdateTweens(canvas, now_ms);
+    for (uint16_t pixel = 0; pixel < TweenPixels; pixel++) {
+      float    progress = std::min(1.0f, (float)now_ms / set.times[pixel]);
+      RgbColor expected = RgbColor::LinearBlend(RgbColor(0), set.colors[pixel], floatEase(set.easings[pixel], progress));
+      RgbColor color    = canvas.GetPixelColor(pixel);
+      TEST_ASSERT_INT_WITHIN(2, expected.R, color.R);
+      TEST_ASSERT_INT_WITHIN(2, expected.G, color.G);
+      TEST_ASSERT_INT_WITHIN(2, expected.B, color.B);
+    }
+  }
+  for (uint16_t pixel = 0; pixel < TweenPixels; pixel++) {
+    TEST_ASSERT_TRUE(canvas.GetPixelColor(pixel) == set.colors[pixel]);
+  }
+}
+
+// the timings are printed for comparison only, what is checked is that the tweens never allocate
+static void test_tween_cost()
+{
+  const uint32_t Frames = 2000;
+  ColorLut::begin();
+  TweenCost tweens   = benchmarkTweens(Frames);
+  TweenCost animator = benchmarkAnimatedTweens(Frames);
+  printf("tweens: %u pixels %.1f us/frame, %lu allocations (animator %.1f us/frame, %lu allocations)\n", TweenPixels, tweens.ns_per_frame / 1000,
+         (unsigned long)tweens.allocations, animator.ns_per_frame / 1000, (unsigned long)animator.allocations);
+  TEST_ASSERT_EQUAL_UINT64(0, tweens.allocations);
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_skips_unchanged);
+  RUN_TEST(test_frame_matches_strip);
+  RUN_TEST(test_scheduler_jitter);
+  RUN_TEST(test_exchange_latest_wins);
+  RUN_TEST(test_exchange_threads);
+  RUN_TEST(test_blend_modes);
+  RUN_TEST(test_compositor_crossfade);
+  RUN_TEST(test_compositor_gamma_crossfade);
+  RUN_TEST(test_blend_cost);
+  RUN_TEST(test_color_lut_error);
+  RUN_TEST(test_color_lut_cost);
+  RUN_TEST(test_random_uniform);
+  RUN_TEST(test_random_wide_range);
+  RUN_TEST(test_random_fill_and_split);
+  RUN_TEST(test_random_cost);
+  RUN_TEST(test_particle_splat);
+  RUN_TEST(test_particle_motion);
+  RUN_TEST(test_particle_edges);
+  RUN_TEST(test_particle_pool_full);
+  RUN_TEST(test_particle_cost);
+  RUN_TEST(test_tweens_follow_easing);
+  RUN_TEST(test_tween_cost);
+  return UNITY_END();
+}
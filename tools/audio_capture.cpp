@@ -0,0 +1,96 @@
+// Records the firmware's audio blocks: makes the Capture requests and turns a capture into a WAV file.
+//
+//   g++ -std=gnu++17 -O2 -Ilib/SerialControl tools/audio_capture.cpp lib/SerialControl/AudioCaptureReader.cpp lib/SerialControl/ControlProtocol.cpp -o audio_capture
+//   audio_capture start|stop > request.bin
+//   audio_capture capture.bin out.wav [--rate R]
+//
+// With the port in raw mode at 921600 baud, record with
+//
+//   stty -F /dev/ttyUSB0 921600 raw; cat /dev/ttyUSB0 > capture.bin & audio_capture start > /dev/ttyUSB0
+//
+// and stop with audio_capture stop. The host runner replays either file into the programs with
+// --replay; the WAV is 16 bit mono at the analysis rate of the firmware (11025, 44100 / AUDIO_DECIMATION,
+// unless --rate says otherwise).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AudioCaptureReader.h"
+
+static void writeUint32(FILE* file, uint32_t value)
+{
+  uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+  fwrite(bytes, 1, 4, file);
+}
+
+static void writeUint16(FILE* file, uint16_t value)
+{
+  uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+  fwrite(bytes, 1, 2, file);
+}
+
+static bool writeWav(const char* path, const std::vector<int16_t>& samples, uint32_t rate)
+{
+  FILE* file = fopen(path, "wb");
+  if (file == NULL)
+    return false;
+  uint32_t data_size = samples.size() * sizeof(int16_t);
+  fwrite("RIFF", 1, 4, file);
+  writeUint32(file, 36 + data_size);
+  fwrite("WAVEfmt ", 1, 8, file);
+  writeUint32(file, 16);
+  writeUint16(file, 1); // PCM
+  writeUint16(file, 1); // mono
+  writeUint32(file, rate);
+  writeUint32(file, rate * sizeof(int16_t));
+  writeUint16(file, sizeof(int16_t));
+  writeUint16(file, 16);
+  fwrite("data", 1, 4, file);
+  writeUint32(file, data_size);
+  for (int16_t sample : samples) {
+    writeUint16(file, sample);
+  }
+  return fclose(file) == 0;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc == 2 && (strcmp(argv[1], "start") == 0 || strcmp(argv[1], "stop") == 0)) {
+    uint8_t enable = strcmp(argv[1], "start") == 0;
+    uint8_t request[1 + ControlProtocol::Overhead];
+    fwrite(request, 1, ControlProtocol::encode(ControlMessage_Capture, &enable, 1, request), stdout);
+    return 0;
+  }
+  if (argc != 3 && !(argc == 5 && strcmp(argv[3], "--rate") == 0)) {
+    fprintf(stderr, "usage: %s start|stop\n       %s capture.bin out.wav [--rate R]\n", argv[0], argv[0]);
+    return 2;
+  }
+  uint32_t rate = argc == 5 ? atoi(argv[4]) : 11025;
+
+  FILE* file = fopen(argv[1], "rb");
+  if (file == NULL) {
+    fprintf(stderr, "%s: cannot read\n", argv[1]);
+    return 1;
+  }
+  AudioCaptureReader reader;
+  uint8_t            buffer[4096];
+  size_t             size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    reader.feed(buffer, size);
+  }
+  fclose(file);
+  if (reader.getBlocks() == 0) {
+    fprintf(stderr, "%s: no audio blocks\n", argv[1]);
+    return 1;
+  }
+  printf("%s: %u blocks of %u samples, %u missing, %u crc errors\n", argv[1], reader.getBlocks(), reader.getBlockSize(),
+         reader.getMissingBlocks(), reader.getCrcErrors());
+
+  if (!writeWav(argv[2], reader.getSamples(), rate)) {
+    fprintf(stderr, "%s: cannot write\n", argv[2]);
+    return 1;
+  }
+  printf("%s: %.1f s at %u Hz\n", argv[2], (float)reader.getSamples().size() / rate, rate);
+  return 0;
+}
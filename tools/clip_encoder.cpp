@@ -0,0 +1,86 @@
+// Encodes raw RGB frames into a clip bank for the spiffs partition (program 9).
+//
+//   g++ -std=gnu++17 -O2 -Ilib/PixelClips tools/clip_encoder.cpp lib/PixelClips/ClipEncoder.cpp -o clip_encoder
+//   clip_encoder bank.bin [--pixels N] [--fps F] [--repeat R] [--tolerance T] clip.rgb ...
+//
+// Every clip file is a sequence of frames of N r, g, b bytes (ffmpeg -pix_fmt rgb24 -f rawvideo gives
+// that for a N x 1 video). The options apply to the clip files after them. Flash the bank with
+//
+//   parttool.py write_partition --partition-type=data --partition-subtype=spiffs --input bank.bin
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ClipEncoder.h"
+
+static bool readFile(const char* path, std::vector<uint8_t>& data)
+{
+  FILE* file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+  uint8_t buffer[4096];
+  size_t  read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.insert(data.end(), buffer, buffer + read);
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s bank.bin [--pixels N] [--fps F] [--repeat R] [--tolerance T] clip.rgb ...\n", argv[0]);
+    return 2;
+  }
+  int pixels    = 300;
+  int fps       = 60;
+  int repeat    = 0;
+  int tolerance = 0;
+
+  std::vector<std::vector<uint8_t>> clips;
+  for (int i = 2; i < argc; i++) {
+    if (i + 1 < argc && strcmp(argv[i], "--pixels") == 0)
+      pixels = atoi(argv[++i]);
+    else if (i + 1 < argc && strcmp(argv[i], "--fps") == 0)
+      fps = atoi(argv[++i]);
+    else if (i + 1 < argc && strcmp(argv[i], "--repeat") == 0)
+      repeat = atoi(argv[++i]);
+    else if (i + 1 < argc && strcmp(argv[i], "--tolerance") == 0)
+      tolerance = atoi(argv[++i]);
+    else {
+      std::vector<uint8_t> frames;
+      if (!readFile(argv[i], frames)) {
+        fprintf(stderr, "%s: cannot read\n", argv[i]);
+        return 1;
+      }
+      size_t frame_size = pixels * 3;
+      if (pixels < 1 || pixels > 0xffff || fps < 1 || fps > 255 || repeat < 0 || repeat > 255 || frames.size() < frame_size) {
+        fprintf(stderr, "%s: bad options or less than one frame\n", argv[i]);
+        return 1;
+      }
+      ClipEncoder encoder;
+      encoder.begin(pixels, fps, repeat, tolerance);
+      for (size_t first = 0; first + frame_size <= frames.size(); first += frame_size) {
+        if (!encoder.addFrame(&frames[first])) {
+          fprintf(stderr, "%s: more than 65535 frames, the rest is dropped\n", argv[i]);
+          break;
+        }
+      }
+      printf("%s: %u frames, %zu bytes, %.1f%% of raw\n", argv[i], encoder.getFrameCount(), encoder.getData().size(),
+             100.0 * encoder.getData().size() / frames.size());
+      clips.push_back(encoder.getData());
+    }
+  }
+
+  std::vector<uint8_t> bank = buildClipBank(clips);
+  FILE*                file = fopen(argv[1], "wb");
+  if (file == NULL || fwrite(bank.data(), 1, bank.size(), file) != bank.size()) {
+    fprintf(stderr, "%s: cannot write\n", argv[1]);
+    return 1;
+  }
+  fclose(file);
+  printf("%s: %zu clips, %zu bytes\n", argv[1], clips.size(), bank.size());
+  return 0;
+}